@@ -1591,6 +1591,18 @@ def CreatePcdDatabasePhaseSpecificAutoGen (Platform, Phase):
             Dict['EXMAPPING_TABLE_LOCAL_TOKEN'].append(str(GeneratedTokenNumber + 1) + 'U')
             Dict['EXMAPPING_TABLE_GUID_INDEX'].append(str(GuidList.index(TokenSpaceGuid)) + 'U')
 
+    #
+    # Sort the EXMAPPING_TABLE by {GUID index, Ex token number}, so that the PCD
+    # Driver/PEIM can binary search it to map EX_GUID and EX_TOKEN_NUMBER to the PCD Token Number.
+    #
+    ExMapTable = sorted(
+                   zip(Dict['EXMAPPING_TABLE_GUID_INDEX'], Dict['EXMAPPING_TABLE_EXTOKEN'], Dict['EXMAPPING_TABLE_LOCAL_TOKEN']),
+                   key = lambda Item: (GetIntegerValue(Item[0]), GetIntegerValue(Item[1]))
+                   )
+    Dict['EXMAPPING_TABLE_GUID_INDEX']  = [Item[0] for Item in ExMapTable]
+    Dict['EXMAPPING_TABLE_EXTOKEN']     = [Item[1] for Item in ExMapTable]
+    Dict['EXMAPPING_TABLE_LOCAL_TOKEN'] = [Item[2] for Item in ExMapTable]
+
     if Platform.Platform.PcdInfoFlag:
         for index in range(len(Dict['PCD_TOKENSPACE_MAP'])):
             TokenSpaceIndex = StringTableSize
@@ -0,0 +1,1002 @@
+/** @file
+  Stress test that replays a recorded trace of GCD memory space operations
+  and reports the latency of each kind of operation.
+
+  The trace is a debug log of a boot with DEBUG_GCD set in
+  PcdDebugPrintErrorLevel. The initial GCD memory space map printed by the DXE
+  core is rebuilt first, then every GCD memory space operation that succeeded
+  on the recorded boot is replayed and timed. I/O space operations are counted
+  but not replayed, because the I/O space of the running platform has no room
+  for a relocated copy of the recorded one.
+
+  The recorded addresses are moved into free space of the running GCD memory
+  space map 1GB at a time, keeping their offsets in each 1GB block. System
+  memory of the trace is replayed as reserved memory so that the DXE core
+  never allocates from it. Everything the replay added is removed when it
+  finishes, so the application can run several times.
+
+  Usage: GcdTraceReplay TraceFile [Repeat]
+
+  Run it on firmware built with and without a GCD change to compare the
+  latencies. It is meant for EmulatorPkg, whose CPU driver does not program
+  any hardware for SetMemorySpaceAttributes().
+
+Copyright (c) 2017, Intel Corporation. All rights reserved.<BR>
+This program and the accompanying materials
+are licensed and made available under the terms and conditions of the BSD License
+which accompanies this distribution.  The full text of the license may be found at
+http://opensource.org/licenses/bsd-license.php
+
+THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+
+**/
+
+#include <PiDxe.h>
+
+#include <Protocol/Shell.h>
+#include <Protocol/ShellParameters.h>
+#include <Protocol/SimpleFileSystem.h>
+
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/DebugLib.h>
+#include <Library/DxeServicesTableLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/TimerLib.h>
+#include <Library/UefiApplicationEntryPoint.h>
+#include <Library/UefiBootServicesTableLib.h>
+#include <Library/UefiLib.h>
+
+//
+// The recorded addresses are relocated in blocks of this size
+//
+#define GCD_TRACE_BLOCK_SHIFT  30
+#define GCD_TRACE_BLOCK_SIZE   LShiftU64 (1, GCD_TRACE_BLOCK_SHIFT)
+
+typedef enum {
+  GcdTraceAddMemorySpace,
+  GcdTraceAllocateMemorySpace,
+  GcdTraceFreeMemorySpace,
+  GcdTraceRemoveMemorySpace,
+  GcdTraceSetMemorySpaceAttributes,
+  GcdTraceSetMemorySpaceCapabilities,
+  GcdTraceIoSpaceOperation,
+  GcdTraceOperationMaximum
+} GCD_TRACE_OPERATION;
+
+//
+// One GCD operation of the trace
+//
+typedef struct {
+  GCD_TRACE_OPERATION   Operation;
+  BOOLEAN               Succeeded;
+  EFI_PHYSICAL_ADDRESS  BaseAddress;
+  UINT64                Length;
+  EFI_GCD_MEMORY_TYPE   GcdMemoryType;
+  UINT64                Capabilities;
+  UINT64                Attributes;
+  UINTN                 Alignment;
+} GCD_TRACE_ENTRY;
+
+//
+// A run of consecutive blocks of the recorded address space, and the free
+// address of the running platform it is moved to
+//
+typedef struct {
+  UINT64                FirstBlock;
+  UINT64                LastBlock;
+  EFI_PHYSICAL_ADDRESS  Target;
+} GCD_TRACE_RUN;
+
+//
+// Latency statistics of one kind of operation
+//
+typedef struct {
+  UINTN                 Count;
+  UINTN                 Failed;
+  UINT64                TotalTicks;
+  UINT64                MaxTicks;
+} GCD_TRACE_STATISTICS;
+
+//
+// Names of the operations in the DEBUG_GCD log of the DXE core
+//
+CONST CHAR8  *mGcdTraceOperationNames[] = {
+  "AddMemorySpace",
+  "AllocateMemorySpace",
+  "FreeMemorySpace",
+  "RemoveMemorySpace",
+  "SetMemorySpaceAttributes",
+  "CoreSetMemorySpaceCapabilities",
+  "IoSpace"
+};
+
+//
+// Names of the GCD memory types in the DEBUG_GCD log, indexed by type
+//
+CONST CHAR8  *mGcdTraceMemoryTypeNames[] = {
+  "NonExist ",
+  "Reserved ",
+  "SystemMem",
+  "MMIO     ",
+  "PersisMem",
+  "MoreRelia"
+};
+
+GCD_TRACE_ENTRY                  *mTrace;
+UINTN                            mTraceCount;
+EFI_GCD_MEMORY_SPACE_DESCRIPTOR  *mInitialMap;
+UINTN                            mInitialMapCount;
+GCD_TRACE_RUN                    *mRuns;
+UINTN                            mRunCount;
+GCD_TRACE_STATISTICS             mStatistics[GcdTraceOperationMaximum];
+UINT64                           mCounterFrequency;
+BOOLEAN                          mCounterCountsDown;
+
+/**
+  Return the nanoseconds of a number of performance counter ticks.
+
+  @param  Ticks  The number of ticks.
+
+  @return The nanoseconds.
+
+**/
+UINT64
+TicksToNanoSeconds (
+  IN UINT64  Ticks
+  )
+{
+  UINT64  Remainder;
+  UINT64  NanoSeconds;
+
+  NanoSeconds = MultU64x32 (DivU64x64Remainder (Ticks, mCounterFrequency, &Remainder), 1000000000);
+  return NanoSeconds + DivU64x64Remainder (MultU64x32 (Remainder, 1000000000), mCounterFrequency, NULL);
+}
+
+/**
+  Read the whole trace file through the shell.
+
+  @param  FileName    The name of the trace file.
+  @param  Buffer      Return the file contents, terminated by a NUL.
+
+  @retval EFI_SUCCESS The file was read.
+  @retval other       The file could not be opened or read.
+
+**/
+EFI_STATUS
+ReadTraceFile (
+  IN  CONST CHAR16  *FileName,
+  OUT CHAR8         **Buffer
+  )
+{
+  EFI_STATUS          Status;
+  EFI_SHELL_PROTOCOL  *Shell;
+  SHELL_FILE_HANDLE   FileHandle;
+  UINT64              FileSize;
+  UINTN               ReadSize;
+
+  Status = gBS->LocateProtocol (&gEfiShellProtocolGuid, NULL, (VOID **) &Shell);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  Status = Shell->OpenFileByName (FileName, &FileHandle, EFI_FILE_MODE_READ);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  Status = Shell->GetFileSize (FileHandle, &FileSize);
+  if (!EFI_ERROR (Status) && (FileSize >= MAX_UINTN)) {
+    Status = EFI_BAD_BUFFER_SIZE;
+  }
+  if (!EFI_ERROR (Status)) {
+    ReadSize = (UINTN) FileSize;
+    *Buffer  = AllocatePool (ReadSize + 1);
+    if (*Buffer == NULL) {
+      Status = EFI_OUT_OF_RESOURCES;
+    } else {
+      Status = Shell->ReadFile (FileHandle, &ReadSize, *Buffer);
+      if (EFI_ERROR (Status)) {
+        FreePool (*Buffer);
+      } else {
+        (*Buffer)[ReadSize] = '\0';
+      }
+    }
+  }
+
+  Shell->CloseFile (FileHandle);
+  return Status;
+}
+
+/**
+  Return the value of a "Key = Value" line of the DEBUG_GCD log.
+
+  @param  Line   The line.
+  @param  Key    The key.
+
+  @return The value, or NULL if the line does not hold the key.
+
+**/
+CONST CHAR8 *
+GetLineValue (
+  IN CONST CHAR8  *Line,
+  IN CONST CHAR8  *Key
+  )
+{
+  while (*Line == ' ') {
+    Line++;
+  }
+  if (AsciiStrnCmp (Line, Key, AsciiStrLen (Key)) != 0) {
+    return NULL;
+  }
+  for (Line += AsciiStrLen (Key); *Line == ' '; Line++) {
+  }
+  if (*Line != '=') {
+    return NULL;
+  }
+  for (Line++; *Line == ' '; Line++) {
+  }
+  return Line;
+}
+
+/**
+  Return the GCD memory type of a memory type name in the DEBUG_GCD log.
+
+  @param  Name           The memory type name.
+  @param  GcdMemoryType  Return the GCD memory type.
+
+  @retval TRUE   The name is a known memory type name.
+  @retval FALSE  The name is unknown.
+
+**/
+BOOLEAN
+GetGcdMemoryType (
+  IN  CONST CHAR8          *Name,
+  OUT EFI_GCD_MEMORY_TYPE  *GcdMemoryType
+  )
+{
+  UINTN  Index;
+  UINTN  Length;
+
+  //
+  // The names are padded with spaces, which a captured log may have lost at
+  // the end of a line.
+  //
+  for (Index = 0; Index < ARRAY_SIZE (mGcdTraceMemoryTypeNames); Index++) {
+    for (Length = AsciiStrLen (mGcdTraceMemoryTypeNames[Index]); mGcdTraceMemoryTypeNames[Index][Length - 1] == ' '; Length--) {
+    }
+    if ((AsciiStrnCmp (Name, mGcdTraceMemoryTypeNames[Index], Length) == 0) &&
+        ((Name[Length] == ' ') || (Name[Length] == '\0'))) {
+      *GcdMemoryType = (EFI_GCD_MEMORY_TYPE) Index;
+      return TRUE;
+    }
+  }
+  return FALSE;
+}
+
+/**
+  Parse an entry of the initial GCD memory space map table of the DEBUG_GCD log.
+
+  The entries are printed as "Type  Base-Limit Capabilities Attributes",
+  followed by '*' for an allocated entry.
+
+  @param  Line        The line.
+  @param  Descriptor  Return the memory space descriptor of the entry. The
+                      ImageHandle is non-NULL for an allocated entry.
+
+  @retval TRUE   The line is an entry of the table.
+  @retval FALSE  The line is not an entry of the table.
+
+**/
+BOOLEAN
+ParseInitialMapEntry (
+  IN  CONST CHAR8                      *Line,
+  OUT EFI_GCD_MEMORY_SPACE_DESCRIPTOR  *Descriptor
+  )
+{
+  UINT64  Limit;
+
+  if ((AsciiStrLen (Line) < 78) || !GetGcdMemoryType (Line, &Descriptor->GcdMemoryType) ||
+      (Line[27] != '-') || (Line[44] != ' ') || (Line[61] != ' ')) {
+    return FALSE;
+  }
+
+  Descriptor->BaseAddress  = AsciiStrHexToUint64 (&Line[11]);
+  Limit                    = AsciiStrHexToUint64 (&Line[28]);
+  Descriptor->Length       = Limit - Descriptor->BaseAddress + 1;
+  Descriptor->Capabilities = AsciiStrHexToUint64 (&Line[45]);
+  Descriptor->Attributes   = AsciiStrHexToUint64 (&Line[62]);
+  Descriptor->ImageHandle  = (Line[78] == '*') ? gImageHandle : NULL;
+  Descriptor->DeviceHandle = NULL;
+  return (BOOLEAN) (Limit >= Descriptor->BaseAddress);
+}
+
+/**
+  Parse the operation line of the DEBUG_GCD log,
+  "GCD:Operation(Base=Address,Length=Length)".
+
+  @param  Line   The text after "GCD:".
+  @param  Entry  Return the operation, base address and length.
+
+  @retval TRUE   The line is a known GCD operation.
+  @retval FALSE  The line is not a known GCD operation.
+
+**/
+BOOLEAN
+ParseOperationLine (
+  IN  CONST CHAR8      *Line,
+  OUT GCD_TRACE_ENTRY  *Entry
+  )
+{
+  UINTN        Index;
+  UINTN        Length;
+  CONST CHAR8  *Value;
+
+  ZeroMem (Entry, sizeof (*Entry));
+  Value = AsciiStrStr (Line, "(");
+  if (Value == NULL) {
+    return FALSE;
+  }
+  Length = Value - Line;
+  for (Index = 0; Index < GcdTraceIoSpaceOperation; Index++) {
+    if ((AsciiStrLen (mGcdTraceOperationNames[Index]) == Length) &&
+        (AsciiStrnCmp (Line, mGcdTraceOperationNames[Index], Length) == 0)) {
+      break;
+    }
+  }
+  //
+  // All the I/O space operations are counted together.
+  //
+  if ((Index == GcdTraceIoSpaceOperation) &&
+      ((Length < 7) || (AsciiStrnCmp (Value - 7, "IoSpace", 7) != 0))) {
+    return FALSE;
+  }
+  Entry->Operation = (GCD_TRACE_OPERATION) Index;
+
+  Value = AsciiStrStr (Line, "Base=");
+  if ((Value != NULL) && (Value[5] != '<')) {
+    Entry->BaseAddress = AsciiStrHexToUint64 (Value + 5);
+  }
+  Value = AsciiStrStr (Line, "Length=");
+  if (Value == NULL) {
+    return FALSE;
+  }
+  Entry->Length = AsciiStrHexToUint64 (Value + 7);
+  return TRUE;
+}
+
+/**
+  Parse the parameter and status lines that follow an operation line of the
+  DEBUG_GCD log.
+
+  @param  Line   The line.
+  @param  Entry  The operation to update.
+
+  @retval TRUE   The line is the status line, which ends the operation.
+  @retval FALSE  The operation continues.
+
+**/
+BOOLEAN
+ParseParameterLine (
+  IN     CONST CHAR8      *Line,
+  IN OUT GCD_TRACE_ENTRY  *Entry
+  )
+{
+  CONST CHAR8  *Value;
+
+  Value = GetLineValue (Line, "GcdMemoryType");
+  if (Value != NULL) {
+    GetGcdMemoryType (Value, &Entry->GcdMemoryType);
+    return FALSE;
+  }
+  Value = GetLineValue (Line, "Capabilities");
+  if (Value != NULL) {
+    Entry->Capabilities = AsciiStrHexToUint64 (Value);
+    return FALSE;
+  }
+  Value = GetLineValue (Line, "Attributes");
+  if (Value != NULL) {
+    Entry->Attributes = AsciiStrHexToUint64 (Value);
+    return FALSE;
+  }
+  Value = GetLineValue (Line, "Alignment");
+  if (Value != NULL) {
+    Entry->Alignment = (UINTN) LowBitSet64 (AsciiStrHexToUint64 (Value));
+    return FALSE;
+  }
+
+  Value = GetLineValue (Line, "Status");
+  if (Value == NULL) {
+    return FALSE;
+  }
+  Entry->Succeeded = (BOOLEAN) (AsciiStrnCmp (Value, "Success", 7) == 0);
+  if (Entry->Operation == GcdTraceAllocateMemorySpace) {
+    //
+    // Replay the allocation at the address the recorded boot got.
+    //
+    Value = AsciiStrStr (Value, "BaseAddress = ");
+    if (Value == NULL) {
+      Entry->Succeeded = FALSE;
+    } else {
+      Entry->BaseAddress = AsciiStrHexToUint64 (Value + 14);
+    }
+  }
+  return TRUE;
+}
+
+/**
+  Parse the initial GCD memory space map and the GCD operations of the
+  DEBUG_GCD log.
+
+  @param  Log           The log, terminated by a NUL. The line ends are
+                        overwritten.
+
+  @retval EFI_SUCCESS           The log was parsed.
+  @retval EFI_NOT_FOUND         The log holds no GCD memory space operation.
+  @retval EFI_OUT_OF_RESOURCES  The parsed log could not be stored.
+
+**/
+EFI_STATUS
+ParseTrace (
+  IN CHAR8  *Log
+  )
+{
+  UINTN            LineCount;
+  CHAR8            *Line;
+  CHAR8            *Next;
+  CONST CHAR8      *Operation;
+  BOOLEAN          InInitialMap;
+  BOOLEAN          InOperation;
+  UINTN            Index;
+
+  LineCount = 1;
+  for (Index = 0; Log[Index] != '\0'; Index++) {
+    if (Log[Index] == '\n') {
+      LineCount++;
+    }
+  }
+  mTrace      = AllocatePool (LineCount * sizeof (GCD_TRACE_ENTRY));
+  mInitialMap = AllocatePool (LineCount * sizeof (EFI_GCD_MEMORY_SPACE_DESCRIPTOR));
+  if ((mTrace == NULL) || (mInitialMap == NULL)) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  InInitialMap = FALSE;
+  InOperation  = FALSE;
+  for (Line = Log; Line != NULL; Line = Next) {
+    Next = AsciiStrStr (Line, "\n");
+    if (Next != NULL) {
+      *Next++ = '\0';
+    }
+    for (Index = AsciiStrLen (Line); (Index > 0) && (Line[Index - 1] == '\r'); Index--) {
+      Line[Index - 1] = '\0';
+    }
+
+    if (AsciiStrStr (Line, "GCD:Initial GCD Memory Space Map") != NULL) {
+      InInitialMap = (BOOLEAN) (mInitialMapCount == 0);
+      continue;
+    }
+    if (InInitialMap) {
+      if (ParseInitialMapEntry (Line, &mInitialMap[mInitialMapCount])) {
+        mInitialMapCount++;
+      } else if (mInitialMapCount != 0) {
+        InInitialMap = FALSE;
+      }
+      continue;
+    }
+
+    Operation = AsciiStrStr (Line, "GCD:");
+    if (Operation != NULL) {
+      InOperation = ParseOperationLine (Operation + 4, &mTrace[mTraceCount]);
+      continue;
+    }
+    if (InOperation && ParseParameterLine (Line, &mTrace[mTraceCount])) {
+      mTraceCount++;
+      InOperation = FALSE;
+    }
+  }
+
+  return (mTraceCount == 0) ? EFI_NOT_FOUND : EFI_SUCCESS;
+}
+
+/**
+  Add the blocks of a recorded range to the relocation runs.
+
+  @param  BaseAddress  The base address of the range.
+  @param  Length       The length of the range.
+
+**/
+VOID
+AddRecordedRange (
+  IN EFI_PHYSICAL_ADDRESS  BaseAddress,
+  IN UINT64                Length
+  )
+{
+  if (Length == 0) {
+    return;
+  }
+  mRuns[mRunCount].FirstBlock = RShiftU64 (BaseAddress, GCD_TRACE_BLOCK_SHIFT);
+  mRuns[mRunCount].LastBlock  = RShiftU64 (BaseAddress + Length - 1, GCD_TRACE_BLOCK_SHIFT);
+  mRuns[mRunCount].Target     = 0;
+  mRunCount++;
+}
+
+/**
+  Move the recorded address ranges into free space of the running GCD memory
+  space map.
+
+  The blocks the trace uses are merged into runs of consecutive blocks, and
+  each run is placed at a block aligned address inside nonexistent memory.
+
+  @retval EFI_SUCCESS           Every run got a target address.
+  @retval EFI_OUT_OF_RESOURCES  The free space is too small for the trace.
+
+**/
+EFI_STATUS
+PlaceRecordedRanges (
+  VOID
+  )
+{
+  EFI_STATUS                       Status;
+  EFI_GCD_MEMORY_SPACE_DESCRIPTOR  *MemorySpaceMap;
+  UINTN                            NumberOfDescriptors;
+  UINTN                            Index;
+  UINTN                            Index2;
+  UINTN                            RunIndex;
+  GCD_TRACE_RUN                    Run;
+  EFI_PHYSICAL_ADDRESS             Cursor;
+  EFI_PHYSICAL_ADDRESS             Target;
+  EFI_PHYSICAL_ADDRESS             Limit;
+  UINT64                           RunLength;
+
+  mRuns = AllocatePool ((mInitialMapCount + mTraceCount) * sizeof (GCD_TRACE_RUN));
+  if (mRuns == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+  for (Index = 0; Index < mInitialMapCount; Index++) {
+    if (mInitialMap[Index].GcdMemoryType != EfiGcdMemoryTypeNonExistent) {
+      AddRecordedRange (mInitialMap[Index].BaseAddress, mInitialMap[Index].Length);
+    }
+  }
+  for (Index = 0; Index < mTraceCount; Index++) {
+    if (mTrace[Index].Succeeded && (mTrace[Index].Operation != GcdTraceIoSpaceOperation)) {
+      AddRecordedRange (mTrace[Index].BaseAddress, mTrace[Index].Length);
+    }
+  }
+
+  //
+  // Sort the runs by their first block and merge the overlapping and
+  // adjacent ones.
+  //
+  for (Index = 1; Index < mRunCount; Index++) {
+    CopyMem (&Run, &mRuns[Index], sizeof (Run));
+    for (Index2 = Index; (Index2 > 0) && (mRuns[Index2 - 1].FirstBlock > Run.FirstBlock); Index2--) {
+      CopyMem (&mRuns[Index2], &mRuns[Index2 - 1], sizeof (Run));
+    }
+    CopyMem (&mRuns[Index2], &Run, sizeof (Run));
+  }
+  for (Index = 0, Index2 = 1; Index2 < mRunCount; Index2++) {
+    if (mRuns[Index2].FirstBlock <= mRuns[Index].LastBlock + 1) {
+      mRuns[Index].LastBlock = MAX (mRuns[Index].LastBlock, mRuns[Index2].LastBlock);
+    } else {
+      CopyMem (&mRuns[++Index], &mRuns[Index2], sizeof (Run));
+    }
+  }
+  mRunCount = (mRunCount == 0) ? 0 : Index + 1;
+
+  Status = gDS->GetMemorySpaceMap (&NumberOfDescriptors, &MemorySpaceMap);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  Cursor   = 0;
+  RunIndex = 0;
+  for (Index = 0; (Index < NumberOfDescriptors) && (RunIndex < mRunCount); Index++) {
+    if (MemorySpaceMap[Index].GcdMemoryType != EfiGcdMemoryTypeNonExistent) {
+      continue;
+    }
+    Limit = MemorySpaceMap[Index].BaseAddress + MemorySpaceMap[Index].Length;
+    while (RunIndex < mRunCount) {
+      RunLength = LShiftU64 (mRuns[RunIndex].LastBlock - mRuns[RunIndex].FirstBlock + 1, GCD_TRACE_BLOCK_SHIFT);
+      Target    = ALIGN_VALUE (MAX (Cursor, MemorySpaceMap[Index].BaseAddress), GCD_TRACE_BLOCK_SIZE);
+      if ((Target < MemorySpaceMap[Index].BaseAddress) || (Target >= Limit) || (RunLength > Limit - Target)) {
+        break;
+      }
+      mRuns[RunIndex].Target = Target;
+      Cursor = Target + RunLength;
+      RunIndex++;
+    }
+  }
+
+  FreePool (MemorySpaceMap);
+  return (RunIndex == mRunCount) ? EFI_SUCCESS : EFI_OUT_OF_RESOURCES;
+}
+
+/**
+  Return the address of the running platform a recorded address is moved to.
+
+  @param  Address  The recorded address.
+
+  @return The relocated address.
+
+**/
+EFI_PHYSICAL_ADDRESS
+RelocateAddress (
+  IN EFI_PHYSICAL_ADDRESS  Address
+  )
+{
+  UINTN   Index;
+  UINT64  Block;
+
+  Block = RShiftU64 (Address, GCD_TRACE_BLOCK_SHIFT);
+  for (Index = 0; Index < mRunCount; Index++) {
+    if ((mRuns[Index].FirstBlock <= Block) && (Block <= mRuns[Index].LastBlock)) {
+      return mRuns[Index].Target + (Address - LShiftU64 (mRuns[Index].FirstBlock, GCD_TRACE_BLOCK_SHIFT));
+    }
+  }
+
+  ASSERT (FALSE);
+  return Address;
+}
+
+/**
+  Return the GCD memory type to replay a recorded memory type as.
+
+  The DXE core adds system memory to the UEFI memory map, so every type of
+  memory is replayed as reserved memory.
+
+  @param  GcdMemoryType  The recorded GCD memory type.
+
+  @return The GCD memory type to replay.
+
+**/
+EFI_GCD_MEMORY_TYPE
+GetReplayMemoryType (
+  IN EFI_GCD_MEMORY_TYPE  GcdMemoryType
+  )
+{
+  if ((GcdMemoryType == EfiGcdMemoryTypeSystemMemory) ||
+      (GcdMemoryType == EfiGcdMemoryTypePersistentMemory) ||
+      (GcdMemoryType == EfiGcdMemoryTypeMoreReliable)) {
+    return EfiGcdMemoryTypeReserved;
+  }
+  return GcdMemoryType;
+}
+
+/**
+  Rebuild the initial GCD memory space map of the trace in the relocated
+  address ranges.
+
+  @return The number of entries that could not be rebuilt.
+
+**/
+UINTN
+AddInitialMap (
+  VOID
+  )
+{
+  EFI_STATUS                       Status;
+  UINTN                            Index;
+  UINTN                            Failed;
+  EFI_GCD_MEMORY_SPACE_DESCRIPTOR  *Descriptor;
+  EFI_PHYSICAL_ADDRESS             BaseAddress;
+
+  Failed = 0;
+  for (Index = 0; Index < mInitialMapCount; Index++) {
+    Descriptor = &mInitialMap[Index];
+    if (Descriptor->GcdMemoryType == EfiGcdMemoryTypeNonExistent) {
+      continue;
+    }
+
+    BaseAddress = RelocateAddress (Descriptor->BaseAddress);
+    Status = gDS->AddMemorySpace (
+                    GetReplayMemoryType (Descriptor->GcdMemoryType),
+                    BaseAddress,
+                    Descriptor->Length,
+                    Descriptor->Capabilities
+                    );
+    if (!EFI_ERROR (Status) && (Descriptor->Attributes != 0)) {
+      Status = gDS->SetMemorySpaceAttributes (BaseAddress, Descriptor->Length, Descriptor->Attributes);
+    }
+    if (!EFI_ERROR (Status) && (Descriptor->ImageHandle != NULL)) {
+      Status = gDS->AllocateMemorySpace (
+                      EfiGcdAllocateAddress,
+                      GetReplayMemoryType (Descriptor->GcdMemoryType),
+                      0,
+                      Descriptor->Length,
+                      &BaseAddress,
+                      gImageHandle,
+                      NULL
+                      );
+    }
+    if (EFI_ERROR (Status)) {
+      Failed++;
+    }
+  }
+  return Failed;
+}
+
+/**
+  Replay a GCD memory space operation of the trace.
+
+  @param  Entry  The operation.
+
+  @return The status of the GCD service.
+
+**/
+EFI_STATUS
+ReplayOperation (
+  IN CONST GCD_TRACE_ENTRY  *Entry
+  )
+{
+  EFI_PHYSICAL_ADDRESS  BaseAddress;
+
+  BaseAddress = RelocateAddress (Entry->BaseAddress);
+  switch (Entry->Operation) {
+  case GcdTraceAddMemorySpace:
+    return gDS->AddMemorySpace (GetReplayMemoryType (Entry->GcdMemoryType), BaseAddress, Entry->Length, Entry->Capabilities);
+  case GcdTraceAllocateMemorySpace:
+    return gDS->AllocateMemorySpace (
+                  EfiGcdAllocateAddress,
+                  GetReplayMemoryType (Entry->GcdMemoryType),
+                  Entry->Alignment,
+                  Entry->Length,
+                  &BaseAddress,
+                  gImageHandle,
+                  NULL
+                  );
+  case GcdTraceFreeMemorySpace:
+    return gDS->FreeMemorySpace (BaseAddress, Entry->Length);
+  case GcdTraceRemoveMemorySpace:
+    return gDS->RemoveMemorySpace (BaseAddress, Entry->Length);
+  case GcdTraceSetMemorySpaceAttributes:
+    return gDS->SetMemorySpaceAttributes (BaseAddress, Entry->Length, Entry->Attributes);
+  case GcdTraceSetMemorySpaceCapabilities:
+    return gDS->SetMemorySpaceCapabilities (BaseAddress, Entry->Length, Entry->Capabilities);
+  default:
+    ASSERT (FALSE);
+    return EFI_UNSUPPORTED;
+  }
+}
+
+/**
+  Replay and time every GCD memory space operation that succeeded on the
+  recorded boot.
+
+**/
+VOID
+ReplayTrace (
+  VOID
+  )
+{
+  EFI_STATUS            Status;
+  UINTN                 Index;
+  CONST GCD_TRACE_ENTRY *Entry;
+  GCD_TRACE_STATISTICS  *Statistics;
+  UINT64                Start;
+  UINT64                End;
+  UINT64                Ticks;
+
+  for (Index = 0; Index < mTraceCount; Index++) {
+    Entry      = &mTrace[Index];
+    Statistics = &mStatistics[Entry->Operation];
+    if (!Entry->Succeeded) {
+      continue;
+    }
+    Statistics->Count++;
+    if (Entry->Operation == GcdTraceIoSpaceOperation) {
+      continue;
+    }
+
+    Start  = GetPerformanceCounter ();
+    Status = ReplayOperation (Entry);
+    End    = GetPerformanceCounter ();
+
+    Ticks = mCounterCountsDown ? Start - End : End - Start;
+    Statistics->TotalTicks += Ticks;
+    Statistics->MaxTicks    = MAX (Statistics->MaxTicks, Ticks);
+    if (EFI_ERROR (Status)) {
+      Statistics->Failed++;
+    }
+  }
+}
+
+/**
+  Free and remove everything the replay left in the relocated address ranges.
+
+**/
+VOID
+RemoveReplayedRanges (
+  VOID
+  )
+{
+  EFI_STATUS                       Status;
+  EFI_GCD_MEMORY_SPACE_DESCRIPTOR  *MemorySpaceMap;
+  UINTN                            NumberOfDescriptors;
+  UINTN                            Pass;
+  UINTN                            Index;
+  UINTN                            RunIndex;
+  EFI_PHYSICAL_ADDRESS             Base;
+  EFI_PHYSICAL_ADDRESS             Limit;
+  EFI_PHYSICAL_ADDRESS             RunLimit;
+
+  //
+  // Free the allocated entries first, since allocated memory cannot be
+  // removed.
+  //
+  for (Pass = 0; Pass < 2; Pass++) {
+    Status = gDS->GetMemorySpaceMap (&NumberOfDescriptors, &MemorySpaceMap);
+    if (EFI_ERROR (Status)) {
+      return;
+    }
+    for (Index = 0; Index < NumberOfDescriptors; Index++) {
+      if ((MemorySpaceMap[Index].GcdMemoryType == EfiGcdMemoryTypeNonExistent) ||
+          ((Pass == 0) && (MemorySpaceMap[Index].ImageHandle == NULL))) {
+        continue;
+      }
+      for (RunIndex = 0; RunIndex < mRunCount; RunIndex++) {
+        RunLimit = mRuns[RunIndex].Target +
+                   LShiftU64 (mRuns[RunIndex].LastBlock - mRuns[RunIndex].FirstBlock + 1, GCD_TRACE_BLOCK_SHIFT);
+        Base  = MAX (MemorySpaceMap[Index].BaseAddress, mRuns[RunIndex].Target);
+        Limit = MIN (MemorySpaceMap[Index].BaseAddress + MemorySpaceMap[Index].Length, RunLimit);
+        if (Base >= Limit) {
+          continue;
+        }
+        if (Pass == 0) {
+          gDS->FreeMemorySpace (Base, Limit - Base);
+        } else {
+          gDS->RemoveMemorySpace (Base, Limit - Base);
+        }
+      }
+    }
+    FreePool (MemorySpaceMap);
+  }
+}
+
+/**
+  Return the number of descriptors of the GCD memory space map.
+
+  @return The number of descriptors.
+
+**/
+UINTN
+GetMemorySpaceMapSize (
+  VOID
+  )
+{
+  EFI_STATUS                       Status;
+  EFI_GCD_MEMORY_SPACE_DESCRIPTOR  *MemorySpaceMap;
+  UINTN                            NumberOfDescriptors;
+
+  Status = gDS->GetMemorySpaceMap (&NumberOfDescriptors, &MemorySpaceMap);
+  if (EFI_ERROR (Status)) {
+    return 0;
+  }
+  FreePool (MemorySpaceMap);
+  return NumberOfDescriptors;
+}
+
+/**
+  The entry point of the application.
+
+  @param  ImageHandle   The firmware allocated handle for the EFI image.
+  @param  SystemTable   A pointer to the EFI System Table.
+
+  @retval EFI_SUCCESS   The trace was replayed.
+  @retval other         The trace could not be read or replayed.
+
+**/
+EFI_STATUS
+EFIAPI
+UefiMain (
+  IN EFI_HANDLE        ImageHandle,
+  IN EFI_SYSTEM_TABLE  *SystemTable
+  )
+{
+  EFI_STATUS                     Status;
+  EFI_SHELL_PARAMETERS_PROTOCOL  *ShellParameters;
+  UINTN                          Repeat;
+  UINTN                          Round;
+  CHAR8                          *Log;
+  UINT64                         StartValue;
+  UINT64                         EndValue;
+  UINTN                          Index;
+  UINTN                          InitialFailed;
+  UINTN                          MapSize;
+  GCD_TRACE_STATISTICS           *Statistics;
+  UINTN                          TotalCount;
+  UINT64                         TotalTicks;
+
+  Status = gBS->HandleProtocol (ImageHandle, &gEfiShellParametersProtocolGuid, (VOID **) &ShellParameters);
+  if (EFI_ERROR (Status) || (ShellParameters->Argc < 2)) {
+    Print (L"Usage: GcdTraceReplay TraceFile [Repeat]\n");
+    return EFI_INVALID_PARAMETER;
+  }
+  Repeat = 1;
+  if (ShellParameters->Argc > 2) {
+    Repeat = MAX (StrDecimalToUintn (ShellParameters->Argv[2]), 1);
+  }
+
+  mCounterFrequency  = GetPerformanceCounterProperties (&StartValue, &EndValue);
+  mCounterCountsDown = (BOOLEAN) (StartValue > EndValue);
+  if (mCounterFrequency == 0) {
+    Print (L"No performance counter to time the operations with\n");
+    return EFI_UNSUPPORTED;
+  }
+
+  Status = ReadTraceFile (ShellParameters->Argv[1], &Log);
+  if (EFI_ERROR (Status)) {
+    Print (L"Cannot read %s - %r\n", ShellParameters->Argv[1], Status);
+    return Status;
+  }
+
+  Status = ParseTrace (Log);
+  if (EFI_ERROR (Status)) {
+    Print (L"No GCD operation found in %s - %r\n", ShellParameters->Argv[1], Status);
+    goto Done;
+  }
+
+  Status = PlaceRecordedRanges ();
+  if (EFI_ERROR (Status)) {
+    Print (L"No room for the %d recorded address runs - %r\n", mRunCount, Status);
+    goto Done;
+  }
+
+  Print (
+    L"%d initial map entries, %d GCD operations, %d address runs, %d rounds\n",
+    mInitialMapCount, mTraceCount, mRunCount, Repeat
+    );
+  MapSize = 0;
+  InitialFailed = 0;
+  for (Round = 0; Round < Repeat; Round++) {
+    InitialFailed += AddInitialMap ();
+    ReplayTrace ();
+    MapSize = MAX (MapSize, GetMemorySpaceMapSize ());
+    RemoveReplayedRanges ();
+  }
+
+  Print (L"Largest GCD memory space map: %d descriptors\n", MapSize);
+  if (InitialFailed != 0) {
+    Print (L"Initial map entries that could not be rebuilt: %d\n", InitialFailed);
+  }
+  Print (L"  %-32s %8s %8s %10s %10s\n", L"Operation", L"Count", L"Failed", L"Avg ns", L"Max ns");
+  TotalCount = 0;
+  TotalTicks = 0;
+  for (Index = 0; Index < GcdTraceOperationMaximum; Index++) {
+    Statistics = &mStatistics[Index];
+    if (Statistics->Count == 0) {
+      continue;
+    }
+    if (Index == GcdTraceIoSpaceOperation) {
+      Print (L"  %-32a %8d  (not replayed)\n", mGcdTraceOperationNames[Index], Statistics->Count);
+      continue;
+    }
+    Print (
+      L"  %-32a %8d %8d %10ld %10ld\n",
+      mGcdTraceOperationNames[Index],
+      Statistics->Count,
+      Statistics->Failed,
+      TicksToNanoSeconds (DivU64x64Remainder (Statistics->TotalTicks, Statistics->Count, NULL)),
+      TicksToNanoSeconds (Statistics->MaxTicks)
+      );
+    TotalCount += Statistics->Count;
+    TotalTicks += Statistics->TotalTicks;
+  }
+  if (TotalCount != 0) {
+    Print (L"Replayed %d operations in %ld us\n", TotalCount, DivU64x64Remainder (TicksToNanoSeconds (TotalTicks), 1000, NULL));
+  }
+
+Done:
+  FreePool (Log);
+  if (mTrace != NULL) {
+    FreePool (mTrace);
+  }
+  if (mInitialMap != NULL) {
+    FreePool (mInitialMap);
+  }
+  if (mRuns != NULL) {
+    FreePool (mRuns);
+  }
+  return Status;
+}
@@ -0,0 +1,428 @@
+/** @file
+  Microbenchmark of the protocol database lookups issued most during BDS
+  connect: LocateHandleBuffer (ByProtocol), LocateHandle (ByProtocol) and
+  LocateProtocol.
+
+  The application installs a private protocol on HandleCount new handles and
+  prints the average latency of each lookup over Iterations calls. It also
+  times lookups right after an interface of the protocol is reinstalled, which
+  makes the DXE core rebuild the handle cache of the protocol, and lookups of
+  the device path protocol, whose handles come from the platform.
+
+  Usage: LocateHandleBenchmark [HandleCount] [Iterations]
+
+  Run it from the shell of firmware built with and without a protocol database
+  change to compare the latencies.
+
+Copyright (c) 2017, Intel Corporation. All rights reserved.<BR>
+This program and the accompanying materials
+are licensed and made available under the terms and conditions of the BSD License
+which accompanies this distribution.  The full text of the license may be found at
+http://opensource.org/licenses/bsd-license.php
+
+THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+
+**/
+
+#include <Uefi.h>
+
+#include <Protocol/DevicePath.h>
+#include <Protocol/ShellParameters.h>
+
+#include <Library/BaseLib.h>
+#include <Library/DebugLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/TimerLib.h>
+#include <Library/UefiApplicationEntryPoint.h>
+#include <Library/UefiBootServicesTableLib.h>
+#include <Library/UefiLib.h>
+
+#define DEFAULT_HANDLE_COUNT  1000
+#define DEFAULT_ITERATIONS    10000
+
+//
+// Protocol installed on the benchmark handles. It is private to the
+// application so that the number of handles each lookup returns is known.
+//
+EFI_GUID  mBenchmarkProtocolGuid = {
+  0xdbe0ccc9, 0x2b62, 0x4c16, { 0x85, 0x6b, 0xcb, 0xda, 0x3d, 0x17, 0xb2, 0x43 }
+};
+
+UINT64    mBenchmarkInterface;
+UINT64    mCounterFrequency;
+BOOLEAN   mCounterCountsDown;
+
+/**
+  Return the nanoseconds between two performance counter values.
+
+  @param  Start  The performance counter value at the start.
+  @param  End    The performance counter value at the end.
+
+  @return The elapsed time in nanoseconds.
+
+**/
+UINT64
+ElapsedNanoSeconds (
+  IN UINT64  Start,
+  IN UINT64  End
+  )
+{
+  UINT64  Ticks;
+  UINT64  Remainder;
+  UINT64  NanoSeconds;
+
+  Ticks       = mCounterCountsDown ? Start - End : End - Start;
+  NanoSeconds = MultU64x32 (DivU64x64Remainder (Ticks, mCounterFrequency, &Remainder), 1000000000);
+  return NanoSeconds + DivU64x64Remainder (MultU64x32 (Remainder, 1000000000), mCounterFrequency, NULL);
+}
+
+/**
+  Print the average latency of a timed operation.
+
+  @param  Name         The name of the operation.
+  @param  Count        The number of times the operation ran.
+  @param  NanoSeconds  The total time of the operation in nanoseconds.
+
+**/
+VOID
+ReportLatency (
+  IN CONST CHAR16  *Name,
+  IN UINTN         Count,
+  IN UINT64        NanoSeconds
+  )
+{
+  Print (L"  %-44s %10ld ns\n", Name, DivU64x64Remainder (NanoSeconds, Count, NULL));
+}
+
+/**
+  Time LocateHandleBuffer (ByProtocol) for a protocol.
+
+  @param  Protocol       The protocol to look up.
+  @param  ExpectedCount  The number of handles the lookup must return, or 0 to
+                         accept any number.
+  @param  Iterations     The number of lookups.
+  @param  NanoSeconds    Return the total time of the lookups.
+
+  @retval EFI_SUCCESS    All the lookups succeeded.
+  @retval other          A lookup failed or returned an unexpected number of
+                         handles.
+
+**/
+EFI_STATUS
+BenchmarkLocateHandleBuffer (
+  IN  EFI_GUID  *Protocol,
+  IN  UINTN     ExpectedCount,
+  IN  UINTN     Iterations,
+  OUT UINT64    *NanoSeconds
+  )
+{
+  EFI_STATUS  Status;
+  UINTN       Index;
+  UINTN       HandleCount;
+  EFI_HANDLE  *Handles;
+  UINT64      Start;
+
+  Start = GetPerformanceCounter ();
+  for (Index = 0; Index < Iterations; Index++) {
+    Status = gBS->LocateHandleBuffer (ByProtocol, Protocol, NULL, &HandleCount, &Handles);
+    if (EFI_ERROR (Status)) {
+      return Status;
+    }
+    FreePool (Handles);
+    if ((ExpectedCount != 0) && (HandleCount != ExpectedCount)) {
+      return EFI_DEVICE_ERROR;
+    }
+  }
+  *NanoSeconds = ElapsedNanoSeconds (Start, GetPerformanceCounter ());
+  return EFI_SUCCESS;
+}
+
+/**
+  Time LocateHandle (ByProtocol) into a caller buffer for a protocol.
+
+  @param  Protocol       The protocol to look up.
+  @param  ExpectedCount  The number of handles the lookup must return.
+  @param  Iterations     The number of lookups.
+  @param  NanoSeconds    Return the total time of the lookups.
+
+  @retval EFI_SUCCESS    All the lookups succeeded.
+  @retval other          A lookup failed or returned an unexpected number of
+                         handles.
+
+**/
+EFI_STATUS
+BenchmarkLocateHandle (
+  IN  EFI_GUID  *Protocol,
+  IN  UINTN     ExpectedCount,
+  IN  UINTN     Iterations,
+  OUT UINT64    *NanoSeconds
+  )
+{
+  EFI_STATUS  Status;
+  UINTN       Index;
+  UINTN       BufferSize;
+  EFI_HANDLE  *Handles;
+  UINT64      Start;
+
+  Handles = AllocatePool (ExpectedCount * sizeof (EFI_HANDLE));
+  if (Handles == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  Status = EFI_SUCCESS;
+  Start  = GetPerformanceCounter ();
+  for (Index = 0; Index < Iterations; Index++) {
+    BufferSize = ExpectedCount * sizeof (EFI_HANDLE);
+    Status = gBS->LocateHandle (ByProtocol, Protocol, NULL, &BufferSize, Handles);
+    if (EFI_ERROR (Status)) {
+      break;
+    }
+    if (BufferSize != ExpectedCount * sizeof (EFI_HANDLE)) {
+      Status = EFI_DEVICE_ERROR;
+      break;
+    }
+  }
+  *NanoSeconds = ElapsedNanoSeconds (Start, GetPerformanceCounter ());
+
+  FreePool (Handles);
+  return Status;
+}
+
+/**
+  Time LocateProtocol for a protocol.
+
+  @param  Protocol     The protocol to look up.
+  @param  Iterations   The number of lookups.
+  @param  NanoSeconds  Return the total time of the lookups.
+
+  @retval EFI_SUCCESS  All the lookups succeeded.
+  @retval other        A lookup failed.
+
+**/
+EFI_STATUS
+BenchmarkLocateProtocol (
+  IN  EFI_GUID  *Protocol,
+  IN  UINTN     Iterations,
+  OUT UINT64    *NanoSeconds
+  )
+{
+  EFI_STATUS  Status;
+  UINTN       Index;
+  VOID        *Interface;
+  UINT64      Start;
+
+  Start = GetPerformanceCounter ();
+  for (Index = 0; Index < Iterations; Index++) {
+    Status = gBS->LocateProtocol (Protocol, NULL, &Interface);
+    if (EFI_ERROR (Status)) {
+      return Status;
+    }
+  }
+  *NanoSeconds = ElapsedNanoSeconds (Start, GetPerformanceCounter ());
+  return EFI_SUCCESS;
+}
+
+/**
+  Time reinstalling the benchmark protocol on a handle, alone and followed by
+  a LocateHandleBuffer (ByProtocol) call that sees the changed database.
+
+  @param  Handle            The handle to reinstall the protocol on.
+  @param  ExpectedCount     The number of handles the lookup must return.
+  @param  Iterations        The number of reinstalls.
+  @param  ReinstallTime     Return the total time of the reinstalls alone.
+  @param  LookupTime        Return the total time of the reinstalls followed
+                            by lookups.
+
+  @retval EFI_SUCCESS    All the reinstalls and lookups succeeded.
+  @retval other          A reinstall or lookup failed, or a lookup returned an
+                         unexpected number of handles.
+
+**/
+EFI_STATUS
+BenchmarkReinstall (
+  IN  EFI_HANDLE  Handle,
+  IN  UINTN       ExpectedCount,
+  IN  UINTN       Iterations,
+  OUT UINT64      *ReinstallTime,
+  OUT UINT64      *LookupTime
+  )
+{
+  EFI_STATUS  Status;
+  UINTN       Index;
+  UINTN       HandleCount;
+  EFI_HANDLE  *Handles;
+  UINT64      Start;
+
+  Start = GetPerformanceCounter ();
+  for (Index = 0; Index < Iterations; Index++) {
+    Status = gBS->ReinstallProtocolInterface (Handle, &mBenchmarkProtocolGuid, &mBenchmarkInterface, &mBenchmarkInterface);
+    if (EFI_ERROR (Status)) {
+      return Status;
+    }
+  }
+  *ReinstallTime = ElapsedNanoSeconds (Start, GetPerformanceCounter ());
+
+  Start = GetPerformanceCounter ();
+  for (Index = 0; Index < Iterations; Index++) {
+    Status = gBS->ReinstallProtocolInterface (Handle, &mBenchmarkProtocolGuid, &mBenchmarkInterface, &mBenchmarkInterface);
+    if (EFI_ERROR (Status)) {
+      return Status;
+    }
+    Status = gBS->LocateHandleBuffer (ByProtocol, &mBenchmarkProtocolGuid, NULL, &HandleCount, &Handles);
+    if (EFI_ERROR (Status)) {
+      return Status;
+    }
+    FreePool (Handles);
+    if (HandleCount != ExpectedCount) {
+      return EFI_DEVICE_ERROR;
+    }
+  }
+  *LookupTime = ElapsedNanoSeconds (Start, GetPerformanceCounter ());
+  return EFI_SUCCESS;
+}
+
+/**
+  Get the handle count and the iteration count from the shell command line.
+
+  @param  ImageHandle  The image handle of the application.
+  @param  HandleCount  Return the number of handles to install the protocol on.
+  @param  Iterations   Return the number of calls to time for each lookup.
+
+**/
+VOID
+GetArguments (
+  IN  EFI_HANDLE  ImageHandle,
+  OUT UINTN       *HandleCount,
+  OUT UINTN       *Iterations
+  )
+{
+  EFI_STATUS                     Status;
+  EFI_SHELL_PARAMETERS_PROTOCOL  *ShellParameters;
+
+  *HandleCount = DEFAULT_HANDLE_COUNT;
+  *Iterations  = DEFAULT_ITERATIONS;
+
+  Status = gBS->HandleProtocol (ImageHandle, &gEfiShellParametersProtocolGuid, (VOID **) &ShellParameters);
+  if (EFI_ERROR (Status)) {
+    return;
+  }
+  if (ShellParameters->Argc > 1) {
+    *HandleCount = MAX (StrDecimalToUintn (ShellParameters->Argv[1]), 1);
+  }
+  if (ShellParameters->Argc > 2) {
+    *Iterations = MAX (StrDecimalToUintn (ShellParameters->Argv[2]), 1);
+  }
+}
+
+/**
+  The entry point of the application.
+
+  @param  ImageHandle   The firmware allocated handle for the EFI image.
+  @param  SystemTable   A pointer to the EFI System Table.
+
+  @retval EFI_SUCCESS   The benchmark ran to completion.
+  @retval other         A protocol database service failed.
+
+**/
+EFI_STATUS
+EFIAPI
+UefiMain (
+  IN EFI_HANDLE        ImageHandle,
+  IN EFI_SYSTEM_TABLE  *SystemTable
+  )
+{
+  EFI_STATUS  Status;
+  UINTN       HandleCount;
+  UINTN       Iterations;
+  EFI_HANDLE  *Handles;
+  UINTN       Index;
+  UINTN       InstalledCount;
+  UINT64      StartValue;
+  UINT64      EndValue;
+  UINT64      Start;
+  UINT64      NanoSeconds;
+  UINT64      LookupTime;
+
+  GetArguments (ImageHandle, &HandleCount, &Iterations);
+
+  mCounterFrequency  = GetPerformanceCounterProperties (&StartValue, &EndValue);
+  mCounterCountsDown = (BOOLEAN) (StartValue > EndValue);
+  if (mCounterFrequency == 0) {
+    Print (L"No performance counter to time the lookups with\n");
+    return EFI_UNSUPPORTED;
+  }
+
+  Handles = AllocateZeroPool (HandleCount * sizeof (EFI_HANDLE));
+  if (Handles == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  Print (L"Protocol database lookups, %d handles, %d iterations, average per call:\n", HandleCount, Iterations);
+
+  Start = GetPerformanceCounter ();
+  for (InstalledCount = 0; InstalledCount < HandleCount; InstalledCount++) {
+    Status = gBS->InstallProtocolInterface (
+                    &Handles[InstalledCount],
+                    &mBenchmarkProtocolGuid,
+                    EFI_NATIVE_INTERFACE,
+                    &mBenchmarkInterface
+                    );
+    if (EFI_ERROR (Status)) {
+      Print (L"InstallProtocolInterface failed - %r\n", Status);
+      goto Done;
+    }
+  }
+  ReportLatency (L"InstallProtocolInterface", HandleCount, ElapsedNanoSeconds (Start, GetPerformanceCounter ()));
+
+  Status = BenchmarkLocateHandleBuffer (&mBenchmarkProtocolGuid, HandleCount, Iterations, &NanoSeconds);
+  if (EFI_ERROR (Status)) {
+    Print (L"LocateHandleBuffer failed - %r\n", Status);
+    goto Done;
+  }
+  ReportLatency (L"LocateHandleBuffer (ByProtocol) + FreePool", Iterations, NanoSeconds);
+
+  Status = BenchmarkLocateHandle (&mBenchmarkProtocolGuid, HandleCount, Iterations, &NanoSeconds);
+  if (EFI_ERROR (Status)) {
+    Print (L"LocateHandle failed - %r\n", Status);
+    goto Done;
+  }
+  ReportLatency (L"LocateHandle (ByProtocol)", Iterations, NanoSeconds);
+
+  Status = BenchmarkLocateProtocol (&mBenchmarkProtocolGuid, Iterations, &NanoSeconds);
+  if (EFI_ERROR (Status)) {
+    Print (L"LocateProtocol failed - %r\n", Status);
+    goto Done;
+  }
+  ReportLatency (L"LocateProtocol", Iterations, NanoSeconds);
+
+  Status = BenchmarkReinstall (Handles[HandleCount / 2], HandleCount, Iterations, &NanoSeconds, &LookupTime);
+  if (EFI_ERROR (Status)) {
+    Print (L"ReinstallProtocolInterface benchmark failed - %r\n", Status);
+    goto Done;
+  }
+  ReportLatency (L"ReinstallProtocolInterface", Iterations, NanoSeconds);
+  ReportLatency (L"Reinstall + LocateHandleBuffer + FreePool", Iterations, LookupTime);
+
+  //
+  // The device path handles are whatever the platform produced, so their
+  // count is not checked.
+  //
+  Status = BenchmarkLocateHandleBuffer (&gEfiDevicePathProtocolGuid, 0, Iterations, &NanoSeconds);
+  if (!EFI_ERROR (Status)) {
+    ReportLatency (L"LocateHandleBuffer (DevicePath) + FreePool", Iterations, NanoSeconds);
+  }
+  Status = EFI_SUCCESS;
+
+Done:
+  Start = GetPerformanceCounter ();
+  for (Index = 0; Index < InstalledCount; Index++) {
+    gBS->UninstallProtocolInterface (Handles[Index], &mBenchmarkProtocolGuid, &mBenchmarkInterface);
+  }
+  if (InstalledCount != 0) {
+    ReportLatency (L"UninstallProtocolInterface", InstalledCount, ElapsedNanoSeconds (Start, GetPerformanceCounter ()));
+  }
+
+  FreePool (Handles);
+  return Status;
+}
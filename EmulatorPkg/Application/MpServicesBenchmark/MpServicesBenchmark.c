@@ -0,0 +1,605 @@
+/** @file
+  Verification and latency benchmark of the MP services protocol.
+
+  The application dispatches a procedure that counts its runs per processor
+  with StartupAllAPs() in blocking, single thread, timeout and non-blocking
+  mode, and with StartupThisAP() on each enabled AP. After every call it checks
+  that each enabled AP ran the procedure exactly once and that no other
+  processor ran it. It prints the average and worst latency of each mode, then
+  repeats blocking StartupAllAPs() with 1 to all of the enabled APs, so that
+  the latency can be compared against the number of processors.
+
+  Usage: MpServicesBenchmark [Iterations]
+
+  On EmulatorPkg the APs are host threads started by the pthread thunk, and
+  PcdEmuApCount sets how many there are. Its APs only look for work every
+  200ms, so the latencies there show the protocol overhead on top of that
+  polling, not the cost of a hardware wakeup.
+
+Copyright (c) 2017, Intel Corporation. All rights reserved.<BR>
+This program and the accompanying materials
+are licensed and made available under the terms and conditions of the BSD License
+which accompanies this distribution.  The full text of the license may be found at
+http://opensource.org/licenses/bsd-license.php
+
+THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+
+**/
+
+#include <PiDxe.h>
+
+#include <Protocol/MpService.h>
+#include <Protocol/ShellParameters.h>
+
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/DebugLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/SynchronizationLib.h>
+#include <Library/TimerLib.h>
+#include <Library/UefiApplicationEntryPoint.h>
+#include <Library/UefiBootServicesTableLib.h>
+#include <Library/UefiLib.h>
+
+#define DEFAULT_ITERATIONS  20
+
+//
+// Timeout given to the timeout mode. The procedure returns at once, so it
+// only has to be long enough never to expire.
+//
+#define BENCHMARK_TIMEOUT_IN_MICROSECONDS  5000000
+
+//
+// Processor number passed to CheckRunCounts() when every enabled AP must have
+// run the procedure.
+//
+#define ALL_ENABLED_APS  MAX_UINTN
+
+typedef struct {
+  UINTN   Count;
+  UINT64  TotalNanoSeconds;
+  UINT64  MaxNanoSeconds;
+} LATENCY_STATISTICS;
+
+EFI_MP_SERVICES_PROTOCOL  *mMpServices;
+UINTN                     mNumberOfProcessors;
+UINTN                     mBspNumber;
+
+//
+// Number of runs of the procedure on each processor, and number of runs on a
+// processor WhoAmI() gave no valid number for.
+//
+volatile UINT32           *mRunCount;
+volatile UINT32           mUnknownRunCount;
+
+UINT64                    mCounterFrequency;
+BOOLEAN                   mCounterCountsDown;
+
+/**
+  Return the nanoseconds between two performance counter values.
+
+  @param  Start  The performance counter value at the start.
+  @param  End    The performance counter value at the end.
+
+  @return The elapsed time in nanoseconds.
+
+**/
+UINT64
+ElapsedNanoSeconds (
+  IN UINT64  Start,
+  IN UINT64  End
+  )
+{
+  UINT64  Ticks;
+  UINT64  Remainder;
+  UINT64  NanoSeconds;
+
+  Ticks       = mCounterCountsDown ? Start - End : End - Start;
+  NanoSeconds = MultU64x32 (DivU64x64Remainder (Ticks, mCounterFrequency, &Remainder), 1000000000);
+  return NanoSeconds + DivU64x64Remainder (MultU64x32 (Remainder, 1000000000), mCounterFrequency, NULL);
+}
+
+/**
+  Add the latency of one call to the statistics of a mode.
+
+  @param  Statistics   The statistics of the mode.
+  @param  NanoSeconds  The latency of the call in nanoseconds.
+
+**/
+VOID
+RecordLatency (
+  IN OUT LATENCY_STATISTICS  *Statistics,
+  IN     UINT64              NanoSeconds
+  )
+{
+  Statistics->Count++;
+  Statistics->TotalNanoSeconds += NanoSeconds;
+  Statistics->MaxNanoSeconds    = MAX (Statistics->MaxNanoSeconds, NanoSeconds);
+}
+
+/**
+  The procedure the APs run. It counts the run in the slot of the processor
+  it runs on.
+
+  @param  Buffer  Not used.
+
+**/
+VOID
+EFIAPI
+CountRun (
+  IN OUT VOID  *Buffer
+  )
+{
+  EFI_STATUS  Status;
+  UINTN       ProcessorNumber;
+
+  Status = mMpServices->WhoAmI (mMpServices, &ProcessorNumber);
+  if (EFI_ERROR (Status) || (ProcessorNumber >= mNumberOfProcessors)) {
+    InterlockedIncrement (&mUnknownRunCount);
+    return;
+  }
+  InterlockedIncrement (&mRunCount[ProcessorNumber]);
+}
+
+/**
+  Clear the run counts before a call.
+
+**/
+VOID
+ResetRunCounts (
+  VOID
+  )
+{
+  ZeroMem ((VOID *) mRunCount, mNumberOfProcessors * sizeof (*mRunCount));
+  mUnknownRunCount = 0;
+}
+
+/**
+  Check the run counts after a call.
+
+  @param  ProcessorNumber  The AP the call dispatched the procedure to, or
+                           ALL_ENABLED_APS for a StartupAllAPs() call.
+
+  @retval EFI_SUCCESS       Every processor that had to run the procedure ran
+                            it once, and no other processor ran it.
+  @retval EFI_DEVICE_ERROR  A processor ran the procedure a wrong number of
+                            times.
+  @retval other             The state of a processor could not be read.
+
+**/
+EFI_STATUS
+CheckRunCounts (
+  IN UINTN  ProcessorNumber
+  )
+{
+  EFI_STATUS                 Status;
+  UINTN                      Index;
+  EFI_PROCESSOR_INFORMATION  Info;
+  UINT32                     Expected;
+
+  if (mUnknownRunCount != 0) {
+    Print (L"  %d runs on a processor with no valid number\n", mUnknownRunCount);
+    return EFI_DEVICE_ERROR;
+  }
+
+  for (Index = 0; Index < mNumberOfProcessors; Index++) {
+    if (ProcessorNumber == ALL_ENABLED_APS) {
+      Status = mMpServices->GetProcessorInfo (mMpServices, Index, &Info);
+      if (EFI_ERROR (Status)) {
+        return Status;
+      }
+      Expected = ((Info.StatusFlag & (PROCESSOR_AS_BSP_BIT | PROCESSOR_ENABLED_BIT)) == PROCESSOR_ENABLED_BIT) ? 1 : 0;
+    } else {
+      Expected = (Index == ProcessorNumber) ? 1 : 0;
+    }
+
+    if (mRunCount[Index] != Expected) {
+      Print (L"  Processor %d ran the procedure %d times, expected %d\n", Index, mRunCount[Index], Expected);
+      return EFI_DEVICE_ERROR;
+    }
+  }
+  return EFI_SUCCESS;
+}
+
+/**
+  Time StartupAllAPs() calls and check that each of them ran the procedure on
+  every enabled AP.
+
+  @param  SingleThread           Run the procedure on one AP at a time.
+  @param  WaitEvent              The event to return at once and wait on, or
+                                 NULL for a blocking call.
+  @param  TimeoutInMicroseconds  The timeout of the calls, or 0 for none.
+  @param  Iterations             The number of calls.
+  @param  Statistics             The statistics to add the latencies to.
+
+  @retval EFI_SUCCESS  All the calls succeeded and ran the procedure on the
+                       expected processors.
+  @retval other        A call failed or a processor ran the procedure a wrong
+                       number of times.
+
+**/
+EFI_STATUS
+BenchmarkStartupAllAps (
+  IN     BOOLEAN             SingleThread,
+  IN     EFI_EVENT           WaitEvent,
+  IN     UINTN               TimeoutInMicroseconds,
+  IN     UINTN               Iterations,
+  IN OUT LATENCY_STATISTICS  *Statistics
+  )
+{
+  EFI_STATUS  Status;
+  UINTN       Index;
+  UINTN       EventIndex;
+  UINTN       *FailedCpuList;
+  UINT64      Start;
+  UINT64      End;
+
+  for (Index = 0; Index < Iterations; Index++) {
+    ResetRunCounts ();
+    FailedCpuList = NULL;
+
+    Start = GetPerformanceCounter ();
+    if (WaitEvent == NULL) {
+      //
+      // Only a blocking call asks for the failed CPU list. A non-blocking
+      // call fills it after returning, when the event is signaled.
+      //
+      Status = mMpServices->StartupAllAPs (
+                              mMpServices,
+                              CountRun,
+                              SingleThread,
+                              NULL,
+                              TimeoutInMicroseconds,
+                              NULL,
+                              &FailedCpuList
+                              );
+    } else {
+      Status = mMpServices->StartupAllAPs (
+                              mMpServices,
+                              CountRun,
+                              SingleThread,
+                              WaitEvent,
+                              TimeoutInMicroseconds,
+                              NULL,
+                              NULL
+                              );
+      if (!EFI_ERROR (Status)) {
+        Status = gBS->WaitForEvent (1, &WaitEvent, &EventIndex);
+      }
+    }
+    End = GetPerformanceCounter ();
+
+    if (FailedCpuList != NULL) {
+      FreePool (FailedCpuList);
+    }
+    if (EFI_ERROR (Status)) {
+      return Status;
+    }
+
+    Status = CheckRunCounts (ALL_ENABLED_APS);
+    if (EFI_ERROR (Status)) {
+      return Status;
+    }
+    RecordLatency (Statistics, ElapsedNanoSeconds (Start, End));
+  }
+  return EFI_SUCCESS;
+}
+
+/**
+  Time blocking StartupThisAP() calls on every enabled AP and check that each
+  of them ran the procedure on that AP only.
+
+  @param  Iterations  The number of calls on each AP.
+  @param  Statistics  The statistics to add the latencies to.
+
+  @retval EFI_SUCCESS  All the calls succeeded and ran the procedure on the
+                       expected processor.
+  @retval other        A call failed or a processor ran the procedure a wrong
+                       number of times.
+
+**/
+EFI_STATUS
+BenchmarkStartupThisAp (
+  IN     UINTN               Iterations,
+  IN OUT LATENCY_STATISTICS  *Statistics
+  )
+{
+  EFI_STATUS                 Status;
+  UINTN                      Index;
+  UINTN                      ProcessorNumber;
+  EFI_PROCESSOR_INFORMATION  Info;
+  UINT64                     Start;
+  UINT64                     End;
+
+  for (ProcessorNumber = 0; ProcessorNumber < mNumberOfProcessors; ProcessorNumber++) {
+    Status = mMpServices->GetProcessorInfo (mMpServices, ProcessorNumber, &Info);
+    if (EFI_ERROR (Status)) {
+      return Status;
+    }
+    if ((Info.StatusFlag & (PROCESSOR_AS_BSP_BIT | PROCESSOR_ENABLED_BIT)) != PROCESSOR_ENABLED_BIT) {
+      continue;
+    }
+
+    for (Index = 0; Index < Iterations; Index++) {
+      ResetRunCounts ();
+
+      Start  = GetPerformanceCounter ();
+      Status = mMpServices->StartupThisAP (mMpServices, CountRun, ProcessorNumber, NULL, 0, NULL, NULL);
+      End    = GetPerformanceCounter ();
+      if (EFI_ERROR (Status)) {
+        return Status;
+      }
+
+      Status = CheckRunCounts (ProcessorNumber);
+      if (EFI_ERROR (Status)) {
+        return Status;
+      }
+      RecordLatency (Statistics, ElapsedNanoSeconds (Start, End));
+    }
+  }
+  return EFI_SUCCESS;
+}
+
+/**
+  Print the latencies of a mode.
+
+  @param  Name        The name of the mode.
+  @param  Statistics  The statistics of the mode.
+
+**/
+VOID
+ReportLatency (
+  IN CONST CHAR16              *Name,
+  IN CONST LATENCY_STATISTICS  *Statistics
+  )
+{
+  Print (
+    L"  %-32s %6d %14ld %14ld\n",
+    Name,
+    Statistics->Count,
+    DivU64x64Remainder (Statistics->TotalNanoSeconds, MAX (Statistics->Count, 1), NULL),
+    Statistics->MaxNanoSeconds
+    );
+}
+
+/**
+  Time blocking StartupAllAPs() with 1 to all of the enabled APs.
+
+  All the enabled APs are disabled first and enabled again one at a time, so
+  they are all enabled when the function returns.
+
+  @param  Iterations  The number of calls for each AP count.
+
+  @retval EFI_SUCCESS  All the calls succeeded and ran the procedure on the
+                       expected processors.
+  @retval other        A call failed or a processor ran the procedure a wrong
+                       number of times.
+
+**/
+EFI_STATUS
+BenchmarkApCounts (
+  IN UINTN  Iterations
+  )
+{
+  EFI_STATUS                 Status;
+  UINTN                      *EnabledAps;
+  UINTN                      EnabledApCount;
+  UINTN                      Index;
+  EFI_PROCESSOR_INFORMATION  Info;
+  LATENCY_STATISTICS         Statistics;
+
+  EnabledAps = AllocatePool (mNumberOfProcessors * sizeof (UINTN));
+  if (EnabledAps == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  EnabledApCount = 0;
+  for (Index = 0; Index < mNumberOfProcessors; Index++) {
+    Status = mMpServices->GetProcessorInfo (mMpServices, Index, &Info);
+    if (EFI_ERROR (Status)) {
+      goto Done;
+    }
+    if ((Info.StatusFlag & (PROCESSOR_AS_BSP_BIT | PROCESSOR_ENABLED_BIT)) == PROCESSOR_ENABLED_BIT) {
+      EnabledAps[EnabledApCount++] = Index;
+    }
+  }
+
+  for (Index = 0; Index < EnabledApCount; Index++) {
+    Status = mMpServices->EnableDisableAP (mMpServices, EnabledAps[Index], FALSE, NULL);
+    if (EFI_ERROR (Status)) {
+      EnabledApCount = Index;
+      goto Done;
+    }
+  }
+
+  Print (L"\nBlocking StartupAllAPs by enabled AP count:\n");
+  Print (L"  %-32s %6s %14s %14s\n", L"APs", L"Count", L"Avg ns", L"Max ns");
+  Status = EFI_SUCCESS;
+  for (Index = 0; Index < EnabledApCount; Index++) {
+    Status = mMpServices->EnableDisableAP (mMpServices, EnabledAps[Index], TRUE, NULL);
+    if (EFI_ERROR (Status)) {
+      goto Done;
+    }
+
+    ZeroMem (&Statistics, sizeof (Statistics));
+    Status = BenchmarkStartupAllAps (FALSE, NULL, 0, Iterations, &Statistics);
+    if (EFI_ERROR (Status)) {
+      goto Done;
+    }
+    Print (
+      L"  %-32d %6d %14ld %14ld\n",
+      Index + 1,
+      Statistics.Count,
+      DivU64x64Remainder (Statistics.TotalNanoSeconds, Statistics.Count, NULL),
+      Statistics.MaxNanoSeconds
+      );
+  }
+
+Done:
+  //
+  // Leave every AP that was enabled on entry enabled again.
+  //
+  for (Index = 0; Index < EnabledApCount; Index++) {
+    mMpServices->EnableDisableAP (mMpServices, EnabledAps[Index], TRUE, NULL);
+  }
+  FreePool (EnabledAps);
+  return Status;
+}
+
+/**
+  Get the iteration count from the shell command line.
+
+  @param  ImageHandle  The image handle of the application.
+
+  @return The number of calls to time for each mode.
+
+**/
+UINTN
+GetIterations (
+  IN EFI_HANDLE  ImageHandle
+  )
+{
+  EFI_STATUS                     Status;
+  EFI_SHELL_PARAMETERS_PROTOCOL  *ShellParameters;
+
+  Status = gBS->HandleProtocol (ImageHandle, &gEfiShellParametersProtocolGuid, (VOID **) &ShellParameters);
+  if (EFI_ERROR (Status) || (ShellParameters->Argc < 2)) {
+    return DEFAULT_ITERATIONS;
+  }
+  return MAX (StrDecimalToUintn (ShellParameters->Argv[1]), 1);
+}
+
+/**
+  The entry point of the application.
+
+  @param  ImageHandle   The firmware allocated handle for the EFI image.
+  @param  SystemTable   A pointer to the EFI System Table.
+
+  @retval EFI_SUCCESS      Every call succeeded and ran the procedure on the
+                           expected processors.
+  @retval EFI_UNSUPPORTED  There is no MP services protocol, no enabled AP or
+                           no performance counter.
+  @retval other            An MP service failed or a processor ran the
+                           procedure a wrong number of times.
+
+**/
+EFI_STATUS
+EFIAPI
+UefiMain (
+  IN EFI_HANDLE        ImageHandle,
+  IN EFI_SYSTEM_TABLE  *SystemTable
+  )
+{
+  EFI_STATUS          Status;
+  UINTN               Iterations;
+  UINTN               NumberOfEnabledProcessors;
+  UINT64              StartValue;
+  UINT64              EndValue;
+  EFI_EVENT           WaitEvent;
+  LATENCY_STATISTICS  Blocking;
+  LATENCY_STATISTICS  SingleThread;
+  LATENCY_STATISTICS  Timeout;
+  LATENCY_STATISTICS  NonBlocking;
+  LATENCY_STATISTICS  ThisAp;
+
+  Iterations = GetIterations (ImageHandle);
+
+  mCounterFrequency  = GetPerformanceCounterProperties (&StartValue, &EndValue);
+  mCounterCountsDown = (BOOLEAN) (StartValue > EndValue);
+  if (mCounterFrequency == 0) {
+    Print (L"No performance counter to time the calls with\n");
+    return EFI_UNSUPPORTED;
+  }
+
+  Status = gBS->LocateProtocol (&gEfiMpServiceProtocolGuid, NULL, (VOID **) &mMpServices);
+  if (EFI_ERROR (Status)) {
+    Print (L"No MP services protocol - %r\n", Status);
+    return EFI_UNSUPPORTED;
+  }
+
+  Status = mMpServices->GetNumberOfProcessors (mMpServices, &mNumberOfProcessors, &NumberOfEnabledProcessors);
+  if (EFI_ERROR (Status)) {
+    Print (L"GetNumberOfProcessors failed - %r\n", Status);
+    return Status;
+  }
+  Status = mMpServices->WhoAmI (mMpServices, &mBspNumber);
+  if (EFI_ERROR (Status)) {
+    Print (L"WhoAmI failed - %r\n", Status);
+    return Status;
+  }
+  Print (
+    L"%d processors, %d enabled, BSP is processor %d, %d iterations\n",
+    mNumberOfProcessors,
+    NumberOfEnabledProcessors,
+    mBspNumber,
+    Iterations
+    );
+  if (NumberOfEnabledProcessors < 2) {
+    Print (L"No enabled AP to dispatch to\n");
+    return EFI_UNSUPPORTED;
+  }
+
+  mRunCount = AllocateZeroPool (mNumberOfProcessors * sizeof (*mRunCount));
+  if (mRunCount == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  Status = gBS->CreateEvent (0, TPL_CALLBACK, NULL, NULL, &WaitEvent);
+  if (EFI_ERROR (Status)) {
+    FreePool ((VOID *) mRunCount);
+    return Status;
+  }
+
+  ZeroMem (&Blocking, sizeof (Blocking));
+  ZeroMem (&SingleThread, sizeof (SingleThread));
+  ZeroMem (&Timeout, sizeof (Timeout));
+  ZeroMem (&NonBlocking, sizeof (NonBlocking));
+  ZeroMem (&ThisAp, sizeof (ThisAp));
+
+  Status = BenchmarkStartupAllAps (FALSE, NULL, 0, Iterations, &Blocking);
+  if (EFI_ERROR (Status)) {
+    Print (L"Blocking StartupAllAPs failed - %r\n", Status);
+    goto Done;
+  }
+  Status = BenchmarkStartupAllAps (TRUE, NULL, 0, Iterations, &SingleThread);
+  if (EFI_ERROR (Status)) {
+    Print (L"Single thread StartupAllAPs failed - %r\n", Status);
+    goto Done;
+  }
+  Status = BenchmarkStartupAllAps (FALSE, NULL, BENCHMARK_TIMEOUT_IN_MICROSECONDS, Iterations, &Timeout);
+  if (EFI_ERROR (Status)) {
+    Print (L"StartupAllAPs with a timeout failed - %r\n", Status);
+    goto Done;
+  }
+  Status = BenchmarkStartupAllAps (FALSE, WaitEvent, 0, Iterations, &NonBlocking);
+  if (EFI_ERROR (Status)) {
+    Print (L"Non-blocking StartupAllAPs failed - %r\n", Status);
+    goto Done;
+  }
+  Status = BenchmarkStartupThisAp (Iterations, &ThisAp);
+  if (EFI_ERROR (Status)) {
+    Print (L"StartupThisAP failed - %r\n", Status);
+    goto Done;
+  }
+
+  Print (L"\n  %-32s %6s %14s %14s\n", L"Mode", L"Count", L"Avg ns", L"Max ns");
+  ReportLatency (L"StartupAllAPs blocking", &Blocking);
+  ReportLatency (L"StartupAllAPs single thread", &SingleThread);
+  ReportLatency (L"StartupAllAPs with timeout", &Timeout);
+  ReportLatency (L"StartupAllAPs non-blocking", &NonBlocking);
+  ReportLatency (L"StartupThisAP blocking", &ThisAp);
+
+  Status = BenchmarkApCounts (Iterations);
+  if (EFI_ERROR (Status)) {
+    Print (L"StartupAllAPs by AP count failed - %r\n", Status);
+    goto Done;
+  }
+
+  Print (L"\nEvery call ran the procedure once on each AP it dispatched to\n");
+
+Done:
+  gBS->CloseEvent (WaitEvent);
+  FreePool ((VOID *) mRunCount);
+  return Status;
+}
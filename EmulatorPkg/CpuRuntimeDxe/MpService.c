@@ -439,6 +439,8 @@ CpuMpServicesStartupAllAps (
     gThread->MutexUnlock(ProcessorData->StateLock);
   }
 
+  gMPSystem.FailedList      = NULL;
+  gMPSystem.FailedListIndex = 0;
   if (FailedCpuList != NULL) {
     gMPSystem.FailedList = AllocatePool ((gMPSystem.NumberOfProcessors + 1) * sizeof (UINTN));
     if (gMPSystem.FailedList == NULL) {
@@ -468,7 +470,9 @@ CpuMpServicesStartupAllAps (
 
     if ((ProcessorData->Info.StatusFlag & PROCESSOR_ENABLED_BIT) == 0) {
       // Skip Disabled processors
-      gMPSystem.FailedList[gMPSystem.FailedListIndex++] = Number;
+      if (gMPSystem.FailedList != NULL) {
+        gMPSystem.FailedList[gMPSystem.FailedListIndex++] = Number;
+      }
       continue;
     }
 
@@ -591,9 +595,10 @@ Done:
       FreePool (*FailedCpuList);
       *FailedCpuList = NULL;
     }
+    gMPSystem.FailedList = NULL;
   }
 
-  return EFI_SUCCESS;
+  return Status;
 }
 
 
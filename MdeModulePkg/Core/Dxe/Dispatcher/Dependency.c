@@ -25,6 +25,24 @@ BOOLEAN *mDepexEvaluationStack        = NULL;
 BOOLEAN *mDepexEvaluationStackEnd     = NULL;
 BOOLEAN *mDepexEvaluationStackPointer = NULL;
 
+//
+// Reverse index from the protocols tested by PUSH opcodes to the drivers
+// whose Depex tests them, hashed by protocol GUID. The dispatcher only
+// evaluates a Depex again after one of its protocols has changed.
+//
+#define DEPEX_PROTOCOL_HASH_BUCKETS       64
+
+#define DEPEX_PROTOCOL_REFERENCE_SIGNATURE SIGNATURE_32('d','p','x','r')
+typedef struct {
+  UINTN                   Signature;
+  LIST_ENTRY              Link;           // mDepexProtocolHashTable
+  EFI_GUID                ProtocolGuid;
+  EFI_CORE_DRIVER_ENTRY   *DriverEntry;
+} DEPEX_PROTOCOL_REFERENCE;
+
+LIST_ENTRY  mDepexProtocolHashTable[DEPEX_PROTOCOL_HASH_BUCKETS];
+BOOLEAN     mDepexProtocolHashTableInitialized = FALSE;
+
 //
 // Worker functions
 //
@@ -154,6 +172,138 @@ PopBool (
 
 
 
+/**
+  Get the hash bucket of mDepexProtocolHashTable that holds a protocol GUID.
+
+  @param  Protocol              The protocol GUID.
+
+  @return The list head of the hash bucket
+
+**/
+LIST_ENTRY *
+CoreGetDepexProtocolHashBucket (
+  IN  EFI_GUID                *Protocol
+  )
+{
+  UINT32  Hash;
+
+  Hash = ReadUnaligned32 ((UINT32 *)Protocol) ^
+         ReadUnaligned32 ((UINT32 *)Protocol + 1) ^
+         ReadUnaligned32 ((UINT32 *)Protocol + 2) ^
+         ReadUnaligned32 ((UINT32 *)Protocol + 3);
+  Hash ^= Hash >> 16;
+
+  return &mDepexProtocolHashTable[Hash & (DEPEX_PROTOCOL_HASH_BUCKETS - 1)];
+}
+
+
+/**
+  Add the protocols tested by the PUSH opcodes of a Depex to the reverse
+  index. If the Depex cannot be parsed, or the index cannot be extended,
+  DriverEntry->DepexIndexed stays FALSE and the dispatcher evaluates the
+  Depex in every pass.
+
+  @param  DriverEntry           DriverEntry element to index.
+
+**/
+VOID
+CoreIndexDepexProtocols (
+  IN  EFI_CORE_DRIVER_ENTRY   *DriverEntry
+  )
+{
+  UINTN                     Index;
+  UINT8                     *Iterator;
+  UINT8                     *End;
+  DEPEX_PROTOCOL_REFERENCE  *Reference;
+  EFI_TPL                   OldTpl;
+
+  if (!mDepexProtocolHashTableInitialized) {
+    for (Index = 0; Index < DEPEX_PROTOCOL_HASH_BUCKETS; Index++) {
+      InitializeListHead (&mDepexProtocolHashTable[Index]);
+    }
+    mDepexProtocolHashTableInitialized = TRUE;
+  }
+
+  Iterator = DriverEntry->Depex;
+  End      = Iterator + DriverEntry->DepexSize;
+  while (Iterator < End) {
+    switch (*Iterator) {
+    case EFI_DEP_PUSH:
+      if ((UINTN)(End - Iterator) < 1 + sizeof (EFI_GUID)) {
+        return;
+      }
+      Reference = AllocatePool (sizeof (DEPEX_PROTOCOL_REFERENCE));
+      if (Reference == NULL) {
+        return;
+      }
+      Reference->Signature   = DEPEX_PROTOCOL_REFERENCE_SIGNATURE;
+      Reference->DriverEntry = DriverEntry;
+      CopyMem (&Reference->ProtocolGuid, Iterator + 1, sizeof (EFI_GUID));
+      //
+      // Protocols are installed at up to TPL_NOTIFY, and each install walks
+      // the bucket of its protocol.
+      //
+      OldTpl = CoreRaiseTpl (TPL_NOTIFY);
+      InsertTailList (CoreGetDepexProtocolHashBucket (&Reference->ProtocolGuid), &Reference->Link);
+      CoreRestoreTpl (OldTpl);
+      Iterator += 1 + sizeof (EFI_GUID);
+      break;
+
+    case EFI_DEP_SOR:
+    case EFI_DEP_AND:
+    case EFI_DEP_OR:
+    case EFI_DEP_NOT:
+    case EFI_DEP_TRUE:
+    case EFI_DEP_FALSE:
+      Iterator++;
+      break;
+
+    case EFI_DEP_END:
+      DriverEntry->DepexIndexed = TRUE;
+      return;
+
+    default:
+      //
+      // BEFORE and AFTER are not evaluated by CoreIsSchedulable (), and
+      // unknown opcodes make the Depex evaluate to FALSE.
+      //
+      return;
+    }
+  }
+}
+
+
+/**
+  Marks the Depex of every driver that tests a protocol for evaluation in the
+  next pass of the dispatcher. Called whenever the protocol is installed or
+  uninstalled.
+
+  @param  Protocol              The protocol that was installed or uninstalled.
+
+**/
+VOID
+CoreInvalidateDepexOnProtocol (
+  IN  EFI_GUID                *Protocol
+  )
+{
+  LIST_ENTRY                *Link;
+  LIST_ENTRY                *Head;
+  DEPEX_PROTOCOL_REFERENCE  *Reference;
+
+  if (!mDepexProtocolHashTableInitialized) {
+    return;
+  }
+
+  Head = CoreGetDepexProtocolHashBucket (Protocol);
+  for (Link = Head->ForwardLink; Link != Head; Link = Link->ForwardLink) {
+    Reference = CR (Link, DEPEX_PROTOCOL_REFERENCE, Link, DEPEX_PROTOCOL_REFERENCE_SIGNATURE);
+    if (CompareGuid (&Reference->ProtocolGuid, Protocol)) {
+      Reference->DriverEntry->DepexDirty = TRUE;
+    }
+  }
+}
+
+
 /**
   Preprocess dependency expression and update DriverEntry to reflect the
   state of  Before, After, and SOR dependencies. If DriverEntry->Before
@@ -188,7 +338,10 @@ CorePreProcessDepex (
 
   if (DriverEntry->Before || DriverEntry->After) {
     CopyMem (&DriverEntry->BeforeAfterGuid, Iterator + 1, sizeof (EFI_GUID));
+  } else {
+    CoreIndexDepexProtocols (DriverEntry);
   }
+  DriverEntry->DepexDirty = TRUE;
 
   return EFI_SUCCESS;
 }
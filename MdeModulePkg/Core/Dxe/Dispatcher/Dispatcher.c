@@ -23,6 +23,12 @@
   The rules for the dispatcher are in chapter 10 of the DXE CIS. Figure 10-3
   is the state diagram for the DXE dispatcher
 
+  Driver entry points are always run on the BSP, one at a time. Boot services
+  are not MP safe, so a driver that wants to overlap slow hardware waits with
+  the rest of the dispatch starts that work on an AP itself, through the
+  non-blocking mode of EFI_MP_SERVICES_PROTOCOL.StartupThisAP(), and must not
+  call boot services from the AP procedure.
+
   Depex - Dependency Expresion.
   SOR   - Schedule On Request - Don't schedule if this bit is set.
 
@@ -332,6 +338,7 @@ CoreSchedule (
       CoreAcquireDispatcherLock ();
       DriverEntry->Unrequested  = FALSE;
       DriverEntry->Dependent    = TRUE;
+      DriverEntry->DepexDirty   = TRUE;
       CoreReleaseDispatcherLock ();
 
       DEBUG ((DEBUG_DISPATCH, "Schedule FFS(%g) - EFI_SUCCESS\n", DriverName));
@@ -563,9 +570,16 @@ CoreDispatcher (
       }
 
       if (DriverEntry->Dependent) {
-        if (CoreIsSchedulable (DriverEntry)) {
-          CoreInsertOnScheduledQueueWhileProcessingBeforeAndAfter (DriverEntry);
-          ReadyToRun = TRUE;
+        //
+        // A Depex whose protocols have not changed since it was last
+        // evaluated still evaluates to FALSE.
+        //
+        if (!DriverEntry->DepexIndexed || DriverEntry->DepexDirty) {
+          DriverEntry->DepexDirty = FALSE;
+          if (CoreIsSchedulable (DriverEntry)) {
+            CoreInsertOnScheduledQueueWhileProcessingBeforeAndAfter (DriverEntry);
+            ReadyToRun = TRUE;
+          }
         }
       } else {
         if (DriverEntry->Unrequested) {
@@ -173,15 +173,28 @@ typedef struct {
   EFI_HANDLE                      ImageHandle;
   BOOLEAN                         IsFvImage;
 
+  ///
+  /// DepexIndexed is set if every protocol the Depex tests is in the reverse
+  /// index of the dispatcher, and DepexDirty is set when one of them has been
+  /// installed or uninstalled since the Depex was last evaluated.
+  ///
+  BOOLEAN                         DepexIndexed;
+  BOOLEAN                         DepexDirty;
 } EFI_CORE_DRIVER_ENTRY;
 
 //
 //The data structure of GCD memory map entry
 //
 #define EFI_GCD_MAP_SIGNATURE  SIGNATURE_32('g','c','d','m')
-typedef struct {
+typedef struct _EFI_GCD_MAP_ENTRY {
   UINTN                 Signature;
   LIST_ENTRY            Link;
+  ///
+  /// Links of the tree that indexes the map by BaseAddress
+  ///
+  struct _EFI_GCD_MAP_ENTRY  *Left;
+  struct _EFI_GCD_MAP_ENTRY  *Right;
+  UINT32                Priority;
   EFI_PHYSICAL_ADDRESS  BaseAddress;
   UINT64                EndAddress;
   UINT64                Capabilities;
@@ -527,6 +540,20 @@ CorePreProcessDepex (
   );
 
 
+/**
+  Marks the Depex of every driver that tests a protocol for evaluation in the
+  next pass of the dispatcher. Called whenever the protocol is installed or
+  uninstalled.
+
+  @param  Protocol              The protocol that was installed or uninstalled.
+
+**/
+VOID
+CoreInvalidateDepexOnProtocol (
+  IN  EFI_GUID                *Protocol
+  );
+
+
 
 /**
   Terminates all boot services.
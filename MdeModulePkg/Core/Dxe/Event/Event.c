@@ -38,9 +38,12 @@ LIST_ENTRY      gEventQueue[TPL_HIGH_LEVEL + 1];
 UINTN           gEventPending = 0;
 
 ///
-/// gEventSignalQueue - A list of events to signal based on EventGroup type
+/// mEventGroupHashTable - The events to signal based on EventGroup type,
+/// hashed by EventGroup. Each bucket keeps the events of a group in the
+/// order they are notified.
 ///
-LIST_ENTRY      gEventSignalQueue = INITIALIZE_LIST_HEAD_VARIABLE (gEventSignalQueue);
+LIST_ENTRY      mEventGroupHashTable[EVENT_GROUP_HASH_BUCKETS];
+BOOLEAN         mEventGroupHashTableInitialized = FALSE;
 
 ///
 /// Enumerate the valid types
@@ -249,13 +252,49 @@ CoreNotifyEvent (
 
 
 /**
-  Signals all events in the EventGroup.
+  Get the hash bucket of mEventGroupHashTable that holds an event group.
+  The table is initialized on first use, since memory map changes signal
+  their event group before the event services are initialized.
+
+  @param  EventGroup             The GUID of the event group
+
+  @return The list head of the hash bucket
+
+**/
+LIST_ENTRY *
+CoreGetEventGroupHashBucket (
+  IN CONST EFI_GUID   *EventGroup
+  )
+{
+  UINTN   Index;
+  UINT32  Hash;
+
+  if (!mEventGroupHashTableInitialized) {
+    for (Index = 0; Index < EVENT_GROUP_HASH_BUCKETS; Index++) {
+      InitializeListHead (&mEventGroupHashTable[Index]);
+    }
+    mEventGroupHashTableInitialized = TRUE;
+  }
+
+  Hash = ReadUnaligned32 ((UINT32 *)EventGroup) ^
+         ReadUnaligned32 ((UINT32 *)EventGroup + 1) ^
+         ReadUnaligned32 ((UINT32 *)EventGroup + 2) ^
+         ReadUnaligned32 ((UINT32 *)EventGroup + 3);
+  Hash ^= Hash >> 16;
+
+  return &mEventGroupHashTable[Hash & (EVENT_GROUP_HASH_BUCKETS - 1)];
+}
+
+
+/**
+  Queues the notification functions of all events in the EventGroup.
+  The event database must be locked.
 
   @param  EventGroup             The list to signal
 
 **/
 VOID
-CoreNotifySignalList (
+CoreNotifyEventGroup (
   IN EFI_GUID     *EventGroup
   )
 {
@@ -263,16 +302,31 @@ CoreNotifySignalList (
   LIST_ENTRY              *Head;
   IEVENT                  *Event;
 
-  CoreAcquireEventLock ();
+  ASSERT_LOCKED (&gEventQueueLock);
 
-  Head = &gEventSignalQueue;
+  Head = CoreGetEventGroupHashBucket (EventGroup);
   for (Link = Head->ForwardLink; Link != Head; Link = Link->ForwardLink) {
     Event = CR (Link, IEVENT, SignalLink, EVENT_SIGNATURE);
     if (CompareGuid (&Event->EventGroup, EventGroup)) {
       CoreNotifyEvent (Event);
     }
   }
+}
+
+
+/**
+  Signals all events in the EventGroup.
+
+  @param  EventGroup             The list to signal
 
+**/
+VOID
+CoreNotifySignalList (
+  IN EFI_GUID     *EventGroup
+  )
+{
+  CoreAcquireEventLock ();
+  CoreNotifyEventGroup (EventGroup);
   CoreReleaseEventLock ();
 }
 
@@ -497,11 +551,11 @@ CoreCreateEventInternal (
 
   CoreAcquireEventLock ();
 
-  if ((Type & EVT_NOTIFY_SIGNAL) != 0x00000000) {
+  if ((Type & EVT_NOTIFY_SIGNAL) != 0x00000000 && (IEvent->ExFlag & EVT_EXFLAG_EVENT_GROUP) != 0) {
     //
-    // The Event's NotifyFunction must be queued whenever the event is signaled
+    // The Event's NotifyFunction must be queued whenever its event group is signaled
     //
-    InsertHeadList (&gEventSignalQueue, &IEvent->SignalLink);
+    InsertHeadList (CoreGetEventGroupHashBucket (&IEvent->EventGroup), &IEvent->SignalLink);
   }
 
   CoreReleaseEventLock ();
@@ -558,12 +612,10 @@ CoreSignalEvent (
       if ((Event->ExFlag & EVT_EXFLAG_EVENT_GROUP) != 0) {
         //
         // The CreateEventEx() style requires all members of the Event Group
-        //  to be signaled.
+        //  to be signaled. Queue them all under the lock that is already held.
         //
-        CoreReleaseEventLock ();
-        CoreNotifySignalList (&Event->EventGroup);
-        CoreAcquireEventLock ();
-       } else {
+        CoreNotifyEventGroup (&Event->EventGroup);
+      } else {
         CoreNotifyEvent (Event);
       }
     }
@@ -29,6 +29,11 @@ extern  UINTN                   gEventPending;
 ///
 #define EVT_EXFLAG_EVENT_PROTOCOL_NOTIFICATION    0x02
 
+///
+/// Number of buckets of the table that holds the events of each event group
+///
+#define EVENT_GROUP_HASH_BUCKETS                  32
+
 //
 // EFI_EVENT
 //
@@ -36,10 +41,17 @@ extern  UINTN                   gEventPending;
 ///
 /// Timer event information
 ///
-typedef struct {
+typedef struct _TIMER_EVENT_INFO {
   LIST_ENTRY      Link;
   UINT64          TriggerTime;
   UINT64          Period;
+  ///
+  /// Links of the tree that indexes the timer list by TriggerTime and Sequence
+  ///
+  struct _TIMER_EVENT_INFO  *Left;
+  struct _TIMER_EVENT_INFO  *Right;
+  UINT32          Priority;
+  UINT64          Sequence;
 } TIMER_EVENT_INFO;
 
 #define EVENT_SIGNATURE         SIGNATURE_32('e','v','n','t')
@@ -48,7 +60,7 @@ typedef struct {
   UINT32                  Type;
   UINT32                  SignalCount;
   ///
-  /// Entry if the event is registered to be signalled
+  /// Entry if the event is registered to be signalled with its event group
   ///
   LIST_ENTRY              SignalLink;
   ///
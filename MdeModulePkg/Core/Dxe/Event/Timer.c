@@ -24,12 +24,139 @@ LIST_ENTRY       mEfiTimerList = INITIALIZE_LIST_HEAD_VARIABLE (mEfiTimerList);
 EFI_LOCK         mEfiTimerLock = EFI_INITIALIZE_LOCK_VARIABLE (TPL_HIGH_LEVEL - 1);
 EFI_EVENT        mEfiCheckTimerEvent = NULL;
 
+//
+// Tree indexing mEfiTimerList, so that a timer finds its place in the sorted
+// list without walking it. Sequence numbers order timers with the same
+// trigger time by the time they were set.
+//
+TIMER_EVENT_INFO *mEfiTimerTree = NULL;
+UINT32           mEfiTimerTreeSeed = 0x1B873593;
+UINT64           mEfiTimerSequence = 0;
+
 EFI_LOCK         mEfiSystemTimeLock = EFI_INITIALIZE_LOCK_VARIABLE (TPL_HIGH_LEVEL);
 UINT64           mEfiSystemTime = 0;
 
 //
 // Timer functions
 //
+/**
+  Checks the order of two timers in the timer database.
+
+  @param  Timer1                 The first timer
+  @param  Timer2                 The second timer
+
+  @retval TRUE                   Timer1 expires before Timer2.
+  @retval FALSE                  Timer1 does not expire before Timer2.
+
+**/
+BOOLEAN
+CoreIsTimerBelow (
+  IN TIMER_EVENT_INFO  *Timer1,
+  IN TIMER_EVENT_INFO  *Timer2
+  )
+{
+  return (BOOLEAN) ((Timer1->TriggerTime < Timer2->TriggerTime) ||
+                    ((Timer1->TriggerTime == Timer2->TriggerTime) && (Timer1->Sequence < Timer2->Sequence)));
+}
+
+/**
+  Splits a timer tree into the timers that expire before Timer and the
+  other timers.
+
+  @param  Tree                   The tree to split
+  @param  Timer                  The timer to split at
+  @param  Left                   Returns the tree of timers before Timer
+  @param  Right                  Returns the tree of the other timers
+
+**/
+VOID
+CoreSplitTimerTree (
+  IN  TIMER_EVENT_INFO  *Tree,
+  IN  TIMER_EVENT_INFO  *Timer,
+  OUT TIMER_EVENT_INFO  **Left,
+  OUT TIMER_EVENT_INFO  **Right
+  )
+{
+  while (Tree != NULL) {
+    if (CoreIsTimerBelow (Tree, Timer)) {
+      *Left = Tree;
+      Left  = &Tree->Right;
+      Tree  = Tree->Right;
+    } else {
+      *Right = Tree;
+      Right  = &Tree->Left;
+      Tree   = Tree->Left;
+    }
+  }
+  *Left  = NULL;
+  *Right = NULL;
+}
+
+/**
+  Joins two timer trees. All timers of Left must expire before all timers
+  of Right.
+
+  @param  Left                   The tree of the earlier timers
+  @param  Right                  The tree of the later timers
+
+  @return The root of the joined tree
+
+**/
+TIMER_EVENT_INFO *
+CoreJoinTimerTree (
+  IN TIMER_EVENT_INFO  *Left,
+  IN TIMER_EVENT_INFO  *Right
+  )
+{
+  TIMER_EVENT_INFO  *Root;
+  TIMER_EVENT_INFO  **Link;
+
+  Link = &Root;
+  while ((Left != NULL) && (Right != NULL)) {
+    if (Left->Priority > Right->Priority) {
+      *Link = Left;
+      Link  = &Left->Right;
+      Left  = Left->Right;
+    } else {
+      *Link = Right;
+      Link  = &Right->Left;
+      Right = Right->Left;
+    }
+  }
+  *Link = (Left != NULL) ? Left : Right;
+
+  return Root;
+}
+
+/**
+  Removes the timer event from the timer database.
+
+  @param  Event                  Points to the internal structure of timer event
+                                 to be removed
+
+**/
+VOID
+CoreRemoveEventTimer (
+  IN IEVENT   *Event
+  )
+{
+  TIMER_EVENT_INFO  **Link;
+
+  ASSERT_LOCKED (&mEfiTimerLock);
+
+  Link = &mEfiTimerTree;
+  while (*Link != &Event->Timer) {
+    ASSERT (*Link != NULL);
+    Link = CoreIsTimerBelow (&Event->Timer, *Link) ? &(*Link)->Left : &(*Link)->Right;
+  }
+  *Link = CoreJoinTimerTree (Event->Timer.Left, Event->Timer.Right);
+  Event->Timer.Left  = NULL;
+  Event->Timer.Right = NULL;
+
+  RemoveEntryList (&Event->Timer.Link);
+  Event->Timer.Link.ForwardLink = NULL;
+}
+
 /**
   Inserts the timer event.
 
@@ -42,29 +169,39 @@ CoreInsertEventTimer (
   IN IEVENT   *Event
   )
 {
-  UINT64          TriggerTime;
-  LIST_ENTRY      *Link;
-  IEVENT          *Event2;
+  TIMER_EVENT_INFO  *Timer;
+  TIMER_EVENT_INFO  *Previous;
+  TIMER_EVENT_INFO  **Link;
 
   ASSERT_LOCKED (&mEfiTimerLock);
 
-  //
-  // Get the timer's trigger time
-  //
-  TriggerTime = Event->Timer.TriggerTime;
+  Timer = &Event->Timer;
+  Timer->Sequence = mEfiTimerSequence++;
+  mEfiTimerTreeSeed = mEfiTimerTreeSeed * 1103515245 + 12345;
+  Timer->Priority = mEfiTimerTreeSeed;
 
   //
-  // Insert the timer into the timer database in assending sorted order
+  // Insert the timer into the timer database in assending sorted order, after
+  // the last timer that does not expire later. The sequence number makes that
+  // the timer ordered right before this one in the tree.
   //
-  for (Link = mEfiTimerList.ForwardLink; Link != &mEfiTimerList; Link = Link->ForwardLink) {
-    Event2 = CR (Link, IEVENT, Timer.Link, EVENT_SIGNATURE);
-
-    if (Event2->Timer.TriggerTime > TriggerTime) {
-      break;
+  Previous = NULL;
+  for (Link = &mEfiTimerTree; *Link != NULL; ) {
+    if (CoreIsTimerBelow (*Link, Timer)) {
+      Previous = *Link;
+      Link     = &(*Link)->Right;
+    } else {
+      Link     = &(*Link)->Left;
     }
   }
+  InsertHeadList ((Previous != NULL) ? &Previous->Link : &mEfiTimerList, &Timer->Link);
 
-  InsertTailList (Link, &Event->Timer.Link);
+  Link = &mEfiTimerTree;
+  while ((*Link != NULL) && ((*Link)->Priority > Timer->Priority)) {
+    Link = CoreIsTimerBelow (Timer, *Link) ? &(*Link)->Left : &(*Link)->Right;
+  }
+  CoreSplitTimerTree (*Link, Timer, &Timer->Left, &Timer->Right);
+  *Link = Timer;
 }
 
 /**
@@ -125,8 +262,7 @@ CoreCheckTimers (
     // Remove this timer from the timer queue
     //
 
-    RemoveEntryList (&Event->Timer.Link);
-    Event->Timer.Link.ForwardLink = NULL;
+    CoreRemoveEventTimer (Event);
 
     //
     // Signal it
@@ -271,8 +407,7 @@ CoreSetTimer (
   // If the timer is queued to the timer database, remove it
   //
   if (Event->Timer.Link.ForwardLink != NULL) {
-    RemoveEntryList (&Event->Timer.Link);
-    Event->Timer.Link.ForwardLink = NULL;
+    CoreRemoveEventTimer (Event);
   }
 
   Event->Timer.TriggerTime = 0;
@@ -48,6 +48,7 @@ FV_DEVICE mFvDevice = {
   0,
   0,
   FALSE,
+  FALSE,
   FALSE
 };
 
@@ -341,6 +342,7 @@ FvCheck (
   BOOLEAN                               FileCached;
   UINTN                                 WholeFileSize;
   EFI_FFS_FILE_HEADER                   *CacheFfsHeader;
+  EFI_GCD_MEMORY_SPACE_DESCRIPTOR       Descriptor;
 
   FileCached = FALSE;
   CacheFfsHeader = NULL;
@@ -370,6 +372,19 @@ FvCheck (
     // Don't cache memory mapped FV really.
     //
     FvDevice->CachedFv = (UINT8 *) (UINTN) (PhysicalAddress + FwVolHeader->HeaderLength);
+
+    //
+    // An FV that PEI has placed in system memory, such as a decompressed
+    // FV, is as fast to read as a cached copy of its files, so FvReadFile ()
+    // does not cache them.
+    //
+    Status = CoreGetMemorySpaceDescriptor (PhysicalAddress, &Descriptor);
+    if (!EFI_ERROR (Status) &&
+        ((Descriptor.GcdMemoryType == EfiGcdMemoryTypeSystemMemory) ||
+         (Descriptor.GcdMemoryType == EfiGcdMemoryTypeMoreReliable)) &&
+        (FwVolHeader->FvLength <= Descriptor.BaseAddress + Descriptor.Length - PhysicalAddress)) {
+      FvDevice->IsInSystemMemory = TRUE;
+    }
   } else {
     FvDevice->IsMemoryMapped = FALSE;
     FvDevice->CachedFv = AllocatePool (Size);
@@ -524,7 +539,7 @@ FvCheck (
 
     CacheFfsHeader = FfsHeader;
     if ((CacheFfsHeader->Attributes & FFS_ATTRIB_CHECKSUM) == FFS_ATTRIB_CHECKSUM) {
-      if (FvDevice->IsMemoryMapped) {
+      if (FvDevice->IsMemoryMapped && !FvDevice->IsInSystemMemory) {
         //
         // Memory mapped FV has not been cached.
         // Here is to cache FFS file to memory buffer for following checksum calculating.
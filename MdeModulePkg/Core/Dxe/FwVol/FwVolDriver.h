@@ -47,6 +47,10 @@ typedef struct {
   UINT8                                   ErasePolarity;
   BOOLEAN                                 IsFfs3Fv;
   BOOLEAN                                 IsMemoryMapped;
+  ///
+  /// TRUE if the FV is memory mapped and lies entirely in system memory
+  ///
+  BOOLEAN                                 IsInSystemMemory;
 } FV_DEVICE;
 
 #define FV_DEVICE_FROM_THIS(a) CR(a, FV_DEVICE, Fv, FV2_DEVICE_SIGNATURE)
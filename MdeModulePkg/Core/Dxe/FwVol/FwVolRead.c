@@ -313,9 +313,11 @@ FvReadFile (
   // Get a pointer to the header
   //
   FfsHeader = FvDevice->LastKey->FfsHeader;
-  if (FvDevice->IsMemoryMapped) {
+  if (FvDevice->IsMemoryMapped && !FvDevice->IsInSystemMemory) {
     //
     // Memory mapped FV has not been cached, so here is to cache by file.
+    // Files of an FV in system memory are read in place, which saves a copy
+    // and an allocation for every driver loaded from it.
     //
     if (!FvDevice->LastKey->FileCached) {
       //
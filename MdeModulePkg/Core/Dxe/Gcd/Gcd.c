@@ -50,12 +50,24 @@ EFI_LOCK           mGcdIoSpaceLock     = EFI_INITIALIZE_LOCK_VARIABLE (TPL_NOTIF
 LIST_ENTRY         mGcdMemorySpaceMap  = INITIALIZE_LIST_HEAD_VARIABLE (mGcdMemorySpaceMap);
 LIST_ENTRY         mGcdIoSpaceMap      = INITIALIZE_LIST_HEAD_VARIABLE (mGcdIoSpaceMap);
 
+///
+/// Trees indexing the entries of mGcdMemorySpaceMap and mGcdIoSpaceMap by
+/// BaseAddress. The entries of a map never overlap, so the entry covering an
+/// address is the one with the highest BaseAddress that is not above it.
+///
+EFI_GCD_MAP_ENTRY  *mGcdMemorySpaceTree = NULL;
+EFI_GCD_MAP_ENTRY  *mGcdIoSpaceTree     = NULL;
+UINT32             mGcdMapTreeSeed      = 0x6C8E9CF5;
+
 EFI_GCD_MAP_ENTRY mGcdMemorySpaceMapEntryTemplate = {
   EFI_GCD_MAP_SIGNATURE,
   {
     NULL,
     NULL
   },
+  NULL,
+  NULL,
+  0,
   0,
   0,
   0,
@@ -72,6 +84,9 @@ EFI_GCD_MAP_ENTRY mGcdIoSpaceMapEntryTemplate = {
     NULL,
     NULL
   },
+  NULL,
+  NULL,
+  0,
   0,
   0,
   0,
@@ -368,6 +383,177 @@ PageAlignLength (
 // GCD Memory Space Worker Functions
 //
 
+/**
+  Internal function.  Returns the root of the tree that indexes a GCD map.
+
+  @param  Map                    The GCD map, mGcdMemorySpaceMap or mGcdIoSpaceMap
+
+  @return The address of the root of the tree
+
+**/
+EFI_GCD_MAP_ENTRY **
+CoreGetGcdMapTree (
+  IN LIST_ENTRY  *Map
+  )
+{
+  ASSERT (Map == &mGcdMemorySpaceMap || Map == &mGcdIoSpaceMap);
+
+  return (Map == &mGcdMemorySpaceMap) ? &mGcdMemorySpaceTree : &mGcdIoSpaceTree;
+}
+
+/**
+  Internal function.  Splits a GCD map tree into the entries that start below
+  BaseAddress and the other entries.
+
+  @param  Tree                   The tree to split
+  @param  BaseAddress            The address to split at
+  @param  Left                   Returns the tree of entries below BaseAddress
+  @param  Right                  Returns the tree of the other entries
+
+**/
+VOID
+CoreSplitGcdMapTree (
+  IN  EFI_GCD_MAP_ENTRY     *Tree,
+  IN  EFI_PHYSICAL_ADDRESS  BaseAddress,
+  OUT EFI_GCD_MAP_ENTRY     **Left,
+  OUT EFI_GCD_MAP_ENTRY     **Right
+  )
+{
+  while (Tree != NULL) {
+    if (Tree->BaseAddress < BaseAddress) {
+      *Left = Tree;
+      Left  = &Tree->Right;
+      Tree  = Tree->Right;
+    } else {
+      *Right = Tree;
+      Right  = &Tree->Left;
+      Tree   = Tree->Left;
+    }
+  }
+  *Left  = NULL;
+  *Right = NULL;
+}
+
+/**
+  Internal function.  Joins two GCD map trees. All entries of Left must start
+  below all entries of Right.
+
+  @param  Left                   The tree of the lower entries
+  @param  Right                  The tree of the upper entries
+
+  @return The root of the joined tree
+
+**/
+EFI_GCD_MAP_ENTRY *
+CoreJoinGcdMapTree (
+  IN EFI_GCD_MAP_ENTRY  *Left,
+  IN EFI_GCD_MAP_ENTRY  *Right
+  )
+{
+  EFI_GCD_MAP_ENTRY  *Root;
+  EFI_GCD_MAP_ENTRY  **Link;
+
+  Link = &Root;
+  while ((Left != NULL) && (Right != NULL)) {
+    if (Left->Priority > Right->Priority) {
+      *Link = Left;
+      Link  = &Left->Right;
+      Left  = Left->Right;
+    } else {
+      *Link = Right;
+      Link  = &Right->Left;
+      Right = Right->Left;
+    }
+  }
+  *Link = (Left != NULL) ? Left : Right;
+
+  return Root;
+}
+
+/**
+  Internal function.  Adds an entry of a GCD map to the tree of that map.
+
+  @param  Map                    The GCD map the entry belongs to
+  @param  Entry                  The entry to add
+
+**/
+VOID
+CoreInsertGcdMapTree (
+  IN     LIST_ENTRY         *Map,
+  IN OUT EFI_GCD_MAP_ENTRY  *Entry
+  )
+{
+  EFI_GCD_MAP_ENTRY  **Link;
+
+  mGcdMapTreeSeed = mGcdMapTreeSeed * 1103515245 + 12345;
+  Entry->Priority = mGcdMapTreeSeed;
+
+  Link = CoreGetGcdMapTree (Map);
+  while ((*Link != NULL) && ((*Link)->Priority > Entry->Priority)) {
+    Link = (Entry->BaseAddress < (*Link)->BaseAddress) ? &(*Link)->Left : &(*Link)->Right;
+  }
+  CoreSplitGcdMapTree (*Link, Entry->BaseAddress, &Entry->Left, &Entry->Right);
+  *Link = Entry;
+}
+
+/**
+  Internal function.  Removes an entry of a GCD map from the tree of that map.
+
+  @param  Map                    The GCD map the entry belongs to
+  @param  Entry                  The entry to remove
+
+**/
+VOID
+CoreRemoveGcdMapTree (
+  IN     LIST_ENTRY         *Map,
+  IN OUT EFI_GCD_MAP_ENTRY  *Entry
+  )
+{
+  EFI_GCD_MAP_ENTRY  **Link;
+
+  Link = CoreGetGcdMapTree (Map);
+  while (*Link != Entry) {
+    ASSERT (*Link != NULL);
+    Link = (Entry->BaseAddress < (*Link)->BaseAddress) ? &(*Link)->Left : &(*Link)->Right;
+  }
+  *Link = CoreJoinGcdMapTree (Entry->Left, Entry->Right);
+  Entry->Left  = NULL;
+  Entry->Right = NULL;
+}
+
+/**
+  Internal function.  Finds the entry of a GCD map with the highest base
+  address that is not above Address.
+
+  @param  Map                    The GCD map to search
+  @param  Address                The address to search for
+
+  @return The entry found, or NULL if all entries start above Address
+
+**/
+EFI_GCD_MAP_ENTRY *
+CoreFindGcdMapTreeFloor (
+  IN LIST_ENTRY            *Map,
+  IN EFI_PHYSICAL_ADDRESS  Address
+  )
+{
+  EFI_GCD_MAP_ENTRY  *Tree;
+  EFI_GCD_MAP_ENTRY  *Floor;
+
+  Floor = NULL;
+  Tree  = *CoreGetGcdMapTree (Map);
+  while (Tree != NULL) {
+    if (Tree->BaseAddress <= Address) {
+      Floor = Tree;
+      Tree  = Tree->Right;
+    } else {
+      Tree  = Tree->Left;
+    }
+  }
+
+  return Floor;
+}
+
 /**
   Allocate pool for two entries.
 
@@ -409,6 +595,7 @@ CoreAllocateGcdMapEntry (
   @param  Length                 The length of the new range in bytes
   @param  TopEntry               Top pad entry to insert if needed.
   @param  BottomEntry            Bottom pad entry to insert if needed.
+  @param  Map                    The GCD map that Entry belongs to.
 
   @retval EFI_SUCCESS            The new range was inserted into the linked list
 
@@ -420,7 +607,8 @@ CoreInsertGcdMapEntry (
   IN EFI_PHYSICAL_ADDRESS  BaseAddress,
   IN UINT64                Length,
   IN EFI_GCD_MAP_ENTRY     *TopEntry,
-  IN EFI_GCD_MAP_ENTRY     *BottomEntry
+  IN EFI_GCD_MAP_ENTRY     *BottomEntry,
+  IN LIST_ENTRY           *Map
   )
 {
   ASSERT (Length != 0);
@@ -428,10 +616,15 @@ CoreInsertGcdMapEntry (
   if (BaseAddress > Entry->BaseAddress) {
     ASSERT (BottomEntry->Signature == 0);
 
+    //
+    // Raising the BaseAddress of Entry keeps its place in the tree, because
+    // no other entry starts between its old and new BaseAddress.
+    //
     CopyMem (BottomEntry, Entry, sizeof (EFI_GCD_MAP_ENTRY));
     Entry->BaseAddress      = BaseAddress;
     BottomEntry->EndAddress = BaseAddress - 1;
     InsertTailList (Link, &BottomEntry->Link);
+    CoreInsertGcdMapTree (Map, BottomEntry);
   }
 
   if ((BaseAddress + Length - 1) < Entry->EndAddress) {
@@ -441,6 +634,7 @@ CoreInsertGcdMapEntry (
     TopEntry->BaseAddress = BaseAddress + Length;
     Entry->EndAddress     = BaseAddress + Length - 1;
     InsertHeadList (Link, &TopEntry->Link);
+    CoreInsertGcdMapTree (Map, TopEntry);
   }
 
   return EFI_SUCCESS;
@@ -508,6 +702,10 @@ CoreMergeGcdMapEntry (
     return EFI_UNSUPPORTED;
   }
 
+  //
+  // Remove AdjacentEntry from the tree before Entry takes over its BaseAddress
+  //
+  CoreRemoveGcdMapTree (Map, AdjacentEntry);
   if (Forward) {
     Entry->EndAddress  = AdjacentEntry->EndAddress;
   } else {
@@ -585,31 +783,33 @@ CoreSearchGcdMapEntry (
   IN  LIST_ENTRY            *Map
   )
 {
-  LIST_ENTRY         *Link;
-  EFI_GCD_MAP_ENTRY  *Entry;
+  EFI_GCD_MAP_ENTRY  *StartEntry;
+  EFI_GCD_MAP_ENTRY  *EndEntry;
 
   ASSERT (Length != 0);
 
   *StartLink = NULL;
   *EndLink   = NULL;
 
-  Link = Map->ForwardLink;
-  while (Link != Map) {
-    Entry = CR (Link, EFI_GCD_MAP_ENTRY, Link, EFI_GCD_MAP_SIGNATURE);
-    if (BaseAddress >= Entry->BaseAddress && BaseAddress <= Entry->EndAddress) {
-      *StartLink = Link;
-    }
-    if (*StartLink != NULL) {
-      if ((BaseAddress + Length - 1) >= Entry->BaseAddress &&
-          (BaseAddress + Length - 1) <= Entry->EndAddress     ) {
-        *EndLink = Link;
-        return EFI_SUCCESS;
-      }
-    }
-    Link = Link->ForwardLink;
+  //
+  // The entries do not overlap, so the only entry that can cover an address
+  // is the one with the highest BaseAddress that is not above it.
+  //
+  StartEntry = CoreFindGcdMapTreeFloor (Map, BaseAddress);
+  if (StartEntry == NULL || BaseAddress > StartEntry->EndAddress) {
+    return EFI_NOT_FOUND;
   }
 
-  return EFI_NOT_FOUND;
+  EndEntry = CoreFindGcdMapTreeFloor (Map, BaseAddress + Length - 1);
+  if (EndEntry == NULL ||
+      EndEntry->BaseAddress < StartEntry->BaseAddress ||
+      (BaseAddress + Length - 1) > EndEntry->EndAddress) {
+    return EFI_NOT_FOUND;
+  }
+
+  *StartLink = &StartEntry->Link;
+  *EndLink   = &EndEntry->Link;
+  return EFI_SUCCESS;
 }
 
 
@@ -884,7 +1084,7 @@ CoreConvertSpace (
   Link = StartLink;
   while (Link != EndLink->ForwardLink) {
     Entry = CR (Link, EFI_GCD_MAP_ENTRY, Link, EFI_GCD_MAP_SIGNATURE);
-    CoreInsertGcdMapEntry (Link, Entry, BaseAddress, Length, TopEntry, BottomEntry);
+    CoreInsertGcdMapEntry (Link, Entry, BaseAddress, Length, TopEntry, BottomEntry, Map);
     switch (Operation) {
     //
     // Add operations
@@ -1145,7 +1345,12 @@ CoreAllocateSpace (
     //
     if (GcdAllocateType == EfiGcdAllocateMaxAddressSearchTopDown ||
         GcdAllocateType == EfiGcdAllocateAnySearchTopDown ) {
-      Link = Map->BackLink;
+      //
+      // Entries that start above MaxAddress can never satisfy the request,
+      // so start the walk at the entry that covers MaxAddress.
+      //
+      Entry = CoreFindGcdMapTreeFloor (Map, MaxAddress);
+      Link  = (Entry != NULL) ? &Entry->Link : Map;
     } else {
       Link = Map->ForwardLink;
     }
@@ -1239,7 +1444,7 @@ CoreAllocateSpace (
   Link = StartLink;
   while (Link != EndLink->ForwardLink) {
     Entry = CR (Link, EFI_GCD_MAP_ENTRY, Link, EFI_GCD_MAP_SIGNATURE);
-    CoreInsertGcdMapEntry (Link, Entry, *BaseAddress, Length, TopEntry, BottomEntry);
+    CoreInsertGcdMapEntry (Link, Entry, *BaseAddress, Length, TopEntry, BottomEntry, Map);
     Entry->ImageHandle  = ImageHandle;
     Entry->DeviceHandle = DeviceHandle;
     Link = Link->ForwardLink;
@@ -2364,6 +2569,7 @@ CoreInitializeGcdServices (
   Entry->EndAddress = LShiftU64 (1, SizeOfMemorySpace) - 1;
 
   InsertHeadList (&mGcdMemorySpaceMap, &Entry->Link);
+  CoreInsertGcdMapTree (&mGcdMemorySpaceMap, Entry);
 
   CoreDumpGcdMemorySpaceMap (TRUE);
   
@@ -2376,6 +2582,7 @@ CoreInitializeGcdServices (
   Entry->EndAddress = LShiftU64 (1, SizeOfIoSpace) - 1;
 
   InsertHeadList (&mGcdIoSpaceMap, &Entry->Link);
+  CoreInsertGcdMapTree (&mGcdIoSpaceMap, Entry);
 
   CoreDumpGcdIoSpaceMap (TRUE);
   
@@ -18,16 +18,101 @@ WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
 
 //
 // mProtocolDatabase     - A list of all protocols in the system.  (simple list for now)
+// mProtocolHashTable    - The protocols in mProtocolDatabase hashed by protocol GUID
 // gHandleList           - A list of all the handles in the system
+// mHandleHashTable      - The handles in gHandleList hashed by handle value
 // gProtocolDatabaseLock - Lock to protect the mProtocolDatabase
 // gHandleDatabaseKey    -  The Key to show that the handle has been created/modified
 //
 LIST_ENTRY      mProtocolDatabase     = INITIALIZE_LIST_HEAD_VARIABLE (mProtocolDatabase);
+LIST_ENTRY      mProtocolHashTable[PROTOCOL_HASH_BUCKETS];
 LIST_ENTRY      gHandleList           = INITIALIZE_LIST_HEAD_VARIABLE (gHandleList);
+LIST_ENTRY      mHandleHashTable[HANDLE_HASH_BUCKETS];
+BOOLEAN         mHashTablesInitialized = FALSE;
 EFI_LOCK        gProtocolDatabaseLock = EFI_INITIALIZE_LOCK_VARIABLE (TPL_NOTIFY);
 UINT64          gHandleDatabaseKey    = 0;
 
 
+/**
+  Initialize the bucket list heads of the handle and protocol hash tables
+  the first time the protocol database is touched.
+
+**/
+VOID
+CoreInitializeHashTables (
+  VOID
+  )
+{
+  UINTN  Index;
+
+  if (mHashTablesInitialized) {
+    return;
+  }
+
+  for (Index = 0; Index < PROTOCOL_HASH_BUCKETS; Index++) {
+    InitializeListHead (&mProtocolHashTable[Index]);
+  }
+  for (Index = 0; Index < HANDLE_HASH_BUCKETS; Index++) {
+    InitializeListHead (&mHandleHashTable[Index]);
+  }
+  mHashTablesInitialized = TRUE;
+}
+
+
+/**
+  Get the hash bucket of mProtocolHashTable that holds a protocol GUID.
+
+  @param  Protocol               The ID of the protocol
+
+  @return The list head of the hash bucket
+
+**/
+LIST_ENTRY *
+CoreGetProtocolHashBucket (
+  IN EFI_GUID   *Protocol
+  )
+{
+  UINT32  Hash;
+
+  CoreInitializeHashTables ();
+
+  Hash = ReadUnaligned32 ((UINT32 *)Protocol) ^
+         ReadUnaligned32 ((UINT32 *)Protocol + 1) ^
+         ReadUnaligned32 ((UINT32 *)Protocol + 2) ^
+         ReadUnaligned32 ((UINT32 *)Protocol + 3);
+  Hash ^= Hash >> 16;
+
+  return &mProtocolHashTable[Hash & (PROTOCOL_HASH_BUCKETS - 1)];
+}
+
+
+/**
+  Get the hash bucket of mHandleHashTable that holds a handle.
+
+  @param  UserHandle             The handle value
+
+  @return The list head of the hash bucket
+
+**/
+LIST_ENTRY *
+CoreGetHandleHashBucket (
+  IN EFI_HANDLE   UserHandle
+  )
+{
+  UINTN  Hash;
+
+  CoreInitializeHashTables ();
+
+  //
+  // Handles are pool allocations, so the low bits carry no information
+  //
+  Hash = (UINTN)UserHandle >> 3;
+  Hash ^= Hash >> 8;
+
+  return &mHandleHashTable[Hash & (HANDLE_HASH_BUCKETS - 1)];
+}
+
+
 
 /**
   Acquire lock on gProtocolDatabaseLock.
@@ -72,15 +157,34 @@ CoreValidateHandle (
   )
 {
   IHANDLE             *Handle;
+  LIST_ENTRY          *Bucket;
+  LIST_ENTRY          *Link;
+  EFI_STATUS          Status;
+  EFI_TPL             OldTpl;
 
-  Handle = (IHANDLE *)UserHandle;
-  if (Handle == NULL) {
+  if (UserHandle == NULL) {
     return EFI_INVALID_PARAMETER;
   }
-  if (Handle->Signature != EFI_HANDLE_SIGNATURE) {
-    return EFI_INVALID_PARAMETER;
+
+  //
+  // Look the handle up in its hash bucket instead of dereferencing it, so a
+  // stale or bogus handle is rejected without touching the memory it points to.
+  // Raise to the TPL of gProtocolDatabaseLock so the bucket cannot change
+  // underneath us, whether or not the caller already owns the lock.
+  //
+  Status = EFI_INVALID_PARAMETER;
+  OldTpl = CoreRaiseTpl (TPL_NOTIFY);
+  Bucket = CoreGetHandleHashBucket (UserHandle);
+  for (Link = Bucket->ForwardLink; Link != Bucket; Link = Link->ForwardLink) {
+    Handle = CR (Link, IHANDLE, HashLink, EFI_HANDLE_SIGNATURE);
+    if (Handle == (IHANDLE *)UserHandle) {
+      Status = EFI_SUCCESS;
+      break;
+    }
   }
-  return EFI_SUCCESS;
+  CoreRestoreTpl (OldTpl);
+
+  return Status;
 }
 
 
@@ -101,6 +205,7 @@ CoreFindProtocolEntry (
   IN BOOLEAN    Create
   )
 {
+  LIST_ENTRY          *Bucket;
   LIST_ENTRY          *Link;
   PROTOCOL_ENTRY      *Item;
   PROTOCOL_ENTRY      *ProtEntry;
@@ -108,15 +213,16 @@ CoreFindProtocolEntry (
   ASSERT_LOCKED(&gProtocolDatabaseLock);
 
   //
-  // Search the database for the matching GUID
+  // Search the hash bucket of the GUID for the matching entry
   //
 
   ProtEntry = NULL;
-  for (Link = mProtocolDatabase.ForwardLink;
-       Link != &mProtocolDatabase;
+  Bucket    = CoreGetProtocolHashBucket (Protocol);
+  for (Link = Bucket->ForwardLink;
+       Link != Bucket;
        Link = Link->ForwardLink) {
 
-    Item = CR(Link, PROTOCOL_ENTRY, AllEntries, PROTOCOL_ENTRY_SIGNATURE);
+    Item = CR(Link, PROTOCOL_ENTRY, HashLink, PROTOCOL_ENTRY_SIGNATURE);
     if (CompareGuid (&Item->ProtocolID, Protocol)) {
 
       //
@@ -143,11 +249,16 @@ CoreFindProtocolEntry (
       CopyGuid ((VOID *)&ProtEntry->ProtocolID, Protocol);
       InitializeListHead (&ProtEntry->Protocols);
       InitializeListHead (&ProtEntry->Notify);
+      ProtEntry->HandleCache      = NULL;
+      ProtEntry->HandleCacheCount = 0;
+      ProtEntry->HandleCacheMax   = 0;
+      ProtEntry->HandleCacheValid = TRUE;
 
       //
       // Add it to protocol database
       //
       InsertTailList (&mProtocolDatabase, &ProtEntry->AllEntries);
+      InsertTailList (Bucket, &ProtEntry->HashLink);
     }
   }
 
@@ -428,6 +539,7 @@ CoreInstallProtocolInterfaceNotify (
     // in the system
     //
     InsertTailList (&gHandleList, &Handle->AllHandles);
+    InsertTailList (CoreGetHandleHashBucket (Handle), &Handle->HashLink);
   }
 
   Status = CoreValidateHandle (Handle);
@@ -465,6 +577,8 @@ CoreInstallProtocolInterfaceNotify (
   // protocol entry
   //
   InsertTailList (&ProtEntry->Protocols, &Prot->ByProtocol);
+  CoreAppendProtocolHandleCache (ProtEntry, Handle);
+  CoreInvalidateDepexOnProtocol (Protocol);
 
   //
   // Notify the notification list for this protocol
@@ -786,6 +900,7 @@ CoreUninstallProtocolInterface (
     //
     Prot->Signature = 0;
     CoreFreePool (Prot);
+    CoreInvalidateDepexOnProtocol (Protocol);
     Status = EFI_SUCCESS;
   }
 
@@ -795,6 +910,7 @@ CoreUninstallProtocolInterface (
   if (IsListEmpty (&Handle->Protocols)) {
     Handle->Signature = 0;
     RemoveEntryList (&Handle->AllHandles);
+    RemoveEntryList (&Handle->HashLink);
     CoreFreePool (Handle);
   }
 
@@ -18,6 +18,12 @@ WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
 
 #define EFI_HANDLE_SIGNATURE            SIGNATURE_32('h','n','d','l')
 
+///
+/// Number of buckets in the handle and protocol hash tables. Both must be a power of 2.
+///
+#define HANDLE_HASH_BUCKETS             256
+#define PROTOCOL_HASH_BUCKETS           64
+
 ///
 /// IHANDLE - contains a list of protocol handles
 ///
@@ -25,6 +31,8 @@ typedef struct {
   UINTN               Signature;
   /// All handles list of IHANDLE
   LIST_ENTRY          AllHandles;
+  /// Link on the handle hash bucket used to validate EFI_HANDLEs
+  LIST_ENTRY          HashLink;
   /// List of PROTOCOL_INTERFACE's for this handle
   LIST_ENTRY          Protocols;      
   UINTN               LocateRequest;
@@ -45,12 +53,22 @@ typedef struct {
   UINTN               Signature;
   /// Link Entry inserted to mProtocolDatabase
   LIST_ENTRY          AllEntries;  
+  /// Link Entry inserted to the protocol hash bucket of ProtocolID
+  LIST_ENTRY          HashLink;
   /// ID of the protocol
   EFI_GUID            ProtocolID;  
   /// All protocol interfaces
   LIST_ENTRY          Protocols;     
   /// Registerd notification handlers
   LIST_ENTRY          Notify;                 
+  /// Handles of all protocol interfaces, in the order of Protocols
+  EFI_HANDLE          *HandleCache;
+  /// Number of handles in HandleCache
+  UINTN               HandleCacheCount;
+  /// Number of handles HandleCache has room for
+  UINTN               HandleCacheMax;
+  /// TRUE if HandleCache matches Protocols
+  BOOLEAN             HandleCacheValid;
 } PROTOCOL_ENTRY;
 
 
@@ -177,6 +195,39 @@ CoreRemoveInterfaceFromProtocol (
   );
 
 
+/**
+  Make sure the handle cache of a protocol entry matches its protocol
+  interface list, rebuilding it if it was invalidated.
+  The gProtocolDatabaseLock must be owned.
+
+  @param  ProtEntry              Protocol entry
+
+  @retval TRUE                   ProtEntry->HandleCache is valid.
+  @retval FALSE                  There was not enough memory to build the cache.
+
+**/
+BOOLEAN
+CoreRefreshProtocolHandleCache (
+  IN PROTOCOL_ENTRY   *ProtEntry
+  );
+
+
+/**
+  Append a handle to the handle cache of a protocol entry after a protocol
+  interface of the handle was inserted at the tail of ProtEntry->Protocols.
+  The gProtocolDatabaseLock must be owned.
+
+  @param  ProtEntry              Protocol entry
+  @param  Handle                 The handle the protocol was installed on
+
+**/
+VOID
+CoreAppendProtocolHandleCache (
+  IN PROTOCOL_ENTRY   *ProtEntry,
+  IN IHANDLE          *Handle
+  );
+
+
 /**
   Connects a controller to a driver.
 
@@ -91,6 +91,130 @@ CoreGetNextLocateByProtocol (
   );
 
 
+/**
+  Grow the handle cache of a protocol entry so it can hold at least Count handles.
+  The gProtocolDatabaseLock must be owned.
+
+  @param  ProtEntry              Protocol entry
+  @param  Count                  The number of handles the cache must hold
+
+  @retval TRUE                   The cache has room for Count handles.
+  @retval FALSE                  There was not enough memory to grow the cache.
+
+**/
+BOOLEAN
+CoreGrowProtocolHandleCache (
+  IN PROTOCOL_ENTRY   *ProtEntry,
+  IN UINTN            Count
+  )
+{
+  EFI_HANDLE          *NewCache;
+  UINTN               NewMax;
+
+  if (Count <= ProtEntry->HandleCacheMax) {
+    return TRUE;
+  }
+
+  NewMax = MAX (ProtEntry->HandleCacheMax * 2, 8);
+  while (NewMax < Count) {
+    NewMax *= 2;
+  }
+
+  NewCache = AllocatePool (NewMax * sizeof (EFI_HANDLE));
+  if (NewCache == NULL) {
+    return FALSE;
+  }
+
+  if (ProtEntry->HandleCache != NULL) {
+    CopyMem (NewCache, ProtEntry->HandleCache, ProtEntry->HandleCacheCount * sizeof (EFI_HANDLE));
+    CoreFreePool (ProtEntry->HandleCache);
+  }
+  ProtEntry->HandleCache    = NewCache;
+  ProtEntry->HandleCacheMax = NewMax;
+  return TRUE;
+}
+
+
+/**
+  Make sure the handle cache of a protocol entry matches its protocol
+  interface list, rebuilding it if it was invalidated.
+  The gProtocolDatabaseLock must be owned.
+
+  @param  ProtEntry              Protocol entry
+
+  @retval TRUE                   ProtEntry->HandleCache is valid.
+  @retval FALSE                  There was not enough memory to build the cache.
+
+**/
+BOOLEAN
+CoreRefreshProtocolHandleCache (
+  IN PROTOCOL_ENTRY   *ProtEntry
+  )
+{
+  LIST_ENTRY          *Link;
+  PROTOCOL_INTERFACE  *Prot;
+  UINTN               Count;
+
+  ASSERT_LOCKED (&gProtocolDatabaseLock);
+
+  if (ProtEntry->HandleCacheValid) {
+    return TRUE;
+  }
+
+  Count = 0;
+  for (Link = ProtEntry->Protocols.ForwardLink; Link != &ProtEntry->Protocols; Link = Link->ForwardLink) {
+    Count++;
+  }
+
+  ProtEntry->HandleCacheCount = 0;
+  if (!CoreGrowProtocolHandleCache (ProtEntry, Count)) {
+    return FALSE;
+  }
+
+  //
+  // A protocol can only be installed once on a handle, so the handles on the
+  // list are already unique
+  //
+  for (Link = ProtEntry->Protocols.ForwardLink; Link != &ProtEntry->Protocols; Link = Link->ForwardLink) {
+    Prot = CR (Link, PROTOCOL_INTERFACE, ByProtocol, PROTOCOL_INTERFACE_SIGNATURE);
+    ProtEntry->HandleCache[ProtEntry->HandleCacheCount++] = Prot->Handle;
+  }
+
+  ProtEntry->HandleCacheValid = TRUE;
+  return TRUE;
+}
+
+
+/**
+  Append a handle to the handle cache of a protocol entry after a protocol
+  interface of the handle was inserted at the tail of ProtEntry->Protocols.
+  The gProtocolDatabaseLock must be owned.
+
+  @param  ProtEntry              Protocol entry
+  @param  Handle                 The handle the protocol was installed on
+
+**/
+VOID
+CoreAppendProtocolHandleCache (
+  IN PROTOCOL_ENTRY   *ProtEntry,
+  IN IHANDLE          *Handle
+  )
+{
+  ASSERT_LOCKED (&gProtocolDatabaseLock);
+
+  if (!ProtEntry->HandleCacheValid) {
+    return;
+  }
+
+  if (!CoreGrowProtocolHandleCache (ProtEntry, ProtEntry->HandleCacheCount + 1)) {
+    ProtEntry->HandleCacheValid = FALSE;
+    return;
+  }
+
+  ProtEntry->HandleCache[ProtEntry->HandleCacheCount++] = Handle;
+}
+
+
 /**
   Locates the requested handle(s) and returns them in Buffer.
 
@@ -201,27 +325,37 @@ CoreLocateHandle (
   }
 
   ASSERT (GetNext != NULL);
-  //
-  // Enumerate out the matching handles
-  //
-  mEfiLocateHandleRequest += 1;
-  for (; ;) {
+  if ((SearchType == ByProtocol) && CoreRefreshProtocolHandleCache (Position.ProtEntry)) {
     //
-    // Get the next handle.  If no more handles, stop
+    // The protocol entry caches its handles in list order, so return them with one copy
     //
-    Handle = GetNext (&Position, &Interface);
-    if (NULL == Handle) {
-      break;
+    ResultSize = Position.ProtEntry->HandleCacheCount * sizeof (EFI_HANDLE);
+    if (ResultSize <= *BufferSize) {
+      CopyMem (Buffer, Position.ProtEntry->HandleCache, ResultSize);
     }
-
+  } else {
     //
-    // Increase the resulting buffer size, and if this handle
-    // fits return it
+    // Enumerate out the matching handles
     //
-    ResultSize += sizeof(Handle);
-    if (ResultSize <= *BufferSize) {
-        *ResultBuffer = Handle;
-        ResultBuffer += 1;
+    mEfiLocateHandleRequest += 1;
+    for (; ;) {
+      //
+      // Get the next handle.  If no more handles, stop
+      //
+      Handle = GetNext (&Position, &Interface);
+      if (NULL == Handle) {
+        break;
+      }
+
+      //
+      // Increase the resulting buffer size, and if this handle
+      // fits return it
+      //
+      ResultSize += sizeof(Handle);
+      if (ResultSize <= *BufferSize) {
+          *ResultBuffer = Handle;
+          ResultBuffer += 1;
+      }
     }
   }
 
@@ -655,6 +789,7 @@ CoreLocateHandleBuffer (
 {
   EFI_STATUS          Status;
   UINTN               BufferSize;
+  PROTOCOL_ENTRY      *ProtEntry;
 
   if (NumberHandles == NULL) {
     return EFI_INVALID_PARAMETER;
@@ -667,6 +802,38 @@ CoreLocateHandleBuffer (
   BufferSize = 0;
   *NumberHandles = 0;
   *Buffer = NULL;
+
+  if ((SearchType == ByProtocol) && (Protocol != NULL)) {
+    //
+    // Size and copy the handle cache of the protocol under a single lock
+    // instead of calling CoreLocateHandle() twice
+    //
+    CoreAcquireProtocolLock ();
+    ProtEntry = CoreFindProtocolEntry (Protocol, FALSE);
+    if (ProtEntry == NULL) {
+      CoreReleaseProtocolLock ();
+      return EFI_NOT_FOUND;
+    }
+    if (CoreRefreshProtocolHandleCache (ProtEntry)) {
+      if (ProtEntry->HandleCacheCount == 0) {
+        Status = EFI_NOT_FOUND;
+      } else {
+        *Buffer = AllocateCopyPool (
+                    ProtEntry->HandleCacheCount * sizeof (EFI_HANDLE),
+                    ProtEntry->HandleCache
+                    );
+        if (*Buffer == NULL) {
+          Status = EFI_OUT_OF_RESOURCES;
+        } else {
+          *NumberHandles = ProtEntry->HandleCacheCount;
+          Status = EFI_SUCCESS;
+        }
+      }
+      CoreReleaseProtocolLock ();
+      return Status;
+    }
+    CoreReleaseProtocolLock ();
+  }
   Status = CoreLocateHandle (
              SearchType,
              Protocol,
@@ -82,9 +82,10 @@ CoreRemoveInterfaceFromProtocol (
     }
 
     //
-    // Remove the protocol interface entry
+    // Remove the protocol interface entry, the handle cache is rebuilt on next use
     //
     RemoveEntryList (&Prot->ByProtocol);
+    ProtEntry->HandleCacheValid = FALSE;
   }
 
   return Prot;
@@ -36,7 +36,7 @@ WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
 //
 
 #define MEMORY_MAP_SIGNATURE   SIGNATURE_32('m','m','a','p')
-typedef struct {
+typedef struct _MEMORY_MAP {
   UINTN           Signature;
   LIST_ENTRY      Link;
   BOOLEAN         FromPages;
@@ -47,6 +47,14 @@ typedef struct {
 
   UINT64          VirtualStart;
   UINT64          Attribute;
+
+  //
+  // Node of the address ordered tree that indexes the entries on gMemoryMap.
+  // EfiConventionalMemory entries are kept in a tree of their own.
+  //
+  struct _MEMORY_MAP  *Left;
+  struct _MEMORY_MAP  *Right;
+  UINT32              Priority;
 } MEMORY_MAP;
 
 //
@@ -50,6 +50,16 @@ UINTN         mFreeMapStack = 0;
 LIST_ENTRY   mFreeMemoryMapEntryList = INITIALIZE_LIST_HEAD_VARIABLE (mFreeMemoryMapEntryList);
 BOOLEAN      mMemoryTypeInformationInitialized = FALSE;
 
+///
+/// Address ordered trees (treaps) that index the entries of gMemoryMap by Start.
+/// mFreeMemoryMapTree holds the EfiConventionalMemory entries and
+/// mMemoryMapTree all other entries. gMemoryMap keeps its own order, which is
+/// the order of the descriptors returned by CoreGetMemoryMap().
+///
+MEMORY_MAP   *mMemoryMapTree     = NULL;
+MEMORY_MAP   *mFreeMemoryMapTree = NULL;
+UINT32       mMemoryMapTreeSeed  = 0x2545F491;
+
 EFI_MEMORY_TYPE_STATISTICS mMemoryTypeStatistics[EfiMaxMemoryType + 1] = {
   { 0, MAX_ADDRESS, 0, 0, EfiMaxMemoryType, TRUE,  FALSE },  // EfiReservedMemoryType
   { 0, MAX_ADDRESS, 0, 0, EfiMaxMemoryType, FALSE, FALSE },  // EfiLoaderCode
@@ -126,6 +136,293 @@ CoreReleaseMemoryLock (
 
 
 
+/**
+  Internal function.  Get the tree that indexes memory map entries of a type.
+
+  @param  Type                   The type of the memory map entries
+
+  @return The root pointer of the tree
+
+**/
+MEMORY_MAP **
+GetMemoryMapTree (
+  IN EFI_MEMORY_TYPE     Type
+  )
+{
+  return (Type == EfiConventionalMemory) ? &mFreeMemoryMapTree : &mMemoryMapTree;
+}
+
+/**
+  Internal function.  Checks the order of two entries in a memory map tree.
+  Entries are ordered by Start, then by End. The End only matters for an entry
+  that ConvertPages has just emptied by moving its Start up to the Start of the
+  next entry, right before removing it.
+
+  @param  Entry1                 The first entry
+  @param  Entry2                 The second entry
+
+  @retval TRUE                   Entry1 is ordered before Entry2.
+  @retval FALSE                  Entry1 is not ordered before Entry2.
+
+**/
+BOOLEAN
+IsMemoryMapEntryBelow (
+  IN MEMORY_MAP          *Entry1,
+  IN MEMORY_MAP          *Entry2
+  )
+{
+  return (BOOLEAN) ((Entry1->Start < Entry2->Start) ||
+                    ((Entry1->Start == Entry2->Start) && (Entry1->End < Entry2->End)));
+}
+
+/**
+  Internal function.  Splits a memory map tree into the entries ordered
+  before Entry and the other entries.
+
+  @param  Tree                   The tree to split
+  @param  Entry                  The entry to split at
+  @param  Left                   Returns the tree of entries before Entry
+  @param  Right                  Returns the tree of the other entries
+
+**/
+VOID
+SplitMemoryMapTree (
+  IN  MEMORY_MAP         *Tree,
+  IN  MEMORY_MAP         *Entry,
+  OUT MEMORY_MAP         **Left,
+  OUT MEMORY_MAP         **Right
+  )
+{
+  while (Tree != NULL) {
+    if (IsMemoryMapEntryBelow (Tree, Entry)) {
+      *Left = Tree;
+      Left  = &Tree->Right;
+      Tree  = Tree->Right;
+    } else {
+      *Right = Tree;
+      Right  = &Tree->Left;
+      Tree   = Tree->Left;
+    }
+  }
+  *Left  = NULL;
+  *Right = NULL;
+}
+
+/**
+  Internal function.  Joins two memory map trees. All entries of Left must
+  start below all entries of Right.
+
+  @param  Left                   The tree of the lower entries
+  @param  Right                  The tree of the upper entries
+
+  @return The root of the joined tree
+
+**/
+MEMORY_MAP *
+JoinMemoryMapTree (
+  IN MEMORY_MAP          *Left,
+  IN MEMORY_MAP          *Right
+  )
+{
+  MEMORY_MAP  *Root;
+  MEMORY_MAP  **Link;
+
+  Link = &Root;
+  while ((Left != NULL) && (Right != NULL)) {
+    if (Left->Priority > Right->Priority) {
+      *Link = Left;
+      Link  = &Left->Right;
+      Left  = Left->Right;
+    } else {
+      *Link = Right;
+      Link  = &Right->Left;
+      Right = Right->Left;
+    }
+  }
+  *Link = (Left != NULL) ? Left : Right;
+
+  return Root;
+}
+
+/**
+  Internal function.  Adds an entry of gMemoryMap to the tree of its type.
+
+  @param  Entry                  The entry to add
+
+**/
+VOID
+InsertMemoryMapTree (
+  IN OUT MEMORY_MAP      *Entry
+  )
+{
+  MEMORY_MAP  **Link;
+
+  mMemoryMapTreeSeed = mMemoryMapTreeSeed * 1103515245 + 12345;
+  Entry->Priority    = mMemoryMapTreeSeed;
+
+  Link = GetMemoryMapTree (Entry->Type);
+  while ((*Link != NULL) && ((*Link)->Priority > Entry->Priority)) {
+    Link = IsMemoryMapEntryBelow (Entry, *Link) ? &(*Link)->Left : &(*Link)->Right;
+  }
+  SplitMemoryMapTree (*Link, Entry, &Entry->Left, &Entry->Right);
+  *Link = Entry;
+}
+
+/**
+  Internal function.  Removes an entry of gMemoryMap from the tree of its type.
+
+  @param  Entry                  The entry to remove
+
+**/
+VOID
+RemoveMemoryMapTree (
+  IN OUT MEMORY_MAP      *Entry
+  )
+{
+  MEMORY_MAP  **Link;
+
+  Link = GetMemoryMapTree (Entry->Type);
+  while (*Link != Entry) {
+    ASSERT (*Link != NULL);
+    Link = IsMemoryMapEntryBelow (Entry, *Link) ? &(*Link)->Left : &(*Link)->Right;
+  }
+  *Link = JoinMemoryMapTree (Entry->Left, Entry->Right);
+  Entry->Left  = NULL;
+  Entry->Right = NULL;
+}
+
+/**
+  Internal function.  Finds the entry of a memory map tree with the highest
+  start address that is not above Address.
+
+  @param  Tree                   The tree to search
+  @param  Address                The address to search for
+
+  @return The entry found, or NULL if all entries start above Address
+
+**/
+MEMORY_MAP *
+FindMemoryMapTreeFloor (
+  IN MEMORY_MAP          *Tree,
+  IN UINT64              Address
+  )
+{
+  MEMORY_MAP  *Floor;
+
+  Floor = NULL;
+  while (Tree != NULL) {
+    if (Tree->Start <= Address) {
+      Floor = Tree;
+      Tree  = Tree->Right;
+    } else {
+      Tree  = Tree->Left;
+    }
+  }
+
+  return Floor;
+}
+
+/**
+  Internal function.  Finds the entry of a memory map tree with the lowest
+  start address that is not below Address.
+
+  @param  Tree                   The tree to search
+  @param  Address                The address to search for
+
+  @return The entry found, or NULL if all entries start below Address
+
+**/
+MEMORY_MAP *
+FindMemoryMapTreeCeiling (
+  IN MEMORY_MAP          *Tree,
+  IN UINT64              Address
+  )
+{
+  MEMORY_MAP  *Ceiling;
+
+  Ceiling = NULL;
+  while (Tree != NULL) {
+    if (Tree->Start >= Address) {
+      Ceiling = Tree;
+      Tree    = Tree->Left;
+    } else {
+      Tree    = Tree->Right;
+    }
+  }
+
+  return Ceiling;
+}
+
+/**
+  Internal function.  Finds the memory map entry from pages with the lowest
+  start address above the start address of an entry. The entries from pages
+  are kept in address order in gMemoryMap, so the entry found is where the
+  given entry goes in gMemoryMap. Entries still on mMapStack are skipped;
+  there are at most MAX_MAP_DEPTH of them.
+
+  @param  Entry                  The entry to find the successor of
+
+  @return The entry found, or NULL if no entry from pages starts above Entry
+
+**/
+MEMORY_MAP *
+FindMemoryMapPagesSuccessor (
+  IN MEMORY_MAP          *Entry
+  )
+{
+  MEMORY_MAP  *Successor;
+  MEMORY_MAP  *FreeSuccessor;
+  UINT64      Address;
+
+  Address = Entry->Start;
+  do {
+    if (Address == MAX_UINT64) {
+      return NULL;
+    }
+    Address       = Address + 1;
+    Successor     = FindMemoryMapTreeCeiling (mMemoryMapTree, Address);
+    FreeSuccessor = FindMemoryMapTreeCeiling (mFreeMemoryMapTree, Address);
+    if ((Successor == NULL) ||
+        ((FreeSuccessor != NULL) && (FreeSuccessor->Start < Successor->Start))) {
+      Successor = FreeSuccessor;
+    }
+    if (Successor == NULL) {
+      return NULL;
+    }
+    Address = Successor->Start;
+  } while (!Successor->FromPages);
+
+  return Successor;
+}
+
+/**
+  Internal function.  Finds the memory map entry that covers an address.
+
+  @param  Address                The address to search for
+
+  @return The entry that covers Address, or NULL if none does
+
+**/
+MEMORY_MAP *
+FindMemoryMapEntry (
+  IN UINT64              Address
+  )
+{
+  MEMORY_MAP  *Entry;
+
+  Entry = FindMemoryMapTreeFloor (mFreeMemoryMapTree, Address);
+  if ((Entry != NULL) && (Entry->End > Address)) {
+    return Entry;
+  }
+
+  Entry = FindMemoryMapTreeFloor (mMemoryMapTree, Address);
+  if ((Entry != NULL) && (Entry->End > Address)) {
+    return Entry;
+  }
+
+  return NULL;
+}
+
 /**
   Internal function.  Removes a descriptor entry.
 
@@ -137,6 +434,7 @@ RemoveMemoryMapEntry (
   IN OUT MEMORY_MAP      *Entry
   )
 {
+  RemoveMemoryMapTree (Entry);
   RemoveEntryList (&Entry->Link);
   Entry->Link.ForwardLink = NULL;
 
@@ -168,7 +466,7 @@ CoreAddRange (
   IN UINT64                   Attribute
   )
 {
-  LIST_ENTRY        *Link;
+  MEMORY_MAP        *Tree;
   MEMORY_MAP        *Entry;
 
   ASSERT ((Start & EFI_PAGE_MASK) == 0);
@@ -212,28 +510,26 @@ CoreAddRange (
   //
 
   // Two memory descriptors can only be merged if they have the same Type
-  // and the same Attribute
+  // and the same Attribute. They are in the same tree, where the one below
+  // is the last entry starting before Start and the one above starts at End + 1.
   //
 
-  Link = gMemoryMap.ForwardLink;
-  while (Link != &gMemoryMap) {
-    Entry = CR (Link, MEMORY_MAP, Link, MEMORY_MAP_SIGNATURE);
-    Link  = Link->ForwardLink;
-
-    if (Entry->Type != Type) {
-      continue;
-    }
-
-    if (Entry->Attribute != Attribute) {
-      continue;
-    }
-
-    if (Entry->End + 1 == Start) {
+  Tree = *GetMemoryMapTree (Type);
+  if (Start != 0) {
+    Entry = FindMemoryMapTreeFloor (Tree, Start - 1);
+    if ((Entry != NULL) && (Entry->End + 1 == Start) &&
+        (Entry->Type == Type) && (Entry->Attribute == Attribute)) {
 
       Start = Entry->Start;
       RemoveMemoryMapEntry (Entry);
+    }
+  }
 
-    } else if (Entry->Start == End + 1) {
+  Tree = *GetMemoryMapTree (Type);
+  if (End != MAX_UINT64) {
+    Entry = FindMemoryMapTreeFloor (Tree, End + 1);
+    if ((Entry != NULL) && (Entry->Start == End + 1) &&
+        (Entry->Type == Type) && (Entry->Attribute == Attribute)) {
 
       End = Entry->End;
       RemoveMemoryMapEntry (Entry);
@@ -252,6 +548,7 @@ CoreAddRange (
   mMapStack[mMapDepth].VirtualStart  = 0;
   mMapStack[mMapDepth].Attribute     = Attribute;
   InsertTailList (&gMemoryMap, &mMapStack[mMapDepth].Link);
+  InsertMemoryMapTree (&mMapStack[mMapDepth]);
 
   mMapDepth += 1;
   ASSERT (mMapDepth < MAX_MAP_DEPTH);
@@ -322,7 +619,6 @@ CoreFreeMemoryMapStack (
 {
   MEMORY_MAP      *Entry;
   MEMORY_MAP      *Entry2;
-  LIST_ENTRY      *Link2;
 
   ASSERT_LOCKED (&gMemoryLock);
 
@@ -356,24 +652,24 @@ CoreFreeMemoryMapStack (
       //
       // Move this entry to general memory
       //
+      RemoveMemoryMapTree (&mMapStack[mMapDepth]);
       RemoveEntryList (&mMapStack[mMapDepth].Link);
       mMapStack[mMapDepth].Link.ForwardLink = NULL;
 
       CopyMem (Entry , &mMapStack[mMapDepth], sizeof (MEMORY_MAP));
       Entry->FromPages = TRUE;
+      InsertMemoryMapTree (Entry);
 
       //
-      // Find insertion location
+      // Insert it in front of the next entry from pages, or at the end
       //
-      for (Link2 = gMemoryMap.ForwardLink; Link2 != &gMemoryMap; Link2 = Link2->ForwardLink) {
-        Entry2 = CR (Link2, MEMORY_MAP, Link, MEMORY_MAP_SIGNATURE);
-        if (Entry2->FromPages && Entry2->Start > Entry->Start) {
-          break;
-        }
+      Entry2 = FindMemoryMapPagesSuccessor (Entry);
+      if (Entry2 != NULL) {
+        InsertTailList (&Entry2->Link, &Entry->Link);
+      } else {
+        InsertTailList (&gMemoryMap, &Entry->Link);
       }
 
-      InsertTailList (Link2, &Entry->Link);
-
     } else {
       //
       // This item of mMapStack[mMapDepth] has already been dequeued from gMemoryMap list,
@@ -715,7 +1011,6 @@ CoreConvertPagesEx (
   UINT64          RangeEnd;
   UINT64          Attribute;
   EFI_MEMORY_TYPE MemType;
-  LIST_ENTRY      *Link;
   MEMORY_MAP      *Entry;
 
   Entry = NULL;
@@ -741,15 +1036,8 @@ CoreConvertPagesEx (
     //
     // Find the entry that the covers the range
     //
-    for (Link = gMemoryMap.ForwardLink; Link != &gMemoryMap; Link = Link->ForwardLink) {
-      Entry = CR (Link, MEMORY_MAP, Link, MEMORY_MAP_SIGNATURE);
-
-      if (Entry->Start <= Start && Entry->End > Start) {
-        break;
-      }
-    }
-
-    if (Link == &gMemoryMap) {
+    Entry = FindMemoryMapEntry (Start);
+    if (Entry == NULL) {
       DEBUG ((DEBUG_ERROR | DEBUG_PAGE, "ConvertPages: failed to find range %lx - %lx\n", Start, End));
       return EFI_NOT_FOUND;
     }
@@ -859,6 +1147,7 @@ CoreConvertPagesEx (
 
       Entry = &mMapStack[mMapDepth];
       InsertTailList (&gMemoryMap, &Entry->Link);
+      InsertMemoryMapTree (Entry);
 
       mMapDepth += 1;
       ASSERT (mMapDepth < MAX_MAP_DEPTH);
@@ -1004,7 +1293,6 @@ CoreFindFreePagesI (
   UINT64          DescStart;
   UINT64          DescEnd;
   UINT64          DescNumberOfBytes;
-  LIST_ENTRY      *Link;
   MEMORY_MAP      *Entry;
 
   if ((MaxAddress < EFI_PAGE_MASK) ||(NumberOfPages == 0)) {
@@ -1036,24 +1324,26 @@ CoreFindFreePagesI (
   NumberOfBytes = LShiftU64 (NumberOfPages, EFI_PAGE_SHIFT);
   Target = 0;
 
-  for (Link = gMemoryMap.ForwardLink; Link != &gMemoryMap; Link = Link->ForwardLink) {
-    Entry = CR (Link, MEMORY_MAP, Link, MEMORY_MAP_SIGNATURE);
+  //
+  // Walk the free entries down from the highest one that starts below
+  // MaxAddress. Free entries do not overlap, so the usable end of each entry
+  // is below that of the entry visited before it, and the first entry that
+  // can hold the request is the highest match.
+  //
+  for (Entry = FindMemoryMapTreeFloor (mFreeMemoryMapTree, MaxAddress - 1);
+       Entry != NULL;
+       Entry = (Entry->Start == 0) ? NULL : FindMemoryMapTreeFloor (mFreeMemoryMapTree, Entry->Start - 1)) {
 
-    //
-    // If it's not a free entry, don't bother with it
-    //
-    if (Entry->Type != EfiConventionalMemory) {
-      continue;
-    }
+    ASSERT (Entry->Type == EfiConventionalMemory);
 
     DescStart = Entry->Start;
     DescEnd = Entry->End;
 
     //
-    // If desc is past max allowed address or below min allowed address, skip it
+    // If desc is below min allowed address, so are all the entries below it
     //
-    if ((DescStart >= MaxAddress) || (DescEnd < MinAddress)) {
-      continue;
+    if (DescEnd < MinAddress) {
+      break;
     }
 
     //
@@ -1063,6 +1353,12 @@ CoreFindFreePagesI (
       DescEnd = MaxAddress;
     }
 
+    //
+    // Skip if nothing is left after alignment clipping
+    //
+    if (((DescEnd + 1) & (~(Alignment - 1))) == 0) {
+      continue;
+    }
     DescEnd = ((DescEnd + 1) & (~(Alignment - 1))) - 1;
 
     // Skip if DescEnd is less than DescStart after alignment clipping
@@ -1085,11 +1381,10 @@ CoreFindFreePagesI (
       }
 
       //
-      // If this is the best match so far remember it
+      // This is the best match
       //
-      if (DescEnd > Target) {
-        Target = DescEnd;
-      }
+      Target = DescEnd;
+      break;
     }
   }
 
@@ -1385,7 +1680,6 @@ CoreInternalFreePages (
   )
 {
   EFI_STATUS      Status;
-  LIST_ENTRY      *Link;
   MEMORY_MAP      *Entry;
   UINTN           Alignment;
 
@@ -1397,14 +1691,8 @@ CoreInternalFreePages (
   //
   // Find the entry that the covers the range
   //
-  Entry = NULL;
-  for (Link = gMemoryMap.ForwardLink; Link != &gMemoryMap; Link = Link->ForwardLink) {
-    Entry = CR(Link, MEMORY_MAP, Link, MEMORY_MAP_SIGNATURE);
-    if (Entry->Start <= Memory && Entry->End > Memory) {
-        break;
-    }
-  }
-  if (Link == &gMemoryMap) {
+  Entry = FindMemoryMapEntry (Memory);
+  if (Entry == NULL) {
     Status = EFI_NOT_FOUND;
     goto Done;
   }
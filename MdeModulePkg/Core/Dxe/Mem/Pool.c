@@ -64,6 +64,78 @@ STATIC CONST UINT16 mPoolSizeTable[] = {
 
 #define MAX_POOL_SIZE     (MAX_ADDRESS - POOL_OVERHEAD)
 
+//
+// Small allocations are served from slabs: runs of pages carved into objects
+// of a single size class. Each object only carries a POOL_SLAB_OBJECT header
+// instead of a POOL_HEAD/POOL_TAIL pair, and is allocated and freed in O(1)
+// from the free list of its slab.
+//
+#define POOL_SLAB_SIGNATURE         SIGNATURE_32('p','s','l','b')
+typedef struct {
+  UINT32          Signature;
+  UINT32          Class;
+  EFI_MEMORY_TYPE Type;
+  UINT32          FreeCount;
+  UINT32          ObjectCount;
+  UINT32          Reserved;
+  LIST_ENTRY      Link;
+  VOID            *FreeList;
+} POOL_SLAB;
+
+#define SIZE_OF_POOL_SLAB ALIGN_VALUE (sizeof (POOL_SLAB), 8)
+
+//
+// The first byte of the object signature is odd, so it can never match the
+// 8-byte aligned Size (or on 32-bit CPUs the EFI_MEMORY_TYPE) field that
+// directly precedes POOL_HEAD.Data. CoreFreePoolI() relies on this to tell
+// slab objects from regular pool entries.
+//
+#define POOL_SLAB_OBJECT_SIGNATURE  SIGNATURE_32('s','l','a','b')
+#define POOL_SLAB_FREE_SIGNATURE    SIGNATURE_32('s','l','f','r')
+typedef struct {
+  UINT32          Signature;
+  UINT32          Offset;
+} POOL_SLAB_OBJECT;
+
+typedef struct {
+  UINT16          Size;
+  UINT16          Pages;
+} POOL_SLAB_CLASS;
+
+//
+// Payload size of each slab size class, and the number of pages of its slabs.
+// The slab sizes keep the unused tail of every slab below 1/8 of the slab.
+//
+STATIC CONST POOL_SLAB_CLASS mPoolSlabClassTable[] = {
+  {   16, 1 }, {   32, 1 }, {   48, 1 }, {   64, 1 },
+  {   96, 1 }, {  128, 1 }, {  192, 1 }, {  256, 1 },
+  {  384, 1 }, {  512, 1 }, {  768, 1 }, { 1024, 2 },
+  { 1536, 2 }, { 2048, 4 }, { 3072, 4 }, { 4096, 8 }
+};
+
+#define MAX_SLAB_CLASS    (ARRAY_SIZE (mPoolSlabClassTable))
+#define MAX_SLAB_SIZE     4096
+#define SLAB_SIZE_TO_SLOT(a)  (((a) + 15) / 16)
+
+typedef struct {
+  ///
+  /// Slabs that have both allocated and free objects
+  ///
+  LIST_ENTRY      Partial;
+  ///
+  /// One completely free slab kept back so a single alloc/free pair does not
+  /// allocate and free pages every time
+  ///
+  POOL_SLAB       *Empty;
+} POOL_SLAB_CACHE;
+
+//
+// Slab caches for each memory type and size class, and the size class for
+// each 16-byte slot of request sizes.
+//
+POOL_SLAB_CACHE mPoolSlabCache[EfiMaxMemoryType][MAX_SLAB_CLASS];
+UINT8           mPoolSlabClassIndex[SLAB_SIZE_TO_SLOT (MAX_SLAB_SIZE) + 1];
+
 //
 // Globals
 //
@@ -122,6 +194,7 @@ CoreInitializePool (
 {
   UINTN  Type;
   UINTN  Index;
+  UINTN  Class;
 
   for (Type=0; Type < EfiMaxMemoryType; Type++) {
     mPoolHead[Type].Signature  = 0;
@@ -130,6 +203,18 @@ CoreInitializePool (
     for (Index=0; Index < MAX_POOL_LIST; Index++) {
       InitializeListHead (&mPoolHead[Type].FreeList[Index]);
     }
+    for (Class=0; Class < MAX_SLAB_CLASS; Class++) {
+      InitializeListHead (&mPoolSlabCache[Type][Class].Partial);
+      mPoolSlabCache[Type][Class].Empty = NULL;
+    }
+  }
+
+  Class = 0;
+  for (Index=0; Index < ARRAY_SIZE (mPoolSlabClassIndex); Index++) {
+    while (mPoolSlabClassTable[Class].Size < Index * 16) {
+      Class++;
+    }
+    mPoolSlabClassIndex[Index] = (UINT8) Class;
   }
 }
 
@@ -328,6 +413,102 @@ CoreAllocatePoolPagesI (
   return Buffer;
 }
 
+/**
+  Internal function to allocate a pool object from the slab cache of its
+  memory type and size class.
+  Caller must have the memory lock held
+
+  @param  Pool                   The pool head of PoolType
+  @param  PoolType               Type of pool to allocate
+  @param  Size                   The amount of pool to allocate, at most MAX_SLAB_SIZE
+
+  @return The allocate pool, or NULL
+
+**/
+STATIC
+VOID *
+CoreAllocateSlabObject (
+  IN POOL             *Pool,
+  IN EFI_MEMORY_TYPE  PoolType,
+  IN UINTN            Size
+  )
+{
+  POOL_SLAB_CACHE   *Cache;
+  POOL_SLAB         *Slab;
+  POOL_SLAB_OBJECT  *Object;
+  UINTN             Class;
+  UINTN             ObjectSize;
+  UINTN             Offset;
+  UINTN             Index;
+
+  ASSERT (Size <= MAX_SLAB_SIZE);
+
+  Class      = mPoolSlabClassIndex[SLAB_SIZE_TO_SLOT (Size)];
+  ObjectSize = mPoolSlabClassTable[Class].Size + sizeof (POOL_SLAB_OBJECT);
+  Cache      = &mPoolSlabCache[PoolType][Class];
+
+  if (IsListEmpty (&Cache->Partial)) {
+    Slab = Cache->Empty;
+    if (Slab != NULL) {
+      Cache->Empty = NULL;
+    } else {
+      //
+      // Get another slab and thread all of its objects on its free list
+      //
+      Slab = CoreAllocatePoolPagesI (
+               PoolType,
+               mPoolSlabClassTable[Class].Pages,
+               DEFAULT_PAGE_ALLOCATION_GRANULARITY
+               );
+      if (Slab == NULL) {
+        return NULL;
+      }
+
+      Slab->Signature   = POOL_SLAB_SIGNATURE;
+      Slab->Class       = (UINT32) Class;
+      Slab->Type        = PoolType;
+      Slab->ObjectCount = (UINT32) ((EFI_PAGES_TO_SIZE (mPoolSlabClassTable[Class].Pages) - SIZE_OF_POOL_SLAB) / ObjectSize);
+      Slab->FreeCount   = Slab->ObjectCount;
+      Slab->FreeList    = NULL;
+      for (Index = Slab->ObjectCount; Index > 0; Index--) {
+        Offset            = SIZE_OF_POOL_SLAB + (Index - 1) * ObjectSize;
+        Object            = (POOL_SLAB_OBJECT *) ((UINT8 *) Slab + Offset);
+        Object->Signature = POOL_SLAB_FREE_SIGNATURE;
+        Object->Offset    = (UINT32) Offset;
+        *(VOID **) (Object + 1) = Slab->FreeList;
+        Slab->FreeList    = Object;
+      }
+    }
+    InsertHeadList (&Cache->Partial, &Slab->Link);
+  }
+
+  //
+  // Take the first free object of the first partially used slab
+  //
+  Slab   = CR (Cache->Partial.ForwardLink, POOL_SLAB, Link, POOL_SLAB_SIGNATURE);
+  Object = Slab->FreeList;
+  ASSERT (Object->Signature == POOL_SLAB_FREE_SIGNATURE);
+  Slab->FreeList = *(VOID **) (Object + 1);
+  Slab->FreeCount--;
+  if (Slab->FreeCount == 0) {
+    RemoveEntryList (&Slab->Link);
+  }
+
+  Object->Signature = POOL_SLAB_OBJECT_SIGNATURE;
+  DEBUG_CLEAR_MEMORY (Object + 1, ObjectSize - sizeof (POOL_SLAB_OBJECT));
+
+  DEBUG ((
+    DEBUG_POOL,
+    "AllocatePoolI: Type %x, Addr %p (len %lx) %,ld\n", PoolType,
+    Object + 1,
+    (UINT64) (ObjectSize - sizeof (POOL_SLAB_OBJECT)),
+    (UINT64) Pool->Used
+    ));
+
+  Pool->Used += ObjectSize;
+  return Object + 1;
+}
+
 /**
   Internal function to allocate pool of a particular type.
   Caller must have the memory lock held
@@ -355,6 +536,7 @@ CoreAllocatePoolI (
   UINTN       Offset, MaxOffset;
   UINTN       NoPages;
   UINTN       Granularity;
+  BOOLEAN     IsRuntimeType;
 
   ASSERT_LOCKED (&mPoolMemoryLock);
 
@@ -363,9 +545,25 @@ CoreAllocatePoolI (
        PoolType == EfiRuntimeServicesCode ||
        PoolType == EfiRuntimeServicesData) {
 
-    Granularity = RUNTIME_PAGE_ALLOCATION_GRANULARITY;
+    Granularity   = RUNTIME_PAGE_ALLOCATION_GRANULARITY;
+    IsRuntimeType = TRUE;
   } else {
-    Granularity = DEFAULT_PAGE_ALLOCATION_GRANULARITY;
+    Granularity   = DEFAULT_PAGE_ALLOCATION_GRANULARITY;
+    IsRuntimeType = FALSE;
+  }
+
+  //
+  // Serve small requests of the boot time memory types from the slab caches.
+  // Runtime and ACPI memory types keep using the pool bins below, whatever
+  // their page granularity is.
+  //
+  if ((Size <= MAX_SLAB_SIZE) &&
+      ((UINT32) PoolType < EfiMaxMemoryType) &&
+      !IsRuntimeType) {
+    Buffer = CoreAllocateSlabObject (&mPoolHead[PoolType], PoolType, Size);
+    if (Buffer != NULL) {
+      return Buffer;
+    }
   }
 
   //
@@ -588,6 +786,77 @@ CoreFreePoolPagesI (
     (EFI_PHYSICAL_ADDRESS)(UINTN)Memory, EFI_PAGES_TO_SIZE (NoPages));
 }
 
+/**
+  Internal function to return a slab object to its slab. A slab that becomes
+  completely free is kept as the empty slab of its cache, or has its pages
+  freed if the cache already holds one.
+  Caller must have the memory lock held
+
+  @param  Object                 The header of the slab object to free
+  @param  PoolType               Pointer to pool type
+
+  @retval EFI_INVALID_PARAMETER  Object does not belong to a valid slab
+  @retval EFI_SUCCESS            Object successfully freed.
+
+**/
+STATIC
+EFI_STATUS
+CoreFreeSlabObject (
+  IN POOL_SLAB_OBJECT   *Object,
+  OUT EFI_MEMORY_TYPE   *PoolType OPTIONAL
+  )
+{
+  POOL_SLAB_CACHE   *Cache;
+  POOL_SLAB         *Slab;
+  UINTN             ObjectSize;
+
+  ASSERT_LOCKED (&mPoolMemoryLock);
+
+  Slab = (POOL_SLAB *) ((UINT8 *) Object - Object->Offset);
+  if ((Slab->Signature != POOL_SLAB_SIGNATURE) || (Slab->Class >= MAX_SLAB_CLASS)) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  ObjectSize = mPoolSlabClassTable[Slab->Class].Size + sizeof (POOL_SLAB_OBJECT);
+  Cache      = &mPoolSlabCache[Slab->Type][Slab->Class];
+
+  mPoolHead[Slab->Type].Used -= ObjectSize;
+  DEBUG ((DEBUG_POOL, "FreePool: %p (len %lx) %,ld\n", Object + 1, (UINT64) (ObjectSize - sizeof (POOL_SLAB_OBJECT)), (UINT64) mPoolHead[Slab->Type].Used));
+
+  if (PoolType != NULL) {
+    *PoolType = Slab->Type;
+  }
+
+  DEBUG_CLEAR_MEMORY (Object + 1, ObjectSize - sizeof (POOL_SLAB_OBJECT));
+  Object->Signature = POOL_SLAB_FREE_SIGNATURE;
+  *(VOID **) (Object + 1) = Slab->FreeList;
+  Slab->FreeList = Object;
+  Slab->FreeCount++;
+
+  if (Slab->FreeCount == 1) {
+    //
+    // The slab was full, make it available for allocation again
+    //
+    InsertHeadList (&Cache->Partial, &Slab->Link);
+  }
+
+  if (Slab->FreeCount == Slab->ObjectCount) {
+    RemoveEntryList (&Slab->Link);
+    if (Cache->Empty == NULL) {
+      Cache->Empty = Slab;
+    } else {
+      Slab->Signature = 0;
+      CoreFreePoolPagesI (
+        Slab->Type,
+        (EFI_PHYSICAL_ADDRESS) (UINTN) Slab,
+        mPoolSlabClassTable[Slab->Class].Pages
+        );
+    }
+  }
+
+  return EFI_SUCCESS;
+}
+
 /**
   Internal function to free a pool entry.
   Caller must have the memory lock held
@@ -618,6 +887,14 @@ CoreFreePoolI (
   UINTN       Granularity;
 
   ASSERT(Buffer != NULL);
+
+  //
+  // Small allocations carry a slab object header instead of a POOL_HEAD
+  //
+  if (((POOL_SLAB_OBJECT *) Buffer - 1)->Signature == POOL_SLAB_OBJECT_SIGNATURE) {
+    return CoreFreeSlabObject ((POOL_SLAB_OBJECT *) Buffer - 1, PoolType);
+  }
+
   //
   // Get the head & tail of the pool entry
   //
@@ -235,6 +235,253 @@ FileHandleToVolume (
   return NULL;
 }
 
+/**
+  Walk the FFS files of a firmware volume and record the valid, non-pad ones.
+
+  The walk follows the rules of FindFileEx(): FFS2 files in a non-FFS3 volume are
+  skipped and every valid file must pass its header and data checksums.
+
+  @param FwVolHeader     Pointer to the FV header of the volume to walk.
+  @param FileIndex       The index to fill in. If NULL, the files are only counted
+                         and their checksums are verified.
+  @param Count           On return, the number of files recorded.
+
+  @retval EFI_SUCCESS           The volume was walked.
+  @retval EFI_VOLUME_CORRUPTED  A file in the volume is corrupted.
+
+**/
+EFI_STATUS
+WalkFvFileIndex (
+  IN  EFI_FIRMWARE_VOLUME_HEADER     *FwVolHeader,
+  OUT PEI_CORE_FV_FILE_INDEX         *FileIndex,  OPTIONAL
+  OUT UINT32                         *Count
+  )
+{
+  EFI_FIRMWARE_VOLUME_EXT_HEADER        *FwVolExtHeader;
+  EFI_FFS_FILE_HEADER                   *FfsFileHeader;
+  UINT32                                FileLength;
+  UINT32                                FileOccupiedSize;
+  UINT32                                FileOffset;
+  UINT64                                FvLength;
+  UINT8                                 ErasePolarity;
+  UINT8                                 DataCheckSum;
+  BOOLEAN                               IsFfs3Fv;
+
+  *Count   = 0;
+  IsFfs3Fv = CompareGuid (&FwVolHeader->FileSystemGuid, &gEfiFirmwareFileSystem3Guid);
+  FvLength = FwVolHeader->FvLength;
+  if ((FwVolHeader->Attributes & EFI_FVB2_ERASE_POLARITY) != 0) {
+    ErasePolarity = 1;
+  } else {
+    ErasePolarity = 0;
+  }
+
+  if (FwVolHeader->ExtHeaderOffset != 0) {
+    FwVolExtHeader = (EFI_FIRMWARE_VOLUME_EXT_HEADER *) ((UINT8 *) FwVolHeader + FwVolHeader->ExtHeaderOffset);
+    FfsFileHeader = (EFI_FFS_FILE_HEADER *) ((UINT8 *) FwVolExtHeader + FwVolExtHeader->ExtHeaderSize);
+    FfsFileHeader = (EFI_FFS_FILE_HEADER *) ALIGN_POINTER (FfsFileHeader, 8);
+  } else {
+    FfsFileHeader = (EFI_FFS_FILE_HEADER *)((UINT8 *) FwVolHeader + FwVolHeader->HeaderLength);
+  }
+  FileOffset = (UINT32) ((UINT8 *)FfsFileHeader - (UINT8 *)FwVolHeader);
+
+  while (FileOffset < (FvLength - sizeof (EFI_FFS_FILE_HEADER))) {
+    switch (GetFileState (ErasePolarity, FfsFileHeader)) {
+
+    case EFI_FILE_HEADER_CONSTRUCTION:
+    case EFI_FILE_HEADER_INVALID:
+      if (IS_FFS_FILE2 (FfsFileHeader)) {
+        FileOccupiedSize = sizeof (EFI_FFS_FILE_HEADER2);
+      } else {
+        FileOccupiedSize = sizeof (EFI_FFS_FILE_HEADER);
+      }
+      break;
+
+    case EFI_FILE_DATA_VALID:
+    case EFI_FILE_MARKED_FOR_UPDATE:
+      if ((FileIndex == NULL) && (CalculateHeaderChecksum (FfsFileHeader) != 0)) {
+        return EFI_VOLUME_CORRUPTED;
+      }
+
+      if (IS_FFS_FILE2 (FfsFileHeader)) {
+        FileLength = FFS_FILE2_SIZE (FfsFileHeader);
+        FileOccupiedSize = GET_OCCUPIED_SIZE (FileLength, 8);
+        if (!IsFfs3Fv) {
+          break;
+        }
+      } else {
+        FileLength = FFS_FILE_SIZE (FfsFileHeader);
+        FileOccupiedSize = GET_OCCUPIED_SIZE (FileLength, 8);
+      }
+
+      if (FileIndex == NULL) {
+        DataCheckSum = FFS_FIXED_CHECKSUM;
+        if ((FfsFileHeader->Attributes & FFS_ATTRIB_CHECKSUM) == FFS_ATTRIB_CHECKSUM) {
+          if (IS_FFS_FILE2 (FfsFileHeader)) {
+            DataCheckSum = CalculateCheckSum8 ((CONST UINT8 *) FfsFileHeader + sizeof (EFI_FFS_FILE_HEADER2), FileLength - sizeof(EFI_FFS_FILE_HEADER2));
+          } else {
+            DataCheckSum = CalculateCheckSum8 ((CONST UINT8 *) FfsFileHeader + sizeof (EFI_FFS_FILE_HEADER), FileLength - sizeof(EFI_FFS_FILE_HEADER));
+          }
+        }
+        if (FfsFileHeader->IntegrityCheck.Checksum.File != DataCheckSum) {
+          return EFI_VOLUME_CORRUPTED;
+        }
+      }
+
+      if (FfsFileHeader->Type != EFI_FV_FILETYPE_FFS_PAD) {
+        if (FileIndex != NULL) {
+          CopyGuid (&FileIndex->Entry[*Count].Name, &FfsFileHeader->Name);
+          FileIndex->Entry[*Count].Offset = FileOffset;
+          FileIndex->Entry[*Count].Type   = FfsFileHeader->Type;
+        }
+        (*Count)++;
+      }
+      break;
+
+    case EFI_FILE_DELETED:
+      if (IS_FFS_FILE2 (FfsFileHeader)) {
+        FileLength = FFS_FILE2_SIZE (FfsFileHeader);
+      } else {
+        FileLength = FFS_FILE_SIZE (FfsFileHeader);
+      }
+      FileOccupiedSize = GET_OCCUPIED_SIZE (FileLength, 8);
+      break;
+
+    default:
+      return EFI_SUCCESS;
+    }
+
+    FileOffset    += FileOccupiedSize;
+    FfsFileHeader =  (EFI_FFS_FILE_HEADER *)((UINT8 *)FfsFileHeader + FileOccupiedSize);
+  }
+
+  return EFI_SUCCESS;
+}
+
+/**
+  Build the file index of a firmware volume known to the PEI core.
+
+  The volume is walked twice: once to count the files and verify their checksums,
+  and once to record them. No index is built for a corrupted volume, so that its
+  searches keep reporting the corruption through FindFileEx().
+
+  @param CoreFvHandle    The PEI_CORE_FV_HANDLE of the volume.
+
+  @retval EFI_SUCCESS    The index was built and recorded in CoreFvHandle.
+  @retval Others         No index was built.
+
+**/
+EFI_STATUS
+BuildFvFileIndex (
+  IN PEI_CORE_FV_HANDLE              *CoreFvHandle
+  )
+{
+  EFI_STATUS                            Status;
+  PEI_CORE_FV_FILE_INDEX                *FileIndex;
+  UINT32                                Count;
+
+  Status = WalkFvFileIndex (CoreFvHandle->FvHeader, NULL, &Count);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  FileIndex = AllocatePool (
+                sizeof (PEI_CORE_FV_FILE_INDEX) +
+                (MAX (Count, 1) - 1) * sizeof (PEI_CORE_FV_FILE_INDEX_ENTRY)
+                );
+  if (FileIndex == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  WalkFvFileIndex (CoreFvHandle->FvHeader, FileIndex, &FileIndex->Count);
+  ASSERT (FileIndex->Count == Count);
+  CoreFvHandle->FileIndex = FileIndex;
+  return EFI_SUCCESS;
+}
+
+/**
+  Search the file index of a firmware volume with the rules of FindFileEx().
+
+  @param FwVolHeader     Pointer to the FV header of the volume to search.
+  @param FileIndex       The file index of the volume.
+  @param FileName        File name
+  @param SearchType      Filter to find only files of this type.
+  @param FileHandle      On input, the file to search after, or NULL to start from the
+                         first file. On output, the file found.
+  @param AprioriFile     Pointer to AprioriFile image in this FV if has
+
+  @retval EFI_SUCCESS      The file was found.
+  @retval EFI_NOT_FOUND    No files matching the search criteria were found.
+  @retval EFI_UNSUPPORTED  The file to search after is not in the index.
+
+**/
+EFI_STATUS
+FindFileInFvFileIndex (
+  IN        EFI_FIRMWARE_VOLUME_HEADER *FwVolHeader,
+  IN        PEI_CORE_FV_FILE_INDEX     *FileIndex,
+  IN  CONST EFI_GUID                   *FileName,   OPTIONAL
+  IN        EFI_FV_FILETYPE            SearchType,
+  IN OUT    EFI_PEI_FILE_HANDLE        *FileHandle,
+  IN OUT    EFI_PEI_FILE_HANDLE        *AprioriFile  OPTIONAL
+  )
+{
+  PEI_CORE_FV_FILE_INDEX_ENTRY          *Entry;
+  UINTN                                 Offset;
+  UINT32                                Index;
+  UINT32                                Low;
+  UINT32                                High;
+  UINT32                                Middle;
+
+  Index = 0;
+  if ((*FileHandle != NULL) && (FileName == NULL)) {
+    //
+    // The entries are in FV order, so the file to search after is found by its offset.
+    //
+    Offset = (UINTN) ((UINT8 *) *FileHandle - (UINT8 *) FwVolHeader);
+    Low    = 0;
+    High   = FileIndex->Count;
+    while (Low < High) {
+      Middle = Low + (High - Low) / 2;
+      if (FileIndex->Entry[Middle].Offset < Offset) {
+        Low = Middle + 1;
+      } else {
+        High = Middle;
+      }
+    }
+    if ((Low == FileIndex->Count) || (FileIndex->Entry[Low].Offset != Offset)) {
+      return EFI_UNSUPPORTED;
+    }
+    Index = Low + 1;
+  }
+
+  for (; Index < FileIndex->Count; Index++) {
+    Entry = &FileIndex->Entry[Index];
+    if (FileName != NULL) {
+      if (CompareGuid (&Entry->Name, FileName)) {
+        *FileHandle = (EFI_PEI_FILE_HANDLE) ((UINT8 *) FwVolHeader + Entry->Offset);
+        return EFI_SUCCESS;
+      }
+    } else if (SearchType == PEI_CORE_INTERNAL_FFS_FILE_DISPATCH_TYPE) {
+      if ((Entry->Type == EFI_FV_FILETYPE_PEIM) ||
+          (Entry->Type == EFI_FV_FILETYPE_COMBINED_PEIM_DRIVER) ||
+          (Entry->Type == EFI_FV_FILETYPE_FIRMWARE_VOLUME_IMAGE)) {
+        *FileHandle = (EFI_PEI_FILE_HANDLE) ((UINT8 *) FwVolHeader + Entry->Offset);
+        return EFI_SUCCESS;
+      } else if ((AprioriFile != NULL) && (Entry->Type == EFI_FV_FILETYPE_FREEFORM)) {
+        if (CompareGuid (&Entry->Name, &gPeiAprioriFileNameGuid)) {
+          *AprioriFile = (EFI_PEI_FILE_HANDLE) ((UINT8 *) FwVolHeader + Entry->Offset);
+        }
+      }
+    } else if ((SearchType == Entry->Type) || (SearchType == EFI_FV_FILETYPE_ALL)) {
+      *FileHandle = (EFI_PEI_FILE_HANDLE) ((UINT8 *) FwVolHeader + Entry->Offset);
+      return EFI_SUCCESS;
+    }
+  }
+
+  *FileHandle = NULL;
+  return EFI_NOT_FOUND;
+}
+
 /**
   Given the input file pointer, search for the first matching file in the
   FFS volume as defined by SearchType. The search starts from FileHeader inside
@@ -242,6 +489,8 @@ FileHandleToVolume (
   If SearchType is EFI_FV_FILETYPE_ALL, the first FFS file will return without check its file type.
   If SearchType is PEI_CORE_INTERNAL_FFS_FILE_DISPATCH_TYPE, 
   the first PEIM, or COMBINED PEIM or FV file type FFS file will return.  
+  Volumes known to the PEI core are searched through their file index, which is
+  built on the first search.
 
   @param FvHandle        Pointer to the FV header of the volume to search
   @param FileName        File name
@@ -275,6 +524,8 @@ FindFileEx (
   UINT8                                 FileState;
   UINT8                                 DataCheckSum;
   BOOLEAN                               IsFfs3Fv;
+  PEI_CORE_FV_HANDLE                    *CoreFvHandle;
+  EFI_STATUS                            Status;
   
   //
   // Convert the handle of FV to FV header for memory-mapped firmware volume
@@ -282,6 +533,23 @@ FindFileEx (
   FwVolHeader = (EFI_FIRMWARE_VOLUME_HEADER *) FvHandle;
   FileHeader  = (EFI_FFS_FILE_HEADER **)FileHandle;
 
+  //
+  // Search the file index of the volume if the PEI core knows it, and fall back
+  // to walking the volume if the index cannot be used.
+  //
+  CoreFvHandle = FvHandleToCoreHandle (FvHandle);
+  if ((CoreFvHandle != NULL) && (CoreFvHandle->FvHeader == FwVolHeader)) {
+    if (CoreFvHandle->FileIndex == NULL) {
+      BuildFvFileIndex (CoreFvHandle);
+    }
+    if (CoreFvHandle->FileIndex != NULL) {
+      Status = FindFileInFvFileIndex (FwVolHeader, CoreFvHandle->FileIndex, FileName, SearchType, FileHandle, AprioriFile);
+      if (Status != EFI_UNSUPPORTED) {
+        return Status;
+      }
+    }
+  }
+
   IsFfs3Fv = CompareGuid (&FwVolHeader->FileSystemGuid, &gEfiFirmwareFileSystem3Guid);
 
   FvLength = FwVolHeader->FvLength;
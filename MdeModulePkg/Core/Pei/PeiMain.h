@@ -65,8 +65,20 @@ typedef union {
 } PEI_PPI_LIST_POINTERS;
 
 ///
-/// PPI database structure which contains two link: PpiList and NotifyList. PpiList
-/// is in head of PpiListPtrs array and notify is in end of PpiListPtrs.
+/// Number of GUID hash buckets of the PPI database. Must be a power of two.
+///
+#define PEI_PPI_HASH_BUCKETS  32
+
+///
+/// End of a hash chain of the PPI database.
+///
+#define PEI_PPI_HASH_END      (-1)
+
+///
+/// PPI database structure which contains two lists: PpiList and NotifyList. Both start
+/// with PcdPeiCoreMaxPpiSupported entries and grow when they are full. Dispatch level
+/// notifies are in head of the NotifyList and callback level notifies follow them.
+/// The installed PPIs are also linked into hash chains by GUID, in install order.
 ///
 typedef struct {
   ///
@@ -74,11 +86,19 @@ typedef struct {
   ///
   INTN                    PpiListEnd;
   ///
+  /// number of entries of PpiListPtrs and PpiHashNext.
+  ///
+  INTN                    PpiListSize;
+  ///
   /// index of end of notify link list.
   ///
   INTN                    NotifyListEnd;
   ///
-  /// index of the dispatched notify list.
+  /// number of entries of NotifyListPtrs.
+  ///
+  INTN                    NotifyListSize;
+  ///
+  /// index of end of the dispatch level notifies in notify link list.
   ///
   INTN                    DispatchListEnd;
   ///
@@ -90,9 +110,22 @@ typedef struct {
   /// 
   INTN                    LastDispatchedNotify;
   ///
-  /// Ppi database has the PcdPeiCoreMaxPpiSupported number of entries.
+  /// Installed PPI descriptors.
   ///
   PEI_PPI_LIST_POINTERS   *PpiListPtrs;
+  ///
+  /// Notify descriptors.
+  ///
+  PEI_PPI_LIST_POINTERS   *NotifyListPtrs;
+  ///
+  /// Index of the next PPI on the same hash chain, for each entry of PpiListPtrs.
+  ///
+  INTN                    *PpiHashNext;
+  ///
+  /// Index of the first and last PPI of each hash chain.
+  ///
+  INTN                    PpiHashHead[PEI_PPI_HASH_BUCKETS];
+  INTN                    PpiHashTail[PEI_PPI_HASH_BUCKETS];
 } PEI_PPI_DATABASE;
 
 
@@ -106,6 +139,27 @@ typedef struct {
 #define PEIM_STATE_REGISITER_FOR_SHADOW   0x02
 #define PEIM_STATE_DONE                   0x03
 
+///
+/// One valid, non-pad FFS file of a firmware volume, as recorded in the file index.
+///
+typedef struct {
+  EFI_GUID                            Name;
+  //
+  // Offset of the FFS file header from the start of the FV header.
+  //
+  UINT32                              Offset;
+  EFI_FV_FILETYPE                     Type;
+} PEI_CORE_FV_FILE_INDEX_ENTRY;
+
+///
+/// Index of the files of a firmware volume in FV order, built on the first file
+/// search so that later searches do not walk and checksum the FFS headers again.
+///
+typedef struct {
+  UINT32                              Count;
+  PEI_CORE_FV_FILE_INDEX_ENTRY        Entry[1];
+} PEI_CORE_FV_FILE_INDEX;
+
 typedef struct {
   EFI_FIRMWARE_VOLUME_HEADER          *FvHeader;
   EFI_PEI_FIRMWARE_VOLUME_PPI         *FvPpi;
@@ -120,6 +174,10 @@ typedef struct {
   EFI_PEI_FILE_HANDLE                 *FvFileHandles;
   BOOLEAN                             ScanFv;
   UINT32                              AuthenticationStatus;
+  //
+  // Pointer to the file index of the FV, NULL if it has not been built.
+  //
+  PEI_CORE_FV_FILE_INDEX              *FileIndex;
 } PEI_CORE_FV_HANDLE;
 
 typedef struct {
@@ -29,11 +29,156 @@ InitializePpiServices (
   IN PEI_CORE_INSTANCE *OldCoreData
   )
 {
+  UINTN   Index;
+
   if (OldCoreData == NULL) {
-    PrivateData->PpiData.NotifyListEnd = PcdGet32 (PcdPeiCoreMaxPpiSupported)-1;
-    PrivateData->PpiData.DispatchListEnd = PcdGet32 (PcdPeiCoreMaxPpiSupported)-1;
-    PrivateData->PpiData.LastDispatchedNotify = PcdGet32 (PcdPeiCoreMaxPpiSupported)-1;
+    PrivateData->PpiData.PpiListSize    = PcdGet32 (PcdPeiCoreMaxPpiSupported);
+    PrivateData->PpiData.NotifyListSize = PcdGet32 (PcdPeiCoreMaxPpiSupported);
+    for (Index = 0; Index < PEI_PPI_HASH_BUCKETS; Index++) {
+      PrivateData->PpiData.PpiHashHead[Index] = PEI_PPI_HASH_END;
+      PrivateData->PpiData.PpiHashTail[Index] = PEI_PPI_HASH_END;
+    }
+  }
+}
+
+/**
+
+  Get the hash bucket of a PPI GUID in the PPI database.
+
+  @param Guid            Pointer to the GUID.
+
+  @return The index of the hash bucket.
+
+**/
+UINTN
+GetPpiHashBucket (
+  IN CONST EFI_GUID      *Guid
+  )
+{
+  UINT32                 Hash;
+
+  Hash = ((UINT32 *)Guid)[0] ^ ((UINT32 *)Guid)[1] ^ ((UINT32 *)Guid)[2] ^ ((UINT32 *)Guid)[3];
+  Hash ^= Hash >> 16;
+  Hash ^= Hash >> 8;
+  return Hash & (PEI_PPI_HASH_BUCKETS - 1);
+}
+
+/**
+
+  Add an installed PPI to the hash chain of its GUID.
+
+  The PPI must be the last one installed, so that the chains stay in install order.
+
+  @param PrivateData     Pointer to the PEI Core data.
+  @param Index           The index of the PPI in the PPI list.
+
+**/
+VOID
+AddPpiHashEntry (
+  IN PEI_CORE_INSTANCE   *PrivateData,
+  IN INTN                Index
+  )
+{
+  UINTN                  Bucket;
+
+  Bucket = GetPpiHashBucket (PrivateData->PpiData.PpiListPtrs[Index].Ppi->Guid);
+  PrivateData->PpiData.PpiHashNext[Index] = PEI_PPI_HASH_END;
+  if (PrivateData->PpiData.PpiHashTail[Bucket] == PEI_PPI_HASH_END) {
+    PrivateData->PpiData.PpiHashHead[Bucket] = Index;
+  } else {
+    PrivateData->PpiData.PpiHashNext[PrivateData->PpiData.PpiHashTail[Bucket]] = Index;
+  }
+  PrivateData->PpiData.PpiHashTail[Bucket] = Index;
+}
+
+/**
+
+  Rebuild the hash chains of the PPI database from the PPI list.
+
+  @param PrivateData     Pointer to the PEI Core data.
+
+**/
+VOID
+RebuildPpiHashIndex (
+  IN PEI_CORE_INSTANCE   *PrivateData
+  )
+{
+  INTN                   Index;
+
+  for (Index = 0; Index < PEI_PPI_HASH_BUCKETS; Index++) {
+    PrivateData->PpiData.PpiHashHead[Index] = PEI_PPI_HASH_END;
+    PrivateData->PpiData.PpiHashTail[Index] = PEI_PPI_HASH_END;
+  }
+  for (Index = 0; Index < PrivateData->PpiData.PpiListEnd; Index++) {
+    AddPpiHashEntry (PrivateData, Index);
+  }
+}
+
+/**
+
+  Grow a list of the PPI database to twice its size.
+
+  The PEI core cannot free pool, so the old buffers are left behind; the
+  lists only grow when PcdPeiCoreMaxPpiSupported is too small for the platform.
+
+  @param Buffer          On input, the list. On output, the grown list.
+  @param EntrySize       The size in bytes of a list entry.
+  @param Size            On input, the number of entries of the list. On output,
+                         the number of entries of the grown list.
+
+  @retval EFI_SUCCESS           The list was grown.
+  @retval EFI_OUT_OF_RESOURCES  There is not enough memory to grow the list.
+
+**/
+EFI_STATUS
+GrowPpiDatabaseList (
+  IN OUT VOID            **Buffer,
+  IN     UINTN           EntrySize,
+  IN OUT INTN            *Size
+  )
+{
+  VOID                   *NewBuffer;
+
+  NewBuffer = AllocateZeroPool (EntrySize * (*Size) * 2);
+  if (NewBuffer == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+  CopyMem (NewBuffer, *Buffer, EntrySize * (*Size));
+  *Buffer = NewBuffer;
+  *Size   = (*Size) * 2;
+  return EFI_SUCCESS;
+}
+
+/**
+
+  Grow the PPI list of the PPI database and its hash links.
+
+  @param PrivateData     Pointer to the PEI Core data.
+
+  @retval EFI_SUCCESS           The list was grown.
+  @retval EFI_OUT_OF_RESOURCES  There is not enough memory to grow the list.
+
+**/
+EFI_STATUS
+GrowPpiList (
+  IN PEI_CORE_INSTANCE   *PrivateData
+  )
+{
+  EFI_STATUS             Status;
+  INTN                   Size;
+
+  Size   = PrivateData->PpiData.PpiListSize;
+  Status = GrowPpiDatabaseList ((VOID **) &PrivateData->PpiData.PpiHashNext, sizeof (INTN), &Size);
+  if (EFI_ERROR (Status)) {
+    return Status;
   }
+
+  Status = GrowPpiDatabaseList ((VOID **) &PrivateData->PpiData.PpiListPtrs, sizeof (PEI_PPI_LIST_POINTERS), &PrivateData->PpiData.PpiListSize);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+  DEBUG ((EFI_D_INFO, "PPI list grown to %d entries\n", (UINT32) PrivateData->PpiData.PpiListSize));
+  return EFI_SUCCESS;
 }
 
 /**
@@ -101,6 +246,65 @@ ConvertSinglePpiPointer (
   }
 }
 
+/**
+
+  Migrate a PPI or notify list entry from the temporary memory to PEI installed memory.
+
+  @param SecCoreData     Points to a data structure containing SEC to PEI handoff data, such as the size 
+                         and location of temporary RAM, the stack location and the BFV location.
+  @param PrivateData     Pointer to PeiCore's private data structure.
+  @param PpiPointer      Pointer to the list entry.
+
+**/
+VOID
+ConvertPpiListPointer (
+  IN CONST EFI_SEC_PEI_HAND_OFF  *SecCoreData,
+  IN PEI_CORE_INSTANCE           *PrivateData,
+  IN PEI_PPI_LIST_POINTERS       *PpiPointer
+  )
+{
+  UINT8                 IndexHole;
+
+  //
+  // Convert PPI pointer in old Heap
+  //
+  ConvertSinglePpiPointer (
+    PpiPointer,
+    (UINTN)SecCoreData->PeiTemporaryRamBase,
+    (UINTN)SecCoreData->PeiTemporaryRamBase + SecCoreData->PeiTemporaryRamSize,
+    PrivateData->HeapOffset,
+    PrivateData->HeapOffsetPositive
+    );
+
+  //
+  // Convert PPI pointer in old Stack
+  //
+  ConvertSinglePpiPointer (
+    PpiPointer,
+    (UINTN)SecCoreData->StackBase,
+    (UINTN)SecCoreData->StackBase + SecCoreData->StackSize,
+    PrivateData->StackOffset,
+    PrivateData->StackOffsetPositive
+    );
+
+  //
+  // Convert PPI pointer in old TempRam Hole
+  //
+  for (IndexHole = 0; IndexHole < HOLE_MAX_NUMBER; IndexHole ++) {
+    if (PrivateData->HoleData[IndexHole].Size == 0) {
+      continue;
+    }
+
+    ConvertSinglePpiPointer (
+      PpiPointer,
+      (UINTN)PrivateData->HoleData[IndexHole].Base,
+      (UINTN)PrivateData->HoleData[IndexHole].Base + PrivateData->HoleData[IndexHole].Size,
+      PrivateData->HoleData[IndexHole].Offset,
+      PrivateData->HoleData[IndexHole].OffsetPositive
+      );
+  }
+}
+
 /**
 
   Migrate PPI Pointers from the temporary memory stack to PEI installed memory.
@@ -116,50 +320,14 @@ ConvertPpiPointers (
   IN PEI_CORE_INSTANCE           *PrivateData
   )
 {
-  UINT8                 Index;
-  UINT8                 IndexHole;
+  INTN                  Index;
 
-  for (Index = 0; Index < PcdGet32 (PcdPeiCoreMaxPpiSupported); Index++) {
-    if (Index < PrivateData->PpiData.PpiListEnd || Index > PrivateData->PpiData.NotifyListEnd) {
-      //
-      // Convert PPI pointer in old Heap
-      //
-      ConvertSinglePpiPointer (
-        &PrivateData->PpiData.PpiListPtrs[Index],
-        (UINTN)SecCoreData->PeiTemporaryRamBase,
-        (UINTN)SecCoreData->PeiTemporaryRamBase + SecCoreData->PeiTemporaryRamSize,
-        PrivateData->HeapOffset,
-        PrivateData->HeapOffsetPositive
-        );
-        
-      //
-      // Convert PPI pointer in old Stack
-      //
-      ConvertSinglePpiPointer (
-        &PrivateData->PpiData.PpiListPtrs[Index],
-        (UINTN)SecCoreData->StackBase,
-        (UINTN)SecCoreData->StackBase + SecCoreData->StackSize,
-        PrivateData->StackOffset,
-        PrivateData->StackOffsetPositive
-        );
-        
-      //
-      // Convert PPI pointer in old TempRam Hole
-      //
-      for (IndexHole = 0; IndexHole < HOLE_MAX_NUMBER; IndexHole ++) {
-        if (PrivateData->HoleData[IndexHole].Size == 0) {
-          continue;
-        }
-        
-        ConvertSinglePpiPointer (
-          &PrivateData->PpiData.PpiListPtrs[Index],
-          (UINTN)PrivateData->HoleData[IndexHole].Base,
-          (UINTN)PrivateData->HoleData[IndexHole].Base + PrivateData->HoleData[IndexHole].Size,
-          PrivateData->HoleData[IndexHole].Offset,
-          PrivateData->HoleData[IndexHole].OffsetPositive
-          );
-      }
-    }
+  for (Index = 0; Index < PrivateData->PpiData.PpiListEnd; Index++) {
+    ConvertPpiListPointer (SecCoreData, PrivateData, &PrivateData->PpiData.PpiListPtrs[Index]);
+  }
+
+  for (Index = 0; Index < PrivateData->PpiData.NotifyListEnd; Index++) {
+    ConvertPpiListPointer (SecCoreData, PrivateData, &PrivateData->PpiData.NotifyListPtrs[Index]);
   }
 }
 
@@ -188,6 +356,7 @@ PeiInstallPpi (
   PEI_CORE_INSTANCE *PrivateData;
   INTN              Index;
   INTN              LastCallbackInstall;
+  EFI_STATUS        Status;
 
 
   if (PpiList == NULL) {
@@ -207,12 +376,14 @@ PeiInstallPpi (
 
   for (;;) {
     //
-    // Since PpiData is used for NotifyList and PpiList, max resource
-    // is reached if the Install reaches the NotifyList
-    // PcdPeiCoreMaxPpiSupported can be set to a larger value in DSC to satisfy more PPI requirement.
+    // Grow the PPI list when it is full.
+    // PcdPeiCoreMaxPpiSupported can be set to a larger value in DSC to avoid growing it.
     //
-    if (Index == PrivateData->PpiData.NotifyListEnd + 1) {
-      return  EFI_OUT_OF_RESOURCES;
+    if (Index == PrivateData->PpiData.PpiListSize) {
+      Status = GrowPpiList (PrivateData);
+      if (EFI_ERROR (Status)) {
+        return Status;
+      }
     }
     //
     // Check if it is a valid PPI.
@@ -221,12 +392,14 @@ PeiInstallPpi (
     //
     if ((PpiList->Flags & EFI_PEI_PPI_DESCRIPTOR_PPI) == 0) {
       PrivateData->PpiData.PpiListEnd = LastCallbackInstall;
+      RebuildPpiHashIndex (PrivateData);
       DEBUG((EFI_D_ERROR, "ERROR -> InstallPpi: %g %p\n", PpiList->Guid, PpiList->Ppi));
       return  EFI_INVALID_PARAMETER;
     }
 
     DEBUG((EFI_D_INFO, "Install PPI: %g\n", PpiList->Guid));
     PrivateData->PpiData.PpiListPtrs[Index].Ppi = (EFI_PEI_PPI_DESCRIPTOR*) PpiList;
+    AddPpiHashEntry (PrivateData, Index);
     PrivateData->PpiData.PpiListEnd++;
 
     //
@@ -312,9 +485,16 @@ PeiReInstallPpi (
   // Remove the old PPI from the database, add the new one.
   //
   DEBUG((EFI_D_INFO, "Reinstall PPI: %g\n", NewPpi->Guid));
-  ASSERT (Index < (INTN)(PcdGet32 (PcdPeiCoreMaxPpiSupported)));
+  ASSERT (Index < PrivateData->PpiData.PpiListSize);
   PrivateData->PpiData.PpiListPtrs[Index].Ppi = (EFI_PEI_PPI_DESCRIPTOR *) NewPpi;
 
+  //
+  // The hash chains only need to change if the PPI is reinstalled under another GUID.
+  //
+  if (!CompareGuid (OldPpi->Guid, NewPpi->Guid)) {
+    RebuildPpiHashIndex (PrivateData);
+  }
+
   //
   // Dispatch any callback level notifies for the newly installed PPI.
   //
@@ -366,9 +546,12 @@ PeiLocatePpi (
   PrivateData = PEI_CORE_INSTANCE_FROM_PS_THIS(PeiServices);
 
   //
-  // Search the data base for the matching instance of the GUIDed PPI.
+  // Search the hash chain of the GUID for the matching instance of the GUIDed PPI.
+  // The chain is in install order, so instances are numbered as in the PPI list.
   //
-  for (Index = 0; Index < PrivateData->PpiData.PpiListEnd; Index++) {
+  for (Index = PrivateData->PpiData.PpiHashHead[GetPpiHashBucket (Guid)];
+       Index != PEI_PPI_HASH_END;
+       Index = PrivateData->PpiData.PpiHashNext[Index]) {
     TempPtr = PrivateData->PpiData.PpiListPtrs[Index].Ppi;
     CheckGuid = TempPtr->Guid;
 
@@ -428,6 +611,7 @@ PeiNotifyPpi (
   INTN                             LastCallbackNotify;
   EFI_PEI_NOTIFY_DESCRIPTOR        *NotifyPtr;
   UINTN                            NotifyDispatchCount;
+  EFI_STATUS                       Status;
 
 
   NotifyDispatchCount = 0;
@@ -449,12 +633,15 @@ PeiNotifyPpi (
 
   for (;;) {
     //
-    // Since PpiData is used for NotifyList and InstallList, max resource
-    // is reached if the Install reaches the PpiList
-    // PcdPeiCoreMaxPpiSupported can be set to a larger value in DSC to satisfy more Notify PPIs requirement.
+    // Grow the notify list when it is full.
+    // PcdPeiCoreMaxPpiSupported can be set to a larger value in DSC to avoid growing it.
     //
-    if (Index == PrivateData->PpiData.PpiListEnd - 1) {
-      return  EFI_OUT_OF_RESOURCES;
+    if (Index == PrivateData->PpiData.NotifyListSize) {
+      Status = GrowPpiDatabaseList ((VOID **) &PrivateData->PpiData.NotifyListPtrs, sizeof (PEI_PPI_LIST_POINTERS), &PrivateData->PpiData.NotifyListSize);
+      if (EFI_ERROR (Status)) {
+        return Status;
+      }
+      DEBUG ((EFI_D_INFO, "Notify list grown to %d entries\n", (UINT32) PrivateData->PpiData.NotifyListSize));
     }
 
     //
@@ -470,38 +657,38 @@ PeiNotifyPpi (
       NotifyDispatchCount ++;
     }
 
-    PrivateData->PpiData.PpiListPtrs[Index].Notify = (EFI_PEI_NOTIFY_DESCRIPTOR *) NotifyList;
+    PrivateData->PpiData.NotifyListPtrs[Index].Notify = (EFI_PEI_NOTIFY_DESCRIPTOR *) NotifyList;
 
-    PrivateData->PpiData.NotifyListEnd--;
+    PrivateData->PpiData.NotifyListEnd++;
     DEBUG((EFI_D_INFO, "Register PPI Notify: %g\n", NotifyList->Guid));
     if ((NotifyList->Flags & EFI_PEI_PPI_DESCRIPTOR_TERMINATE_LIST) ==
         EFI_PEI_PPI_DESCRIPTOR_TERMINATE_LIST) {
       break;
     }
     //
-    // Go the next descriptor. Remember the NotifyList moves down.
+    // Go the next descriptor.
     //
     NotifyList++;
-    Index--;
+    Index++;
   }
 
   //
-  // If there is Dispatch Notify PPI installed put them on the bottom
+  // If there is Dispatch Notify PPI installed put them on the head of the notify list
   //
   if (NotifyDispatchCount > 0) {
-    for (NotifyIndex = LastCallbackNotify; NotifyIndex > PrivateData->PpiData.NotifyListEnd; NotifyIndex--) {
-      if ((PrivateData->PpiData.PpiListPtrs[NotifyIndex].Notify->Flags & EFI_PEI_PPI_DESCRIPTOR_NOTIFY_DISPATCH) != 0) {
-        NotifyPtr = PrivateData->PpiData.PpiListPtrs[NotifyIndex].Notify;
+    for (NotifyIndex = LastCallbackNotify; NotifyIndex < PrivateData->PpiData.NotifyListEnd; NotifyIndex++) {
+      if ((PrivateData->PpiData.NotifyListPtrs[NotifyIndex].Notify->Flags & EFI_PEI_PPI_DESCRIPTOR_NOTIFY_DISPATCH) != 0) {
+        NotifyPtr = PrivateData->PpiData.NotifyListPtrs[NotifyIndex].Notify;
 
-        for (Index = NotifyIndex; Index < PrivateData->PpiData.DispatchListEnd; Index++){
-          PrivateData->PpiData.PpiListPtrs[Index].Notify = PrivateData->PpiData.PpiListPtrs[Index + 1].Notify;
+        for (Index = NotifyIndex; Index > PrivateData->PpiData.DispatchListEnd; Index--){
+          PrivateData->PpiData.NotifyListPtrs[Index].Notify = PrivateData->PpiData.NotifyListPtrs[Index - 1].Notify;
         }
-        PrivateData->PpiData.PpiListPtrs[Index].Notify = NotifyPtr;
-        PrivateData->PpiData.DispatchListEnd--;
+        PrivateData->PpiData.NotifyListPtrs[Index].Notify = NotifyPtr;
+        PrivateData->PpiData.DispatchListEnd++;
       }
     }
 
-    LastCallbackNotify -= NotifyDispatchCount;
+    LastCallbackNotify += NotifyDispatchCount;
   }
 
   //
@@ -570,7 +757,7 @@ ProcessNotifyList (
         EFI_PEI_PPI_DESCRIPTOR_NOTIFY_DISPATCH,
         PrivateData->PpiData.LastDispatchedInstall,
         PrivateData->PpiData.PpiListEnd,
-        PcdGet32 (PcdPeiCoreMaxPpiSupported)-1,
+        0,
         PrivateData->PpiData.DispatchListEnd
         );
       PrivateData->PpiData.LastDispatchedInstall = TempValue;
@@ -587,6 +774,9 @@ ProcessNotifyList (
 
   Dispatch notifications.
 
+  Each notify is only matched against the installed PPIs on the hash chain of
+  its GUID, so the cost no longer grows with the size of the PPI list.
+
   @param PrivateData        PeiCore's private data structure
   @param NotifyType         Type of notify to fire.
   @param InstallStartIndex  Install Beginning index.
@@ -611,15 +801,21 @@ DispatchNotify (
   EFI_GUID                *CheckGuid;
   EFI_PEI_NOTIFY_DESCRIPTOR   *NotifyDescriptor;
 
-  //
-  // Remember that Installs moves up and Notifies moves down.
-  //
-  for (Index1 = NotifyStartIndex; Index1 > NotifyStopIndex; Index1--) {
-    NotifyDescriptor = PrivateData->PpiData.PpiListPtrs[Index1].Notify;
+  for (Index1 = NotifyStartIndex; Index1 < NotifyStopIndex; Index1++) {
+    NotifyDescriptor = PrivateData->PpiData.NotifyListPtrs[Index1].Notify;
 
     CheckGuid = NotifyDescriptor->Guid;
 
-    for (Index2 = InstallStartIndex; Index2 < InstallStopIndex; Index2++) {
+    //
+    // The hash chain is in install order; skip the PPIs installed before the range
+    // and stop at the first one installed after it.
+    //
+    for (Index2 = PrivateData->PpiData.PpiHashHead[GetPpiHashBucket (CheckGuid)];
+         (Index2 != PEI_PPI_HASH_END) && (Index2 < InstallStopIndex);
+         Index2 = PrivateData->PpiData.PpiHashNext[Index2]) {
+      if (Index2 < InstallStartIndex) {
+        continue;
+      }
       SearchGuid = PrivateData->PpiData.PpiListPtrs[Index2].Ppi->Guid;
       //
       // Don't use CompareGuid function here for performance reasons.
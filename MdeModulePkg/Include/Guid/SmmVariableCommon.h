@@ -72,6 +72,26 @@ typedef struct {
 #define SMM_VARIABLE_FUNCTION_VAR_CHECK_VARIABLE_PROPERTY_GET  10
 
 #define SMM_VARIABLE_FUNCTION_GET_PAYLOAD_SIZE        11
+//
+// The payload for this function is SMM_VARIABLE_COMMUNICATE_RUNTIME_CACHE.
+// It returns the size of the buffer needed for the runtime variable cache.
+//
+#define SMM_VARIABLE_FUNCTION_GET_RUNTIME_CACHE_SIZE  12
+//
+// The payload for this function is SMM_VARIABLE_COMMUNICATE_RUNTIME_CACHE.
+// It hands the runtime variable cache buffer to the SMM variable module,
+// it is only accepted before EndOfDxe.
+//
+#define SMM_VARIABLE_FUNCTION_INIT_RUNTIME_CACHE      13
+//
+// It brings the runtime variable cache up to date after updates were deferred,
+// no extra payload for this function.
+//
+#define SMM_VARIABLE_FUNCTION_SYNC_RUNTIME_CACHE      14
+//
+// The payload for this function is SMM_VARIABLE_COMMUNICATE_SET_VARIABLE_BATCH.
+//
+#define SMM_VARIABLE_FUNCTION_SET_VARIABLE_BATCH      15
 
 ///
 /// Size of SMM communicate header, without including the payload.
@@ -126,4 +146,58 @@ typedef struct {
   UINTN                         VariablePayloadSize;
 } SMM_VARIABLE_COMMUNICATE_GET_PAYLOAD_SIZE;
 
+///
+/// This structure is used to communicate with SMI handler by SetVariableBatch.
+/// It is followed by EntryCount SMM_VARIABLE_COMMUNICATE_ACCESS_VARIABLE structures
+/// with their data, each one starting at a UINT64 aligned offset from the start of
+/// this structure.
+/// Unlike the payloads of the other functions, the payload of a batch is not limited
+/// to the variable payload size, but to MAX (variable payload size, PcdFlashNvStorageVariableSize),
+/// so that a batch can hold as much data as the non-volatile variable store.
+///
+typedef struct {
+  UINTN                         EntryCount;
+  UINTN                         FailedEntry;  // Return the entry that failed
+} SMM_VARIABLE_COMMUNICATE_SET_VARIABLE_BATCH;
+
+///
+/// This structure is used to communicate with SMI handler by GetRuntimeCacheSize and InitRuntimeCache.
+///
+typedef struct {
+  EFI_PHYSICAL_ADDRESS          CacheBase;
+  UINT64                        CacheSize;
+} SMM_VARIABLE_COMMUNICATE_RUNTIME_CACHE;
+
+///
+/// The number of variable stores in the runtime variable cache, in the order they are
+/// searched: volatile, HOB and non-volatile.
+///
+#define VARIABLE_RUNTIME_CACHE_STORE_COUNT  3
+
+///
+/// Header of the runtime variable cache. It is followed by copies of the variable stores
+/// that the SMM variable module updates after each change, so that the SMM variable
+/// wrapper module can read variables without triggering an SMI.
+///
+typedef struct {
+  ///
+  /// Set by the SMM variable wrapper module while it reads the cache.
+  /// The SMM variable module does not update the cache while it is set.
+  ///
+  BOOLEAN                       ReadLock;
+  ///
+  /// Set by the SMM variable module when it deferred an update because of ReadLock.
+  ///
+  BOOLEAN                       PendingUpdate;
+  UINT8                         Reserved[6];
+  ///
+  /// Offset of each variable store copy from the start of this header.
+  ///
+  UINT32                        StoreOffset[VARIABLE_RUNTIME_CACHE_STORE_COUNT];
+  ///
+  /// Size of each variable store copy, 0 if the variable store is not present.
+  ///
+  UINT32                        StoreSize[VARIABLE_RUNTIME_CACHE_STORE_COUNT];
+} VARIABLE_RUNTIME_CACHE_HEADER;
+
 #endif // _SMM_VARIABLE_COMMON_H_
@@ -22,8 +22,12 @@ WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
 #define EFI_AUTHENTICATED_VARIABLE_GUID \
   { 0xaaf32c78, 0x947b, 0x439a, { 0xa1, 0x80, 0x2e, 0x14, 0x4e, 0xc3, 0x77, 0x92 } }
 
+#define EDKII_GUID_DICTIONARY_VARIABLE_GUID \
+  { 0x7db616e2, 0xb0bd, 0x4b07, { 0x8d, 0xa2, 0x34, 0xcb, 0x7d, 0xbc, 0xf6, 0x71 } }
+
 extern EFI_GUID gEfiVariableGuid;
 extern EFI_GUID gEfiAuthenticatedVariableGuid;
+extern EFI_GUID gEdkiiGuidDictionaryVariableGuid;
 
 ///
 /// Alignment of variable name and data, according to the architecture:
@@ -65,6 +69,7 @@ typedef enum {
 
 #define VARIABLE_STORE_SIGNATURE  EFI_VARIABLE_GUID
 #define AUTHENTICATED_VARIABLE_STORE_SIGNATURE  EFI_AUTHENTICATED_VARIABLE_GUID
+#define GUID_DICTIONARY_VARIABLE_STORE_SIGNATURE  EDKII_GUID_DICTIONARY_VARIABLE_GUID
 
 ///
 /// Variable Store Header Format and State.
@@ -197,6 +202,35 @@ typedef struct {
   EFI_GUID    VendorGuid;
 } AUTHENTICATED_VARIABLE_HEADER;
 
+///
+/// A variable store with the GUID_DICTIONARY_VARIABLE_STORE_SIGNATURE signature holds
+/// authenticated variables without their VendorGuid field. The Reserved field of such
+/// a variable header is instead the index of its vendor GUID in a GUID dictionary.
+///
+#define GUID_DICTIONARY_VARIABLE_HEADER_SIZE  OFFSET_OF (AUTHENTICATED_VARIABLE_HEADER, VendorGuid)
+
+///
+/// Vendor GUID index that no GUID dictionary holds.
+///
+#define VARIABLE_GUID_INDEX_INVALID           0xFF
+
+///
+/// GUID dictionary, following the header of a variable store with the
+/// GUID_DICTIONARY_VARIABLE_STORE_SIGNATURE signature and followed by Capacity
+/// EFI_GUID slots. The slot of vendor GUID index Index is Index - FirstIndex.
+/// A slot that is all 0xFF is free, a slot is written only once.
+///
+/// The non-volatile variables only use the GUID dictionary of the non-volatile
+/// variable store. The dictionaries of the variable stores used together hold
+/// separate ranges of vendor GUID indexes, which all end before
+/// VARIABLE_GUID_INDEX_INVALID.
+///
+typedef struct {
+  UINT8       FirstIndex;
+  UINT8       Capacity;
+  UINT8       Reserved[6];
+} VARIABLE_GUID_DICTIONARY;
+
 typedef struct {
   EFI_GUID    *Guid;
   CHAR16      *Name;
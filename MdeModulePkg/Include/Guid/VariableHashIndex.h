@@ -0,0 +1,73 @@
+/** @file
+  The variable hash index is related to EDK II-specific implementation of UEFI variables.
+  The PEI variable module builds it in a GUID HOB over the non-volatile variable store,
+  so that a named lookup only walks the variables with the same hash.
+
+Copyright (c) 2015, Intel Corporation. All rights reserved.<BR>
+This program and the accompanying materials are licensed and made available under
+the terms and conditions of the BSD License that accompanies this distribution.
+The full text of the license may be found at
+http://opensource.org/licenses/bsd-license.php.
+
+THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+
+**/
+
+#ifndef __VARIABLE_HASH_INDEX_H__
+#define __VARIABLE_HASH_INDEX_H__
+
+#define EDKII_VARIABLE_HASH_INDEX_GUID \
+  { 0x482b7674, 0x7550, 0x487f, { 0x92, 0x6d, 0x27, 0x14, 0x9d, 0xbf, 0x3e, 0x52 } }
+
+extern EFI_GUID gEdkiiVariableHashIndexGuid;
+
+///
+/// The number of hash buckets, a power of 2.
+///
+/// The bucket of a variable is its hash modulo VARIABLE_HASH_INDEX_BUCKETS. The hash
+/// starts as the XOR of the four UINT32 of the vendor GUID; each CHAR16 of the name,
+/// up to its NULL terminator, is then folded in as Hash = (Hash ^ Char) * 0x01000193;
+/// the result is Hash ^ (Hash >> 16).
+///
+#define VARIABLE_HASH_INDEX_BUCKETS   32
+
+///
+/// The maximum number of variables indexed. The hash index is usually built before
+/// permanent memory is installed, so it is kept small like VARIABLE_INDEX_TABLE. A
+/// variable store with more variables is not indexed.
+///
+#define VARIABLE_HASH_INDEX_MAX_ENTRIES   128
+
+///
+/// Marks the end of a bucket.
+///
+#define VARIABLE_HASH_INDEX_END       MAX_UINT32
+
+typedef struct {
+  ///
+  /// Offset of the variable header from the variable store header.
+  ///
+  UINT32    Offset;
+  ///
+  /// Next entry in the same bucket, or VARIABLE_HASH_INDEX_END.
+  ///
+  UINT32    Next;
+} VARIABLE_HASH_INDEX_ENTRY;
+
+///
+/// The hash index of the VAR_ADDED and IN_DELETED_TRANSITION variables of a variable store.
+/// The entries of a bucket are linked in store order. The structure is followed by Count
+/// VARIABLE_HASH_INDEX_ENTRY.
+///
+typedef struct {
+  ///
+  /// Offset from the variable store header of the end of the last variable,
+  /// or 0 if the variable store could not be indexed.
+  ///
+  UINT32                    EndOffset;
+  UINT32                    Count;
+  UINT32                    Head[VARIABLE_HASH_INDEX_BUCKETS];
+} VARIABLE_HASH_INDEX;
+
+#endif // __VARIABLE_HASH_INDEX_H__
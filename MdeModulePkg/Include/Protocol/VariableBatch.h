@@ -0,0 +1,83 @@
+/** @file
+  Variable Batch Protocol is related to EDK II-specific implementation of variables
+  and intended for use as a means to update several non-volatile variables as one
+  transaction, so that either all or none of the updates reach the variable store.
+
+  Copyright (c) 2015, Intel Corporation. All rights reserved.<BR>
+  This program and the accompanying materials
+  are licensed and made available under the terms and conditions of the BSD License
+  which accompanies this distribution.  The full text of the license may be found at
+  http://opensource.org/licenses/bsd-license.php
+
+  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+
+**/
+
+#ifndef __VARIABLE_BATCH_H__
+#define __VARIABLE_BATCH_H__
+
+#define EDKII_VARIABLE_BATCH_PROTOCOL_GUID \
+  { \
+    0xa99ab3c9, 0xe4e6, 0x4c7f, { 0xa1, 0x4a, 0xb6, 0xe9, 0x85, 0x9d, 0x9c, 0x6a } \
+  }
+
+typedef struct _EDKII_VARIABLE_BATCH_PROTOCOL  EDKII_VARIABLE_BATCH_PROTOCOL;
+
+///
+/// One variable update of a batch. The fields have the same meaning as the
+/// parameters of the SetVariable() runtime service.
+///
+typedef struct {
+  CHAR16      *VariableName;
+  EFI_GUID    *VendorGuid;
+  UINT32      Attributes;
+  UINTN       DataSize;
+  VOID        *Data;
+} EDKII_VARIABLE_BATCH_ENTRY;
+
+/**
+  Update several variables as one transaction.
+
+  The entries are applied in order with the semantics of SetVariable(), so a later entry
+  sees the result of the earlier ones. The changes of the whole batch are committed to the
+  variable store with a single fault tolerant write; if any entry fails, none of the changes
+  of the batch are committed.
+
+  Only non-volatile variables that are not authenticated can be updated in a batch. All the
+  entries are checked before any of them is applied, and an entry that sets or deletes a
+  volatile variable, or an authenticated variable, fails the batch with EFI_INVALID_PARAMETER.
+
+  @param[in]  This          The EDKII_VARIABLE_BATCH_PROTOCOL instance.
+  @param[in]  EntryCount    The number of entries in Entries.
+  @param[in]  Entries       The variable updates to apply.
+  @param[out] FailedEntry   On error, the index of the entry that failed, or EntryCount
+                            if the batch failed as a whole. Optional.
+
+  @retval EFI_SUCCESS           All the updates were applied and committed.
+  @retval EFI_INVALID_PARAMETER EntryCount is 0 or Entries is NULL, or an entry is invalid
+                                or updates a volatile or an authenticated variable.
+  @retval EFI_BAD_BUFFER_SIZE   The batch is too large to be handled as one transaction.
+  @retval Others                The status of the entry that failed, or of the commit.
+**/
+typedef
+EFI_STATUS
+(EFIAPI * EDKII_VARIABLE_BATCH_PROTOCOL_SET_VARIABLES) (
+  IN CONST EDKII_VARIABLE_BATCH_PROTOCOL  *This,
+  IN       UINTN                          EntryCount,
+  IN       EDKII_VARIABLE_BATCH_ENTRY     *Entries,
+  OUT      UINTN                          *FailedEntry OPTIONAL
+  );
+
+///
+/// Variable Batch Protocol is related to EDK II-specific implementation of variables
+/// and intended for use as a means to update several non-volatile variables as one
+/// transaction.
+///
+struct _EDKII_VARIABLE_BATCH_PROTOCOL {
+  EDKII_VARIABLE_BATCH_PROTOCOL_SET_VARIABLES SetVariables;
+};
+
+extern EFI_GUID gEdkiiVariableBatchProtocolGuid;
+
+#endif
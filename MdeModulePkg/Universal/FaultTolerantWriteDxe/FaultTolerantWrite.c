@@ -178,6 +178,7 @@ FtwAllocate (
   @param Fvb             The FVB protocol that provides services for
                          reading, writing, and erasing the target block.
   @param BlockSize       The size of the block.
+  @param Restart         TRUE if the write is restarted, e.g. after a reset.
 
   @retval  EFI_SUCCESS          The function completed successfully
   @retval  EFI_ABORTED          The function could not complete successfully
@@ -187,7 +188,8 @@ EFI_STATUS
 FtwWriteRecord (
   IN EFI_FAULT_TOLERANT_WRITE_PROTOCOL     *This,
   IN EFI_FIRMWARE_VOLUME_BLOCK_PROTOCOL    *Fvb,
-  IN UINTN                                 BlockSize
+  IN UINTN                                 BlockSize,
+  IN BOOLEAN                               Restart
   )
 {
   EFI_STATUS                      Status;
@@ -238,7 +240,7 @@ FtwWriteRecord (
     // Update blocks other than working block or boot block
     //
     NumberOfWriteBlocks = FTW_BLOCKS ((UINTN) (Record->Offset + Record->Length), BlockSize);
-    Status = FlushSpareBlockToTargetBlock (FtwDevice, Fvb, Record->Lba, BlockSize, NumberOfWriteBlocks);
+    Status = FlushSpareBlockToTargetBlock (FtwDevice, Fvb, Record->Lba, BlockSize, NumberOfWriteBlocks, Restart);
   }
 
   if (EFI_ERROR (Status)) {
@@ -525,35 +527,12 @@ FtwWrite (
   // Write the memory buffer to spare block
   // Do not assume Spare Block and Target Block have same block size
   //
-  Status  = FtwEraseSpareBlock (FtwDevice);
+  Status  = FtwWriteSpareBlock (FtwDevice, MyBuffer, MyBufferSize);
   if (EFI_ERROR (Status)) {
     FreePool (MyBuffer);
     FreePool (SpareBuffer);
     return EFI_ABORTED;
   }
-  Ptr     = MyBuffer;
-  for (Index = 0; MyBufferSize > 0; Index += 1) {
-    if (MyBufferSize > FtwDevice->SpareBlockSize) {
-      MyLength = FtwDevice->SpareBlockSize;
-    } else {
-      MyLength = MyBufferSize;
-    }
-    Status = FtwDevice->FtwBackupFvb->Write (
-                                        FtwDevice->FtwBackupFvb,
-                                        FtwDevice->FtwSpareLba + Index,
-                                        0,
-                                        &MyLength,
-                                        Ptr
-                                        );
-    if (EFI_ERROR (Status)) {
-      FreePool (MyBuffer);
-      FreePool (SpareBuffer);
-      return EFI_ABORTED;
-    }
-
-    Ptr += MyLength;
-    MyBufferSize -= MyLength;
-  }
   //
   // Free MyBuffer
   //
@@ -581,7 +560,7 @@ FtwWrite (
   //  Since the content has already backuped in spare block, the write is
   //  guaranteed to be completed with fault tolerant manner.
   //
-  Status = FtwWriteRecord (This, Fvb, BlockSize);
+  Status = FtwWriteRecord (This, Fvb, BlockSize, FALSE);
   if (EFI_ERROR (Status)) {
     FreePool (SpareBuffer);
     return EFI_ABORTED;
@@ -589,28 +568,11 @@ FtwWrite (
   //
   // Restore spare backup buffer into spare block , if no failure happened during FtwWrite.
   //
-  Status  = FtwEraseSpareBlock (FtwDevice);
+  Status  = FtwWriteSpareBlock (FtwDevice, SpareBuffer, SpareBufferSize);
   if (EFI_ERROR (Status)) {
     FreePool (SpareBuffer);
     return EFI_ABORTED;
   }
-  Ptr     = SpareBuffer;
-  for (Index = 0; Index < FtwDevice->NumberOfSpareBlock; Index += 1) {
-    MyLength = FtwDevice->SpareBlockSize;
-    Status = FtwDevice->FtwBackupFvb->Write (
-                                        FtwDevice->FtwBackupFvb,
-                                        FtwDevice->FtwSpareLba + Index,
-                                        0,
-                                        &MyLength,
-                                        Ptr
-                                        );
-    if (EFI_ERROR (Status)) {
-      FreePool (SpareBuffer);
-      return EFI_ABORTED;
-    }
-
-    Ptr += MyLength;
-  }
   //
   // All success.
   //
@@ -706,7 +668,7 @@ FtwRestart (
   //  Since the content has already backuped in spare block, the write is
   //  guaranteed to be completed with fault tolerant manner.
   //
-  Status = FtwWriteRecord (This, Fvb, BlockSize);
+  Status = FtwWriteRecord (This, Fvb, BlockSize, TRUE);
   if (EFI_ERROR (Status)) {
     return EFI_ABORTED;
   }
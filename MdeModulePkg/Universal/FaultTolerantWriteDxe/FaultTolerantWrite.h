@@ -82,6 +82,7 @@ typedef struct {
   UINTN                                   FtwWorkSpaceSize;   // Size of working space range that stores write record.
   EFI_LBA                                 FtwWorkSpaceLbaInSpare; // Start LBA of working space in spare block.
   UINTN                                   FtwWorkSpaceBaseInSpare;// Offset into the FtwWorkSpaceLbaInSpare block.
+  BOOLEAN                                 SpareAreaWritten;   // The whole spare area was erased and written in this boot.
   UINT8                                   *FtwWorkSpace;      // Point to Work Space in memory buffer 
   //
   // Following a buffer of FtwWorkSpace[FTW_WORK_SPACE_SIZE],
@@ -299,6 +300,33 @@ FtwEraseSpareBlock (
   IN EFI_FTW_DEVICE   *FtwDevice
   );
 
+/**
+  Write a buffer to the start of the spare area, the rest of the spare area is left erased.
+
+  The first call in a boot erases and writes every spare block, since a block left by
+  an erase or a write interrupted in an earlier boot can read back as erased or as
+  expected while only being marginally programmed. Once the spare area has been
+  written in this boot, each spare block is read back first, a block that already
+  holds its new content is neither erased nor written, and a block that is already
+  erased is not erased again. This keeps the result the same as erasing the whole
+  spare area and then writing the buffer, with fewer erase cycles on the spare area.
+
+  @param FtwDevice       The private data of FTW driver
+  @param Buffer          The data to write to the spare area
+  @param BufferSize      The size of Buffer, must not be larger than the spare area
+
+  @retval  EFI_SUCCESS               Buffer is written to the spare area
+  @retval  EFI_OUT_OF_RESOURCES      Allocate memory error
+  @retval  EFI_ABORTED               The function could not complete successfully
+
+**/
+EFI_STATUS
+FtwWriteSpareBlock (
+  IN EFI_FTW_DEVICE   *FtwDevice,
+  IN UINT8            *Buffer,
+  IN UINTN            BufferSize
+  );
+
 /**
   Retrieve the proper FVB protocol interface by HANDLE.
 
@@ -362,6 +390,13 @@ IsBootBlock (
   @param Lba             Lba of the target block
   @param BlockSize       The size of the block
   @param NumberOfBlocks  The number of consecutive blocks starting with Lba
+  @param Restart         TRUE if the write is restarted, e.g. after a reset. Every target
+                         block is then erased and written, since an interrupted erase or
+                         write can leave a block that reads back as erased or as expected
+                         while only being marginally programmed. FALSE if the write is
+                         done right after its spare blocks were written, a target block
+                         that already holds its new content is then left alone, and one
+                         that is already erased is not erased again.
 
   @retval  EFI_SUCCESS               Spare block content is copied to target block
   @retval  EFI_INVALID_PARAMETER     Input parameter error
@@ -375,7 +410,8 @@ FlushSpareBlockToTargetBlock (
   EFI_FIRMWARE_VOLUME_BLOCK_PROTOCOL  *FvBlock,
   EFI_LBA                             Lba,
   UINTN                               BlockSize,
-  UINTN                               NumberOfBlocks
+  UINTN                               NumberOfBlocks,
+  BOOLEAN                             Restart
   );
 
 /**
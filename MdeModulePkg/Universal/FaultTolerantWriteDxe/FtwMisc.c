@@ -106,6 +106,114 @@ FtwEraseSpareBlock (
                                     );
 }
 
+/**
+  Write a buffer to the start of the spare area, the rest of the spare area is left erased.
+
+  The first call in a boot erases and writes every spare block, since a block left by
+  an erase or a write interrupted in an earlier boot can read back as erased or as
+  expected while only being marginally programmed. Once the spare area has been
+  written in this boot, each spare block is read back first, a block that already
+  holds its new content is neither erased nor written, and a block that is already
+  erased is not erased again. This keeps the result the same as erasing the whole
+  spare area and then writing the buffer, with fewer erase cycles on the spare area.
+
+  @param FtwDevice       The private data of FTW driver
+  @param Buffer          The data to write to the spare area
+  @param BufferSize      The size of Buffer, must not be larger than the spare area
+
+  @retval  EFI_SUCCESS               Buffer is written to the spare area
+  @retval  EFI_OUT_OF_RESOURCES      Allocate memory error
+  @retval  EFI_ABORTED               The function could not complete successfully
+
+**/
+EFI_STATUS
+FtwWriteSpareBlock (
+  IN EFI_FTW_DEVICE   *FtwDevice,
+  IN UINT8            *Buffer,
+  IN UINTN            BufferSize
+  )
+{
+  EFI_STATUS  Status;
+  UINT8       *Block;
+  UINTN       Index;
+  UINTN       Offset;
+  UINTN       Length;
+  UINTN       Count;
+  BOOLEAN     Verified;
+
+  ASSERT (BufferSize <= FtwDevice->SpareAreaLength);
+
+  Block = AllocatePool (FtwDevice->SpareBlockSize);
+  if (Block == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  //
+  // Spare content left by an earlier boot is not trusted, the spare area is only
+  // read back once it has been erased and written in this boot.
+  //
+  Verified = FtwDevice->SpareAreaWritten;
+  FtwDevice->SpareAreaWritten = FALSE;
+
+  Status = EFI_SUCCESS;
+  for (Index = 0, Offset = 0; Index < FtwDevice->NumberOfSpareBlock; Index += 1, Offset += FtwDevice->SpareBlockSize) {
+    //
+    // The part of the block covered by Buffer, the rest must end up erased.
+    //
+    Length = 0;
+    if (Offset < BufferSize) {
+      Length = MIN (FtwDevice->SpareBlockSize, BufferSize - Offset);
+    }
+
+    if (Verified) {
+      Count  = FtwDevice->SpareBlockSize;
+      Status = FtwDevice->FtwBackupFvb->Read (
+                                          FtwDevice->FtwBackupFvb,
+                                          FtwDevice->FtwSpareLba + Index,
+                                          0,
+                                          &Count,
+                                          Block
+                                          );
+      if (EFI_ERROR (Status)) {
+        break;
+      }
+
+      if ((CompareMem (Block, Buffer + Offset, Length) == 0) &&
+          IsErasedFlashBuffer (Block + Length, FtwDevice->SpareBlockSize - Length)) {
+        continue;
+      }
+    }
+
+    if (!Verified || !IsErasedFlashBuffer (Block, FtwDevice->SpareBlockSize)) {
+      Status = FtwEraseBlock (FtwDevice, FtwDevice->FtwBackupFvb, FtwDevice->FtwSpareLba + Index, 1);
+      if (EFI_ERROR (Status)) {
+        break;
+      }
+    }
+
+    if ((Length != 0) && !IsErasedFlashBuffer (Buffer + Offset, Length)) {
+      Count  = Length;
+      Status = FtwDevice->FtwBackupFvb->Write (
+                                          FtwDevice->FtwBackupFvb,
+                                          FtwDevice->FtwSpareLba + Index,
+                                          0,
+                                          &Count,
+                                          Buffer + Offset
+                                          );
+      if (EFI_ERROR (Status)) {
+        break;
+      }
+    }
+  }
+
+  FreePool (Block);
+  if (EFI_ERROR (Status)) {
+    return EFI_ABORTED;
+  }
+  FtwDevice->SpareAreaWritten = TRUE;
+  return EFI_SUCCESS;
+}
+
 /**
 
   Is it in working block?
@@ -462,6 +570,13 @@ FlushSpareBlockToBootBlock (
   @param Lba             Lba of the target block
   @param BlockSize       The size of the block
   @param NumberOfBlocks  The number of consecutive blocks starting with Lba
+  @param Restart         TRUE if the write is restarted, e.g. after a reset. Every target
+                         block is then erased and written, since an interrupted erase or
+                         write can leave a block that reads back as erased or as expected
+                         while only being marginally programmed. FALSE if the write is
+                         done right after its spare blocks were written, a target block
+                         that already holds its new content is then left alone, and one
+                         that is already erased is not erased again.
 
   @retval  EFI_SUCCESS               Spare block content is copied to target block
   @retval  EFI_INVALID_PARAMETER     Input parameter error
@@ -475,12 +590,14 @@ FlushSpareBlockToTargetBlock (
   EFI_FIRMWARE_VOLUME_BLOCK_PROTOCOL  *FvBlock,
   EFI_LBA                             Lba,
   UINTN                               BlockSize,
-  UINTN                               NumberOfBlocks
+  UINTN                               NumberOfBlocks,
+  BOOLEAN                             Restart
   )
 {
   EFI_STATUS  Status;
   UINTN       Length;
   UINT8       *Buffer;
+  UINT8       *TargetBuffer;
   UINTN       Count;
   UINT8       *Ptr;
   UINTN       Index;
@@ -496,6 +613,11 @@ FlushSpareBlockToTargetBlock (
   if (Buffer == NULL) {
     return EFI_OUT_OF_RESOURCES;
   }
+  TargetBuffer = AllocatePool (BlockSize);
+  if (TargetBuffer == NULL) {
+    FreePool (Buffer);
+    return EFI_OUT_OF_RESOURCES;
+  }
   //
   // Read all content of spare block to memory buffer
   //
@@ -511,36 +633,55 @@ FlushSpareBlockToTargetBlock (
                                         );
     if (EFI_ERROR (Status)) {
       FreePool (Buffer);
+      FreePool (TargetBuffer);
       return Status;
     }
 
     Ptr += Count;
   }
   //
-  // Erase the target block
-  //
-  Status = FtwEraseBlock (FtwDevice, FvBlock, Lba, NumberOfBlocks);
-  if (EFI_ERROR (Status)) {
-    FreePool (Buffer);
-    return EFI_ABORTED;
-  }
-  //
-  // Write memory buffer to block, using the FvBlock protocol interface
+  // Write memory buffer to block, using the FvBlock protocol interface.
+  // Unless the write is restarted, a target block that already holds the content
+  // of the spare block is left alone, and one that is already erased is not
+  // erased again.
   //
   Ptr = Buffer;
-  for (Index = 0; Index < NumberOfBlocks; Index += 1) {
+  for (Index = 0; Index < NumberOfBlocks; Index += 1, Ptr += BlockSize) {
+    if (!Restart) {
+      Count   = BlockSize;
+      Status  = FvBlock->Read (FvBlock, Lba + Index, 0, &Count, TargetBuffer);
+      if (EFI_ERROR (Status)) {
+        FreePool (Buffer);
+        FreePool (TargetBuffer);
+        return EFI_ABORTED;
+      }
+
+      if (CompareMem (TargetBuffer, Ptr, BlockSize) == 0) {
+        continue;
+      }
+    }
+
+    if (Restart || !IsErasedFlashBuffer (TargetBuffer, BlockSize)) {
+      Status = FtwEraseBlock (FtwDevice, FvBlock, Lba + Index, 1);
+      if (EFI_ERROR (Status)) {
+        FreePool (Buffer);
+        FreePool (TargetBuffer);
+        return EFI_ABORTED;
+      }
+    }
+
     Count   = BlockSize;
     Status  = FvBlock->Write (FvBlock, Lba + Index, 0, &Count, Ptr);
     if (EFI_ERROR (Status)) {
       DEBUG ((EFI_D_ERROR, "Ftw: FVB Write block - %r\n", Status));
       FreePool (Buffer);
+      FreePool (TargetBuffer);
       return Status;
     }
-
-    Ptr += Count;
   }
 
   FreePool (Buffer);
+  FreePool (TargetBuffer);
 
   return Status;
 }
@@ -509,35 +509,12 @@ FtwReclaimWorkSpace (
   //
   // Write the memory buffer to spare block
   //
-  Status  = FtwEraseSpareBlock (FtwDevice);
+  Status  = FtwWriteSpareBlock (FtwDevice, TempBuffer, TempBufferSize);
   if (EFI_ERROR (Status)) {
     FreePool (TempBuffer);
     FreePool (SpareBuffer);
     return EFI_ABORTED;
   }
-  Ptr     = TempBuffer;
-  for (Index = 0; TempBufferSize > 0; Index += 1) {
-    if (TempBufferSize > FtwDevice->SpareBlockSize) {
-      Length = FtwDevice->SpareBlockSize;
-    } else {
-      Length = TempBufferSize;
-    }
-    Status = FtwDevice->FtwBackupFvb->Write (
-                                            FtwDevice->FtwBackupFvb,
-                                            FtwDevice->FtwSpareLba + Index,
-                                            0,
-                                            &Length,
-                                            Ptr
-                                            );
-    if (EFI_ERROR (Status)) {
-      FreePool (TempBuffer);
-      FreePool (SpareBuffer);
-      return EFI_ABORTED;
-    }
-
-    Ptr += Length;
-    TempBufferSize -= Length;
-  }
   //
   // Free TempBuffer
   //
@@ -588,28 +565,11 @@ FtwReclaimWorkSpace (
   //
   // Restore spare backup buffer into spare block , if no failure happened during FtwWrite.
   //
-  Status  = FtwEraseSpareBlock (FtwDevice);
+  Status  = FtwWriteSpareBlock (FtwDevice, SpareBuffer, SpareBufferSize);
   if (EFI_ERROR (Status)) {
     FreePool (SpareBuffer);
     return EFI_ABORTED;
   }
-  Ptr     = SpareBuffer;
-  for (Index = 0; Index < FtwDevice->NumberOfSpareBlock; Index += 1) {
-    Length = FtwDevice->SpareBlockSize;
-    Status = FtwDevice->FtwBackupFvb->Write (
-                                        FtwDevice->FtwBackupFvb,
-                                        FtwDevice->FtwSpareLba + Index,
-                                        0,
-                                        &Length,
-                                        Ptr
-                                        );
-    if (EFI_ERROR (Status)) {
-      FreePool (SpareBuffer);
-      return EFI_ABORTED;
-    }
-
-    Ptr += Length;
-  }
 
   FreePool (SpareBuffer);
 
@@ -32,6 +32,8 @@ UINT32         mDxeGuidTableSize;
 BOOLEAN        mPeiExMapTableEmpty; 
 BOOLEAN        mDxeExMapTableEmpty; 
 BOOLEAN        mPeiDatabaseEmpty;
+BOOLEAN        mPeiExMapSorted;
+BOOLEAN        mDxeExMapSorted;
 
 LIST_ENTRY    *mCallbackFnTable;
 EFI_GUID     **TmpTokenSpaceBuffer;
@@ -854,6 +856,15 @@ BuildPcdDxeDataBase (
   mDxeExMapTableEmpty     = (mPcdDatabase.DxeDb->ExTokenCount == 0) ? TRUE : FALSE;
   mPeiDatabaseEmpty       = (mPeiLocalTokenCount == 0) ? TRUE : FALSE;
 
+  mPeiExMapSorted         = IsExMapSorted (
+                              (DYNAMICEX_MAPPING *)((UINT8 *)mPcdDatabase.PeiDb + mPcdDatabase.PeiDb->ExMapTableOffset),
+                              mPcdDatabase.PeiDb->ExTokenCount
+                              );
+  mDxeExMapSorted         = IsExMapSorted (
+                              (DYNAMICEX_MAPPING *)((UINT8 *)mPcdDatabase.DxeDb + mPcdDatabase.DxeDb->ExMapTableOffset),
+                              mPcdDatabase.DxeDb->ExTokenCount
+                              );
+
   TmpTokenSpaceBufferCount = mPcdDatabase.PeiDb->ExTokenCount + mPcdDatabase.DxeDb->ExTokenCount;
   TmpTokenSpaceBuffer     = (EFI_GUID **)AllocateZeroPool(TmpTokenSpaceBufferCount * sizeof (EFI_GUID *));
 
@@ -960,9 +971,9 @@ GetSkuEnabledTokenNumber (
   SKU_HEAD              *SkuHead;
   SKU_ID                *SkuIdTable;
   UINTN                 Index;
+  UINTN                 DefaultIndex;
   UINT8                 *Value;
   UINT8                 *PcdDb;
-  BOOLEAN               FoundSku;
 
   ASSERT ((LocalTokenNumber & PCD_TYPE_SKU_ENABLED) == 0);
 
@@ -973,27 +984,21 @@ GetSkuEnabledTokenNumber (
 
   SkuIdTable =  (SKU_ID *)(PcdDb + SkuHead->SkuIdTableOffset);
   //
-  // Find the current system's SKU ID entry in SKU ID table.
+  // Find the current system's SKU ID entry in SKU ID table, and the default
+  // SKU ID entry in the same pass in case the system's SKU ID is not there.
   //
-  FoundSku = FALSE;
+  DefaultIndex = (UINTN) SkuIdTable[0];
   for (Index = 0; Index < SkuIdTable[0]; Index++) {
     if (mPcdDatabase.DxeDb->SystemSkuId == SkuIdTable[Index + 1]) {
-      FoundSku = TRUE;
       break;
     }
-  }
-  
-  //
-  // Find the default SKU ID entry in SKU ID table.
-  //
-  
-  if(!FoundSku) {
-    for (Index = 0; Index < SkuIdTable[0]; Index++) {
-      if (0 == SkuIdTable[Index + 1]) {
-        break;
-      }
+    if ((0 == SkuIdTable[Index + 1]) && (DefaultIndex == SkuIdTable[0])) {
+      DefaultIndex = Index;
     }
   }
+  if (Index == SkuIdTable[0]) {
+    Index = DefaultIndex;
+  }
   ASSERT (Index < SkuIdTable[0]);
 
   switch (LocalTokenNumber & PCD_TYPE_ALL_SET) {
@@ -1591,11 +1596,11 @@ GetExPcdTokenNumber (
   IN UINT32                     ExTokenNumber
   )
 {
-  UINT32              Index;
   DYNAMICEX_MAPPING   *ExMap;
   EFI_GUID            *GuidTable;
   EFI_GUID            *MatchGuid;
   UINTN               MatchGuidIdx;
+  UINTN               TokenNumber;
 
   if (!mPeiDatabaseEmpty) {
     ExMap       = (DYNAMICEX_MAPPING *)((UINT8 *)mPcdDatabase.PeiDb + mPcdDatabase.PeiDb->ExMapTableOffset);
@@ -1607,11 +1612,9 @@ GetExPcdTokenNumber (
 
       MatchGuidIdx = MatchGuid - GuidTable;
 
-      for (Index = 0; Index < mPcdDatabase.PeiDb->ExTokenCount; Index++) {
-        if ((ExTokenNumber == ExMap[Index].ExTokenNumber) &&
-            (MatchGuidIdx == ExMap[Index].ExGuidIndex)) {
-            return ExMap[Index].TokenNumber;
-        }
+      TokenNumber = FindExMapTokenNumber (ExMap, mPcdDatabase.PeiDb->ExTokenCount, mPeiExMapSorted, MatchGuidIdx, ExTokenNumber);
+      if (TokenNumber != PCD_INVALID_TOKEN_NUMBER) {
+        return TokenNumber;
       }
     }
   }
@@ -1628,16 +1631,99 @@ GetExPcdTokenNumber (
 
   MatchGuidIdx = MatchGuid - GuidTable;
 
-  for (Index = 0; Index < mPcdDatabase.DxeDb->ExTokenCount; Index++) {
-    if ((ExTokenNumber == ExMap[Index].ExTokenNumber) &&
-         (MatchGuidIdx == ExMap[Index].ExGuidIndex)) {
+  TokenNumber = FindExMapTokenNumber (ExMap, mPcdDatabase.DxeDb->ExTokenCount, mDxeExMapSorted, MatchGuidIdx, ExTokenNumber);
+  ASSERT (TokenNumber != PCD_INVALID_TOKEN_NUMBER);
+
+  return TokenNumber;
+}
+
+/**
+  Look up the Token Number of a dynamic-ex PCD in an ExMap table.
+
+  The build tool sorts the ExMap table by {ExGuidIndex, ExTokenNumber}, so that
+  it can be binary searched. A table that is not sorted has to be scanned.
+
+  @param ExMap           DynamicEx token number mapping table.
+  @param ExMapCount      The number of entries in ExMap.
+  @param Sorted          If TRUE, ExMap is sorted by {ExGuidIndex, ExTokenNumber}.
+  @param GuidTableIdx    Index of the token space guid in the GUID table.
+  @param ExTokenNumber   Dynamic-ex PCD token number.
+
+  @return Token Number for dynamic-ex PCD, or PCD_INVALID_TOKEN_NUMBER if it is not in ExMap.
+
+**/
+UINTN
+FindExMapTokenNumber (
+  IN DYNAMICEX_MAPPING          *ExMap,
+  IN UINTN                      ExMapCount,
+  IN BOOLEAN                    Sorted,
+  IN UINTN                      GuidTableIdx,
+  IN UINTN                      ExTokenNumber
+  )
+{
+  UINTN               Index;
+  UINTN               Low;
+  UINTN               High;
+
+  if (!Sorted) {
+    for (Index = 0; Index < ExMapCount; Index++) {
+      if ((ExTokenNumber == ExMap[Index].ExTokenNumber) &&
+          (GuidTableIdx == ExMap[Index].ExGuidIndex)) {
         return ExMap[Index].TokenNumber;
+      }
     }
+    return PCD_INVALID_TOKEN_NUMBER;
   }
 
-  ASSERT (FALSE);
+  //
+  // Find the first entry that is not less than {GuidTableIdx, ExTokenNumber}.
+  //
+  Low  = 0;
+  High = ExMapCount;
+  while (Low < High) {
+    Index = (Low + High) / 2;
+    if ((ExMap[Index].ExGuidIndex < GuidTableIdx) ||
+        ((ExMap[Index].ExGuidIndex == GuidTableIdx) && (ExMap[Index].ExTokenNumber < ExTokenNumber))) {
+      Low = Index + 1;
+    } else {
+      High = Index;
+    }
+  }
 
-  return 0;
+  if ((Low < ExMapCount) &&
+      (ExTokenNumber == ExMap[Low].ExTokenNumber) &&
+      (GuidTableIdx == ExMap[Low].ExGuidIndex)) {
+    return ExMap[Low].TokenNumber;
+  }
+  return PCD_INVALID_TOKEN_NUMBER;
+}
+
+/**
+  Check whether an ExMap table is sorted by {ExGuidIndex, ExTokenNumber}.
+
+  @param ExMap           DynamicEx token number mapping table.
+  @param ExMapCount      The number of entries in ExMap.
+
+  @retval TRUE           ExMap is sorted.
+  @retval FALSE          ExMap is not sorted.
+
+**/
+BOOLEAN
+IsExMapSorted (
+  IN DYNAMICEX_MAPPING          *ExMap,
+  IN UINTN                      ExMapCount
+  )
+{
+  UINTN               Index;
+
+  for (Index = 1; Index < ExMapCount; Index++) {
+    if ((ExMap[Index - 1].ExGuidIndex > ExMap[Index].ExGuidIndex) ||
+        ((ExMap[Index - 1].ExGuidIndex == ExMap[Index].ExGuidIndex) &&
+         (ExMap[Index - 1].ExTokenNumber >= ExMap[Index].ExTokenNumber))) {
+      return FALSE;
+    }
+  }
+  return TRUE;
 }
 
 /**
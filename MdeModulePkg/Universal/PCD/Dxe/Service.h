@@ -1096,6 +1096,46 @@ GetExPcdTokenNumber (
   IN UINT32                     ExTokenNumber
   );
 
+/**
+  Look up the Token Number of a dynamic-ex PCD in an ExMap table.
+
+  The build tool sorts the ExMap table by {ExGuidIndex, ExTokenNumber}, so that
+  it can be binary searched. A table that is not sorted has to be scanned.
+
+  @param ExMap           DynamicEx token number mapping table.
+  @param ExMapCount      The number of entries in ExMap.
+  @param Sorted          If TRUE, ExMap is sorted by {ExGuidIndex, ExTokenNumber}.
+  @param GuidTableIdx    Index of the token space guid in the GUID table.
+  @param ExTokenNumber   Dynamic-ex PCD token number.
+
+  @return Token Number for dynamic-ex PCD, or PCD_INVALID_TOKEN_NUMBER if it is not in ExMap.
+
+**/
+UINTN
+FindExMapTokenNumber (
+  IN DYNAMICEX_MAPPING          *ExMap,
+  IN UINTN                      ExMapCount,
+  IN BOOLEAN                    Sorted,
+  IN UINTN                      GuidTableIdx,
+  IN UINTN                      ExTokenNumber
+  );
+
+/**
+  Check whether an ExMap table is sorted by {ExGuidIndex, ExTokenNumber}.
+
+  @param ExMap           DynamicEx token number mapping table.
+  @param ExMapCount      The number of entries in ExMap.
+
+  @retval TRUE           ExMap is sorted.
+  @retval FALSE          ExMap is not sorted.
+
+**/
+BOOLEAN
+IsExMapSorted (
+  IN DYNAMICEX_MAPPING          *ExMap,
+  IN UINTN                      ExMapCount
+  );
+
 /**
   Get next token number in given token space.
   
@@ -1192,6 +1232,8 @@ extern  UINT32         mDxeGuidTableSize;
 extern  BOOLEAN        mPeiExMapTableEmpty; 
 extern  BOOLEAN        mDxeExMapTableEmpty; 
 extern  BOOLEAN        mPeiDatabaseEmpty;
+extern  BOOLEAN        mPeiExMapSorted;
+extern  BOOLEAN        mDxeExMapSorted;
 
 extern  EFI_GUID     **TmpTokenSpaceBuffer;
 extern  UINTN          TmpTokenSpaceBufferCount;
@@ -551,8 +551,8 @@ GetSkuEnabledTokenNumber (
   SKU_HEAD              *SkuHead;
   SKU_ID                *SkuIdTable;
   UINTN                 Index;
+  UINTN                 DefaultIndex;
   UINT8                 *Value;
-  BOOLEAN               FoundSku;
 
   PeiPcdDb = GetPcdDatabase ();
 
@@ -563,26 +563,21 @@ GetSkuEnabledTokenNumber (
   SkuIdTable  = (SKU_ID *) ((UINT8 *)PeiPcdDb + (SkuHead->SkuIdTableOffset));
 
   //
-  // Find the current system's SKU ID entry in SKU ID table.
+  // Find the current system's SKU ID entry in SKU ID table, and the default
+  // SKU ID entry in the same pass in case the system's SKU ID is not there.
   //
-  FoundSku = FALSE;
+  DefaultIndex = (UINTN) SkuIdTable[0];
   for (Index = 0; Index < SkuIdTable[0]; Index++) {
     if (PeiPcdDb->SystemSkuId == SkuIdTable[Index + 1]) {
-      FoundSku = TRUE;
       break;
     }
-  }
-
-  //
-  // Find the default SKU ID entry in SKU ID table.
-  //
-  if(!FoundSku) {
-    for (Index = 0; Index < SkuIdTable[0]; Index++) {
-      if (0 == SkuIdTable[Index + 1]) {
-        break;
-      }
+    if ((0 == SkuIdTable[Index + 1]) && (DefaultIndex == SkuIdTable[0])) {
+      DefaultIndex = Index;
     }
   }
+  if (Index == SkuIdTable[0]) {
+    Index = DefaultIndex;
+  }
   ASSERT (Index < SkuIdTable[0]);
 
   switch (LocalTokenNumber & PCD_TYPE_ALL_SET) {
@@ -1067,11 +1062,11 @@ GetExPcdTokenNumber (
   IN UINTN                      ExTokenNumber
   )
 {
-  UINT32              Index;
   DYNAMICEX_MAPPING   *ExMap;
   EFI_GUID            *GuidTable;
   EFI_GUID            *MatchGuid;
   UINTN               MatchGuidIdx;
+  UINTN               TokenNumber;
   PEI_PCD_DATABASE    *PeiPcdDb;
 
   PeiPcdDb    = GetPcdDatabase();
@@ -1087,14 +1082,76 @@ GetExPcdTokenNumber (
   ASSERT (MatchGuid != NULL);
   
   MatchGuidIdx = MatchGuid - GuidTable;
-  
-  for (Index = 0; Index < PeiPcdDb->ExTokenCount; Index++) {
-    if ((ExTokenNumber == ExMap[Index].ExTokenNumber) && 
-        (MatchGuidIdx == ExMap[Index].ExGuidIndex)) {
-      return ExMap[Index].TokenNumber;
+
+  TokenNumber = FindExMapTokenNumber (ExMap, PeiPcdDb->ExTokenCount, TRUE, MatchGuidIdx, ExTokenNumber);
+  if (TokenNumber == PCD_INVALID_TOKEN_NUMBER) {
+    //
+    // The ExMap table of a PCD database built by an older tool may not be sorted.
+    //
+    TokenNumber = FindExMapTokenNumber (ExMap, PeiPcdDb->ExTokenCount, FALSE, MatchGuidIdx, ExTokenNumber);
+  }
+
+  return TokenNumber;
+}
+
+/**
+  Look up the Token Number of a dynamic-ex PCD in an ExMap table.
+
+  The build tool sorts the ExMap table by {ExGuidIndex, ExTokenNumber}, so that
+  it can be binary searched. A table that is not sorted has to be scanned.
+
+  @param ExMap           DynamicEx token number mapping table.
+  @param ExMapCount      The number of entries in ExMap.
+  @param Sorted          If TRUE, ExMap is sorted by {ExGuidIndex, ExTokenNumber}.
+  @param GuidTableIdx    Index of the token space guid in the GUID table.
+  @param ExTokenNumber   Dynamic-ex PCD token number.
+
+  @return Token Number for dynamic-ex PCD, or PCD_INVALID_TOKEN_NUMBER if it is not in ExMap.
+
+**/
+UINTN
+FindExMapTokenNumber (
+  IN DYNAMICEX_MAPPING          *ExMap,
+  IN UINTN                      ExMapCount,
+  IN BOOLEAN                    Sorted,
+  IN UINTN                      GuidTableIdx,
+  IN UINTN                      ExTokenNumber
+  )
+{
+  UINTN               Index;
+  UINTN               Low;
+  UINTN               High;
+
+  if (!Sorted) {
+    for (Index = 0; Index < ExMapCount; Index++) {
+      if ((ExTokenNumber == ExMap[Index].ExTokenNumber) &&
+          (GuidTableIdx == ExMap[Index].ExGuidIndex)) {
+        return ExMap[Index].TokenNumber;
+      }
     }
+    return PCD_INVALID_TOKEN_NUMBER;
+  }
+
+  //
+  // Find the first entry that is not less than {GuidTableIdx, ExTokenNumber}.
+  //
+  Low  = 0;
+  High = ExMapCount;
+  while (Low < High) {
+    Index = (Low + High) / 2;
+    if ((ExMap[Index].ExGuidIndex < GuidTableIdx) ||
+        ((ExMap[Index].ExGuidIndex == GuidTableIdx) && (ExMap[Index].ExTokenNumber < ExTokenNumber))) {
+      Low = Index + 1;
+    } else {
+      High = Index;
+    }
+  }
+
+  if ((Low < ExMapCount) &&
+      (ExTokenNumber == ExMap[Low].ExTokenNumber) &&
+      (GuidTableIdx == ExMap[Low].ExGuidIndex)) {
+    return ExMap[Low].TokenNumber;
   }
-  
   return PCD_INVALID_TOKEN_NUMBER;
 }
 
@@ -992,6 +992,30 @@ GetExPcdTokenNumber (
   IN UINTN                      ExTokenNumber
   );
 
+/**
+  Look up the Token Number of a dynamic-ex PCD in an ExMap table.
+
+  The build tool sorts the ExMap table by {ExGuidIndex, ExTokenNumber}, so that
+  it can be binary searched. A table that is not sorted has to be scanned.
+
+  @param ExMap           DynamicEx token number mapping table.
+  @param ExMapCount      The number of entries in ExMap.
+  @param Sorted          If TRUE, ExMap is sorted by {ExGuidIndex, ExTokenNumber}.
+  @param GuidTableIdx    Index of the token space guid in the GUID table.
+  @param ExTokenNumber   Dynamic-ex PCD token number.
+
+  @return Token Number for dynamic-ex PCD, or PCD_INVALID_TOKEN_NUMBER if it is not in ExMap.
+
+**/
+UINTN
+FindExMapTokenNumber (
+  IN DYNAMICEX_MAPPING          *ExMap,
+  IN UINTN                      ExMapCount,
+  IN BOOLEAN                    Sorted,
+  IN UINTN                      GuidTableIdx,
+  IN UINTN                      ExTokenNumber
+  );
+
 /**
   Find the local token number according to system SKU ID.
 
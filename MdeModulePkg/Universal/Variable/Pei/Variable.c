@@ -65,6 +65,16 @@ GetStartPointer (
   IN VARIABLE_STORE_HEADER       *VarStoreHeader
   )
 {
+  VARIABLE_GUID_DICTIONARY       *GuidDictionary;
+
+  //
+  // The variables follow the GUID dictionary if there is one.
+  //
+  if (CompareGuid (&VarStoreHeader->Signature, &gEdkiiGuidDictionaryVariableGuid)) {
+    GuidDictionary = (VARIABLE_GUID_DICTIONARY *) (VarStoreHeader + 1);
+    return (VARIABLE_HEADER *) HEADER_ALIGN ((EFI_GUID *) (GuidDictionary + 1) + GuidDictionary->Capacity);
+  }
+
   //
   // The end of variable store
   //
@@ -116,19 +126,21 @@ IsValidVariableHeader (
 /**
   This code gets the size of variable header.
 
-  @param AuthFlag   Authenticated variable flag.
+  @param StoreInfo  Pointer to variable store info structure.
 
   @return Size of variable header in bytes in type UINTN.
 
 **/
 UINTN
 GetVariableHeaderSize (
-  IN  BOOLEAN       AuthFlag
+  IN  VARIABLE_STORE_INFO   *StoreInfo
   )
 {
   UINTN Value;
 
-  if (AuthFlag) {
+  if (StoreInfo->GuidDictionary != NULL) {
+    Value = GUID_DICTIONARY_VARIABLE_HEADER_SIZE;
+  } else if (StoreInfo->AuthFlag) {
     Value = sizeof (AUTHENTICATED_VARIABLE_HEADER);
   } else {
     Value = sizeof (VARIABLE_HEADER);
@@ -216,39 +228,53 @@ DataSizeOfVariable (
   This code gets the pointer to the variable name.
 
   @param   Variable  Pointer to the Variable Header.
-  @param   AuthFlag  Authenticated variable flag.
+  @param   StoreInfo Pointer to variable store info structure.
 
   @return  A CHAR16* pointer to Variable Name.
 
 **/
 CHAR16 *
 GetVariableNamePtr (
-  IN VARIABLE_HEADER    *Variable,
-  IN BOOLEAN            AuthFlag
+  IN VARIABLE_HEADER        *Variable,
+  IN VARIABLE_STORE_INFO    *StoreInfo
   )
 {
-  return (CHAR16 *) ((UINTN) Variable + GetVariableHeaderSize (AuthFlag));
+  return (CHAR16 *) ((UINTN) Variable + GetVariableHeaderSize (StoreInfo));
 }
 
 /**
   This code gets the pointer to the variable guid.
 
+  In the GUID dictionary format, the vendor GUID index of the variable is
+  looked up in the GUID dictionary of the variable store.
+
   @param Variable   Pointer to the Variable Header.
-  @param AuthFlag   Authenticated variable flag.
+  @param StoreInfo  Pointer to variable store info structure.
 
   @return A EFI_GUID* pointer to Vendor Guid.
 
 **/
 EFI_GUID *
 GetVendorGuidPtr (
-  IN VARIABLE_HEADER    *Variable,
-  IN BOOLEAN            AuthFlag
+  IN VARIABLE_HEADER        *Variable,
+  IN VARIABLE_STORE_INFO    *StoreInfo
   )
 {
   AUTHENTICATED_VARIABLE_HEADER *AuthVariable;
+  VARIABLE_GUID_DICTIONARY      *GuidDictionary;
 
   AuthVariable = (AUTHENTICATED_VARIABLE_HEADER *) Variable;
-  if (AuthFlag) {
+  GuidDictionary = StoreInfo->GuidDictionary;
+  if (GuidDictionary != NULL) {
+    if ((AuthVariable->Reserved >= GuidDictionary->FirstIndex) &&
+        (AuthVariable->Reserved - GuidDictionary->FirstIndex < GuidDictionary->Capacity)) {
+      return (EFI_GUID *) (GuidDictionary + 1) + (AuthVariable->Reserved - GuidDictionary->FirstIndex);
+    }
+    //
+    // The variable header is corrupted.
+    //
+    return &gZeroGuid;
+  } else if (StoreInfo->AuthFlag) {
     return &AuthVariable->VendorGuid;
   } else {
     return &Variable->VendorGuid;
@@ -260,16 +286,16 @@ GetVendorGuidPtr (
 
   @param   Variable         Pointer to the Variable Header.
   @param   VariableHeader   Pointer to the Variable Header that has consecutive content.
-  @param   AuthFlag         Authenticated variable flag.
+  @param   StoreInfo        Pointer to variable store info structure.
 
   @return  A UINT8* pointer to Variable Data.
 
 **/
 UINT8 *
 GetVariableDataPtr (
-  IN  VARIABLE_HEADER   *Variable,
-  IN  VARIABLE_HEADER   *VariableHeader,
-  IN  BOOLEAN           AuthFlag
+  IN  VARIABLE_HEADER       *Variable,
+  IN  VARIABLE_HEADER       *VariableHeader,
+  IN  VARIABLE_STORE_INFO   *StoreInfo
   )
 {
   UINTN Value;
@@ -277,9 +303,9 @@ GetVariableDataPtr (
   //
   // Be careful about pad size for alignment
   //
-  Value =  (UINTN) GetVariableNamePtr (Variable, AuthFlag);
-  Value += NameSizeOfVariable (VariableHeader, AuthFlag);
-  Value += GET_PAD_SIZE (NameSizeOfVariable (VariableHeader, AuthFlag));
+  Value =  (UINTN) GetVariableNamePtr (Variable, StoreInfo);
+  Value += NameSizeOfVariable (VariableHeader, StoreInfo->AuthFlag);
+  Value += GET_PAD_SIZE (NameSizeOfVariable (VariableHeader, StoreInfo->AuthFlag));
 
   return (UINT8 *) Value;
 }
@@ -306,7 +332,7 @@ GetNextVariablePtr (
   EFI_PHYSICAL_ADDRESS  SpareAddress;
   UINTN                 Value;
 
-  Value =  (UINTN) GetVariableDataPtr (Variable, VariableHeader, StoreInfo->AuthFlag);
+  Value =  (UINTN) GetVariableDataPtr (Variable, VariableHeader, StoreInfo);
   Value += DataSizeOfVariable (VariableHeader, StoreInfo->AuthFlag);
   Value += GET_PAD_SIZE (DataSizeOfVariable (VariableHeader, StoreInfo->AuthFlag));
   //
@@ -343,6 +369,8 @@ GetVariableStoreStatus (
   IN VARIABLE_STORE_HEADER *VarStoreHeader
   )
 {
+  VARIABLE_GUID_DICTIONARY  *GuidDictionary;
+
   if ((CompareGuid (&VarStoreHeader->Signature, &gEfiAuthenticatedVariableGuid) ||
        CompareGuid (&VarStoreHeader->Signature, &gEfiVariableGuid)) &&
       VarStoreHeader->Format == VARIABLE_STORE_FORMATTED &&
@@ -352,6 +380,21 @@ GetVariableStoreStatus (
     return EfiValid;
   }
 
+  if (CompareGuid (&VarStoreHeader->Signature, &gEdkiiGuidDictionaryVariableGuid) &&
+      VarStoreHeader->Format == VARIABLE_STORE_FORMATTED &&
+      VarStoreHeader->State == VARIABLE_STORE_HEALTHY
+      ) {
+    //
+    // The GUID dictionary must fit in the variable store and in the vendor GUID indexes.
+    //
+    GuidDictionary = (VARIABLE_GUID_DICTIONARY *) (VarStoreHeader + 1);
+    if ((UINTN) GuidDictionary->FirstIndex + GuidDictionary->Capacity > VARIABLE_GUID_INDEX_INVALID ||
+        sizeof (VARIABLE_STORE_HEADER) + sizeof (VARIABLE_GUID_DICTIONARY) + GuidDictionary->Capacity * sizeof (EFI_GUID) > VarStoreHeader->Size) {
+      return EfiInvalid;
+    }
+    return EfiValid;
+  }
+
   if (((UINT32 *)(&VarStoreHeader->Signature))[0] == 0xffffffff &&
       ((UINT32 *)(&VarStoreHeader->Signature))[1] == 0xffffffff &&
       ((UINT32 *)(&VarStoreHeader->Signature))[2] == 0xffffffff &&
@@ -467,7 +510,7 @@ CompareWithValidVariable (
   VOID      *Point;
   EFI_GUID  *TempVendorGuid;
 
-  TempVendorGuid = GetVendorGuidPtr (VariableHeader, StoreInfo->AuthFlag);
+  TempVendorGuid = GetVendorGuidPtr (VariableHeader, StoreInfo);
 
   if (VariableName[0] == 0) {
     PtrTrack->CurrPtr = Variable;
@@ -484,7 +527,7 @@ CompareWithValidVariable (
         (((INT32 *) VendorGuid)[3] == ((INT32 *) TempVendorGuid)[3])
         ) {
       ASSERT (NameSizeOfVariable (VariableHeader, StoreInfo->AuthFlag) != 0);
-      Point = (VOID *) GetVariableNamePtr (Variable, StoreInfo->AuthFlag);
+      Point = (VOID *) GetVariableNamePtr (Variable, StoreInfo);
       if (CompareVariableName (StoreInfo, VariableName, Point, NameSizeOfVariable (VariableHeader, StoreInfo->AuthFlag))) {
         PtrTrack->CurrPtr = Variable;
         return EFI_SUCCESS;
@@ -495,6 +538,149 @@ CompareWithValidVariable (
   return EFI_NOT_FOUND;
 }
 
+/**
+  Compute the hash of a variable name and vendor GUID used by the variable hash index.
+
+  The name is hashed up to its NULL terminator, or up to NameSize bytes,
+  whichever comes first.
+
+  @param  VariableName  Name of the variable.
+  @param  NameSize      Maximum size in bytes of the name to hash.
+  @param  VendorGuid    Vendor GUID of the variable.
+
+  @return The hash value.
+
+**/
+UINT32
+GetVariableHashIndexHash (
+  IN CONST CHAR16               *VariableName,
+  IN UINTN                      NameSize,
+  IN CONST EFI_GUID             *VendorGuid
+  )
+{
+  UINT32                        Hash;
+  UINTN                         Index;
+  CHAR16                        Char;
+
+  Hash = ReadUnaligned32 ((CONST UINT32 *) VendorGuid) ^
+         ReadUnaligned32 ((CONST UINT32 *) VendorGuid + 1) ^
+         ReadUnaligned32 ((CONST UINT32 *) VendorGuid + 2) ^
+         ReadUnaligned32 ((CONST UINT32 *) VendorGuid + 3);
+  for (Index = 0; Index < NameSize / sizeof (CHAR16); Index++) {
+    Char = ReadUnaligned16 ((CONST UINT16 *) &VariableName[Index]);
+    if (Char == 0) {
+      break;
+    }
+    Hash = (Hash ^ Char) * 0x01000193;
+  }
+  return Hash ^ (Hash >> 16);
+}
+
+/**
+  Get the hash index of the variable store in NV storage, building its guid hob
+  the first time.
+
+  The variable store must be consecutive in flash NV storage.
+
+  @param StoreInfo            Pointer to the store info structure.
+  @param VariableStoreHeader  Pointer to the variable store header in NV storage.
+
+  @return  Pointer to the variable hash index, or NULL if the variable store is not valid.
+**/
+VARIABLE_HASH_INDEX *
+GetVariableHashIndex (
+  IN VARIABLE_STORE_INFO        *StoreInfo,
+  IN VARIABLE_STORE_HEADER      *VariableStoreHeader
+  )
+{
+  EFI_HOB_GUID_TYPE             *GuidHob;
+  VARIABLE_HASH_INDEX           *HashIndex;
+  VARIABLE_HASH_INDEX_ENTRY     *HashEntry;
+  VARIABLE_HEADER               *Variable;
+  VARIABLE_HEADER               *EndPtr;
+  UINT32                        Tail[VARIABLE_HASH_INDEX_BUCKETS];
+  UINT32                        Count;
+  UINT32                        Bucket;
+  UINTN                         Index;
+
+  GuidHob = GetFirstGuidHob (&gEdkiiVariableHashIndexGuid);
+  if (GuidHob != NULL) {
+    return (VARIABLE_HASH_INDEX *) GET_GUID_HOB_DATA (GuidHob);
+  }
+
+  if ((GetVariableStoreStatus (VariableStoreHeader) != EfiValid) || (~VariableStoreHeader->Size == 0)) {
+    return NULL;
+  }
+
+  //
+  // Count the variables to index, up to one more than the index can hold.
+  //
+  Count  = 0;
+  EndPtr = GetEndPointer (VariableStoreHeader);
+  for (Variable = GetStartPointer (VariableStoreHeader);
+       (Variable < EndPtr) && IsValidVariableHeader (Variable) && (Count <= VARIABLE_HASH_INDEX_MAX_ENTRIES);
+       Variable = GetNextVariablePtr (StoreInfo, Variable, Variable)) {
+    if (Variable->State == VAR_ADDED || Variable->State == (VAR_IN_DELETED_TRANSITION & VAR_ADDED)) {
+      Count++;
+    }
+  }
+
+  if (Count > VARIABLE_HASH_INDEX_MAX_ENTRIES) {
+    //
+    // Too many variables for the temporary memory budget of the index, record that
+    // the store is not indexed so that it is not counted again.
+    //
+    HashIndex = (VARIABLE_HASH_INDEX *) BuildGuidHob (&gEdkiiVariableHashIndexGuid, sizeof (VARIABLE_HASH_INDEX));
+    if (HashIndex != NULL) {
+      ZeroMem (HashIndex, sizeof (VARIABLE_HASH_INDEX));
+    }
+    return HashIndex;
+  }
+
+  HashIndex = (VARIABLE_HASH_INDEX *) BuildGuidHob (
+                                        &gEdkiiVariableHashIndexGuid,
+                                        sizeof (VARIABLE_HASH_INDEX) + Count * sizeof (VARIABLE_HASH_INDEX_ENTRY)
+                                        );
+  if (HashIndex == NULL) {
+    return NULL;
+  }
+  HashIndex->EndOffset     = (UINT32) ((UINTN) Variable - (UINTN) VariableStoreHeader);
+  HashIndex->Count         = Count;
+  for (Index = 0; Index < VARIABLE_HASH_INDEX_BUCKETS; Index++) {
+    HashIndex->Head[Index] = VARIABLE_HASH_INDEX_END;
+    Tail[Index]            = VARIABLE_HASH_INDEX_END;
+  }
+
+  //
+  // Link the variables of each bucket in store order.
+  //
+  Count     = 0;
+  HashEntry = (VARIABLE_HASH_INDEX_ENTRY *) (HashIndex + 1);
+  for (Variable = GetStartPointer (VariableStoreHeader);
+       (Variable < EndPtr) && IsValidVariableHeader (Variable);
+       Variable = GetNextVariablePtr (StoreInfo, Variable, Variable)) {
+    if (Variable->State == VAR_ADDED || Variable->State == (VAR_IN_DELETED_TRANSITION & VAR_ADDED)) {
+      Bucket = GetVariableHashIndexHash (
+                 GetVariableNamePtr (Variable, StoreInfo),
+                 NameSizeOfVariable (Variable, StoreInfo->AuthFlag),
+                 GetVendorGuidPtr (Variable, StoreInfo)
+                 ) & (VARIABLE_HASH_INDEX_BUCKETS - 1);
+      HashEntry[Count].Offset = (UINT32) ((UINTN) Variable - (UINTN) VariableStoreHeader);
+      HashEntry[Count].Next   = VARIABLE_HASH_INDEX_END;
+      if (Tail[Bucket] == VARIABLE_HASH_INDEX_END) {
+        HashIndex->Head[Bucket] = Count;
+      } else {
+        HashEntry[Tail[Bucket]].Next = Count;
+      }
+      Tail[Bucket] = Count;
+      Count++;
+    }
+  }
+
+  DEBUG ((EFI_D_INFO, "PeiVariable: Hash index of %d variables\n", Count));
+  return HashIndex;
+}
+
 /**
   Return the variable store header and the store info based on the Index.
 
@@ -518,8 +704,10 @@ GetVariableStore (
   UINT32                                BackUpOffset;
 
   StoreInfo->IndexTable = NULL;
+  StoreInfo->HashIndex = NULL;
   StoreInfo->FtwLastWriteData = NULL;
   StoreInfo->AuthFlag = FALSE;
+  StoreInfo->GuidDictionary = NULL;
   VariableStoreHeader = NULL;
   switch (Type) {
     case VariableStoreTypeHob:
@@ -589,6 +777,17 @@ GetVariableStore (
         VariableStoreHeader = (VARIABLE_STORE_HEADER *) ((UINT8 *) FvHeader + FvHeader->HeaderLength);
 
         StoreInfo->AuthFlag = (BOOLEAN) (CompareGuid (&VariableStoreHeader->Signature, &gEfiAuthenticatedVariableGuid));
+        if (CompareGuid (&VariableStoreHeader->Signature, &gEdkiiGuidDictionaryVariableGuid)) {
+          //
+          // The GUID dictionary format keeps the authenticated variable fields.
+          //
+          if (GetVariableStoreStatus (VariableStoreHeader) != EfiValid) {
+            VariableStoreHeader = NULL;
+            break;
+          }
+          StoreInfo->AuthFlag       = TRUE;
+          StoreInfo->GuidDictionary = (VARIABLE_GUID_DICTIONARY *) (VariableStoreHeader + 1);
+        }
 
         GuidHob = GetFirstGuidHob (&gEfiVariableIndexTableGuid);
         if (GuidHob != NULL) {
@@ -606,6 +805,14 @@ GetVariableStore (
           StoreInfo->IndexTable->EndPtr      = GetEndPointer   (VariableStoreHeader);
           StoreInfo->IndexTable->GoneThrough = 0;
         }
+
+        //
+        // The variables found by the hash index are used in place, so it is only
+        // built when the whole variable store is in flash NV storage.
+        //
+        if ((StoreInfo->FtwLastWriteData == NULL) && ((UINTN) FvHeader == (UINTN) NvStorageBase)) {
+          StoreInfo->HashIndex = GetVariableHashIndex (StoreInfo, VariableStoreHeader);
+        }
       }
       break;
 
@@ -660,7 +867,7 @@ GetVariableHeader (
       //
       return FALSE;
     }
-    if (((UINTN) Variable < (UINTN) TargetAddress) && (((UINTN) Variable + GetVariableHeaderSize (StoreInfo->AuthFlag)) > (UINTN) TargetAddress)) {
+    if (((UINTN) Variable < (UINTN) TargetAddress) && (((UINTN) Variable + GetVariableHeaderSize (StoreInfo)) > (UINTN) TargetAddress)) {
       //
       // Variable header pointed by Variable is inconsecutive,
       // create a guid hob to combine the two partial variable header content together.
@@ -669,7 +876,7 @@ GetVariableHeader (
       if (GuidHob != NULL) {
         *VariableHeader = (VARIABLE_HEADER *) GET_GUID_HOB_DATA (GuidHob);
       } else {
-        *VariableHeader = (VARIABLE_HEADER *) BuildGuidHob (&gEfiCallerIdGuid, GetVariableHeaderSize (StoreInfo->AuthFlag));
+        *VariableHeader = (VARIABLE_HEADER *) BuildGuidHob (&gEfiCallerIdGuid, GetVariableHeaderSize (StoreInfo));
         PartialHeaderSize = (UINTN) TargetAddress - (UINTN) Variable;
         //
         // Partial content is in NV storage.
@@ -678,7 +885,7 @@ GetVariableHeader (
         //
         // Another partial content is in spare block.
         //
-        CopyMem ((UINT8 *) *VariableHeader + PartialHeaderSize, (UINT8 *) (UINTN) SpareAddress, GetVariableHeaderSize (StoreInfo->AuthFlag) - PartialHeaderSize);
+        CopyMem ((UINT8 *) *VariableHeader + PartialHeaderSize, (UINT8 *) (UINTN) SpareAddress, GetVariableHeaderSize (StoreInfo) - PartialHeaderSize);
       }
     }
   } else {
@@ -771,6 +978,9 @@ FindVariableEx (
   VARIABLE_STORE_HEADER   *VariableStoreHeader;
   VARIABLE_INDEX_TABLE    *IndexTable;
   VARIABLE_HEADER         *VariableHeader;
+  VARIABLE_HASH_INDEX     *HashIndex;
+  VARIABLE_HASH_INDEX_ENTRY *HashEntry;
+  UINT32                  Entry;
 
   VariableStoreHeader = StoreInfo->VariableStoreHeader;
 
@@ -798,6 +1008,28 @@ FindVariableEx (
   MaxIndex   = NULL;
   VariableHeader = NULL;
 
+  HashIndex = StoreInfo->HashIndex;
+  if ((HashIndex != NULL) && (HashIndex->EndOffset != 0) && (VariableName[0] != 0)) {
+    //
+    // Only walk the variables with the same hash, they are linked in store order.
+    //
+    HashEntry = (VARIABLE_HASH_INDEX_ENTRY *) (HashIndex + 1);
+    Entry     = HashIndex->Head[GetVariableHashIndexHash (VariableName, MAX_UINTN, VendorGuid) & (VARIABLE_HASH_INDEX_BUCKETS - 1)];
+    for (; Entry != VARIABLE_HASH_INDEX_END; Entry = HashEntry[Entry].Next) {
+      Variable = (VARIABLE_HEADER *) ((UINT8 *) VariableStoreHeader + HashEntry[Entry].Offset);
+      if (CompareWithValidVariable (StoreInfo, Variable, Variable, VariableName, VendorGuid, PtrTrack) == EFI_SUCCESS) {
+        if (Variable->State == (VAR_IN_DELETED_TRANSITION & VAR_ADDED)) {
+          InDeletedVariable = PtrTrack->CurrPtr;
+        } else {
+          return EFI_SUCCESS;
+        }
+      }
+    }
+
+    PtrTrack->CurrPtr = InDeletedVariable;
+    return (PtrTrack->CurrPtr == NULL) ? EFI_NOT_FOUND : EFI_SUCCESS;
+  }
+
   if (IndexTable != NULL) {
     //
     // traverse the variable index table to look for varible.
@@ -1002,7 +1234,7 @@ PeiGetVariable (
       return EFI_INVALID_PARAMETER;
     }
 
-    GetVariableNameOrData (&StoreInfo, GetVariableDataPtr (Variable.CurrPtr, VariableHeader, StoreInfo.AuthFlag), VarDataSize, Data);
+    GetVariableNameOrData (&StoreInfo, GetVariableDataPtr (Variable.CurrPtr, VariableHeader, &StoreInfo), VarDataSize, Data);
 
     if (Attributes != NULL) {
       *Attributes = VariableHeader->Attributes;
@@ -1133,8 +1365,8 @@ PeiGetNextVariableName (
         //
         Status = FindVariableEx (
                    &StoreInfo,
-                   GetVariableNamePtr (Variable.CurrPtr, StoreInfo.AuthFlag),
-                   GetVendorGuidPtr (VariableHeader, StoreInfo.AuthFlag),
+                   GetVariableNamePtr (Variable.CurrPtr, &StoreInfo),
+                   GetVendorGuidPtr (VariableHeader, &StoreInfo),
                    &VariablePtrTrack
                    );
         if (!EFI_ERROR (Status) && VariablePtrTrack.CurrPtr != Variable.CurrPtr) {
@@ -1151,8 +1383,8 @@ PeiGetNextVariableName (
          ) {
         Status = FindVariableEx (
                    &StoreInfoForHob,
-                   GetVariableNamePtr (Variable.CurrPtr, StoreInfo.AuthFlag),
-                   GetVendorGuidPtr (VariableHeader, StoreInfo.AuthFlag),
+                   GetVariableNamePtr (Variable.CurrPtr, &StoreInfo),
+                   GetVendorGuidPtr (VariableHeader, &StoreInfo),
                    &VariableInHob
                    );
         if (!EFI_ERROR (Status)) {
@@ -1165,9 +1397,9 @@ PeiGetNextVariableName (
       ASSERT (VarNameSize != 0);
 
       if (VarNameSize <= *VariableNameSize) {
-        GetVariableNameOrData (&StoreInfo, (UINT8 *) GetVariableNamePtr (Variable.CurrPtr, StoreInfo.AuthFlag), VarNameSize, (UINT8 *) VariableName);
+        GetVariableNameOrData (&StoreInfo, (UINT8 *) GetVariableNamePtr (Variable.CurrPtr, &StoreInfo), VarNameSize, (UINT8 *) VariableName);
 
-        CopyMem (VariableGuid, GetVendorGuidPtr (VariableHeader, StoreInfo.AuthFlag), sizeof (EFI_GUID));
+        CopyMem (VariableGuid, GetVendorGuidPtr (VariableHeader, &StoreInfo), sizeof (EFI_GUID));
 
         Status = EFI_SUCCESS;
       } else {
@@ -24,13 +24,16 @@ WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
 #include <Library/HobLib.h>
 #include <Library/PcdLib.h>
 #include <Library/BaseMemoryLib.h>
+#include <Library/BaseLib.h>
 #include <Library/PeiServicesTablePointerLib.h>
 #include <Library/PeiServicesLib.h>
 
 #include <Guid/VariableFormat.h>
 #include <Guid/VariableIndexTable.h>
+#include <Guid/VariableHashIndex.h>
 #include <Guid/SystemNvDataGuid.h>
 #include <Guid/FaultTolerantWrite.h>
+#include <Guid/ZeroGuid.h>
 
 typedef enum {
   VariableStoreTypeHob,
@@ -42,12 +45,22 @@ typedef struct {
   VARIABLE_STORE_HEADER                   *VariableStoreHeader;
   VARIABLE_INDEX_TABLE                    *IndexTable;
   //
+  // If it is not NULL and its EndOffset is not 0, it indexes all the
+  // VAR_ADDED type variables of the variable store by hash.
+  //
+  VARIABLE_HASH_INDEX                     *HashIndex;
+  //
   // If it is not NULL, it means there may be an inconsecutive variable whose
   // partial content is still in NV storage, but another partial content is backed up
   // in spare block.
   //
   FAULT_TOLERANT_WRITE_LAST_WRITE_DATA    *FtwLastWriteData;
   BOOLEAN                                 AuthFlag;
+  //
+  // If it is not NULL, the variables use the GUID dictionary format and
+  // their vendor GUIDs are in this GUID dictionary.
+  //
+  VARIABLE_GUID_DICTIONARY                *GuidDictionary;
 } VARIABLE_STORE_INFO;
 
 //
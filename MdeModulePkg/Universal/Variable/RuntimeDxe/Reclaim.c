@@ -97,6 +97,9 @@ GetLbaAndOffsetByAddress (
   This function writes a buffer to variable storage space into a firmware
   volume block device. The destination is specified by parameter
   VariableBase. Fault Tolerant Write protocol is used for writing.
+  Only the range of the buffer that differs from the variable storage space
+  is written, so the blocks holding the variables in front of the first
+  changed one, and the erased blocks at the end, are not rewritten.
 
   @param  VariableBase   Base address of variable to write
   @param  VariableBuffer Point to the variable data buffer.
@@ -118,6 +121,10 @@ FtwVariableSpace (
   UINTN                              VarOffset;
   UINTN                              FtwBufferSize;
   EFI_FAULT_TOLERANT_WRITE_PROTOCOL  *FtwProtocol;
+  UINT8                              *Flash;
+  UINT8                              *Buffer;
+  UINTN                              Start;
+  UINTN                              End;
 
   //
   // Locate fault tolerant write protocol.
@@ -133,17 +140,31 @@ FtwVariableSpace (
   if (EFI_ERROR (Status)) {
     return Status;
   }
+
+  FtwBufferSize = ((VARIABLE_STORE_HEADER *) ((UINTN) VariableBase))->Size;
+  ASSERT (FtwBufferSize == VariableBuffer->Size);
+
+  //
+  // Find the range that differs from the variable storage space.
+  //
+  Flash  = (UINT8 *) (UINTN) VariableBase;
+  Buffer = (UINT8 *) VariableBuffer;
+  for (Start = 0; (Start < FtwBufferSize) && (Flash[Start] == Buffer[Start]); Start++) {
+  }
+  if (Start == FtwBufferSize) {
+    return EFI_SUCCESS;
+  }
+  for (End = FtwBufferSize; Flash[End - 1] == Buffer[End - 1]; End--) {
+  }
+
   //
   // Get LBA and Offset by address.
   //
-  Status = GetLbaAndOffsetByAddress (VariableBase, &VarLba, &VarOffset);
+  Status = GetLbaAndOffsetByAddress (VariableBase + Start, &VarLba, &VarOffset);
   if (EFI_ERROR (Status)) {
     return EFI_ABORTED;
   }
 
-  FtwBufferSize = ((VARIABLE_STORE_HEADER *) ((UINTN) VariableBase))->Size;
-  ASSERT (FtwBufferSize == VariableBuffer->Size);
-
   //
   // FTW write record.
   //
@@ -151,11 +172,15 @@ FtwVariableSpace (
                           FtwProtocol,
                           VarLba,         // LBA
                           VarOffset,      // Offset
-                          FtwBufferSize,  // NumBytes
+                          End - Start,    // NumBytes
                           NULL,           // PrivateData NULL
                           FvbHandle,      // Fvb Handle
-                          (VOID *) VariableBuffer // write buffer
+                          Buffer + Start  // write buffer
                           );
+  if (!EFI_ERROR (Status)) {
+    mVariableFtwInfo.FtwWriteSize += End - Start;
+    mVariableFtwInfo.FtwSkipSize  += FtwBufferSize - (End - Start);
+  }
 
   return Status;
 }
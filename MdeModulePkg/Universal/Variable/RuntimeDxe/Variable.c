@@ -37,6 +37,11 @@ VARIABLE_MODULE_GLOBAL  *mVariableModuleGlobal;
 ///
 VARIABLE_STORE_HEADER  *mNvVariableCache      = NULL;
 
+///
+/// Hash indexes over the volatile, HOB and non-volatile variable stores.
+///
+VARIABLE_INDEX         *mVariableIndex[VariableStoreTypeMax] = { NULL, NULL, NULL };
+
 ///
 /// Memory cache of Fv Header.
 ///
@@ -47,11 +52,27 @@ EFI_FIRMWARE_VOLUME_HEADER *mNvFvHeaderCache  = NULL;
 ///
 VARIABLE_INFO_ENTRY    *gVariableInfo         = NULL;
 
+///
+/// The statistics of the NV variable store writes through FTW.
+///
+VARIABLE_FTW_INFO      mVariableFtwInfo;
+
 ///
 /// The flag to indicate whether the platform has left the DXE phase of execution.
 ///
 BOOLEAN                mEndOfDxe              = FALSE;
 
+///
+/// The state of the variable batch. While a batch is active, the non-volatile
+/// updates are only staged in mNvVariableCache until VariableBatchEnd () is called.
+///
+BOOLEAN                mVariableBatchActive   = FALSE;
+BOOLEAN                mVariableBatchUpdated  = FALSE;
+UINTN                  mVariableBatchLastVariableOffset;
+UINTN                  mVariableBatchHwErrVariableTotalSize;
+UINTN                  mVariableBatchCommonVariableTotalSize;
+UINTN                  mVariableBatchCommonUserVariableTotalSize;
+
 ///
 /// It indicates the var check request source.
 /// In the implementation, DXE is regarded as untrusted, and SMM is trusted.
@@ -342,6 +363,23 @@ UpdateVariableStore (
     if ((DataPtr + DataSize) >= ((EFI_PHYSICAL_ADDRESS) (UINTN) ((UINT8 *) FwVolHeader + FwVolHeader->FvLength))) {
       return EFI_INVALID_PARAMETER;
     }
+
+    if (mVariableBatchActive) {
+      //
+      // Stage the update in the NV variable cache, VariableBatchEnd () commits it.
+      //
+      if ((DataPtr < mVariableModuleGlobal->VariableGlobal.NonVolatileVariableBase) ||
+          ((DataPtr + DataSize) > mVariableModuleGlobal->VariableGlobal.NonVolatileVariableBase + mNvVariableCache->Size)) {
+        return EFI_INVALID_PARAMETER;
+      }
+      CopyMem (
+        (UINT8 *) mNvVariableCache + (UINTN) (DataPtr - mVariableModuleGlobal->VariableGlobal.NonVolatileVariableBase),
+        Buffer,
+        DataSize
+        );
+      mVariableBatchUpdated = TRUE;
+      return EFI_SUCCESS;
+    }
   } else {
     //
     // Data Pointer should point to the actual Address where data is to be
@@ -436,12 +474,27 @@ GetVariableStoreStatus (
   IN VARIABLE_STORE_HEADER *VarStoreHeader
   )
 {
+  VARIABLE_GUID_DICTIONARY  *GuidDictionary;
+
   if ((CompareGuid (&VarStoreHeader->Signature, &gEfiAuthenticatedVariableGuid) ||
        CompareGuid (&VarStoreHeader->Signature, &gEfiVariableGuid)) &&
       VarStoreHeader->Format == VARIABLE_STORE_FORMATTED &&
       VarStoreHeader->State == VARIABLE_STORE_HEALTHY
       ) {
 
+    return EfiValid;
+  } else if (CompareGuid (&VarStoreHeader->Signature, &gEdkiiGuidDictionaryVariableGuid) &&
+             VarStoreHeader->Format == VARIABLE_STORE_FORMATTED &&
+             VarStoreHeader->State == VARIABLE_STORE_HEALTHY
+            ) {
+    //
+    // The GUID dictionary must fit in the variable store and in the vendor GUID indexes.
+    //
+    GuidDictionary = (VARIABLE_GUID_DICTIONARY *) (VarStoreHeader + 1);
+    if ((UINTN) GuidDictionary->FirstIndex + GuidDictionary->Capacity > VARIABLE_GUID_INDEX_INVALID ||
+        sizeof (VARIABLE_STORE_HEADER) + sizeof (VARIABLE_GUID_DICTIONARY) + GuidDictionary->Capacity * sizeof (EFI_GUID) > VarStoreHeader->Size) {
+      return EfiInvalid;
+    }
     return EfiValid;
   } else if (((UINT32 *)(&VarStoreHeader->Signature))[0] == 0xffffffff &&
              ((UINT32 *)(&VarStoreHeader->Signature))[1] == 0xffffffff &&
@@ -471,7 +524,9 @@ GetVariableHeaderSize (
 {
   UINTN Value;
 
-  if (mVariableModuleGlobal->VariableGlobal.AuthFormat) {
+  if (mVariableModuleGlobal->VariableGlobal.GuidDictionary) {
+    Value = GUID_DICTIONARY_VARIABLE_HEADER_SIZE;
+  } else if (mVariableModuleGlobal->VariableGlobal.AuthFormat) {
     Value = sizeof (AUTHENTICATED_VARIABLE_HEADER);
   } else {
     Value = sizeof (VARIABLE_HEADER);
@@ -615,9 +670,32 @@ GetVariableNamePtr (
   return (CHAR16 *) ((UINTN) Variable + GetVariableHeaderSize ());
 }
 
+/**
+  Get the GUID dictionary of a variable store.
+
+  @param VarStoreHeader  Pointer to the Variable Store Header.
+
+  @return Pointer to the GUID dictionary, or NULL if the variable store is not
+          in the GUID dictionary format.
+
+**/
+VARIABLE_GUID_DICTIONARY *
+GetGuidDictionary (
+  IN VARIABLE_STORE_HEADER       *VarStoreHeader
+  )
+{
+  if (!CompareGuid (&VarStoreHeader->Signature, &gEdkiiGuidDictionaryVariableGuid)) {
+    return NULL;
+  }
+  return (VARIABLE_GUID_DICTIONARY *) (VarStoreHeader + 1);
+}
+
 /**
   This code gets the pointer to the variable guid.
 
+  In the GUID dictionary format, the vendor GUID index of the variable is looked
+  up in the GUID dictionaries of the non-volatile and volatile variable stores.
+
   @param Variable   Pointer to the Variable Header.
 
   @return A EFI_GUID* pointer to Vendor Guid.
@@ -629,15 +707,180 @@ GetVendorGuidPtr (
   )
 {
   AUTHENTICATED_VARIABLE_HEADER *AuthVariable;
+  VARIABLE_STORE_HEADER         *VariableStore[2];
+  VARIABLE_GUID_DICTIONARY      *GuidDictionary;
+  UINTN                         Index;
 
   AuthVariable = (AUTHENTICATED_VARIABLE_HEADER *) Variable;
-  if (mVariableModuleGlobal->VariableGlobal.AuthFormat) {
+  if (mVariableModuleGlobal->VariableGlobal.GuidDictionary) {
+    VariableStore[0] = mNvVariableCache;
+    VariableStore[1] = (VARIABLE_STORE_HEADER *) (UINTN) mVariableModuleGlobal->VariableGlobal.VolatileVariableBase;
+    for (Index = 0; Index < ARRAY_SIZE (VariableStore); Index++) {
+      if (VariableStore[Index] == NULL) {
+        continue;
+      }
+      GuidDictionary = (VARIABLE_GUID_DICTIONARY *) (VariableStore[Index] + 1);
+      if ((AuthVariable->Reserved >= GuidDictionary->FirstIndex) &&
+          (AuthVariable->Reserved - GuidDictionary->FirstIndex < GuidDictionary->Capacity)) {
+        return (EFI_GUID *) (GuidDictionary + 1) + (AuthVariable->Reserved - GuidDictionary->FirstIndex);
+      }
+    }
+    //
+    // The variable header is corrupted.
+    //
+    return &gZeroGuid;
+  } else if (mVariableModuleGlobal->VariableGlobal.AuthFormat) {
     return &AuthVariable->VendorGuid;
   } else {
     return &Variable->VendorGuid;
   }
 }
 
+/**
+  Check whether a slot of a GUID dictionary is free.
+
+  @param Guid       Pointer to the slot.
+
+  @retval TRUE      The slot is free.
+  @retval FALSE     The slot holds a GUID.
+
+**/
+BOOLEAN
+IsFreeGuidDictionarySlot (
+  IN EFI_GUID           *Guid
+  )
+{
+  return (BOOLEAN) ((ReadUnaligned32 ((UINT32 *) Guid) & ReadUnaligned32 ((UINT32 *) Guid + 1) &
+                     ReadUnaligned32 ((UINT32 *) Guid + 2) & ReadUnaligned32 ((UINT32 *) Guid + 3)) == MAX_UINT32);
+}
+
+/**
+  Get the vendor GUID index of a GUID in the GUID dictionary of the non-volatile
+  or the volatile variable store, optionally adding the GUID to it.
+
+  A GUID added to the dictionary of the non-volatile variable store is written to
+  the NV storage at once, like the variable headers.
+
+  @param[in]  Volatile          TRUE for the volatile variable store.
+  @param[in]  VendorGuid        The vendor GUID.
+  @param[in]  Add               TRUE to add VendorGuid to the dictionary if it is not there.
+  @param[out] GuidIndex         The vendor GUID index of VendorGuid.
+
+  @retval EFI_SUCCESS           GuidIndex is the vendor GUID index of VendorGuid.
+  @retval EFI_NOT_FOUND         VendorGuid is not in the dictionary and Add is FALSE.
+  @retval EFI_OUT_OF_RESOURCES  The dictionary is full.
+  @retval EFI_UNSUPPORTED       VendorGuid is all 0xFF, which marks a free slot.
+  @return Others                Writing the NV storage failed.
+
+**/
+EFI_STATUS
+GetVendorGuidIndex (
+  IN  BOOLEAN           Volatile,
+  IN  EFI_GUID          *VendorGuid,
+  IN  BOOLEAN           Add,
+  OUT UINT8             *GuidIndex
+  )
+{
+  EFI_STATUS                    Status;
+  VARIABLE_STORE_HEADER         *VariableStoreHeader;
+  VARIABLE_GUID_DICTIONARY      *GuidDictionary;
+  EFI_GUID                      *Guid;
+  UINTN                         Slot;
+
+  if (Volatile) {
+    VariableStoreHeader = (VARIABLE_STORE_HEADER *) (UINTN) mVariableModuleGlobal->VariableGlobal.VolatileVariableBase;
+  } else {
+    VariableStoreHeader = mNvVariableCache;
+  }
+  GuidDictionary = (VARIABLE_GUID_DICTIONARY *) (VariableStoreHeader + 1);
+  Guid           = (EFI_GUID *) (GuidDictionary + 1);
+
+  //
+  // The used slots are before the free ones.
+  //
+  for (Slot = 0; Slot < GuidDictionary->Capacity && !IsFreeGuidDictionarySlot (&Guid[Slot]); Slot++) {
+    if (CompareGuid (&Guid[Slot], VendorGuid)) {
+      *GuidIndex = (UINT8) (GuidDictionary->FirstIndex + Slot);
+      return EFI_SUCCESS;
+    }
+  }
+
+  if (!Add) {
+    return EFI_NOT_FOUND;
+  }
+  if (Slot == GuidDictionary->Capacity) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+  if (IsFreeGuidDictionarySlot (VendorGuid)) {
+    return EFI_UNSUPPORTED;
+  }
+
+  if (!Volatile) {
+    Status = UpdateVariableStore (
+               &mVariableModuleGlobal->VariableGlobal,
+               FALSE,
+               TRUE,
+               mVariableModuleGlobal->FvbInstance,
+               (UINTN) &Guid[Slot] - (UINTN) VariableStoreHeader,
+               sizeof (EFI_GUID),
+               (UINT8 *) VendorGuid
+               );
+    if (EFI_ERROR (Status)) {
+      return Status;
+    }
+  }
+  //
+  // Update the volatile variable store, or the memory copy of the NV storage.
+  //
+  CopyGuid (&Guid[Slot], VendorGuid);
+
+  *GuidIndex = (UINT8) (GuidDictionary->FirstIndex + Slot);
+  return EFI_SUCCESS;
+}
+
+/**
+  Set the vendor GUID of a new variable.
+
+  In the GUID dictionary format, a non-volatile variable uses the dictionary of the
+  non-volatile variable store, and a volatile variable also the one of the volatile
+  variable store.
+
+  @param[in, out] Variable      Pointer to the Variable Header, its Attributes must be set.
+  @param[in]      VendorGuid    The vendor GUID.
+
+  @retval EFI_SUCCESS           The vendor GUID is set.
+  @return Others                The vendor GUID cannot be added to the GUID dictionary.
+
+**/
+EFI_STATUS
+SetVendorGuidOfVariable (
+  IN OUT VARIABLE_HEADER        *Variable,
+  IN     EFI_GUID               *VendorGuid
+  )
+{
+  EFI_STATUS                    Status;
+  BOOLEAN                       Volatile;
+  UINT8                         GuidIndex;
+
+  if (!mVariableModuleGlobal->VariableGlobal.GuidDictionary) {
+    CopyMem (GetVendorGuidPtr (Variable), VendorGuid, sizeof (EFI_GUID));
+    return EFI_SUCCESS;
+  }
+
+  Volatile = (BOOLEAN) ((Variable->Attributes & EFI_VARIABLE_NON_VOLATILE) == 0);
+  Status   = EFI_NOT_FOUND;
+  if (Volatile) {
+    Status = GetVendorGuidIndex (FALSE, VendorGuid, FALSE, &GuidIndex);
+  }
+  if (Status == EFI_NOT_FOUND) {
+    Status = GetVendorGuidIndex (Volatile, VendorGuid, TRUE, &GuidIndex);
+  }
+  if (!EFI_ERROR (Status)) {
+    Variable->Reserved = GuidIndex;
+  }
+  return Status;
+}
+
 /**
 
   This code gets the pointer to the variable data.
@@ -729,6 +972,16 @@ GetStartPointer (
   IN VARIABLE_STORE_HEADER       *VarStoreHeader
   )
 {
+  VARIABLE_GUID_DICTIONARY       *GuidDictionary;
+
+  //
+  // The variables follow the GUID dictionary if there is one.
+  //
+  GuidDictionary = GetGuidDictionary (VarStoreHeader);
+  if (GuidDictionary != NULL) {
+    return (VARIABLE_HEADER *) HEADER_ALIGN ((EFI_GUID *) (GuidDictionary + 1) + GuidDictionary->Capacity);
+  }
+
   //
   // The end of variable store.
   //
@@ -978,6 +1231,272 @@ InitializeVariableQuota (
   CalculateCommonUserVariableTotalSize ();
 }
 
+/**
+  Get the variable store that a variable index is built over.
+
+  @param[in] Type               The variable store type.
+
+  @return Pointer to the variable store header, or NULL if the store is not present.
+
+**/
+VARIABLE_STORE_HEADER *
+GetVariableIndexStore (
+  IN VARIABLE_STORE_TYPE        Type
+  )
+{
+  switch (Type) {
+  case VariableStoreTypeVolatile:
+    return (VARIABLE_STORE_HEADER *) (UINTN) mVariableModuleGlobal->VariableGlobal.VolatileVariableBase;
+  case VariableStoreTypeHob:
+    return (VARIABLE_STORE_HEADER *) (UINTN) mVariableModuleGlobal->VariableGlobal.HobVariableBase;
+  case VariableStoreTypeNv:
+    return mNvVariableCache;
+  default:
+    return NULL;
+  }
+}
+
+/**
+  Compute the variable index hash of a variable name and vendor GUID.
+
+  The name is hashed up to its NULL terminator, or up to NameSize bytes,
+  whichever comes first.
+
+  @param[in] VariableName       Name of the variable.
+  @param[in] NameSize           Maximum size in bytes of the name to hash.
+  @param[in] VendorGuid         Vendor GUID of the variable.
+
+  @return The hash value.
+
+**/
+UINT32
+GetVariableIndexHash (
+  IN CHAR16                     *VariableName,
+  IN UINTN                      NameSize,
+  IN EFI_GUID                   *VendorGuid
+  )
+{
+  UINT32                        Hash;
+  UINTN                         Index;
+  CHAR16                        Char;
+
+  Hash = ReadUnaligned32 ((UINT32 *) VendorGuid) ^
+         ReadUnaligned32 ((UINT32 *) VendorGuid + 1) ^
+         ReadUnaligned32 ((UINT32 *) VendorGuid + 2) ^
+         ReadUnaligned32 ((UINT32 *) VendorGuid + 3);
+  for (Index = 0; Index < NameSize / sizeof (CHAR16); Index++) {
+    Char = ReadUnaligned16 ((UINT16 *) &VariableName[Index]);
+    if (Char == 0) {
+      break;
+    }
+    Hash = (Hash ^ Char) * 0x01000193;
+  }
+  return Hash ^ (Hash >> 16);
+}
+
+/**
+  Add a variable to the index of the variable store it lives in.
+
+  If the index is full, it is marked invalid and lookups in that store fall
+  back to walking the store until the index is rebuilt.
+
+  @param[in] Type               The variable store type.
+  @param[in] Variable           Pointer to the variable header in the store.
+
+**/
+VOID
+AddVariableIndexEntry (
+  IN VARIABLE_STORE_TYPE        Type,
+  IN VARIABLE_HEADER            *Variable
+  )
+{
+  VARIABLE_INDEX                *VariableIndex;
+  VARIABLE_STORE_HEADER         *VariableStoreHeader;
+  UINT32                        Bucket;
+
+  VariableIndex       = mVariableIndex[Type];
+  VariableStoreHeader = GetVariableIndexStore (Type);
+  if (VariableIndex == NULL || !VariableIndex->Valid || VariableStoreHeader == NULL) {
+    return;
+  }
+
+  if (VariableIndex->Count == VariableIndex->Capacity) {
+    VariableIndex->Valid = FALSE;
+    return;
+  }
+
+  Bucket = GetVariableIndexHash (
+             GetVariableNamePtr (Variable),
+             NameSizeOfVariable (Variable),
+             GetVendorGuidPtr (Variable)
+             ) & (VARIABLE_INDEX_BUCKETS - 1);
+
+  VariableIndex->Entry[VariableIndex->Count].Offset = (UINT32) ((UINTN) Variable - (UINTN) VariableStoreHeader);
+  VariableIndex->Entry[VariableIndex->Count].Next   = VARIABLE_INDEX_END;
+  if (VariableIndex->Tail[Bucket] == VARIABLE_INDEX_END) {
+    VariableIndex->Head[Bucket] = VariableIndex->Count;
+  } else {
+    VariableIndex->Entry[VariableIndex->Tail[Bucket]].Next = VariableIndex->Count;
+  }
+  VariableIndex->Tail[Bucket] = VariableIndex->Count;
+  VariableIndex->Count++;
+}
+
+/**
+  Rebuild the index of a variable store from the variables in the store.
+
+  @param[in] Type               The variable store type.
+
+**/
+VOID
+RebuildVariableIndex (
+  IN VARIABLE_STORE_TYPE        Type
+  )
+{
+  VARIABLE_INDEX                *VariableIndex;
+  VARIABLE_STORE_HEADER         *VariableStoreHeader;
+  VARIABLE_HEADER               *Variable;
+  UINTN                         Index;
+
+  VariableIndex       = mVariableIndex[Type];
+  VariableStoreHeader = GetVariableIndexStore (Type);
+  if (VariableIndex == NULL || VariableStoreHeader == NULL) {
+    return;
+  }
+
+  for (Index = 0; Index < VARIABLE_INDEX_BUCKETS; Index++) {
+    VariableIndex->Head[Index] = VARIABLE_INDEX_END;
+    VariableIndex->Tail[Index] = VARIABLE_INDEX_END;
+  }
+  VariableIndex->Count = 0;
+  VariableIndex->Valid = TRUE;
+
+  for ( Variable = GetStartPointer (VariableStoreHeader)
+      ; IsValidVariableHeader (Variable, GetEndPointer (VariableStoreHeader))
+      ; Variable = GetNextVariablePtr (Variable)
+      ) {
+    if (Variable->State == VAR_ADDED ||
+        Variable->State == (VAR_IN_DELETED_TRANSITION & VAR_ADDED)) {
+      AddVariableIndexEntry (Type, Variable);
+    }
+  }
+}
+
+/**
+  Allocate and build the index of a variable store.
+
+  The index is sized for the largest number of variables the store can hold,
+  so that it never needs to grow at runtime.
+
+  @param[in] Type               The variable store type.
+
+**/
+VOID
+CreateVariableIndex (
+  IN VARIABLE_STORE_TYPE        Type
+  )
+{
+  VARIABLE_STORE_HEADER         *VariableStoreHeader;
+  UINTN                         Capacity;
+
+  VariableStoreHeader = GetVariableIndexStore (Type);
+  if (VariableStoreHeader == NULL || mVariableIndex[Type] != NULL) {
+    return;
+  }
+
+  Capacity = VariableStoreHeader->Size / HEADER_ALIGN (GetVariableHeaderSize () + sizeof (CHAR16)) + 1;
+  mVariableIndex[Type] = AllocateRuntimeZeroPool (sizeof (VARIABLE_INDEX) + Capacity * sizeof (VARIABLE_INDEX_ENTRY));
+  if (mVariableIndex[Type] == NULL) {
+    //
+    // Lookups in this store just walk the store.
+    //
+    return;
+  }
+  mVariableIndex[Type]->Capacity = (UINT32) Capacity;
+  RebuildVariableIndex (Type);
+}
+
+/**
+  Find a variable through the index of the variable store being searched.
+
+  This is equivalent to walking the range of PtrTrack for a non-empty
+  VariableName, but only visits the variables with the same hash.
+
+  @param[in]       VariableName        Name of the variable to be found, not empty.
+  @param[in]       VendorGuid          Vendor GUID to be found.
+  @param[in]       IgnoreRtCheck       Ignore EFI_VARIABLE_RUNTIME_ACCESS attribute
+                                       check at runtime when searching variable.
+  @param[in, out]  PtrTrack            Variable Track Pointer structure that contains Variable Information.
+
+  @retval          EFI_SUCCESS         Variable found successfully
+  @retval          EFI_NOT_FOUND       Variable not found
+  @retval          EFI_UNSUPPORTED     No valid index covers the range of PtrTrack.
+**/
+EFI_STATUS
+FindVariableInIndex (
+  IN     CHAR16                  *VariableName,
+  IN     EFI_GUID                *VendorGuid,
+  IN     BOOLEAN                 IgnoreRtCheck,
+  IN OUT VARIABLE_POINTER_TRACK  *PtrTrack
+  )
+{
+  VARIABLE_STORE_TYPE            Type;
+  VARIABLE_STORE_HEADER          *VariableStoreHeader;
+  VARIABLE_INDEX                 *VariableIndex;
+  VARIABLE_HEADER                *Variable;
+  VARIABLE_HEADER                *InDeletedVariable;
+  UINT32                         Entry;
+
+  if (mVariableModuleGlobal == NULL) {
+    return EFI_UNSUPPORTED;
+  }
+
+  VariableIndex       = NULL;
+  VariableStoreHeader = NULL;
+  for (Type = (VARIABLE_STORE_TYPE) 0; Type < VariableStoreTypeMax; Type++) {
+    VariableStoreHeader = GetVariableIndexStore (Type);
+    if (VariableStoreHeader != NULL &&
+        PtrTrack->StartPtr == GetStartPointer (VariableStoreHeader) &&
+        PtrTrack->EndPtr == GetEndPointer (VariableStoreHeader)) {
+      VariableIndex = mVariableIndex[Type];
+      break;
+    }
+  }
+  if (VariableIndex == NULL || !VariableIndex->Valid) {
+    return EFI_UNSUPPORTED;
+  }
+
+  InDeletedVariable = NULL;
+  Entry = VariableIndex->Head[GetVariableIndexHash (VariableName, MAX_UINTN, VendorGuid) & (VARIABLE_INDEX_BUCKETS - 1)];
+  for (; Entry != VARIABLE_INDEX_END; Entry = VariableIndex->Entry[Entry].Next) {
+    Variable = (VARIABLE_HEADER *) ((UINTN) VariableStoreHeader + VariableIndex->Entry[Entry].Offset);
+    if (Variable->State != VAR_ADDED &&
+        Variable->State != (VAR_IN_DELETED_TRANSITION & VAR_ADDED)) {
+      continue;
+    }
+    if (!IgnoreRtCheck && AtRuntime () && ((Variable->Attributes & EFI_VARIABLE_RUNTIME_ACCESS) == 0)) {
+      continue;
+    }
+    if (!CompareGuid (VendorGuid, GetVendorGuidPtr (Variable))) {
+      continue;
+    }
+    ASSERT (NameSizeOfVariable (Variable) != 0);
+    if (CompareMem (VariableName, GetVariableNamePtr (Variable), NameSizeOfVariable (Variable)) != 0) {
+      continue;
+    }
+    if (Variable->State == (VAR_IN_DELETED_TRANSITION & VAR_ADDED)) {
+      InDeletedVariable = Variable;
+    } else {
+      PtrTrack->CurrPtr                = Variable;
+      PtrTrack->InDeletedTransitionPtr = InDeletedVariable;
+      return EFI_SUCCESS;
+    }
+  }
+
+  PtrTrack->CurrPtr = InDeletedVariable;
+  return (PtrTrack->CurrPtr  == NULL) ? EFI_NOT_FOUND : EFI_SUCCESS;
+}
+
 /**
 
   Variable store garbage collection and reclaim operation.
@@ -1024,6 +1543,8 @@ Reclaim (
   UINTN                 HwErrVariableTotalSize;
   VARIABLE_HEADER       *UpdatingVariable;
   VARIABLE_HEADER       *UpdatingInDeletedTransition;
+  UINT8                 *BatchBuffer;
+  UINT64                FtwWriteSize;
 
   UpdatingVariable = NULL;
   UpdatingInDeletedTransition = NULL;
@@ -1034,6 +1555,30 @@ Reclaim (
 
   VariableStoreHeader = (VARIABLE_STORE_HEADER *) ((UINTN) VariableBase);
 
+  BatchBuffer = NULL;
+  if (!IsVolatile && mVariableBatchActive) {
+    //
+    // The staged updates of a variable batch are only in mNvVariableCache, which is
+    // also the buffer of NV variable reclaim, so reclaim from a copy of it instead.
+    //
+    BatchBuffer = AllocateCopyPool (mNvVariableCache->Size, mNvVariableCache);
+    if (BatchBuffer == NULL) {
+      return EFI_OUT_OF_RESOURCES;
+    }
+    if (UpdatingVariable != NULL) {
+      UpdatingVariable = (VARIABLE_HEADER *) ((UINTN) UpdatingVariable - (UINTN) VariableBase + (UINTN) BatchBuffer);
+    }
+    if (UpdatingInDeletedTransition != NULL) {
+      UpdatingInDeletedTransition = (VARIABLE_HEADER *) ((UINTN) UpdatingInDeletedTransition - (UINTN) VariableBase + (UINTN) BatchBuffer);
+    }
+    VariableStoreHeader = (VARIABLE_STORE_HEADER *) BatchBuffer;
+  }
+
+  FtwWriteSize = mVariableFtwInfo.FtwWriteSize;
+  if (!IsVolatile) {
+    PERF_START (NULL, "VariableReclaim", NULL, 0);
+  }
+
   CommonVariableTotalSize = 0;
   CommonUserVariableTotalSize = 0;
   HwErrVariableTotalSize  = 0;
@@ -1043,7 +1588,7 @@ Reclaim (
     // Start Pointers for the variable.
     //
     Variable          = GetStartPointer (VariableStoreHeader);
-    MaximumBufferSize = sizeof (VARIABLE_STORE_HEADER);
+    MaximumBufferSize = (UINTN) Variable - (UINTN) VariableStoreHeader;
 
     while (IsValidVariableHeader (Variable, GetEndPointer (VariableStoreHeader))) {
       NextVariable = GetNextVariablePtr (Variable);
@@ -1086,9 +1631,9 @@ Reclaim (
   SetMem (ValidBuffer, MaximumBufferSize, 0xff);
 
   //
-  // Copy variable store header.
+  // Copy variable store header, and the GUID dictionary that follows it if any.
   //
-  CopyMem (ValidBuffer, VariableStoreHeader, sizeof (VARIABLE_STORE_HEADER));
+  CopyMem (ValidBuffer, VariableStoreHeader, (UINTN) GetStartPointer (VariableStoreHeader) - (UINTN) VariableStoreHeader);
   CurrPtr = (UINT8 *) GetStartPointer ((VARIABLE_STORE_HEADER *) ValidBuffer);
 
   //
@@ -1214,6 +1759,16 @@ Reclaim (
     CopyMem ((UINT8 *) (UINTN) VariableBase, ValidBuffer, (UINTN) CurrPtr - (UINTN) ValidBuffer);
     *LastVariableOffset = (UINTN) CurrPtr - (UINTN) ValidBuffer;
     Status  = EFI_SUCCESS;
+  } else if (BatchBuffer != NULL) {
+    //
+    // The reclaimed store stays in mNvVariableCache, VariableBatchEnd () commits it.
+    //
+    *LastVariableOffset = (UINTN) CurrPtr - (UINTN) ValidBuffer;
+    mVariableModuleGlobal->HwErrVariableTotalSize = HwErrVariableTotalSize;
+    mVariableModuleGlobal->CommonVariableTotalSize = CommonVariableTotalSize;
+    mVariableModuleGlobal->CommonUserVariableTotalSize = CommonUserVariableTotalSize;
+    mVariableBatchUpdated = TRUE;
+    Status = EFI_SUCCESS;
   } else {
     //
     // If non-volatile variable store, perform FTW here.
@@ -1253,11 +1808,35 @@ Reclaim (
 Done:
   if (IsVolatile) {
     FreePool (ValidBuffer);
+    RebuildVariableIndex (VariableStoreTypeVolatile);
+  } else if (BatchBuffer != NULL) {
+    if (EFI_ERROR (Status)) {
+      CopyMem (mNvVariableCache, BatchBuffer, VariableStoreHeader->Size);
+    }
+    FreePool (BatchBuffer);
+    RebuildVariableIndex (VariableStoreTypeNv);
   } else {
     //
     // For NV variable reclaim, we use mNvVariableCache as the buffer, so copy the data back.
     //
     CopyMem (mNvVariableCache, (UINT8 *)(UINTN)VariableBase, VariableStoreHeader->Size);
+    RebuildVariableIndex (VariableStoreTypeNv);
+  }
+
+  if (!IsVolatile) {
+    PERF_END (NULL, "VariableReclaim", NULL, 0);
+    mVariableFtwInfo.ReclaimCount++;
+    if (FeaturePcdGet (PcdVariableCollectStatistics)) {
+      DEBUG ((
+        EFI_D_INFO,
+        "Variable: reclaim %d - %r, 0x%lx bytes written (total 0x%lx written, 0x%lx unchanged)\n",
+        mVariableFtwInfo.ReclaimCount,
+        Status,
+        mVariableFtwInfo.FtwWriteSize - FtwWriteSize,
+        mVariableFtwInfo.FtwWriteSize,
+        mVariableFtwInfo.FtwSkipSize
+        ));
+    }
   }
 
   return Status;
@@ -1283,11 +1862,19 @@ FindVariableEx (
   IN OUT VARIABLE_POINTER_TRACK  *PtrTrack
   )
 {
+  EFI_STATUS                     Status;
   VARIABLE_HEADER                *InDeletedVariable;
   VOID                           *Point;
 
   PtrTrack->InDeletedTransitionPtr = NULL;
 
+  if (VariableName[0] != 0) {
+    Status = FindVariableInIndex (VariableName, VendorGuid, IgnoreRtCheck, PtrTrack);
+    if (Status != EFI_UNSUPPORTED) {
+      return Status;
+    }
+  }
+
   //
   // Find the variable by walk through HOB, volatile and non-volatile variable store.
   //
@@ -2541,7 +3128,10 @@ UpdateVariable (
       );
   }
 
-  CopyMem (GetVendorGuidPtr (NextVariable), VendorGuid, sizeof (EFI_GUID));
+  Status = SetVendorGuidOfVariable (NextVariable, VendorGuid);
+  if (EFI_ERROR (Status)) {
+    goto Done;
+  }
   //
   // There will be pad bytes after Data, the NextVariable->NameSize and
   // NextVariable->DataSize should not include pad size so that variable
@@ -2703,6 +3293,7 @@ UpdateVariable (
     // update the memory copy of Flash region.
     //
     CopyMem ((UINT8 *)mNvVariableCache + CacheOffset, (UINT8 *)NextVariable, VarSize);
+    AddVariableIndexEntry (VariableStoreTypeNv, (VARIABLE_HEADER *) ((UINT8 *) mNvVariableCache + CacheOffset));
   } else {
     //
     // Create a volatile variable.
@@ -2750,6 +3341,10 @@ UpdateVariable (
       goto Done;
     }
 
+    AddVariableIndexEntry (
+      VariableStoreTypeVolatile,
+      (VARIABLE_HEADER *) ((UINTN) mVariableModuleGlobal->VariableGlobal.VolatileVariableBase + mVariableModuleGlobal->VolatileLastVariableOffset)
+      );
     mVariableModuleGlobal->VolatileLastVariableOffset += HEADER_ALIGN (VarSize);
   }
 
@@ -3330,6 +3925,141 @@ Done:
   return Status;
 }
 
+/**
+  Check an entry of a variable batch before any entry of the batch is applied.
+
+  A failed batch can only be rolled back in the non-volatile variable store, so a batch
+  only accepts updates of non-volatile variables that are not authenticated. Updates of
+  volatile variables and of authenticated variables, which also change the in-memory
+  state of AuthVariableLib, are rejected.
+
+  @param[in] VariableName       Name of the variable.
+  @param[in] VendorGuid         Variable vendor GUID.
+  @param[in] Attributes         Attribute value of the variable.
+  @param[in] DataSize           Size of Data found.
+  @param[in] Data               Data pointer.
+
+  @retval EFI_SUCCESS           The entry can be applied in a variable batch.
+  @retval EFI_INVALID_PARAMETER The entry is invalid, or it updates a volatile or an
+                                authenticated variable.
+
+**/
+EFI_STATUS
+VariableBatchCheckEntry (
+  IN CHAR16                  *VariableName,
+  IN EFI_GUID                *VendorGuid,
+  IN UINT32                  Attributes,
+  IN UINTN                   DataSize,
+  IN VOID                    *Data
+  )
+{
+  EFI_STATUS                 Status;
+  VARIABLE_POINTER_TRACK     Variable;
+
+  if ((VariableName == NULL) || (VariableName[0] == 0) || (VendorGuid == NULL)) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  if ((DataSize != 0) && (Data == NULL)) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  if ((Attributes != 0) && ((Attributes & EFI_VARIABLE_NON_VOLATILE) == 0)) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  if ((Attributes & (EFI_VARIABLE_AUTHENTICATED_WRITE_ACCESS | EFI_VARIABLE_TIME_BASED_AUTHENTICATED_WRITE_ACCESS)) != 0) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  //
+  // A deletion with Attributes 0 can still target a volatile or an authenticated variable.
+  //
+  AcquireLockOnlyAtBootTime(&mVariableModuleGlobal->VariableGlobal.VariableServicesLock);
+  Status = FindVariable (VariableName, VendorGuid, &Variable, &mVariableModuleGlobal->VariableGlobal, FALSE);
+  if (!EFI_ERROR (Status) && (Variable.CurrPtr != NULL)) {
+    if (Variable.Volatile ||
+        ((Variable.CurrPtr->Attributes & (EFI_VARIABLE_AUTHENTICATED_WRITE_ACCESS | EFI_VARIABLE_TIME_BASED_AUTHENTICATED_WRITE_ACCESS)) != 0)) {
+      ReleaseLockOnlyAtBootTime (&mVariableModuleGlobal->VariableGlobal.VariableServicesLock);
+      return EFI_INVALID_PARAMETER;
+    }
+  }
+  ReleaseLockOnlyAtBootTime (&mVariableModuleGlobal->VariableGlobal.VariableServicesLock);
+
+  return EFI_SUCCESS;
+}
+
+/**
+  Start a variable batch.
+
+  Until VariableBatchEnd () is called, the updates of non-volatile variables made by
+  VariableServiceSetVariable () are only staged in the NV variable cache, so that they
+  can be committed to the variable store with a single fault tolerant write.
+
+**/
+VOID
+VariableBatchBegin (
+  VOID
+  )
+{
+  ASSERT (!mVariableBatchActive);
+
+  mVariableBatchLastVariableOffset          = mVariableModuleGlobal->NonVolatileLastVariableOffset;
+  mVariableBatchHwErrVariableTotalSize      = mVariableModuleGlobal->HwErrVariableTotalSize;
+  mVariableBatchCommonVariableTotalSize     = mVariableModuleGlobal->CommonVariableTotalSize;
+  mVariableBatchCommonUserVariableTotalSize = mVariableModuleGlobal->CommonUserVariableTotalSize;
+  mVariableBatchUpdated = FALSE;
+  mVariableBatchActive  = TRUE;
+}
+
+/**
+  End a variable batch.
+
+  @param[in] Commit       TRUE to commit the staged non-volatile updates to the variable store,
+                          FALSE to discard them.
+
+  @retval EFI_SUCCESS     The staged updates were committed, or discarded as requested.
+  @retval Others          The commit failed and the staged updates were discarded.
+
+**/
+EFI_STATUS
+VariableBatchEnd (
+  IN BOOLEAN                 Commit
+  )
+{
+  EFI_STATUS                 Status;
+  EFI_PHYSICAL_ADDRESS       VariableBase;
+
+  ASSERT (mVariableBatchActive);
+
+  mVariableBatchActive = FALSE;
+  if (!mVariableBatchUpdated) {
+    return EFI_SUCCESS;
+  }
+
+  VariableBase = mVariableModuleGlobal->VariableGlobal.NonVolatileVariableBase;
+  Status       = EFI_SUCCESS;
+  if (Commit) {
+    Status = FtwVariableSpace (VariableBase, mNvVariableCache);
+    if (!EFI_ERROR (Status)) {
+      return EFI_SUCCESS;
+    }
+  }
+
+  //
+  // Nothing of the batch reached the flash, so reload the cache from it and
+  // restore the accounting recorded when the batch started.
+  //
+  CopyMem (mNvVariableCache, (UINT8 *) (UINTN) VariableBase, mNvVariableCache->Size);
+  mVariableModuleGlobal->NonVolatileLastVariableOffset = mVariableBatchLastVariableOffset;
+  mVariableModuleGlobal->HwErrVariableTotalSize        = mVariableBatchHwErrVariableTotalSize;
+  mVariableModuleGlobal->CommonVariableTotalSize       = mVariableBatchCommonVariableTotalSize;
+  mVariableModuleGlobal->CommonUserVariableTotalSize   = mVariableBatchCommonUserVariableTotalSize;
+  RebuildVariableIndex (VariableStoreTypeNv);
+
+  return Status;
+}
+
 /**
 
   This code returns information about the EFI variables.
@@ -3771,7 +4501,9 @@ InitNonVolatileVariableStore (
 
   ASSERT (sizeof (VARIABLE_STORE_HEADER) <= VariableStoreLength);
 
-  mVariableModuleGlobal->VariableGlobal.AuthFormat = (BOOLEAN)(CompareGuid (&mNvVariableCache->Signature, &gEfiAuthenticatedVariableGuid));
+  mVariableModuleGlobal->VariableGlobal.GuidDictionary = (BOOLEAN)(GetGuidDictionary (mNvVariableCache) != NULL);
+  mVariableModuleGlobal->VariableGlobal.AuthFormat = (BOOLEAN)(CompareGuid (&mNvVariableCache->Signature, &gEfiAuthenticatedVariableGuid) ||
+                                                               mVariableModuleGlobal->VariableGlobal.GuidDictionary);
 
   HwErrStorageSize = PcdGet32 (PcdHwErrStorageSize);
   MaxUserNvVariableSpaceSize = PcdGet32 (PcdMaxUserNvVariableSpaceSize);
@@ -3795,7 +4527,7 @@ InitNonVolatileVariableStore (
   //
   ASSERT (BoottimeReservedNvVariableSpaceSize < (VariableStoreLength - sizeof (VARIABLE_STORE_HEADER) - HwErrStorageSize));
 
-  mVariableModuleGlobal->CommonVariableSpace = ((UINTN) VariableStoreLength - sizeof (VARIABLE_STORE_HEADER) - HwErrStorageSize);
+  mVariableModuleGlobal->CommonVariableSpace = ((UINTN) VariableStoreLength - ((UINTN) GetStartPointer (mNvVariableCache) - (UINTN) mNvVariableCache) - HwErrStorageSize);
   mVariableModuleGlobal->CommonMaxUserVariableSpace = ((MaxUserNvVariableSpaceSize != 0) ? MaxUserNvVariableSpaceSize : mVariableModuleGlobal->CommonVariableSpace);
   mVariableModuleGlobal->CommonRuntimeVariableSpace = mVariableModuleGlobal->CommonVariableSpace - BoottimeReservedNvVariableSpaceSize;
 
@@ -3920,6 +4652,10 @@ FlushHobVariableToFlash (
       DEBUG ((EFI_D_INFO, "Variable driver: all HOB variables have been flushed in flash.\n"));
       if (!AtRuntime ()) {
         FreePool ((VOID *) VariableStoreHeader);
+        if (mVariableIndex[VariableStoreTypeHob] != NULL) {
+          FreePool (mVariableIndex[VariableStoreTypeHob]);
+          mVariableIndex[VariableStoreTypeHob] = NULL;
+        }
       }
     }
   }
@@ -4035,6 +4771,93 @@ VariableWriteServiceInitialize (
 }
 
 
+/**
+  Copy the authenticated variable store of the HOB to runtime memory in the GUID
+  dictionary format.
+
+  The copy has an empty GUID dictionary of its own, the vendor GUIDs of its
+  variables are looked up in the dictionary of the non-volatile variable store,
+  or else added to the one of the volatile variable store, as NV storage cannot
+  be written yet. FlushHobVariableToFlash() later gives the variables flushed to
+  NV storage vendor GUID indexes of the non-volatile variable store.
+
+  @param[in] HobVariableStore   Pointer to the authenticated variable store of the HOB.
+  @param[in] HobVariableSize    Size of the variable store of the HOB.
+
+  @return Pointer to the copy of the variable store, or NULL if there is not enough memory.
+
+**/
+VARIABLE_STORE_HEADER *
+ConvertHobVariableStoreToGuidDictionary (
+  IN VARIABLE_STORE_HEADER      *HobVariableStore,
+  IN UINTN                      HobVariableSize
+  )
+{
+  EFI_STATUS                    Status;
+  VARIABLE_STORE_HEADER         *VariableStoreHeader;
+  VARIABLE_GUID_DICTIONARY      *GuidDictionary;
+  AUTHENTICATED_VARIABLE_HEADER *HobVariable;
+  UINTN                         HobVariableEnd;
+  UINTN                         VariableSize;
+  UINT8                         *CurrPtr;
+  UINT8                         GuidIndex;
+
+  //
+  // The copy drops 16 bytes from each variable, and adds the dictionary header.
+  //
+  HobVariableSize = MIN (HobVariableSize, HobVariableStore->Size);
+  VariableStoreHeader = AllocateRuntimePool (HobVariableSize + sizeof (VARIABLE_GUID_DICTIONARY));
+  if (VariableStoreHeader == NULL) {
+    return NULL;
+  }
+  SetMem (VariableStoreHeader, HobVariableSize + sizeof (VARIABLE_GUID_DICTIONARY), 0xff);
+
+  CopyMem (VariableStoreHeader, HobVariableStore, sizeof (VARIABLE_STORE_HEADER));
+  CopyGuid (&VariableStoreHeader->Signature, &gEdkiiGuidDictionaryVariableGuid);
+  VariableStoreHeader->Size  = (UINT32) (HobVariableSize + sizeof (VARIABLE_GUID_DICTIONARY));
+  GuidDictionary             = (VARIABLE_GUID_DICTIONARY *) (VariableStoreHeader + 1);
+  GuidDictionary->FirstIndex = 0;
+  GuidDictionary->Capacity   = 0;
+  ZeroMem (GuidDictionary->Reserved, sizeof (GuidDictionary->Reserved));
+
+  CurrPtr        = (UINT8 *) GetStartPointer (VariableStoreHeader);
+  HobVariableEnd = (UINTN) HobVariableStore + HobVariableSize;
+  for (HobVariable = (AUTHENTICATED_VARIABLE_HEADER *) HEADER_ALIGN (HobVariableStore + 1);
+       ((UINTN) (HobVariable + 1) <= HobVariableEnd) && (HobVariable->StartId == VARIABLE_DATA);
+       HobVariable = (AUTHENTICATED_VARIABLE_HEADER *) HEADER_ALIGN ((UINTN) HobVariable + VariableSize)) {
+    if ((HobVariable->NameSize + GET_PAD_SIZE (HobVariable->NameSize) > HobVariableEnd - (UINTN) (HobVariable + 1)) ||
+        (HobVariable->DataSize > HobVariableEnd - (UINTN) (HobVariable + 1) - HobVariable->NameSize - GET_PAD_SIZE (HobVariable->NameSize))) {
+      break;
+    }
+    VariableSize = sizeof (AUTHENTICATED_VARIABLE_HEADER) +
+                   HobVariable->NameSize + GET_PAD_SIZE (HobVariable->NameSize) +
+                   HobVariable->DataSize + GET_PAD_SIZE (HobVariable->DataSize);
+    if ((HobVariable->State != VAR_ADDED) && (HobVariable->State != (VAR_IN_DELETED_TRANSITION & VAR_ADDED))) {
+      continue;
+    }
+
+    Status = GetVendorGuidIndex (FALSE, &HobVariable->VendorGuid, FALSE, &GuidIndex);
+    if (Status == EFI_NOT_FOUND) {
+      Status = GetVendorGuidIndex (TRUE, &HobVariable->VendorGuid, TRUE, &GuidIndex);
+    }
+    if (EFI_ERROR (Status)) {
+      DEBUG ((EFI_D_ERROR, "Variable: HOB variable of vendor %g dropped - %r\n", &HobVariable->VendorGuid, Status));
+      continue;
+    }
+
+    CopyMem (CurrPtr, HobVariable, GUID_DICTIONARY_VARIABLE_HEADER_SIZE);
+    ((VARIABLE_HEADER *) CurrPtr)->Reserved = GuidIndex;
+    CopyMem (
+      CurrPtr + GUID_DICTIONARY_VARIABLE_HEADER_SIZE,
+      HobVariable + 1,
+      VariableSize - sizeof (AUTHENTICATED_VARIABLE_HEADER)
+      );
+    CurrPtr = (UINT8 *) HEADER_ALIGN (CurrPtr + VariableSize - sizeof (EFI_GUID));
+  }
+
+  return VariableStoreHeader;
+}
+
 /**
   Initializes variable store area for non-volatile and volatile variable.
 
@@ -4054,7 +4877,11 @@ VariableCommonInitialize (
   UINTN                           ScratchSize;
   EFI_HOB_GUID_TYPE               *GuidHob;
   EFI_GUID                        *VariableGuid;
+  EFI_GUID                        *HobVariableGuid;
   EFI_FIRMWARE_VOLUME_HEADER      *NvFvHeader;
+  VARIABLE_STORE_TYPE             Type;
+  VARIABLE_GUID_DICTIONARY        *NvGuidDictionary;
+  VARIABLE_GUID_DICTIONARY        *GuidDictionary;
 
   //
   // Allocate runtime memory for variable driver global structure.
@@ -4077,39 +4904,30 @@ VariableCommonInitialize (
   }
 
   //
-  // mVariableModuleGlobal->VariableGlobal.AuthFormat
-  // has been initialized in InitNonVolatileVariableStore().
+  // mVariableModuleGlobal->VariableGlobal.AuthFormat and GuidDictionary
+  // have been initialized in InitNonVolatileVariableStore().
   //
-  if (mVariableModuleGlobal->VariableGlobal.AuthFormat) {
+  if (mVariableModuleGlobal->VariableGlobal.GuidDictionary) {
+    DEBUG ((EFI_D_INFO, "Variable driver will work with GUID dictionary variable format!\n"));
+    //
+    // Set AuthSupport to FALSE first, VariableWriteServiceInitialize() will initialize it.
+    //
+    mVariableModuleGlobal->VariableGlobal.AuthSupport = FALSE;
+    VariableGuid    = &gEdkiiGuidDictionaryVariableGuid;
+    HobVariableGuid = &gEfiAuthenticatedVariableGuid;
+  } else if (mVariableModuleGlobal->VariableGlobal.AuthFormat) {
     DEBUG ((EFI_D_INFO, "Variable driver will work with auth variable format!\n"));
     //
     // Set AuthSupport to FALSE first, VariableWriteServiceInitialize() will initialize it.
     //
     mVariableModuleGlobal->VariableGlobal.AuthSupport = FALSE;
-    VariableGuid = &gEfiAuthenticatedVariableGuid;
+    VariableGuid    = &gEfiAuthenticatedVariableGuid;
+    HobVariableGuid = VariableGuid;
   } else {
     DEBUG ((EFI_D_INFO, "Variable driver will work without auth variable support!\n"));
     mVariableModuleGlobal->VariableGlobal.AuthSupport = FALSE;
-    VariableGuid = &gEfiVariableGuid;
-  }
-
-  //
-  // Get HOB variable store.
-  //
-  GuidHob = GetFirstGuidHob (VariableGuid);
-  if (GuidHob != NULL) {
-    VariableStoreHeader = GET_GUID_HOB_DATA (GuidHob);
-    VariableStoreLength = GuidHob->Header.HobLength - sizeof (EFI_HOB_GUID_TYPE);
-    if (GetVariableStoreStatus (VariableStoreHeader) == EfiValid) {
-      mVariableModuleGlobal->VariableGlobal.HobVariableBase = (EFI_PHYSICAL_ADDRESS) (UINTN) AllocateRuntimeCopyPool ((UINTN) VariableStoreLength, (VOID *) VariableStoreHeader);
-      if (mVariableModuleGlobal->VariableGlobal.HobVariableBase == 0) {
-        FreePool (NvFvHeader);
-        FreePool (mVariableModuleGlobal);
-        return EFI_OUT_OF_RESOURCES;
-      }
-    } else {
-      DEBUG ((EFI_D_ERROR, "HOB Variable Store header is corrupted!\n"));
-    }
+    VariableGuid    = &gEfiVariableGuid;
+    HobVariableGuid = VariableGuid;
   }
 
   //
@@ -4119,9 +4937,6 @@ VariableCommonInitialize (
   mVariableModuleGlobal->ScratchBufferSize = ScratchSize;
   VolatileVariableStore = AllocateRuntimePool (PcdGet32 (PcdVariableStoreSize) + ScratchSize);
   if (VolatileVariableStore == NULL) {
-    if (mVariableModuleGlobal->VariableGlobal.HobVariableBase != 0) {
-      FreePool ((VOID *) (UINTN) mVariableModuleGlobal->VariableGlobal.HobVariableBase);
-    }
     FreePool (NvFvHeader);
     FreePool (mVariableModuleGlobal);
     return EFI_OUT_OF_RESOURCES;
@@ -4132,9 +4947,6 @@ VariableCommonInitialize (
   //
   // Initialize Variable Specific Data.
   //
-  mVariableModuleGlobal->VariableGlobal.VolatileVariableBase = (EFI_PHYSICAL_ADDRESS) (UINTN) VolatileVariableStore;
-  mVariableModuleGlobal->VolatileLastVariableOffset = (UINTN) GetStartPointer (VolatileVariableStore) - (UINTN) VolatileVariableStore;
-
   CopyGuid (&VolatileVariableStore->Signature, VariableGuid);
   VolatileVariableStore->Size        = PcdGet32 (PcdVariableStoreSize);
   VolatileVariableStore->Format      = VARIABLE_STORE_FORMATTED;
@@ -4142,6 +4954,51 @@ VariableCommonInitialize (
   VolatileVariableStore->Reserved    = 0;
   VolatileVariableStore->Reserved1   = 0;
 
+  GuidDictionary = GetGuidDictionary (VolatileVariableStore);
+  if (GuidDictionary != NULL) {
+    //
+    // The vendor GUID indexes of the volatile variable store follow those of the non-volatile one.
+    //
+    NvGuidDictionary           = GetGuidDictionary (mNvVariableCache);
+    GuidDictionary->FirstIndex = (UINT8) (NvGuidDictionary->FirstIndex + NvGuidDictionary->Capacity);
+    GuidDictionary->Capacity   = (UINT8) MIN (VOLATILE_GUID_DICTIONARY_CAPACITY, VARIABLE_GUID_INDEX_INVALID - GuidDictionary->FirstIndex);
+    ZeroMem (GuidDictionary->Reserved, sizeof (GuidDictionary->Reserved));
+  }
+
+  mVariableModuleGlobal->VariableGlobal.VolatileVariableBase = (EFI_PHYSICAL_ADDRESS) (UINTN) VolatileVariableStore;
+  mVariableModuleGlobal->VolatileLastVariableOffset = (UINTN) GetStartPointer (VolatileVariableStore) - (UINTN) VolatileVariableStore;
+
+  //
+  // Get HOB variable store.
+  //
+  GuidHob = GetFirstGuidHob (HobVariableGuid);
+  if (GuidHob != NULL) {
+    VariableStoreHeader = GET_GUID_HOB_DATA (GuidHob);
+    VariableStoreLength = GuidHob->Header.HobLength - sizeof (EFI_HOB_GUID_TYPE);
+    if (GetVariableStoreStatus (VariableStoreHeader) == EfiValid) {
+      if (mVariableModuleGlobal->VariableGlobal.GuidDictionary) {
+        mVariableModuleGlobal->VariableGlobal.HobVariableBase = (EFI_PHYSICAL_ADDRESS) (UINTN) ConvertHobVariableStoreToGuidDictionary (VariableStoreHeader, (UINTN) VariableStoreLength);
+      } else {
+        mVariableModuleGlobal->VariableGlobal.HobVariableBase = (EFI_PHYSICAL_ADDRESS) (UINTN) AllocateRuntimeCopyPool ((UINTN) VariableStoreLength, (VOID *) VariableStoreHeader);
+      }
+      if (mVariableModuleGlobal->VariableGlobal.HobVariableBase == 0) {
+        FreePool (VolatileVariableStore);
+        FreePool (NvFvHeader);
+        FreePool (mVariableModuleGlobal);
+        return EFI_OUT_OF_RESOURCES;
+      }
+    } else {
+      DEBUG ((EFI_D_ERROR, "HOB Variable Store header is corrupted!\n"));
+    }
+  }
+
+  //
+  // Build the hash indexes used by FindVariable().
+  //
+  for (Type = (VARIABLE_STORE_TYPE) 0; Type < VariableStoreTypeMax; Type++) {
+    CreateVariableIndex (Type);
+  }
+
   return EFI_SUCCESS;
 }
 
@@ -22,6 +22,7 @@ WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
 #include <Protocol/FirmwareVolumeBlock.h>
 #include <Protocol/Variable.h>
 #include <Protocol/VariableLock.h>
+#include <Protocol/VariableBatch.h>
 #include <Protocol/VarCheck.h>
 #include <Library/PcdLib.h>
 #include <Library/HobLib.h>
@@ -37,12 +38,14 @@ WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
 #include <Library/MemoryAllocationLib.h>
 #include <Library/AuthVariableLib.h>
 #include <Library/VarCheckLib.h>
+#include <Library/PerformanceLib.h>
 #include <Guid/GlobalVariable.h>
 #include <Guid/EventGroup.h>
 #include <Guid/VariableFormat.h>
 #include <Guid/SystemNvDataGuid.h>
 #include <Guid/FaultTolerantWrite.h>
 #include <Guid/VarErrorFlag.h>
+#include <Guid/ZeroGuid.h>
 
 #define EFI_VARIABLE_ATTRIBUTES_MASK (EFI_VARIABLE_NON_VOLATILE | \
                                       EFI_VARIABLE_BOOTSERVICE_ACCESS | \
@@ -78,6 +81,44 @@ typedef struct {
   BOOLEAN         Volatile;
 } VARIABLE_POINTER_TRACK;
 
+///
+/// The number of hash buckets in a variable index, must be a power of 2.
+///
+#define VARIABLE_INDEX_BUCKETS     128
+#define VARIABLE_INDEX_END         MAX_UINT32
+
+///
+/// The number of vendor GUID slots of the volatile variable store in the GUID
+/// dictionary format, if the vendor GUID indexes left by the non-volatile variable
+/// store allow it.
+///
+#define VOLATILE_GUID_DICTIONARY_CAPACITY  64
+
+typedef struct {
+  //
+  // Offset of the variable header from the variable store header.
+  //
+  UINT32          Offset;
+  //
+  // Next entry in the same hash bucket, or VARIABLE_INDEX_END.
+  //
+  UINT32          Next;
+} VARIABLE_INDEX_ENTRY;
+
+///
+/// Hash index over the variables of one variable store.
+/// Entries are appended in store order, so walking a bucket visits the
+/// variables in the same order as walking the store itself.
+///
+typedef struct {
+  BOOLEAN               Valid;
+  UINT32                Count;
+  UINT32                Capacity;
+  UINT32                Head[VARIABLE_INDEX_BUCKETS];
+  UINT32                Tail[VARIABLE_INDEX_BUCKETS];
+  VARIABLE_INDEX_ENTRY  Entry[1];
+} VARIABLE_INDEX;
+
 typedef struct {
   EFI_PHYSICAL_ADDRESS  HobVariableBase;
   EFI_PHYSICAL_ADDRESS  VolatileVariableBase;
@@ -85,6 +126,10 @@ typedef struct {
   EFI_LOCK              VariableServicesLock;
   UINT32                ReentrantState;
   BOOLEAN               AuthFormat;
+  //
+  // TRUE if the variables use the GUID dictionary format, AuthFormat is also TRUE then.
+  //
+  BOOLEAN               GuidDictionary;
   BOOLEAN               AuthSupport;
 } VARIABLE_GLOBAL;
 
@@ -108,6 +153,15 @@ typedef struct {
   EFI_FIRMWARE_VOLUME_BLOCK_PROTOCOL *FvbInstance;
 } VARIABLE_MODULE_GLOBAL;
 
+///
+/// Statistics of the non-volatile variable store writes done through FTW.
+///
+typedef struct {
+  UINT32          ReclaimCount;   ///< Number of reclaim operations of the NV variable store.
+  UINT64          FtwWriteSize;   ///< Number of bytes written through FTW.
+  UINT64          FtwSkipSize;    ///< Number of bytes not written because they did not change.
+} VARIABLE_FTW_INFO;
+
 /**
   Flush the HOB variable to flash.
 
@@ -142,6 +196,19 @@ FtwVariableSpace (
   IN VARIABLE_STORE_HEADER  *VariableBuffer
   );
 
+/**
+  Get the variable store that a variable index is built over.
+
+  @param[in] Type               The variable store type.
+
+  @return Pointer to the variable store header, or NULL if the store is not present.
+
+**/
+VARIABLE_STORE_HEADER *
+GetVariableIndexStore (
+  IN VARIABLE_STORE_TYPE        Type
+  );
+
 /**
   Finds variable in storage blocks of volatile and non-volatile storage areas.
 
@@ -614,6 +681,62 @@ VariableServiceSetVariable (
   IN VOID                    *Data
   );
 
+/**
+  Check an entry of a variable batch before any entry of the batch is applied.
+
+  A failed batch can only be rolled back in the non-volatile variable store, so a batch
+  only accepts updates of non-volatile variables that are not authenticated. Updates of
+  volatile variables and of authenticated variables, which also change the in-memory
+  state of AuthVariableLib, are rejected.
+
+  @param[in] VariableName       Name of the variable.
+  @param[in] VendorGuid         Variable vendor GUID.
+  @param[in] Attributes         Attribute value of the variable.
+  @param[in] DataSize           Size of Data found.
+  @param[in] Data               Data pointer.
+
+  @retval EFI_SUCCESS           The entry can be applied in a variable batch.
+  @retval EFI_INVALID_PARAMETER The entry is invalid, or it updates a volatile or an
+                                authenticated variable.
+
+**/
+EFI_STATUS
+VariableBatchCheckEntry (
+  IN CHAR16                  *VariableName,
+  IN EFI_GUID                *VendorGuid,
+  IN UINT32                  Attributes,
+  IN UINTN                   DataSize,
+  IN VOID                    *Data
+  );
+
+/**
+  Start a variable batch.
+
+  Until VariableBatchEnd () is called, the updates of non-volatile variables made by
+  VariableServiceSetVariable () are only staged in the NV variable cache, so that they
+  can be committed to the variable store with a single fault tolerant write.
+
+**/
+VOID
+VariableBatchBegin (
+  VOID
+  );
+
+/**
+  End a variable batch.
+
+  @param[in] Commit       TRUE to commit the staged non-volatile updates to the variable store,
+                          FALSE to discard them.
+
+  @retval EFI_SUCCESS     The staged updates were committed, or discarded as requested.
+  @retval Others          The commit failed and the staged updates were discarded.
+
+**/
+EFI_STATUS
+VariableBatchEnd (
+  IN BOOLEAN                 Commit
+  );
+
 /**
 
   This code returns information about the EFI variables.
@@ -769,6 +892,8 @@ InitializeVariableQuota (
 
 extern VARIABLE_MODULE_GLOBAL  *mVariableModuleGlobal;
 
+extern VARIABLE_FTW_INFO       mVariableFtwInfo;
+
 extern AUTH_VAR_LIB_CONTEXT_OUT mAuthContextOut;
 
 /**
@@ -18,6 +18,7 @@ WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
 #include "Variable.h"
 
 extern VARIABLE_STORE_HEADER        *mNvVariableCache;
+extern VARIABLE_INDEX               *mVariableIndex[VariableStoreTypeMax];
 extern EFI_FIRMWARE_VOLUME_HEADER   *mNvFvHeaderCache;
 extern VARIABLE_INFO_ENTRY          *gVariableInfo;
 EFI_HANDLE                          mHandle                    = NULL;
@@ -42,6 +43,30 @@ RecordSecureBootPolicyVarData(
   VOID
   );
 
+/**
+  Update several variables as one transaction.
+
+  @param[in]  This          The EDKII_VARIABLE_BATCH_PROTOCOL instance.
+  @param[in]  EntryCount    The number of entries in Entries.
+  @param[in]  Entries       The variable updates to apply.
+  @param[out] FailedEntry   On error, the index of the entry that failed, or EntryCount
+                            if the batch failed as a whole. Optional.
+
+  @retval EFI_SUCCESS           All the updates were applied and committed.
+  @retval EFI_INVALID_PARAMETER EntryCount is 0 or Entries is NULL.
+  @retval Others                The status of the entry that failed, or of the commit.
+**/
+EFI_STATUS
+EFIAPI
+VariableBatchSetVariables (
+  IN CONST EDKII_VARIABLE_BATCH_PROTOCOL  *This,
+  IN       UINTN                          EntryCount,
+  IN       EDKII_VARIABLE_BATCH_ENTRY     *Entries,
+  OUT      UINTN                          *FailedEntry OPTIONAL
+  );
+
+EDKII_VARIABLE_BATCH_PROTOCOL       mVariableBatch             = { VariableBatchSetVariables };
+
 /**
   Return TRUE if ExitBootServices () has been called.
 
@@ -256,6 +281,9 @@ VariableClassAddressChangeEvent (
   EfiConvertPointer (0x0, (VOID **) &mVariableModuleGlobal->VariableGlobal.HobVariableBase);
   EfiConvertPointer (0x0, (VOID **) &mVariableModuleGlobal);
   EfiConvertPointer (0x0, (VOID **) &mNvVariableCache);
+  EfiConvertPointer (0x0, (VOID **) &mVariableIndex[VariableStoreTypeVolatile]);
+  EfiConvertPointer (0x0, (VOID **) &mVariableIndex[VariableStoreTypeHob]);
+  EfiConvertPointer (0x0, (VOID **) &mVariableIndex[VariableStoreTypeNv]);
   EfiConvertPointer (0x0, (VOID **) &mNvFvHeaderCache);
 
   if (mAuthContextOut.AddressPointer != NULL) {
@@ -343,6 +371,91 @@ OnEndOfDxe (
   gBS->CloseEvent (Event);
 }
 
+/**
+  Update several variables as one transaction.
+
+  All the entries are checked by VariableBatchCheckEntry () first. They are then applied
+  in order by VariableServiceSetVariable () inside a variable batch, and the non-volatile
+  changes are committed with a single fault tolerant write only when all of them
+  succeeded. The TPL is kept at the level of the variable services lock for the whole
+  batch, so no other SetVariable () call can join or be rolled back with it.
+
+  @param[in]  This          The EDKII_VARIABLE_BATCH_PROTOCOL instance.
+  @param[in]  EntryCount    The number of entries in Entries.
+  @param[in]  Entries       The variable updates to apply.
+  @param[out] FailedEntry   On error, the index of the entry that failed, or EntryCount
+                            if the batch failed as a whole. Optional.
+
+  @retval EFI_SUCCESS           All the updates were applied and committed.
+  @retval EFI_INVALID_PARAMETER EntryCount is 0 or Entries is NULL, or an entry is invalid.
+  @retval Others                The status of the entry that failed, or of the commit.
+**/
+EFI_STATUS
+EFIAPI
+VariableBatchSetVariables (
+  IN CONST EDKII_VARIABLE_BATCH_PROTOCOL  *This,
+  IN       UINTN                          EntryCount,
+  IN       EDKII_VARIABLE_BATCH_ENTRY     *Entries,
+  OUT      UINTN                          *FailedEntry OPTIONAL
+  )
+{
+  EFI_STATUS                              Status;
+  EFI_TPL                                 OldTpl;
+  UINTN                                   Index;
+
+  if ((EntryCount == 0) || (Entries == NULL)) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  OldTpl = gBS->RaiseTPL (TPL_NOTIFY);
+
+  for (Index = 0; Index < EntryCount; Index++) {
+    Status = VariableBatchCheckEntry (
+               Entries[Index].VariableName,
+               Entries[Index].VendorGuid,
+               Entries[Index].Attributes,
+               Entries[Index].DataSize,
+               Entries[Index].Data
+               );
+    if (EFI_ERROR (Status)) {
+      gBS->RestoreTPL (OldTpl);
+      if (FailedEntry != NULL) {
+        *FailedEntry = Index;
+      }
+      return Status;
+    }
+  }
+
+  VariableBatchBegin ();
+
+  Status = EFI_SUCCESS;
+  for (Index = 0; Index < EntryCount; Index++) {
+    Status = VariableServiceSetVariable (
+               Entries[Index].VariableName,
+               Entries[Index].VendorGuid,
+               Entries[Index].Attributes,
+               Entries[Index].DataSize,
+               Entries[Index].Data
+               );
+    if (EFI_ERROR (Status)) {
+      break;
+    }
+  }
+
+  if (EFI_ERROR (Status)) {
+    VariableBatchEnd (FALSE);
+  } else {
+    Status = VariableBatchEnd (TRUE);
+  }
+
+  gBS->RestoreTPL (OldTpl);
+
+  if (EFI_ERROR (Status) && (FailedEntry != NULL)) {
+    *FailedEntry = Index;
+  }
+  return Status;
+}
+
 /**
   Fault Tolerant Write protocol notification event handler.
 
@@ -442,6 +555,17 @@ FtwNotificationEvent (
                   );
   ASSERT_EFI_ERROR (Status);
 
+  //
+  // The variable batch commits through FTW, so install it with the write service.
+  //
+  Status = gBS->InstallMultipleProtocolInterfaces (
+                  &mHandle,
+                  &gEdkiiVariableBatchProtocolGuid,
+                  &mVariableBatch,
+                  NULL
+                  );
+  ASSERT_EFI_ERROR (Status);
+
   //
   // Close the notify event to avoid install gEfiVariableWriteArchProtocolGuid again.
   //
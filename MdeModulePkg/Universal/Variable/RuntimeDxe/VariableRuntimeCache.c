@@ -0,0 +1,575 @@
+/** @file
+  Serve GetVariable() and GetNextVariableName() from the runtime variable cache.
+
+  The SMM variable driver keeps a copy of the volatile, HOB and non-volatile
+  variable stores in runtime memory up to date, so that reading a variable does
+  not need to trigger an SMI.
+
+  Caution: This module requires additional review when modified.
+  The runtime variable cache is writable outside SMM, so the variable headers
+  it holds are checked against the bounds of their store before being used.
+
+Copyright (c) 2017, Intel Corporation. All rights reserved.<BR>
+This program and the accompanying materials
+are licensed and made available under the terms and conditions of the BSD License
+which accompanies this distribution.  The full text of the license may be found at
+http://opensource.org/licenses/bsd-license.php
+
+THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+
+**/
+
+#include <PiDxe.h>
+
+#include <Library/UefiRuntimeLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/DebugLib.h>
+#include <Library/BaseLib.h>
+
+#include <Guid/VariableFormat.h>
+#include <Guid/SmmVariableCommon.h>
+
+///
+/// The runtime variable cache, NULL if it is not in use.
+///
+VARIABLE_RUNTIME_CACHE_HEADER    *mVariableRuntimeCache     = NULL;
+
+///
+/// TRUE if the variables of the locked runtime variable cache use the GUID
+/// dictionary format, and the GUID dictionaries of its volatile and non-volatile
+/// variable stores then.
+///
+BOOLEAN                          mRuntimeCacheGuidDictionaryFormat = FALSE;
+VARIABLE_GUID_DICTIONARY         *mRuntimeCacheGuidDictionary[2];
+
+/**
+  Ask the SMM variable driver to apply the updates of the runtime variable cache
+  that it deferred while the cache was being read.
+
+  @retval EFI_SUCCESS           The runtime variable cache is up to date.
+  @retval Others                The runtime variable cache could not be updated.
+
+**/
+EFI_STATUS
+SyncRuntimeVariableCache (
+  VOID
+  );
+
+/**
+  Get the size of the header of the variables in the runtime variable cache.
+
+  @param[in] AuthFormat         TRUE if the variables use the authenticated format.
+
+  @return Size of the variable header.
+
+**/
+UINTN
+RuntimeCacheHeaderSize (
+  IN BOOLEAN                    AuthFormat
+  )
+{
+  if (mRuntimeCacheGuidDictionaryFormat) {
+    return GUID_DICTIONARY_VARIABLE_HEADER_SIZE;
+  }
+  return AuthFormat ? sizeof (AUTHENTICATED_VARIABLE_HEADER) : sizeof (VARIABLE_HEADER);
+}
+
+/**
+  Get the name size and data size of a variable in the runtime variable cache.
+
+  @param[in]  Variable          Pointer to the variable header.
+  @param[in]  AuthFormat        TRUE if the variables use the authenticated format.
+  @param[out] NameSize          Size of the variable name.
+  @param[out] DataSize          Size of the variable data.
+
+**/
+VOID
+RuntimeCacheVariableSizes (
+  IN  VARIABLE_HEADER           *Variable,
+  IN  BOOLEAN                   AuthFormat,
+  OUT UINTN                     *NameSize,
+  OUT UINTN                     *DataSize
+  )
+{
+  AUTHENTICATED_VARIABLE_HEADER *AuthVariable;
+
+  AuthVariable = (AUTHENTICATED_VARIABLE_HEADER *) Variable;
+  if (AuthFormat) {
+    *NameSize = AuthVariable->NameSize;
+    *DataSize = AuthVariable->DataSize;
+  } else {
+    *NameSize = Variable->NameSize;
+    *DataSize = Variable->DataSize;
+  }
+  if (Variable->State == (UINT8) (-1) ||
+      *DataSize == (UINT32) (-1) ||
+      *NameSize == (UINT32) (-1) ||
+      Variable->Attributes == (UINT32) (-1)) {
+    *NameSize = 0;
+    *DataSize = 0;
+  }
+}
+
+/**
+  Get the vendor GUID of a variable in the runtime variable cache.
+
+  @param[in] Variable           Pointer to the variable header.
+  @param[in] AuthFormat         TRUE if the variables use the authenticated format.
+
+  @return Pointer to the vendor GUID, or NULL if the vendor GUID index of the
+          variable is not in the GUID dictionaries.
+
+**/
+EFI_GUID *
+RuntimeCacheVendorGuid (
+  IN VARIABLE_HEADER            *Variable,
+  IN BOOLEAN                    AuthFormat
+  )
+{
+  VARIABLE_GUID_DICTIONARY      *GuidDictionary;
+  UINTN                         Index;
+
+  if (mRuntimeCacheGuidDictionaryFormat) {
+    for (Index = 0; Index < ARRAY_SIZE (mRuntimeCacheGuidDictionary); Index++) {
+      GuidDictionary = mRuntimeCacheGuidDictionary[Index];
+      if ((GuidDictionary != NULL) &&
+          (Variable->Reserved >= GuidDictionary->FirstIndex) &&
+          (Variable->Reserved - GuidDictionary->FirstIndex < GuidDictionary->Capacity)) {
+        return (EFI_GUID *) (GuidDictionary + 1) + (Variable->Reserved - GuidDictionary->FirstIndex);
+      }
+    }
+    return NULL;
+  }
+  if (AuthFormat) {
+    return &((AUTHENTICATED_VARIABLE_HEADER *) Variable)->VendorGuid;
+  }
+  return &Variable->VendorGuid;
+}
+
+/**
+  Get the next variable in a variable store of the runtime variable cache.
+
+  @param[in] Variable           Pointer to the current variable header, NULL to get the first.
+  @param[in] Store              The variable store.
+  @param[in] AuthFormat         TRUE if the variables use the authenticated format.
+
+  @return Pointer to the next variable header, or NULL at the end of the store.
+
+**/
+VARIABLE_HEADER *
+RuntimeCacheNextVariable (
+  IN VARIABLE_HEADER            *Variable OPTIONAL,
+  IN VARIABLE_STORE_HEADER      *Store,
+  IN BOOLEAN                    AuthFormat
+  )
+{
+  UINTN                         End;
+  UINTN                         Next;
+  UINTN                         NameSize;
+  UINTN                         DataSize;
+  VARIABLE_GUID_DICTIONARY      *GuidDictionary;
+
+  End = (UINTN) Store + Store->Size;
+  if (Variable == NULL) {
+    Next = HEADER_ALIGN (Store + 1);
+    if (mRuntimeCacheGuidDictionaryFormat) {
+      GuidDictionary = (VARIABLE_GUID_DICTIONARY *) (Store + 1);
+      Next = HEADER_ALIGN ((EFI_GUID *) (GuidDictionary + 1) + GuidDictionary->Capacity);
+    }
+  } else {
+    RuntimeCacheVariableSizes (Variable, AuthFormat, &NameSize, &DataSize);
+    Next = HEADER_ALIGN ((UINTN) Variable + RuntimeCacheHeaderSize (AuthFormat) +
+                         NameSize + GET_PAD_SIZE (NameSize) + DataSize + GET_PAD_SIZE (DataSize));
+  }
+
+  //
+  // The whole variable must lie inside the store.
+  //
+  if (Next + RuntimeCacheHeaderSize (AuthFormat) > End ||
+      ((VARIABLE_HEADER *) Next)->StartId != VARIABLE_DATA) {
+    return NULL;
+  }
+  RuntimeCacheVariableSizes ((VARIABLE_HEADER *) Next, AuthFormat, &NameSize, &DataSize);
+  End -= Next + RuntimeCacheHeaderSize (AuthFormat);
+  if (NameSize + GET_PAD_SIZE (NameSize) > End ||
+      DataSize > End - NameSize - GET_PAD_SIZE (NameSize)) {
+    return NULL;
+  }
+  if (RuntimeCacheVendorGuid ((VARIABLE_HEADER *) Next, AuthFormat) == NULL) {
+    return NULL;
+  }
+  return (VARIABLE_HEADER *) Next;
+}
+
+/**
+  Find a variable in one variable store of the runtime variable cache.
+
+  This follows FindVariableEx() of the variable driver: an ADDED variable is
+  preferred over an IN_DELETED_TRANSITION one, and variables without
+  EFI_VARIABLE_RUNTIME_ACCESS are not visible at runtime.
+
+  @param[in] Store              The variable store.
+  @param[in] VariableName       Name of the variable, an empty string matches the first variable.
+  @param[in] VendorGuid         Vendor GUID of the variable.
+  @param[in] AuthFormat         TRUE if the variables use the authenticated format.
+
+  @return Pointer to the variable header, or NULL if it is not found.
+
+**/
+VARIABLE_HEADER *
+FindVariableInRuntimeCacheStore (
+  IN VARIABLE_STORE_HEADER      *Store,
+  IN CHAR16                     *VariableName,
+  IN EFI_GUID                   *VendorGuid,
+  IN BOOLEAN                    AuthFormat
+  )
+{
+  VARIABLE_HEADER               *Variable;
+  VARIABLE_HEADER               *InDeletedVariable;
+  UINTN                         NameSize;
+  UINTN                         DataSize;
+
+  InDeletedVariable = NULL;
+  for (Variable = RuntimeCacheNextVariable (NULL, Store, AuthFormat);
+       Variable != NULL;
+       Variable = RuntimeCacheNextVariable (Variable, Store, AuthFormat)) {
+    if (Variable->State != VAR_ADDED && Variable->State != (VAR_IN_DELETED_TRANSITION & VAR_ADDED)) {
+      continue;
+    }
+    if (EfiAtRuntime () && ((Variable->Attributes & EFI_VARIABLE_RUNTIME_ACCESS) == 0)) {
+      continue;
+    }
+    if (VariableName[0] != 0) {
+      RuntimeCacheVariableSizes (Variable, AuthFormat, &NameSize, &DataSize);
+      if (NameSize == 0 ||
+          !CompareGuid (VendorGuid, RuntimeCacheVendorGuid (Variable, AuthFormat)) ||
+          CompareMem (VariableName, (UINT8 *) Variable + RuntimeCacheHeaderSize (AuthFormat), NameSize) != 0) {
+        continue;
+      }
+    }
+    if (Variable->State == VAR_ADDED) {
+      return Variable;
+    }
+    InDeletedVariable = Variable;
+  }
+  return InDeletedVariable;
+}
+
+/**
+  Lock the runtime variable cache for reading.
+
+  Updates that the SMM variable driver deferred are applied first.
+
+  @param[out] Store             The variable stores of the cache, NULL for a store not present.
+  @param[out] AuthFormat        TRUE if the variables use the authenticated format.
+
+  @retval TRUE                  The cache is locked and can be read.
+  @retval FALSE                 The cache cannot be used.
+
+**/
+BOOLEAN
+AcquireRuntimeVariableCache (
+  OUT VARIABLE_STORE_HEADER     **Store,
+  OUT BOOLEAN                   *AuthFormat
+  )
+{
+  UINTN                         Index;
+  VARIABLE_GUID_DICTIONARY      *GuidDictionary;
+
+  if (mVariableRuntimeCache == NULL) {
+    return FALSE;
+  }
+
+  while (TRUE) {
+    mVariableRuntimeCache->ReadLock = TRUE;
+    MemoryFence ();
+    if (!*(volatile BOOLEAN *) &mVariableRuntimeCache->PendingUpdate) {
+      break;
+    }
+    mVariableRuntimeCache->ReadLock = FALSE;
+    if (EFI_ERROR (SyncRuntimeVariableCache ())) {
+      return FALSE;
+    }
+  }
+
+  for (Index = 0; Index < VARIABLE_RUNTIME_CACHE_STORE_COUNT; Index++) {
+    Store[Index] = NULL;
+    if (mVariableRuntimeCache->StoreSize[Index] >= sizeof (VARIABLE_STORE_HEADER)) {
+      Store[Index] = (VARIABLE_STORE_HEADER *) ((UINTN) mVariableRuntimeCache + mVariableRuntimeCache->StoreOffset[Index]);
+      if (Store[Index]->Size > mVariableRuntimeCache->StoreSize[Index]) {
+        Store[Index] = NULL;
+      }
+    }
+  }
+
+  //
+  // The volatile variable store always exists and has the same format as the others.
+  //
+  if (Store[0] == NULL) {
+    mVariableRuntimeCache->ReadLock = FALSE;
+    return FALSE;
+  }
+  *AuthFormat = CompareGuid (&Store[0]->Signature, &gEfiAuthenticatedVariableGuid);
+
+  mRuntimeCacheGuidDictionaryFormat = CompareGuid (&Store[0]->Signature, &gEdkiiGuidDictionaryVariableGuid);
+  if (mRuntimeCacheGuidDictionaryFormat) {
+    *AuthFormat = TRUE;
+    for (Index = 0; Index < VARIABLE_RUNTIME_CACHE_STORE_COUNT; Index++) {
+      if (Store[Index] == NULL) {
+        continue;
+      }
+      //
+      // Each GUID dictionary must lie inside its store.
+      //
+      GuidDictionary = (VARIABLE_GUID_DICTIONARY *) (Store[Index] + 1);
+      if (!CompareGuid (&Store[Index]->Signature, &gEdkiiGuidDictionaryVariableGuid) ||
+          Store[Index]->Size < sizeof (VARIABLE_STORE_HEADER) + sizeof (VARIABLE_GUID_DICTIONARY) ||
+          GuidDictionary->Capacity * sizeof (EFI_GUID) > Store[Index]->Size - sizeof (VARIABLE_STORE_HEADER) - sizeof (VARIABLE_GUID_DICTIONARY)) {
+        mVariableRuntimeCache->ReadLock = FALSE;
+        return FALSE;
+      }
+    }
+    //
+    // Store 0 is the volatile variable store and store 2 the non-volatile one.
+    //
+    mRuntimeCacheGuidDictionary[0] = (VARIABLE_GUID_DICTIONARY *) (Store[0] + 1);
+    mRuntimeCacheGuidDictionary[1] = (Store[2] != NULL) ? (VARIABLE_GUID_DICTIONARY *) (Store[2] + 1) : NULL;
+  }
+  return TRUE;
+}
+
+/**
+  Unlock the runtime variable cache after reading.
+
+**/
+VOID
+ReleaseRuntimeVariableCache (
+  VOID
+  )
+{
+  MemoryFence ();
+  mVariableRuntimeCache->ReadLock = FALSE;
+}
+
+/**
+  Find a variable in the runtime variable cache.
+
+  @param[in]  Store             The variable stores of the cache.
+  @param[in]  VariableName      Name of the variable.
+  @param[in]  VendorGuid        Vendor GUID of the variable.
+  @param[in]  AuthFormat        TRUE if the variables use the authenticated format.
+  @param[out] StoreIndex        Index of the store the variable was found in.
+
+  @return Pointer to the variable header, or NULL if it is not found.
+
+**/
+VARIABLE_HEADER *
+FindVariableInRuntimeCache (
+  IN  VARIABLE_STORE_HEADER     **Store,
+  IN  CHAR16                    *VariableName,
+  IN  EFI_GUID                  *VendorGuid,
+  IN  BOOLEAN                   AuthFormat,
+  OUT UINTN                     *StoreIndex
+  )
+{
+  VARIABLE_HEADER               *Variable;
+
+  for (*StoreIndex = 0; *StoreIndex < VARIABLE_RUNTIME_CACHE_STORE_COUNT; (*StoreIndex)++) {
+    if (Store[*StoreIndex] != NULL) {
+      Variable = FindVariableInRuntimeCacheStore (Store[*StoreIndex], VariableName, VendorGuid, AuthFormat);
+      if (Variable != NULL) {
+        return Variable;
+      }
+    }
+  }
+  return NULL;
+}
+
+/**
+  This code finds variable in the runtime variable cache.
+
+  @param[in]      VariableName       Name of Variable to be found.
+  @param[in]      VendorGuid         Variable vendor GUID.
+  @param[out]     Attributes         Attribute value of the variable found.
+  @param[in, out] DataSize           Size of Data found. If size is less than the
+                                     data, this value contains the required size.
+  @param[out]     Data               Data pointer.
+
+  @retval EFI_INVALID_PARAMETER      Invalid parameter.
+  @retval EFI_SUCCESS                Find the specified variable.
+  @retval EFI_NOT_FOUND              Not found.
+  @retval EFI_BUFFER_TO_SMALL        DataSize is too small for the result.
+  @retval EFI_UNSUPPORTED            The runtime variable cache cannot be used.
+
+**/
+EFI_STATUS
+GetVariableFromRuntimeCache (
+  IN      CHAR16                    *VariableName,
+  IN      EFI_GUID                  *VendorGuid,
+  OUT     UINT32                    *Attributes OPTIONAL,
+  IN OUT  UINTN                     *DataSize,
+  OUT     VOID                      *Data
+  )
+{
+  EFI_STATUS                        Status;
+  VARIABLE_STORE_HEADER             *Store[VARIABLE_RUNTIME_CACHE_STORE_COUNT];
+  BOOLEAN                           AuthFormat;
+  VARIABLE_HEADER                   *Variable;
+  UINTN                             StoreIndex;
+  UINTN                             NameSize;
+  UINTN                             VarDataSize;
+
+  if (!AcquireRuntimeVariableCache (Store, &AuthFormat)) {
+    return EFI_UNSUPPORTED;
+  }
+
+  if (VariableName[0] == 0) {
+    Status = EFI_NOT_FOUND;
+    goto Done;
+  }
+
+  Variable = FindVariableInRuntimeCache (Store, VariableName, VendorGuid, AuthFormat, &StoreIndex);
+  if (Variable == NULL) {
+    Status = EFI_NOT_FOUND;
+    goto Done;
+  }
+
+  //
+  // Like the SMM variable driver, return the attributes also when DataSize is too small.
+  //
+  if (Attributes != NULL) {
+    *Attributes = Variable->Attributes;
+  }
+
+  RuntimeCacheVariableSizes (Variable, AuthFormat, &NameSize, &VarDataSize);
+  if (*DataSize >= VarDataSize) {
+    if (Data == NULL) {
+      Status = EFI_INVALID_PARAMETER;
+      goto Done;
+    }
+    CopyMem (
+      Data,
+      (UINT8 *) Variable + RuntimeCacheHeaderSize (AuthFormat) + NameSize + GET_PAD_SIZE (NameSize),
+      VarDataSize
+      );
+    Status = EFI_SUCCESS;
+  } else {
+    Status = EFI_BUFFER_TOO_SMALL;
+  }
+  *DataSize = VarDataSize;
+
+Done:
+  ReleaseRuntimeVariableCache ();
+  return Status;
+}
+
+/**
+  This code finds the next available variable in the runtime variable cache.
+
+  This follows VariableServiceGetNextVariableInternal() of the variable driver.
+
+  @param[in, out] VariableNameSize   Size of the variable name.
+  @param[in, out] VariableName       Pointer to variable name.
+  @param[in, out] VendorGuid         Variable Vendor Guid.
+
+  @retval EFI_SUCCESS                Find the specified variable.
+  @retval EFI_NOT_FOUND              Not found.
+  @retval EFI_BUFFER_TO_SMALL        VariableNameSize is too small for the result.
+  @retval EFI_UNSUPPORTED            The runtime variable cache cannot be used.
+
+**/
+EFI_STATUS
+GetNextVariableNameFromRuntimeCache (
+  IN OUT  UINTN                     *VariableNameSize,
+  IN OUT  CHAR16                    *VariableName,
+  IN OUT  EFI_GUID                  *VendorGuid
+  )
+{
+  EFI_STATUS                        Status;
+  VARIABLE_STORE_HEADER             *Store[VARIABLE_RUNTIME_CACHE_STORE_COUNT];
+  BOOLEAN                           AuthFormat;
+  VARIABLE_HEADER                   *Variable;
+  VARIABLE_HEADER                   *Found;
+  UINTN                             StoreIndex;
+  UINTN                             NameSize;
+  UINTN                             DataSize;
+  CHAR16                            *Name;
+
+  if (!AcquireRuntimeVariableCache (Store, &AuthFormat)) {
+    return EFI_UNSUPPORTED;
+  }
+
+  Variable = FindVariableInRuntimeCache (Store, VariableName, VendorGuid, AuthFormat, &StoreIndex);
+  if (Variable == NULL) {
+    Status = EFI_NOT_FOUND;
+    goto Done;
+  }
+  if (VariableName[0] != 0) {
+    Variable = RuntimeCacheNextVariable (Variable, Store[StoreIndex], AuthFormat);
+  }
+
+  while (TRUE) {
+    //
+    // Switch from Volatile to HOB, to Non-Volatile.
+    //
+    while (Variable == NULL) {
+      for (StoreIndex++; StoreIndex < VARIABLE_RUNTIME_CACHE_STORE_COUNT; StoreIndex++) {
+        if (Store[StoreIndex] != NULL) {
+          break;
+        }
+      }
+      if (StoreIndex == VARIABLE_RUNTIME_CACHE_STORE_COUNT) {
+        Status = EFI_NOT_FOUND;
+        goto Done;
+      }
+      Variable = RuntimeCacheNextVariable (NULL, Store[StoreIndex], AuthFormat);
+    }
+
+    if ((Variable->State == VAR_ADDED || Variable->State == (VAR_IN_DELETED_TRANSITION & VAR_ADDED)) &&
+        (!EfiAtRuntime () || ((Variable->Attributes & EFI_VARIABLE_RUNTIME_ACCESS) != 0))) {
+      RuntimeCacheVariableSizes (Variable, AuthFormat, &NameSize, &DataSize);
+      Name = (CHAR16 *) ((UINTN) Variable + RuntimeCacheHeaderSize (AuthFormat));
+      if (NameSize == 0 || Name[NameSize / sizeof (CHAR16) - 1] != 0) {
+        //
+        // Leave a malformed name to the SMM variable driver.
+        //
+        Status = EFI_UNSUPPORTED;
+        goto Done;
+      }
+
+      Found = Variable;
+      if (Variable->State == (VAR_IN_DELETED_TRANSITION & VAR_ADDED)) {
+        //
+        // Don't return an IN_DELETED_TRANSITION variable when
+        // the same ADDED one is present.
+        //
+        Found = FindVariableInRuntimeCacheStore (Store[StoreIndex], Name, RuntimeCacheVendorGuid (Variable, AuthFormat), AuthFormat);
+      }
+
+      //
+      // Don't return NV variable when HOB overrides it.
+      // Store 1 is the HOB variable store and store 2 the non-volatile one.
+      //
+      if ((Found == Variable || Found == NULL || Found->State != VAR_ADDED) &&
+          (StoreIndex != 2 || Store[1] == NULL ||
+           FindVariableInRuntimeCacheStore (Store[1], Name, RuntimeCacheVendorGuid (Variable, AuthFormat), AuthFormat) == NULL)) {
+        if (NameSize <= *VariableNameSize) {
+          CopyMem (VariableName, Name, NameSize);
+          CopyGuid (VendorGuid, RuntimeCacheVendorGuid (Variable, AuthFormat));
+          Status = EFI_SUCCESS;
+        } else {
+          Status = EFI_BUFFER_TOO_SMALL;
+        }
+        *VariableNameSize = NameSize;
+        goto Done;
+      }
+    }
+
+    Variable = RuntimeCacheNextVariable (Variable, Store[StoreIndex], AuthFormat);
+  }
+
+Done:
+  ReleaseRuntimeVariableCache ();
+  return Status;
+}
@@ -46,6 +46,16 @@ UINTN                                                mVariableBufferPayloadSize;
 extern BOOLEAN                                       mEndOfDxe;
 extern VAR_CHECK_REQUEST_SOURCE                      mRequestSource;
 
+///
+/// The runtime variable cache shared with the variable wrapper driver. Its layout is
+/// kept in SMRAM, only the ReadLock flag is read back from the shared buffer.
+///
+VARIABLE_RUNTIME_CACHE_HEADER                        *mVariableRuntimeCache  = NULL;
+UINT32                                               mVariableRuntimeCacheOffset[VariableStoreTypeMax];
+UINT32                                               mVariableRuntimeCacheSize[VariableStoreTypeMax];
+UINTN                                                mVariableRuntimeCacheUsed[VariableStoreTypeMax];
+UINTN                                                mVariableRuntimeCacheTotalSize = 0;
+
 /**
   SecureBoot Hook for SetVariable.
 
@@ -63,6 +73,298 @@ SecureBootHook (
   return ;
 }
 
+/**
+  Copy the changes of the variable stores into the runtime variable cache.
+
+  Only the used part of each store, or the part used at the previous update
+  if it was larger, is copied. If the variable wrapper driver is reading the
+  cache, the update is deferred until it asks for it.
+
+**/
+VOID
+SynchronizeRuntimeVariableCache (
+  VOID
+  )
+{
+  VARIABLE_STORE_TYPE        Type;
+  VARIABLE_STORE_HEADER      *VariableStoreHeader;
+  UINTN                      Used;
+  UINTN                      Length;
+
+  if (mVariableRuntimeCache == NULL) {
+    return;
+  }
+
+  if (*(volatile BOOLEAN *) &mVariableRuntimeCache->ReadLock) {
+    mVariableRuntimeCache->PendingUpdate = TRUE;
+    return;
+  }
+
+  for (Type = (VARIABLE_STORE_TYPE) 0; Type < VariableStoreTypeMax; Type++) {
+    mVariableRuntimeCache->StoreOffset[Type] = mVariableRuntimeCacheOffset[Type];
+    VariableStoreHeader = GetVariableIndexStore (Type);
+    if (VariableStoreHeader == NULL || VariableStoreHeader->Size > mVariableRuntimeCacheSize[Type]) {
+      mVariableRuntimeCache->StoreSize[Type] = 0;
+      mVariableRuntimeCacheUsed[Type]        = MAX_UINTN;
+      continue;
+    }
+
+    switch (Type) {
+    case VariableStoreTypeVolatile:
+      Used = mVariableModuleGlobal->VolatileLastVariableOffset;
+      break;
+    case VariableStoreTypeNv:
+      Used = mVariableModuleGlobal->NonVolatileLastVariableOffset;
+      break;
+    default:
+      Used = VariableStoreHeader->Size;
+      break;
+    }
+    Length = MIN (MAX (Used, mVariableRuntimeCacheUsed[Type]), VariableStoreHeader->Size);
+    CopyMem ((UINT8 *) mVariableRuntimeCache + mVariableRuntimeCacheOffset[Type], VariableStoreHeader, Length);
+    mVariableRuntimeCacheUsed[Type]        = Used;
+    mVariableRuntimeCache->StoreSize[Type] = VariableStoreHeader->Size;
+  }
+
+  mVariableRuntimeCache->PendingUpdate = FALSE;
+}
+
+/**
+  Get the size of the runtime variable cache.
+
+  The layout of the cache is computed only once, when the cache is initialized.
+  Once the cache is in use, the size it was initialized with is returned and
+  the layout is left untouched.
+
+  @return The size in bytes of the runtime variable cache.
+
+**/
+UINTN
+GetRuntimeVariableCacheSize (
+  VOID
+  )
+{
+  VARIABLE_STORE_TYPE        Type;
+  VARIABLE_STORE_HEADER      *VariableStoreHeader;
+  UINTN                      Size;
+
+  if (mVariableRuntimeCache != NULL) {
+    return mVariableRuntimeCacheTotalSize;
+  }
+
+  Size = sizeof (VARIABLE_RUNTIME_CACHE_HEADER);
+  for (Type = (VARIABLE_STORE_TYPE) 0; Type < VariableStoreTypeMax; Type++) {
+    Size = ALIGN_VALUE (Size, sizeof (UINT64));
+    VariableStoreHeader = GetVariableIndexStore (Type);
+    Size += (VariableStoreHeader == NULL) ? 0 : VariableStoreHeader->Size;
+  }
+  return Size;
+}
+
+/**
+  Compute the layout of the runtime variable cache.
+
+  @return The size in bytes of the runtime variable cache.
+
+**/
+UINTN
+ComputeRuntimeVariableCacheLayout (
+  VOID
+  )
+{
+  VARIABLE_STORE_TYPE        Type;
+  VARIABLE_STORE_HEADER      *VariableStoreHeader;
+  UINTN                      Size;
+
+  ASSERT (mVariableRuntimeCache == NULL);
+
+  Size = sizeof (VARIABLE_RUNTIME_CACHE_HEADER);
+  for (Type = (VARIABLE_STORE_TYPE) 0; Type < VariableStoreTypeMax; Type++) {
+    Size = ALIGN_VALUE (Size, sizeof (UINT64));
+    VariableStoreHeader = GetVariableIndexStore (Type);
+    mVariableRuntimeCacheOffset[Type] = (UINT32) Size;
+    mVariableRuntimeCacheSize[Type]   = (VariableStoreHeader == NULL) ? 0 : VariableStoreHeader->Size;
+    Size += mVariableRuntimeCacheSize[Type];
+  }
+  return Size;
+}
+
+/**
+  Start to keep the runtime variable cache provided by the variable wrapper driver.
+
+  Caution: This function may receive untrusted input.
+  The cache buffer is external input, so this function will validate it is outside SMRAM.
+
+  @param[in] CacheBase          Base address of the runtime variable cache.
+  @param[in] CacheSize          Size in bytes of the runtime variable cache.
+
+  @retval EFI_SUCCESS           The runtime variable cache is initialized.
+  @retval EFI_INVALID_PARAMETER The cache is too small.
+  @retval EFI_ACCESS_DENIED     The cache overlaps SMRAM.
+
+**/
+EFI_STATUS
+InitRuntimeVariableCache (
+  IN EFI_PHYSICAL_ADDRESS    CacheBase,
+  IN UINT64                  CacheSize
+  )
+{
+  VARIABLE_STORE_TYPE        Type;
+  UINTN                      Size;
+
+  Size = ComputeRuntimeVariableCacheLayout ();
+  if (CacheSize < Size) {
+    return EFI_INVALID_PARAMETER;
+  }
+  if (!SmmIsBufferOutsideSmmValid (CacheBase, Size)) {
+    DEBUG ((EFI_D_ERROR, "InitRuntimeVariableCache: Runtime variable cache in SMRAM or overflow!\n"));
+    return EFI_ACCESS_DENIED;
+  }
+
+  mVariableRuntimeCache          = (VARIABLE_RUNTIME_CACHE_HEADER *) (UINTN) CacheBase;
+  mVariableRuntimeCacheTotalSize = Size;
+  SetMem (mVariableRuntimeCache, Size, 0xff);
+  ZeroMem (mVariableRuntimeCache, sizeof (VARIABLE_RUNTIME_CACHE_HEADER));
+  for (Type = (VARIABLE_STORE_TYPE) 0; Type < VariableStoreTypeMax; Type++) {
+    mVariableRuntimeCacheUsed[Type] = MAX_UINTN;
+  }
+
+  SynchronizeRuntimeVariableCache ();
+  return EFI_SUCCESS;
+}
+
+/**
+  Get the next entry of a variable batch.
+
+  Caution: This function may receive untrusted input.
+  The batch is external input, so the entry is validated to be inside the batch.
+
+  @param[in]      Batch         The batch, already copied to SMRAM.
+  @param[in]      BatchSize     The size in bytes of the batch.
+  @param[in, out] Offset        On input, the offset of the end of the previous entry.
+                                On output, the offset of the end of the entry.
+  @param[out]     Entry         The entry.
+
+  @retval EFI_SUCCESS           The entry is returned.
+  @retval EFI_ACCESS_DENIED     The entry is malformed.
+
+**/
+EFI_STATUS
+GetVariableBatchEntry (
+  IN     SMM_VARIABLE_COMMUNICATE_SET_VARIABLE_BATCH  *Batch,
+  IN     UINTN                                        BatchSize,
+  IN OUT UINTN                                        *Offset,
+  OUT    SMM_VARIABLE_COMMUNICATE_ACCESS_VARIABLE     **Entry
+  )
+{
+  UINTN                                     InfoSize;
+
+  *Offset = ALIGN_VALUE (*Offset, sizeof (UINT64));
+  if ((*Offset > BatchSize) ||
+      (BatchSize - *Offset < OFFSET_OF (SMM_VARIABLE_COMMUNICATE_ACCESS_VARIABLE, Name))) {
+    return EFI_ACCESS_DENIED;
+  }
+  *Entry = (SMM_VARIABLE_COMMUNICATE_ACCESS_VARIABLE *) ((UINT8 *) Batch + *Offset);
+
+  //
+  // Prevent InfoSize overflow and make sure the entry is inside the batch.
+  //
+  InfoSize = BatchSize - *Offset - OFFSET_OF (SMM_VARIABLE_COMMUNICATE_ACCESS_VARIABLE, Name);
+  if (((*Entry)->NameSize > InfoSize) || ((*Entry)->DataSize > InfoSize - (*Entry)->NameSize)) {
+    return EFI_ACCESS_DENIED;
+  }
+
+  if ((*Entry)->NameSize < sizeof (CHAR16) || (*Entry)->Name[(*Entry)->NameSize/sizeof (CHAR16) - 1] != L'\0') {
+    //
+    // Make sure VariableName is A Null-terminated string.
+    //
+    return EFI_ACCESS_DENIED;
+  }
+
+  *Offset += OFFSET_OF (SMM_VARIABLE_COMMUNICATE_ACCESS_VARIABLE, Name) + (*Entry)->NameSize + (*Entry)->DataSize;
+  return EFI_SUCCESS;
+}
+
+/**
+  Apply the entries of a variable batch as one transaction.
+
+  Caution: This function may receive untrusted input.
+  The batch is external input, so all the entries are validated by GetVariableBatchEntry ()
+  and VariableBatchCheckEntry () before any of them is applied.
+
+  @param[in, out] Batch         The batch, already copied to the variable buffer payload.
+  @param[in]      BatchSize     The size in bytes of the batch.
+
+  @retval EFI_SUCCESS           All the entries were applied and committed.
+  @retval EFI_INVALID_PARAMETER The batch has no entry, or an entry is invalid.
+  @retval EFI_ACCESS_DENIED     An entry is malformed.
+  @retval Others                The status of the entry that failed, or of the commit.
+
+**/
+EFI_STATUS
+SmmVariableSetVariableBatch (
+  IN OUT SMM_VARIABLE_COMMUNICATE_SET_VARIABLE_BATCH  *Batch,
+  IN     UINTN                                        BatchSize
+  )
+{
+  EFI_STATUS                                Status;
+  SMM_VARIABLE_COMMUNICATE_ACCESS_VARIABLE  *Entry;
+  UINTN                                     Index;
+  UINTN                                     Offset;
+
+  if (Batch->EntryCount == 0) {
+    Batch->FailedEntry = 0;
+    return EFI_INVALID_PARAMETER;
+  }
+
+  Offset = sizeof (SMM_VARIABLE_COMMUNICATE_SET_VARIABLE_BATCH);
+  for (Index = 0; Index < Batch->EntryCount; Index++) {
+    Status = GetVariableBatchEntry (Batch, BatchSize, &Offset, &Entry);
+    if (!EFI_ERROR (Status)) {
+      Status = VariableBatchCheckEntry (
+                 Entry->Name,
+                 &Entry->Guid,
+                 Entry->Attributes,
+                 Entry->DataSize,
+                 (UINT8 *) Entry->Name + Entry->NameSize
+                 );
+    }
+    if (EFI_ERROR (Status)) {
+      Batch->FailedEntry = Index;
+      return Status;
+    }
+  }
+
+  VariableBatchBegin ();
+
+  Status = EFI_SUCCESS;
+  Offset = sizeof (SMM_VARIABLE_COMMUNICATE_SET_VARIABLE_BATCH);
+  for (Index = 0; Index < Batch->EntryCount; Index++) {
+    Status = GetVariableBatchEntry (Batch, BatchSize, &Offset, &Entry);
+    ASSERT_EFI_ERROR (Status);
+
+    Status = VariableServiceSetVariable (
+               Entry->Name,
+               &Entry->Guid,
+               Entry->Attributes,
+               Entry->DataSize,
+               (UINT8 *) Entry->Name + Entry->NameSize
+               );
+    if (EFI_ERROR (Status)) {
+      break;
+    }
+  }
+
+  if (EFI_ERROR (Status)) {
+    VariableBatchEnd (FALSE);
+  } else {
+    Status = VariableBatchEnd (TRUE);
+  }
+
+  Batch->FailedEntry = Index;
+  return Status;
+}
+
 /**
 
   This code sets variable in storage blocks (Volatile or Non-Volatile).
@@ -105,6 +407,7 @@ SmmVariableSetVariable (
                      Data
                      );
   mRequestSource = VarCheckFromUntrusted;
+  SynchronizeRuntimeVariableCache ();
   return Status;
 }
 
@@ -476,10 +779,13 @@ SmmVariableHandler (
   VARIABLE_INFO_ENTRY                              *VariableInfo;
   SMM_VARIABLE_COMMUNICATE_LOCK_VARIABLE           *VariableToLock;
   SMM_VARIABLE_COMMUNICATE_VAR_CHECK_VARIABLE_PROPERTY *CommVariableProperty;
+  SMM_VARIABLE_COMMUNICATE_RUNTIME_CACHE           *RuntimeCache;
+  SMM_VARIABLE_COMMUNICATE_SET_VARIABLE_BATCH      *VariableBatch;
   UINTN                                            InfoSize;
   UINTN                                            NameBufferSize;
   UINTN                                            CommBufferPayloadSize;
   UINTN                                            TempCommBufferSize;
+  UINTN                                            Function;
 
   //
   // If input is invalid, stop processing this SMI
@@ -495,18 +801,25 @@ SmmVariableHandler (
     return EFI_SUCCESS;
   }
   CommBufferPayloadSize = TempCommBufferSize - SMM_VARIABLE_COMMUNICATE_HEADER_SIZE;
-  if (CommBufferPayloadSize > mVariableBufferPayloadSize) {
-    DEBUG ((EFI_D_ERROR, "SmmVariableHandler: SMM communication buffer payload size invalid!\n"));
-    return EFI_SUCCESS;
-  }
 
   if (!SmmIsBufferOutsideSmmValid ((UINTN)CommBuffer, TempCommBufferSize)) {
     DEBUG ((EFI_D_ERROR, "SmmVariableHandler: SMM communication buffer in SMRAM or overflow!\n"));
     return EFI_SUCCESS;
   }
 
+  //
+  // Read the function only once, a batch is allowed a larger payload than the other functions.
+  //
   SmmVariableFunctionHeader = (SMM_VARIABLE_COMMUNICATE_HEADER *)CommBuffer;
-  switch (SmmVariableFunctionHeader->Function) {
+  Function = SmmVariableFunctionHeader->Function;
+  if ((CommBufferPayloadSize > mVariableBufferPayloadSize) &&
+      ((Function != SMM_VARIABLE_FUNCTION_SET_VARIABLE_BATCH) ||
+       (CommBufferPayloadSize > PcdGet32 (PcdFlashNvStorageVariableSize)))) {
+    DEBUG ((EFI_D_ERROR, "SmmVariableHandler: SMM communication buffer payload size invalid!\n"));
+    return EFI_SUCCESS;
+  }
+
+  switch (Function) {
     case SMM_VARIABLE_FUNCTION_GET_VARIABLE:
       if (CommBufferPayloadSize < OFFSET_OF(SMM_VARIABLE_COMMUNICATE_ACCESS_VARIABLE, Name)) {
         DEBUG ((EFI_D_ERROR, "GetVariable: SMM communication buffer size invalid!\n"));
@@ -646,6 +959,28 @@ SmmVariableHandler (
                  SmmVariableHeader->DataSize,
                  (UINT8 *)SmmVariableHeader->Name + SmmVariableHeader->NameSize
                  );
+      SynchronizeRuntimeVariableCache ();
+      break;
+
+    case SMM_VARIABLE_FUNCTION_SET_VARIABLE_BATCH:
+      if (CommBufferPayloadSize < sizeof (SMM_VARIABLE_COMMUNICATE_SET_VARIABLE_BATCH)) {
+        DEBUG ((EFI_D_ERROR, "SetVariableBatch: SMM communication buffer size invalid!\n"));
+        return EFI_SUCCESS;
+      }
+      //
+      // Copy the input communicate buffer payload to SMRAM. The batch can be larger than
+      // the pre-allocated SMM variable buffer payload, so it gets a buffer of its own.
+      //
+      VariableBatch = AllocateCopyPool (CommBufferPayloadSize, SmmVariableFunctionHeader->Data);
+      if (VariableBatch == NULL) {
+        Status = EFI_OUT_OF_RESOURCES;
+        break;
+      }
+
+      Status = SmmVariableSetVariableBatch (VariableBatch, CommBufferPayloadSize);
+      ((SMM_VARIABLE_COMMUNICATE_SET_VARIABLE_BATCH *) SmmVariableFunctionHeader->Data)->FailedEntry = VariableBatch->FailedEntry;
+      FreePool (VariableBatch);
+      SynchronizeRuntimeVariableCache ();
       break;
 
     case SMM_VARIABLE_FUNCTION_QUERY_VARIABLE_INFO:
@@ -673,6 +1008,38 @@ SmmVariableHandler (
       Status = EFI_SUCCESS;
       break;
 
+    case SMM_VARIABLE_FUNCTION_GET_RUNTIME_CACHE_SIZE:
+      if (CommBufferPayloadSize < sizeof (SMM_VARIABLE_COMMUNICATE_RUNTIME_CACHE)) {
+        DEBUG ((EFI_D_ERROR, "GetRuntimeCacheSize: SMM communication buffer size invalid!\n"));
+        return EFI_SUCCESS;
+      }
+      RuntimeCache = (SMM_VARIABLE_COMMUNICATE_RUNTIME_CACHE *) SmmVariableFunctionHeader->Data;
+      RuntimeCache->CacheSize = GetRuntimeVariableCacheSize ();
+      Status = EFI_SUCCESS;
+      break;
+
+    case SMM_VARIABLE_FUNCTION_INIT_RUNTIME_CACHE:
+      if (CommBufferPayloadSize < sizeof (SMM_VARIABLE_COMMUNICATE_RUNTIME_CACHE)) {
+        DEBUG ((EFI_D_ERROR, "InitRuntimeCache: SMM communication buffer size invalid!\n"));
+        return EFI_SUCCESS;
+      }
+      if (mEndOfDxe || mVariableRuntimeCache != NULL) {
+        Status = EFI_ACCESS_DENIED;
+        break;
+      }
+      RuntimeCache = (SMM_VARIABLE_COMMUNICATE_RUNTIME_CACHE *) SmmVariableFunctionHeader->Data;
+      Status = InitRuntimeVariableCache (RuntimeCache->CacheBase, RuntimeCache->CacheSize);
+      break;
+
+    case SMM_VARIABLE_FUNCTION_SYNC_RUNTIME_CACHE:
+      if (mVariableRuntimeCache == NULL) {
+        Status = EFI_NOT_READY;
+        break;
+      }
+      SynchronizeRuntimeVariableCache ();
+      Status = mVariableRuntimeCache->PendingUpdate ? EFI_ACCESS_DENIED : EFI_SUCCESS;
+      break;
+
     case SMM_VARIABLE_FUNCTION_READY_TO_BOOT:
       if (AtRuntime()) {
         Status = EFI_UNSUPPORTED;
@@ -687,6 +1054,7 @@ SmmVariableHandler (
         InitializeVariableQuota ();
       }
       ReclaimForOS ();
+      SynchronizeRuntimeVariableCache ();
       Status = EFI_SUCCESS;
       break;
 
@@ -819,6 +1187,7 @@ SmmEndOfDxeCallback (
   InitializeVariableQuota ();
   if (PcdGetBool (PcdReclaimVariableSpaceAtEndOfDxe)) {
     ReclaimForOS ();
+    SynchronizeRuntimeVariableCache ();
   }
 
   return EFI_SUCCESS;
@@ -887,6 +1256,7 @@ SmmFtwNotificationEvent (
   if (EFI_ERROR (Status)) {
     DEBUG ((DEBUG_ERROR, "Variable write service initialization failed. Status = %r\n", Status));
   }
+  SynchronizeRuntimeVariableCache ();
 
   //
   // Notify the variable wrapper driver the variable write service is ready
@@ -29,6 +29,7 @@ WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
 #include <Protocol/SmmCommunication.h>
 #include <Protocol/SmmVariable.h>
 #include <Protocol/VariableLock.h>
+#include <Protocol/VariableBatch.h>
 #include <Protocol/VarCheck.h>
 
 #include <Library/UefiBootServicesTableLib.h>
@@ -40,6 +41,7 @@ WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
 #include <Library/DebugLib.h>
 #include <Library/UefiLib.h>
 #include <Library/BaseLib.h>
+#include <Library/PcdLib.h>
 
 #include <Guid/EventGroup.h>
 #include <Guid/SmmVariableCommon.h>
@@ -54,6 +56,7 @@ UINTN                            mVariableBufferSize;
 UINTN                            mVariableBufferPayloadSize;
 EFI_LOCK                         mVariableServicesLock;
 EDKII_VARIABLE_LOCK_PROTOCOL     mVariableLock;
+EDKII_VARIABLE_BATCH_PROTOCOL    mVariableBatch;
 EDKII_VAR_CHECK_PROTOCOL         mVarCheck;
 
 /**
@@ -81,6 +84,54 @@ RecordSecureBootPolicyVarData(
   VOID
   );
 
+extern VARIABLE_RUNTIME_CACHE_HEADER  *mVariableRuntimeCache;
+
+/**
+  This code finds variable in the runtime variable cache.
+
+  @param[in]      VariableName       Name of Variable to be found.
+  @param[in]      VendorGuid         Variable vendor GUID.
+  @param[out]     Attributes         Attribute value of the variable found.
+  @param[in, out] DataSize           Size of Data found. If size is less than the
+                                     data, this value contains the required size.
+  @param[out]     Data               Data pointer.
+
+  @retval EFI_INVALID_PARAMETER      Invalid parameter.
+  @retval EFI_SUCCESS                Find the specified variable.
+  @retval EFI_NOT_FOUND              Not found.
+  @retval EFI_BUFFER_TO_SMALL        DataSize is too small for the result.
+  @retval EFI_UNSUPPORTED            The runtime variable cache cannot be used.
+
+**/
+EFI_STATUS
+GetVariableFromRuntimeCache (
+  IN      CHAR16                            *VariableName,
+  IN      EFI_GUID                          *VendorGuid,
+  OUT     UINT32                            *Attributes OPTIONAL,
+  IN OUT  UINTN                             *DataSize,
+  OUT     VOID                              *Data
+  );
+
+/**
+  This code finds the next available variable in the runtime variable cache.
+
+  @param[in, out] VariableNameSize   Size of the variable name.
+  @param[in, out] VariableName       Pointer to variable name.
+  @param[in, out] VendorGuid         Variable Vendor Guid.
+
+  @retval EFI_SUCCESS                Find the specified variable.
+  @retval EFI_NOT_FOUND              Not found.
+  @retval EFI_BUFFER_TO_SMALL        VariableNameSize is too small for the result.
+  @retval EFI_UNSUPPORTED            The runtime variable cache cannot be used.
+
+**/
+EFI_STATUS
+GetNextVariableNameFromRuntimeCache (
+  IN OUT  UINTN                             *VariableNameSize,
+  IN OUT  CHAR16                            *VariableName,
+  IN OUT  EFI_GUID                          *VendorGuid
+  );
+
 /**
   Acquires lock only at boot time. Simply returns at runtime.
 
@@ -494,6 +545,16 @@ RuntimeServiceGetVariable (
 
   AcquireLockOnlyAtBootTime(&mVariableServicesLock);
 
+  //
+  // Read the variable from the runtime variable cache if possible, to avoid an SMI.
+  //
+  if (mVariableRuntimeCache != NULL) {
+    Status = GetVariableFromRuntimeCache (VariableName, VendorGuid, Attributes, DataSize, Data);
+    if (Status != EFI_UNSUPPORTED) {
+      goto Done;
+    }
+  }
+
   //
   // Init the communicate buffer. The buffer data size is:
   // SMM_COMMUNICATE_HEADER_SIZE + SMM_VARIABLE_COMMUNICATE_HEADER_SIZE + PayloadSize.
@@ -601,6 +662,16 @@ RuntimeServiceGetNextVariableName (
 
   AcquireLockOnlyAtBootTime(&mVariableServicesLock);
 
+  //
+  // Read the variable from the runtime variable cache if possible, to avoid an SMI.
+  //
+  if (mVariableRuntimeCache != NULL) {
+    Status = GetNextVariableNameFromRuntimeCache (VariableNameSize, VariableName, VendorGuid);
+    if (Status != EFI_UNSUPPORTED) {
+      goto Done;
+    }
+  }
+
   //
   // Init the communicate buffer. The buffer data size is:
   // SMM_COMMUNICATE_HEADER_SIZE + SMM_VARIABLE_COMMUNICATE_HEADER_SIZE + PayloadSize.
@@ -759,6 +830,141 @@ Done:
   return Status;
 }
 
+/**
+  Update several variables as one transaction.
+
+  All the entries are sent to SMM in one communicate buffer, where they are applied
+  in order and the non-volatile changes are committed with a single fault tolerant
+  write only when all of them succeeded. The batch can be larger than the variable
+  payload size, so it is sent in a communicate buffer of its own, which can hold as
+  much data as the non-volatile variable store.
+
+  @param[in]  This          The EDKII_VARIABLE_BATCH_PROTOCOL instance.
+  @param[in]  EntryCount    The number of entries in Entries.
+  @param[in]  Entries       The variable updates to apply.
+  @param[out] FailedEntry   On error, the index of the entry that failed, or EntryCount
+                            if the batch failed as a whole. Optional.
+
+  @retval EFI_SUCCESS           All the updates were applied and committed.
+  @retval EFI_INVALID_PARAMETER EntryCount is 0 or Entries is NULL, or an entry is invalid.
+  @retval EFI_BAD_BUFFER_SIZE   The batch exceeds the SMM payload limit.
+  @retval EFI_OUT_OF_RESOURCES  The communicate buffer could not be allocated.
+  @retval Others                The status of the entry that failed, or of the commit.
+**/
+EFI_STATUS
+EFIAPI
+VariableBatchSetVariables (
+  IN CONST EDKII_VARIABLE_BATCH_PROTOCOL  *This,
+  IN       UINTN                          EntryCount,
+  IN       EDKII_VARIABLE_BATCH_ENTRY     *Entries,
+  OUT      UINTN                          *FailedEntry OPTIONAL
+  )
+{
+  EFI_STATUS                                  Status;
+  UINTN                                       Index;
+  UINTN                                       PayloadSize;
+  UINTN                                       VariableNameSize;
+  UINTN                                       MaxPayloadSize;
+  UINTN                                       CommSize;
+  EFI_SMM_COMMUNICATE_HEADER                  *SmmCommunicateHeader;
+  SMM_VARIABLE_COMMUNICATE_HEADER             *SmmVariableFunctionHeader;
+  SMM_VARIABLE_COMMUNICATE_SET_VARIABLE_BATCH *SmmVariableBatch;
+  SMM_VARIABLE_COMMUNICATE_ACCESS_VARIABLE    *SmmVariableHeader;
+
+  if ((EntryCount == 0) || (Entries == NULL)) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  //
+  // Check the entries and compute the payload size, the entries have to fit in
+  // one communicate buffer to be handled as one transaction.
+  //
+  MaxPayloadSize = MAX (mVariableBufferPayloadSize, PcdGet32 (PcdFlashNvStorageVariableSize));
+  PayloadSize    = sizeof (SMM_VARIABLE_COMMUNICATE_SET_VARIABLE_BATCH);
+  for (Index = 0; Index < EntryCount; Index++) {
+    if ((Entries[Index].VariableName == NULL) || (Entries[Index].VariableName[0] == 0) ||
+        (Entries[Index].VendorGuid == NULL) ||
+        ((Entries[Index].DataSize != 0) && (Entries[Index].Data == NULL))) {
+      if (FailedEntry != NULL) {
+        *FailedEntry = Index;
+      }
+      return EFI_INVALID_PARAMETER;
+    }
+
+    VariableNameSize = StrSize (Entries[Index].VariableName);
+    PayloadSize      = ALIGN_VALUE (PayloadSize, sizeof (UINT64));
+    if ((PayloadSize > MaxPayloadSize) ||
+        (VariableNameSize > MaxPayloadSize - PayloadSize - OFFSET_OF (SMM_VARIABLE_COMMUNICATE_ACCESS_VARIABLE, Name)) ||
+        (Entries[Index].DataSize > MaxPayloadSize - PayloadSize - OFFSET_OF (SMM_VARIABLE_COMMUNICATE_ACCESS_VARIABLE, Name) - VariableNameSize)) {
+      if (FailedEntry != NULL) {
+        *FailedEntry = EntryCount;
+      }
+      return EFI_BAD_BUFFER_SIZE;
+    }
+    PayloadSize += OFFSET_OF (SMM_VARIABLE_COMMUNICATE_ACCESS_VARIABLE, Name) + VariableNameSize + Entries[Index].DataSize;
+  }
+
+  //
+  // Init the communicate buffer. The buffer data size is:
+  // SMM_COMMUNICATE_HEADER_SIZE + SMM_VARIABLE_COMMUNICATE_HEADER_SIZE + PayloadSize.
+  //
+  CommSize             = SMM_COMMUNICATE_HEADER_SIZE + SMM_VARIABLE_COMMUNICATE_HEADER_SIZE + PayloadSize;
+  SmmCommunicateHeader = AllocatePool (CommSize);
+  if (SmmCommunicateHeader == NULL) {
+    if (FailedEntry != NULL) {
+      *FailedEntry = EntryCount;
+    }
+    return EFI_OUT_OF_RESOURCES;
+  }
+  CopyGuid (&SmmCommunicateHeader->HeaderGuid, &gEfiSmmVariableProtocolGuid);
+  SmmCommunicateHeader->MessageLength = PayloadSize + SMM_VARIABLE_COMMUNICATE_HEADER_SIZE;
+
+  SmmVariableFunctionHeader = (SMM_VARIABLE_COMMUNICATE_HEADER *) SmmCommunicateHeader->Data;
+  SmmVariableFunctionHeader->Function = SMM_VARIABLE_FUNCTION_SET_VARIABLE_BATCH;
+  SmmVariableBatch = (SMM_VARIABLE_COMMUNICATE_SET_VARIABLE_BATCH *) SmmVariableFunctionHeader->Data;
+
+  SmmVariableBatch->EntryCount  = EntryCount;
+  SmmVariableBatch->FailedEntry = EntryCount;
+  PayloadSize = sizeof (SMM_VARIABLE_COMMUNICATE_SET_VARIABLE_BATCH);
+  for (Index = 0; Index < EntryCount; Index++) {
+    PayloadSize       = ALIGN_VALUE (PayloadSize, sizeof (UINT64));
+    SmmVariableHeader = (SMM_VARIABLE_COMMUNICATE_ACCESS_VARIABLE *) ((UINT8 *) SmmVariableBatch + PayloadSize);
+
+    CopyGuid (&SmmVariableHeader->Guid, Entries[Index].VendorGuid);
+    SmmVariableHeader->DataSize   = Entries[Index].DataSize;
+    SmmVariableHeader->NameSize   = StrSize (Entries[Index].VariableName);
+    SmmVariableHeader->Attributes = Entries[Index].Attributes;
+    CopyMem (SmmVariableHeader->Name, Entries[Index].VariableName, SmmVariableHeader->NameSize);
+    CopyMem ((UINT8 *) SmmVariableHeader->Name + SmmVariableHeader->NameSize, Entries[Index].Data, Entries[Index].DataSize);
+
+    PayloadSize += OFFSET_OF (SMM_VARIABLE_COMMUNICATE_ACCESS_VARIABLE, Name) + SmmVariableHeader->NameSize + SmmVariableHeader->DataSize;
+  }
+
+  //
+  // Send data to SMM.
+  //
+  AcquireLockOnlyAtBootTime(&mVariableServicesLock);
+  Status = mSmmCommunication->Communicate (mSmmCommunication, SmmCommunicateHeader, &CommSize);
+  ASSERT_EFI_ERROR (Status);
+  Status = SmmVariableFunctionHeader->ReturnStatus;
+  ReleaseLockOnlyAtBootTime (&mVariableServicesLock);
+
+  if (EFI_ERROR (Status) && (FailedEntry != NULL)) {
+    *FailedEntry = SmmVariableBatch->FailedEntry;
+  }
+  FreePool (SmmCommunicateHeader);
+
+  if (!EFI_ERROR (Status)) {
+    for (Index = 0; Index < EntryCount; Index++) {
+      SecureBootHook (
+        Entries[Index].VariableName,
+        Entries[Index].VendorGuid
+        );
+    }
+  }
+  return Status;
+}
+
 
 /**
   This code returns information about the EFI variables.
@@ -911,6 +1117,7 @@ VariableAddressChangeEvent (
 {
   EfiConvertPointer (0x0, (VOID **) &mVariableBuffer);
   EfiConvertPointer (0x0, (VOID **) &mSmmCommunication);
+  EfiConvertPointer (0x0, (VOID **) &mVariableRuntimeCache);
 }
 
 /**
@@ -987,6 +1194,78 @@ Done:
   return Status;
 }
 
+/**
+  Ask the SMM variable driver to apply the updates of the runtime variable cache
+  that it deferred while the cache was being read.
+
+  The caller must hold mVariableServicesLock.
+
+  @retval EFI_SUCCESS           The runtime variable cache is up to date.
+  @retval Others                The runtime variable cache could not be updated.
+
+**/
+EFI_STATUS
+SyncRuntimeVariableCache (
+  VOID
+  )
+{
+  EFI_STATUS                                Status;
+
+  Status = InitCommunicateBuffer (NULL, 0, SMM_VARIABLE_FUNCTION_SYNC_RUNTIME_CACHE);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+  return SendCommunicateBuffer (0);
+}
+
+/**
+  Allocate the runtime variable cache and hand it to the SMM variable driver,
+  which copies the variable stores into it and keeps it up to date.
+
+  If this fails, all variable reads go through SMI.
+
+**/
+VOID
+InitRuntimeVariableCache (
+  VOID
+  )
+{
+  EFI_STATUS                                Status;
+  SMM_VARIABLE_COMMUNICATE_RUNTIME_CACHE    *RuntimeCache;
+  UINTN                                     CacheSize;
+  VOID                                      *Cache;
+
+  RuntimeCache = NULL;
+  Status = InitCommunicateBuffer ((VOID **) &RuntimeCache, sizeof (*RuntimeCache), SMM_VARIABLE_FUNCTION_GET_RUNTIME_CACHE_SIZE);
+  if (EFI_ERROR (Status)) {
+    return;
+  }
+  ASSERT (RuntimeCache != NULL);
+  Status = SendCommunicateBuffer (sizeof (*RuntimeCache));
+  if (EFI_ERROR (Status) || RuntimeCache->CacheSize > MAX_UINTN) {
+    return;
+  }
+
+  CacheSize = (UINTN) RuntimeCache->CacheSize;
+  Cache     = AllocateRuntimePages (EFI_SIZE_TO_PAGES (CacheSize));
+  if (Cache == NULL) {
+    return;
+  }
+
+  Status = InitCommunicateBuffer ((VOID **) &RuntimeCache, sizeof (*RuntimeCache), SMM_VARIABLE_FUNCTION_INIT_RUNTIME_CACHE);
+  ASSERT_EFI_ERROR (Status);
+  RuntimeCache->CacheBase = (EFI_PHYSICAL_ADDRESS) (UINTN) Cache;
+  RuntimeCache->CacheSize = CacheSize;
+  Status = SendCommunicateBuffer (sizeof (*RuntimeCache));
+  if (EFI_ERROR (Status)) {
+    DEBUG ((EFI_D_ERROR, "Variable: runtime variable cache not initialized - %r\n", Status));
+    FreePages (Cache, EFI_SIZE_TO_PAGES (CacheSize));
+    return;
+  }
+
+  mVariableRuntimeCache = Cache;
+}
+
 /**
   Initialize variable service and install Variable Architectural protocol.
 
@@ -1025,6 +1304,10 @@ SmmVariableReady (
   //
   mVariableBufferPhysical = mVariableBuffer;
 
+  if (FeaturePcdGet (PcdEnableVariableRuntimeCache)) {
+    InitRuntimeVariableCache ();
+  }
+
   gRT->GetVariable         = RuntimeServiceGetVariable;
   gRT->GetNextVariableName = RuntimeServiceGetNextVariableName;
   gRT->SetVariable         = RuntimeServiceSetVariable;
@@ -1104,6 +1387,15 @@ SmmVariableWriteReady (
                   );
   ASSERT_EFI_ERROR (Status);
 
+  mVariableBatch.SetVariables = VariableBatchSetVariables;
+  Status = gBS->InstallMultipleProtocolInterfaces (
+                  &mHandle,
+                  &gEdkiiVariableBatchProtocolGuid,
+                  &mVariableBatch,
+                  NULL
+                  );
+  ASSERT_EFI_ERROR (Status);
+
   gBS->CloseEvent (Event);
 }
 
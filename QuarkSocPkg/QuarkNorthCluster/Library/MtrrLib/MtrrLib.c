@@ -1893,6 +1893,65 @@ MtrrSetMemoryAttributeInMtrrSettings (
            );
 }
 
+/**
+  This function attempts to set the attributes into MTRR setting buffer for
+  several memory ranges at once.
+
+  The memory ranges are applied in order, so a later range overrides an
+  earlier one where they overlap. The result of each range must fit in the
+  variable MTRRs.
+
+  MtrrSetting is only updated when all the memory ranges are set, it is left
+  unchanged when an error is returned.
+
+  @param[in, out]  MtrrSetting  MTRR setting buffer to be set.
+  @param[in]       Ranges       The memory ranges to set.
+  @param[in]       RangeCount   The count of memory ranges.
+
+  @retval RETURN_SUCCESS            The attributes were set for all the memory ranges.
+  @retval RETURN_INVALID_PARAMETER  Ranges is NULL or RangeCount is zero.
+  @retval RETURN_INVALID_PARAMETER  Length of a memory range is zero.
+  @retval RETURN_UNSUPPORTED        The processor does not support one or more bytes of a
+                                    memory resource range.
+  @retval RETURN_UNSUPPORTED        The bit mask of attributes is not support for a memory
+                                    resource range.
+  @retval RETURN_OUT_OF_RESOURCES   There are not enough system resources to modify the attributes of
+                                    the memory resource ranges.
+
+**/
+RETURN_STATUS
+EFIAPI
+MtrrSetMemoryAttributesInMtrrSettings (
+  IN OUT MTRR_SETTINGS            *MtrrSetting,
+  IN CONST MTRR_MEMORY_RANGE      *Ranges,
+  IN UINTN                        RangeCount
+  )
+{
+  RETURN_STATUS                   Status;
+  UINTN                           Index;
+  MTRR_SETTINGS                   WorkingMtrrSetting;
+
+  if ((Ranges == NULL) || (RangeCount == 0)) {
+    return RETURN_INVALID_PARAMETER;
+  }
+
+  CopyMem (&WorkingMtrrSetting, MtrrSetting, sizeof (WorkingMtrrSetting));
+  for (Index = 0; Index < RangeCount; Index++) {
+    Status = MtrrSetMemoryAttributeInMtrrSettings (
+               &WorkingMtrrSetting,
+               Ranges[Index].BaseAddress,
+               Ranges[Index].Length,
+               Ranges[Index].Type
+               );
+    if (RETURN_ERROR (Status)) {
+      return Status;
+    }
+  }
+
+  CopyMem (MtrrSetting, &WorkingMtrrSetting, sizeof (WorkingMtrrSetting));
+  return RETURN_SUCCESS;
+}
+
 /**
   Worker function setting variable MTRRs
 
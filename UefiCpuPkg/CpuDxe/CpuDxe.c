@@ -392,6 +392,8 @@ CpuSetMemoryAttributes (
   EFI_STATUS                MpStatus;
   EFI_MP_SERVICES_PROTOCOL  *MpService;
   MTRR_SETTINGS             MtrrSettings;
+  MTRR_SETTINGS             OriginalMtrrSettings;
+  MTRR_MEMORY_RANGE         MtrrRange;
   UINT64                    CacheAttributes;
   UINT64                    MemoryAttributes;
   MTRR_MEMORY_CACHE_TYPE    CurrentCacheType;
@@ -447,15 +449,20 @@ CpuSetMemoryAttributes (
     CurrentCacheType = MtrrGetMemoryAttribute(BaseAddress);
     if (CurrentCacheType != CacheType) {
       //
-      // call MTRR libary function
+      // Calculate the new MTRR settings in memory, and program them to the BSP
+      // and all APs in one pass per processor only when they change.
       //
-      Status = MtrrSetMemoryAttribute (
-                 BaseAddress,
-                 Length,
-                 CacheType
-                 );
+      MtrrGetAllMtrrs (&MtrrSettings);
+      CopyMem (&OriginalMtrrSettings, &MtrrSettings, sizeof (MtrrSettings));
+      MtrrRange.BaseAddress = BaseAddress;
+      MtrrRange.Length      = Length;
+      MtrrRange.Type        = CacheType;
+      Status = MtrrSetMemoryAttributesInMtrrSettings (&MtrrSettings, &MtrrRange, 1);
+
+      if (!RETURN_ERROR (Status) &&
+          CompareMem (&MtrrSettings, &OriginalMtrrSettings, sizeof (MtrrSettings)) != 0) {
+        MtrrSetAllMtrrs (&MtrrSettings);
 
-      if (!RETURN_ERROR (Status)) {
         MpStatus = gBS->LocateProtocol (
                           &gEfiMpServiceProtocolGuid,
                           NULL,
@@ -465,7 +472,6 @@ CpuSetMemoryAttributes (
         // Synchronize the update with all APs
         //
         if (!EFI_ERROR (MpStatus)) {
-          MtrrGetAllMtrrs (&MtrrSettings);
           MpStatus = MpService->StartupAllAPs (
                                   MpService,          // This
                                   SetMtrrsFromBuffer, // Procedure
@@ -85,6 +85,18 @@ PAGE_ATTRIBUTE_TABLE mPageAttributeTable[] = {
   {Page1G,  SIZE_1GB, PAGING_1G_ADDRESS_MASK_64},
 };
 
+#define MAX_PENDING_PAGE_TABLE_PAGES  64
+
+//
+// Page table pages released by page merging. The processors may still walk a
+// released page through their paging-structure caches, so it is left untouched
+// in the pending list until the TLB is flushed. Then it is moved to the free
+// list, linked through its first entry, and reused by later page splits.
+//
+VOID                 *mPendingPageTablePages[MAX_PENDING_PAGE_TABLE_PAGES];
+UINTN                mPendingPageTablePageCount = 0;
+VOID                 *mFreePageTablePages = NULL;
+
 /**
   Enable write protection function for AP.
 
@@ -326,6 +338,43 @@ GetPageTableEntry (
   return &L1PageTable[Index1];
 }
 
+/**
+  Return page directory pointer entry to match the address.
+
+  @param[in]  PagingContext     The paging context.
+  @param[in]  Address           The address to be checked.
+
+  @return The page directory pointer entry, or NULL if the address is not mapped.
+**/
+UINT64 *
+GetPageDirectoryPointerEntry (
+  IN  PAGE_TABLE_LIB_PAGING_CONTEXT     *PagingContext,
+  IN  PHYSICAL_ADDRESS                  Address
+  )
+{
+  UINTN                 Index3;
+  UINTN                 Index4;
+  UINT64                *L3PageTable;
+  UINT64                *L4PageTable;
+  UINT64                AddressEncMask;
+
+  Index4 = ((UINTN)RShiftU64 (Address, 39)) & PAGING_PAE_INDEX_MASK;
+  Index3 = ((UINTN)RShiftU64 (Address, 30)) & PAGING_PAE_INDEX_MASK;
+
+  AddressEncMask = PcdGet64 (PcdPteMemoryEncryptionAddressOrMask) & PAGING_1G_ADDRESS_MASK_64;
+
+  if (PagingContext->MachineType == IMAGE_FILE_MACHINE_X64) {
+    L4PageTable = (UINT64 *)(UINTN)PagingContext->ContextData.X64.PageTableBase;
+    if (L4PageTable[Index4] == 0) {
+      return NULL;
+    }
+    L3PageTable = (UINT64 *)(UINTN)(L4PageTable[Index4] & ~AddressEncMask & PAGING_4K_ADDRESS_MASK_64);
+  } else {
+    L3PageTable = (UINT64 *)(UINTN)PagingContext->ContextData.Ia32.PageTableBase;
+  }
+  return &L3PageTable[Index3];
+}
+
 /**
   Return memory attributes of page entry.
 
@@ -480,6 +529,30 @@ NeedSplitPage (
   return Page2M;
 }
 
+/**
+  Allocate one page for page table.
+
+  The pages released by page merging are reused first.
+
+  @param[in]  AllocatePagesFunc This function is used to allocate more pages.
+
+  @return The page, or NULL if allocation fails.
+**/
+VOID *
+AllocatePageTablePage (
+  IN  PAGE_TABLE_LIB_ALLOCATE_PAGES     AllocatePagesFunc
+  )
+{
+  VOID  *Page;
+
+  if (mFreePageTablePages != NULL) {
+    Page = mFreePageTablePages;
+    mFreePageTablePages = *(VOID **)Page;
+    return Page;
+  }
+  return AllocatePagesFunc (1);
+}
+
 /**
   This function splits one page entry to small page entries.
 
@@ -519,7 +592,7 @@ SplitPage (
     //
     ASSERT (SplitAttribute == Page4K);
     if (SplitAttribute == Page4K) {
-      NewPageEntry = AllocatePagesFunc (1);
+      NewPageEntry = AllocatePageTablePage (AllocatePagesFunc);
       DEBUG ((DEBUG_INFO, "Split - 0x%x\n", NewPageEntry));
       if (NewPageEntry == NULL) {
         return RETURN_OUT_OF_RESOURCES;
@@ -540,7 +613,7 @@ SplitPage (
     //
     ASSERT (SplitAttribute == Page2M || SplitAttribute == Page4K);
     if ((SplitAttribute == Page2M || SplitAttribute == Page4K)) {
-      NewPageEntry = AllocatePagesFunc (1);
+      NewPageEntry = AllocatePageTablePage (AllocatePagesFunc);
       DEBUG ((DEBUG_INFO, "Split - 0x%x\n", NewPageEntry));
       if (NewPageEntry == NULL) {
         return RETURN_OUT_OF_RESOURCES;
@@ -559,6 +632,215 @@ SplitPage (
   }
 }
 
+/**
+  This function merges one page entry pointing to a page table back to one large page entry,
+  if all the entries of the page table map contiguous memory with the same attributes.
+
+  The page table page is put in the pending list. Caller should flush TLB after the merge, and then
+  call ReleasePendingPageTablePages() to make the page available to later page splits.
+
+  @param[in]  PageEntry         The page entry pointing to the page table.
+  @param[in]  PageAttribute     The page attribute of the large page entry: Page2M or Page1G.
+
+  @retval TRUE   The page entry is merged.
+  @retval FALSE  The page entry is not merged, or the pending list is full.
+**/
+BOOLEAN
+MergePage (
+  IN  UINT64                            *PageEntry,
+  IN  PAGE_ATTRIBUTE                    PageAttribute
+  )
+{
+  UINT64   *PageTable;
+  UINT64   FirstPageEntry;
+  UINT64   SubLength;
+  UINT64   SubAddressMask;
+  UINT64   IgnoredBits;
+  UINTN    Index;
+  UINT64   AddressEncMask;
+
+  ASSERT (PageAttribute == Page2M || PageAttribute == Page1G);
+
+  if (mPendingPageTablePageCount == ARRAY_SIZE (mPendingPageTablePages)) {
+    return FALSE;
+  }
+
+  AddressEncMask = PcdGet64 (PcdPteMemoryEncryptionAddressOrMask) & PAGING_1G_ADDRESS_MASK_64;
+
+  PageTable      = (UINT64 *)(UINTN)(*PageEntry & ~AddressEncMask & PAGING_4K_ADDRESS_MASK_64);
+  FirstPageEntry = PageTable[0];
+  if (PageAttribute == Page2M) {
+    //
+    // The PAT bit of 4K page entry is at the position of the PS bit.
+    //
+    if ((FirstPageEntry & IA32_PG_PAT_4K) != 0) {
+      return FALSE;
+    }
+    SubLength      = SIZE_4KB;
+    SubAddressMask = PAGING_4K_ADDRESS_MASK_64;
+  } else {
+    if ((FirstPageEntry & IA32_PG_PS) == 0) {
+      return FALSE;
+    }
+    SubLength      = SIZE_2MB;
+    SubAddressMask = PAGING_2M_ADDRESS_MASK_64;
+  }
+  if ((FirstPageEntry & ~AddressEncMask & SubAddressMask & (PageAttributeToLength (PageAttribute) - 1)) != 0) {
+    return FALSE;
+  }
+
+  //
+  // The processor sets accessed and dirty bits on its own, ignore them.
+  //
+  IgnoredBits = IA32_PG_A | IA32_PG_D;
+  for (Index = 1; Index < SIZE_4KB / sizeof(UINT64); Index++) {
+    if (((PageTable[Index] ^ (FirstPageEntry + SubLength * Index)) & ~IgnoredBits) != 0) {
+      return FALSE;
+    }
+  }
+
+  //
+  // The access rights of the page entry pointing to the page table apply to all the pages.
+  //
+  FirstPageEntry |= IA32_PG_PS | IA32_PG_A | IA32_PG_D;
+  if ((*PageEntry & IA32_PG_P) == 0) {
+    FirstPageEntry &= ~(UINT64)IA32_PG_P;
+  }
+  if ((*PageEntry & IA32_PG_RW) == 0) {
+    FirstPageEntry &= ~(UINT64)IA32_PG_RW;
+  }
+  if ((*PageEntry & IA32_PG_U) == 0) {
+    FirstPageEntry &= ~(UINT64)IA32_PG_U;
+  }
+  FirstPageEntry |= *PageEntry & IA32_PG_NX;
+
+  *PageEntry = FirstPageEntry;
+  DEBUG ((DEBUG_INFO, "Merge - 0x%x\n", PageTable));
+
+  mPendingPageTablePages[mPendingPageTablePageCount++] = PageTable;
+  return TRUE;
+}
+
+/**
+  This function moves the page table pages released by page merging to the free list.
+
+  Caller should make sure no processor uses the pages any more, e.g. by flushing TLB.
+**/
+VOID
+ReleasePendingPageTablePages (
+  VOID
+  )
+{
+  UINTN  Index;
+
+  for (Index = 0; Index < mPendingPageTablePageCount; Index++) {
+    *(VOID **)mPendingPageTablePages[Index] = mFreePageTablePages;
+    mFreePageTablePages = mPendingPageTablePages[Index];
+  }
+  mPendingPageTablePageCount = 0;
+}
+
+/**
+  Check if the paging context is the one in use by the current CPU.
+
+  @param[in]  PagingContext     The paging context.
+
+  @retval TRUE   The paging context is in use by the current CPU.
+  @retval FALSE  The paging context is not in use by the current CPU.
+**/
+BOOLEAN
+IsCurrentPagingContext (
+  IN  PAGE_TABLE_LIB_PAGING_CONTEXT     *PagingContext
+  )
+{
+  UINT64  PageTableBase;
+
+  if ((AsmReadCr0 () & BIT31) == 0) {
+    return FALSE;
+  }
+  if (PagingContext->MachineType == IMAGE_FILE_MACHINE_X64) {
+    PageTableBase = PagingContext->ContextData.X64.PageTableBase;
+  } else {
+    PageTableBase = PagingContext->ContextData.Ia32.PageTableBase;
+  }
+  return (BOOLEAN)(PageTableBase == (AsmReadCr3 () & PAGING_4K_ADDRESS_MASK_64));
+}
+
+/**
+  This function merges the page tables mapping the memory region specified by BaseAddress and
+  Length back to large pages where possible, so that the page table does not keep growing as
+  the attributes of memory regions change back and forth.
+
+  @param[in]  PagingContext     The paging context.
+  @param[in]  BaseAddress       The physical address that is the start address of a memory region.
+  @param[in]  Length            The size in bytes of the memory region.
+
+  @retval TRUE   At least one page entry is merged.
+  @retval FALSE  No page entry is merged.
+**/
+BOOLEAN
+MergeMemoryPages (
+  IN  PAGE_TABLE_LIB_PAGING_CONTEXT     *PagingContext,
+  IN  PHYSICAL_ADDRESS                  BaseAddress,
+  IN  UINT64                            Length
+  )
+{
+  PHYSICAL_ADDRESS  Address;
+  PHYSICAL_ADDRESS  EndAddress;
+  UINT64            *PageDirectoryPointerEntry;
+  UINT64            *PageDirectory;
+  UINT64            *PageEntry;
+  UINT64            AddressEncMask;
+  BOOLEAN           IsMerged;
+
+  AddressEncMask = PcdGet64 (PcdPteMemoryEncryptionAddressOrMask) & PAGING_1G_ADDRESS_MASK_64;
+
+  IsMerged   = FALSE;
+  EndAddress = BaseAddress + Length;
+
+  //
+  // Merge 4K pages to 2M pages.
+  //
+  Address = BaseAddress & ~(UINT64)PAGING_2M_MASK;
+  while (Address < EndAddress) {
+    PageDirectoryPointerEntry = GetPageDirectoryPointerEntry (PagingContext, Address);
+    if ((PageDirectoryPointerEntry == NULL) || (*PageDirectoryPointerEntry == 0) ||
+        ((*PageDirectoryPointerEntry & IA32_PG_PS) != 0)) {
+      Address = (Address & ~(UINT64)PAGING_1G_MASK) + SIZE_1GB;
+      continue;
+    }
+    PageDirectory = (UINT64 *)(UINTN)(*PageDirectoryPointerEntry & ~AddressEncMask & PAGING_4K_ADDRESS_MASK_64);
+    PageEntry     = &PageDirectory[((UINTN)RShiftU64 (Address, 21)) & PAGING_PAE_INDEX_MASK];
+    if ((*PageEntry != 0) && ((*PageEntry & IA32_PG_PS) == 0)) {
+      if (MergePage (PageEntry, Page2M)) {
+        IsMerged = TRUE;
+      }
+    }
+    Address += SIZE_2MB;
+  }
+
+  //
+  // Merge 2M pages to 1G pages. The PAE page directory pointer entry cannot map a 1G page.
+  //
+  if ((PagingContext->MachineType != IMAGE_FILE_MACHINE_X64) ||
+      ((PagingContext->ContextData.X64.Attributes & PAGE_TABLE_LIB_PAGING_CONTEXT_IA32_X64_ATTRIBUTES_PAGE_1G_SUPPORT) == 0)) {
+    return IsMerged;
+  }
+  Address = BaseAddress & ~(UINT64)PAGING_1G_MASK;
+  while (Address < EndAddress) {
+    PageDirectoryPointerEntry = GetPageDirectoryPointerEntry (PagingContext, Address);
+    if ((PageDirectoryPointerEntry != NULL) && (*PageDirectoryPointerEntry != 0) &&
+        ((*PageDirectoryPointerEntry & IA32_PG_PS) == 0)) {
+      if (MergePage (PageDirectoryPointerEntry, Page1G)) {
+        IsMerged = TRUE;
+      }
+    }
+    Address += SIZE_1GB;
+  }
+
+  return IsMerged;
+}
+
 /**
   This function modifies the page attributes for the memory region specified by BaseAddress and
   Length from their current attributes to the attributes specified by Attributes.
@@ -607,6 +889,9 @@ ConvertMemoryPageAttributes (
   PAGE_ATTRIBUTE                    SplitAttribute;
   RETURN_STATUS                     Status;
   BOOLEAN                           IsEntryModified;
+  UINT64                            NewPageEntry;
+  PHYSICAL_ADDRESS                  OriginalBaseAddress;
+  UINT64                            OriginalLength;
 
   if ((BaseAddress & (SIZE_4KB - 1)) != 0) {
     DEBUG ((DEBUG_ERROR, "BaseAddress(0x%lx) is not aligned!\n", BaseAddress));
@@ -664,6 +949,9 @@ ConvertMemoryPageAttributes (
     *IsModified = FALSE;
   }
 
+  OriginalBaseAddress = BaseAddress;
+  OriginalLength      = Length;
+
   //
   // Below logic is to check 2M/4K page to make sure we donot waist memory.
   //
@@ -687,6 +975,21 @@ ConvertMemoryPageAttributes (
       BaseAddress += PageEntryLength;
       Length -= PageEntryLength;
     } else {
+      //
+      // No need to split the page if the attributes of the whole page do not change.
+      //
+      NewPageEntry = *PageEntry;
+      ConvertPageEntryAttribute (&CurrentPagingContext, &NewPageEntry, Attributes, PageAction, &IsEntryModified);
+      if (!IsEntryModified) {
+        PageEntryLength -= (UINTN)(BaseAddress & (PageEntryLength - 1));
+        if (PageEntryLength > Length) {
+          PageEntryLength = (UINTN)Length;
+        }
+        BaseAddress += PageEntryLength;
+        Length -= PageEntryLength;
+        continue;
+      }
+
       if (AllocatePagesFunc == NULL) {
         return RETURN_UNSUPPORTED;
       }
@@ -707,6 +1010,18 @@ ConvertMemoryPageAttributes (
     }
   }
 
+  //
+  // Merge the pages with the same attributes back to large pages. The TLB is only
+  // flushed for the paging context from the current CPU context, so a paging context
+  // given by the caller is not merged if it is in use.
+  //
+  if (((PagingContext == NULL) || !IsCurrentPagingContext (PagingContext)) &&
+      MergeMemoryPages (&CurrentPagingContext, OriginalBaseAddress, OriginalLength)) {
+    if (IsModified != NULL) {
+      *IsModified = TRUE;
+    }
+  }
+
   return RETURN_SUCCESS;
 }
 
@@ -762,6 +1077,11 @@ AssignMemoryPageAttributes (
       CpuFlushTlb();
       SyncMemoryPageAttributesAp (SyncCpuFlushTlb);
     }
+    //
+    // The page table pages released by page merging are not used any more, either
+    // after the TLB flush, or because the paging context is not in use.
+    //
+    ReleasePendingPageTablePages ();
   }
 
   return Status;
@@ -123,6 +123,15 @@ typedef enum {
   CacheInvalid        = 7
 } MTRR_MEMORY_CACHE_TYPE;
 
+//
+// Structure to describe a memory range and its memory cache type
+//
+typedef struct {
+  UINT64                 BaseAddress;
+  UINT64                 Length;
+  MTRR_MEMORY_CACHE_TYPE Type;
+} MTRR_MEMORY_RANGE;
+
 #define  MTRR_CACHE_UNCACHEABLE      0
 #define  MTRR_CACHE_WRITE_COMBINING  1
 #define  MTRR_CACHE_WRITE_THROUGH    4
@@ -384,4 +393,43 @@ MtrrSetMemoryAttributeInMtrrSettings (
   IN MTRR_MEMORY_CACHE_TYPE  Attribute
   );
 
+/**
+  This function attempts to set the attributes into MTRR setting buffer for
+  several memory ranges at once.
+
+  The memory ranges are applied in order, so a later range overrides an
+  earlier one where they overlap. Callers can collect all the changes in an
+  MTRR setting buffer and program the processors once with MtrrSetAllMtrrs().
+
+  The memory type map built while the ranges are applied can hold up to
+  2 * MTRR_NUMBER_OF_VARIABLE_MTRR + 2 ranges. RETURN_OUT_OF_RESOURCES is
+  returned when an intermediate map needs more, even if the final one would
+  fit in the variable MTRRs.
+
+  MtrrSetting is only updated when all the memory ranges are set, it is left
+  unchanged when an error is returned.
+
+  @param[in, out]  MtrrSetting  MTRR setting buffer to be set.
+  @param[in]       Ranges       The memory ranges to set.
+  @param[in]       RangeCount   The count of memory ranges.
+
+  @retval RETURN_SUCCESS            The attributes were set for all the memory ranges.
+  @retval RETURN_INVALID_PARAMETER  Ranges is NULL or RangeCount is zero.
+  @retval RETURN_INVALID_PARAMETER  Length of a memory range is zero.
+  @retval RETURN_UNSUPPORTED        The processor does not support one or more bytes of a
+                                    memory resource range.
+  @retval RETURN_UNSUPPORTED        The bit mask of attributes is not support for a memory
+                                    resource range.
+  @retval RETURN_OUT_OF_RESOURCES   There are not enough system resources to modify the attributes of
+                                    the memory resource ranges.
+
+**/
+RETURN_STATUS
+EFIAPI
+MtrrSetMemoryAttributesInMtrrSettings (
+  IN OUT MTRR_SETTINGS            *MtrrSetting,
+  IN CONST MTRR_MEMORY_RANGE      *Ranges,
+  IN UINTN                        RangeCount
+  );
+
 #endif // _MTRR_LIB_H_
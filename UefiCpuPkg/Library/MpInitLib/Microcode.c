@@ -93,104 +93,131 @@ MicrocodeDetect (
 
   LatestRevision = 0;
   MicrocodeData  = NULL;
-  MicrocodeEnd = (UINTN) (MicrocodePatchAddress + MicrocodePatchRegionSize);
-  MicrocodeEntryPoint = (CPU_MICROCODE_HEADER *) (UINTN) MicrocodePatchAddress;
-  do {
+  if (CpuMpData->MicrocodeCached &&
+      CpuMpData->MicrocodeSignature == Eax.Uint32 &&
+      CpuMpData->MicrocodePlatformId == PlatformId) {
     //
-    // Check if the microcode is for the Cpu and the version is newer
-    // and the update can be processed on the platform
+    // A processor with the same signature and platform ID has already scanned
+    // the microcode patch region, so reuse its result instead of scanning and
+    // checksumming the region again.
     //
-    CorrectMicrocode = FALSE;
-    if (MicrocodeEntryPoint->HeaderVersion == 0x1) {
+    LatestRevision = CpuMpData->MicrocodeRevision;
+    MicrocodeData  = CpuMpData->MicrocodeData;
+  } else {
+    MicrocodeEnd = (UINTN) (MicrocodePatchAddress + MicrocodePatchRegionSize);
+    MicrocodeEntryPoint = (CPU_MICROCODE_HEADER *) (UINTN) MicrocodePatchAddress;
+    do {
       //
-      // It is the microcode header. It is not the padding data between microcode patches
-      // because the padding data should not include 0x00000001 and it should be the repeated
-      // byte format (like 0xXYXYXYXY....).
+      // Check if the microcode is for the Cpu and the version is newer
+      // and the update can be processed on the platform
       //
-      if (MicrocodeEntryPoint->ProcessorSignature.Uint32 == Eax.Uint32 &&
-          MicrocodeEntryPoint->UpdateRevision > LatestRevision &&
-          (MicrocodeEntryPoint->ProcessorFlags & (1 << PlatformId))
-          ) {
-        if (MicrocodeEntryPoint->DataSize == 0) {
-          CheckSum32 = CalculateSum32 ((UINT32 *) MicrocodeEntryPoint, 2048);
-        } else {
-          CheckSum32 = CalculateSum32 (
-                         (UINT32 *) MicrocodeEntryPoint,
-                         MicrocodeEntryPoint->DataSize + sizeof (CPU_MICROCODE_HEADER)
-                         );
-        }
-        if (CheckSum32 == 0) {
-          CorrectMicrocode = TRUE;
-        }
-      } else if ((MicrocodeEntryPoint->DataSize != 0) &&
-                 (MicrocodeEntryPoint->UpdateRevision > LatestRevision)) {
-        ExtendedTableLength = MicrocodeEntryPoint->TotalSize - (MicrocodeEntryPoint->DataSize +
-                                sizeof (CPU_MICROCODE_HEADER));
-        if (ExtendedTableLength != 0) {
-          //
-          // Extended Table exist, check if the CPU in support list
-          //
-          ExtendedTableHeader = (CPU_MICROCODE_EXTENDED_TABLE_HEADER *) ((UINT8 *) (MicrocodeEntryPoint)
-                                  + MicrocodeEntryPoint->DataSize + sizeof (CPU_MICROCODE_HEADER));
-          //
-          // Calculate Extended Checksum
-          //
-          if ((ExtendedTableLength % 4) == 0) {
-            CheckSum32 = CalculateSum32 ((UINT32 *) ExtendedTableHeader, ExtendedTableLength);
-            if (CheckSum32 == 0) {
-              //
-              // Checksum correct
-              //
-              ExtendedTableCount = ExtendedTableHeader->ExtendedSignatureCount;
-              ExtendedTable      = (CPU_MICROCODE_EXTENDED_TABLE *) (ExtendedTableHeader + 1);
-              for (Index = 0; Index < ExtendedTableCount; Index ++) {
-                CheckSum32 = CalculateSum32 ((UINT32 *) ExtendedTable, sizeof(CPU_MICROCODE_EXTENDED_TABLE));
-                if (CheckSum32 == 0) {
-                  //
-                  // Verify Header
-                  //
-                  if ((ExtendedTable->ProcessorSignature.Uint32 == Eax.Uint32) &&
-                      (ExtendedTable->ProcessorFlag & (1 << PlatformId)) ) {
+      CorrectMicrocode = FALSE;
+      if (MicrocodeEntryPoint->HeaderVersion == 0x1) {
+        //
+        // It is the microcode header. It is not the padding data between microcode patches
+        // because the padding data should not include 0x00000001 and it should be the repeated
+        // byte format (like 0xXYXYXYXY....).
+        //
+        if (MicrocodeEntryPoint->ProcessorSignature.Uint32 == Eax.Uint32 &&
+            MicrocodeEntryPoint->UpdateRevision > LatestRevision &&
+            (MicrocodeEntryPoint->ProcessorFlags & (1 << PlatformId))
+            ) {
+          if (MicrocodeEntryPoint->DataSize == 0) {
+            CheckSum32 = CalculateSum32 ((UINT32 *) MicrocodeEntryPoint, 2048);
+          } else {
+            CheckSum32 = CalculateSum32 (
+                           (UINT32 *) MicrocodeEntryPoint,
+                           MicrocodeEntryPoint->DataSize + sizeof (CPU_MICROCODE_HEADER)
+                           );
+          }
+          if (CheckSum32 == 0) {
+            CorrectMicrocode = TRUE;
+          }
+        } else if ((MicrocodeEntryPoint->DataSize != 0) &&
+                   (MicrocodeEntryPoint->UpdateRevision > LatestRevision)) {
+          ExtendedTableLength = MicrocodeEntryPoint->TotalSize - (MicrocodeEntryPoint->DataSize +
+                                  sizeof (CPU_MICROCODE_HEADER));
+          if (ExtendedTableLength != 0) {
+            //
+            // Extended Table exist, check if the CPU in support list
+            //
+            ExtendedTableHeader = (CPU_MICROCODE_EXTENDED_TABLE_HEADER *) ((UINT8 *) (MicrocodeEntryPoint)
+                                    + MicrocodeEntryPoint->DataSize + sizeof (CPU_MICROCODE_HEADER));
+            //
+            // Calculate Extended Checksum
+            //
+            if ((ExtendedTableLength % 4) == 0) {
+              CheckSum32 = CalculateSum32 ((UINT32 *) ExtendedTableHeader, ExtendedTableLength);
+              if (CheckSum32 == 0) {
+                //
+                // Checksum correct
+                //
+                ExtendedTableCount = ExtendedTableHeader->ExtendedSignatureCount;
+                ExtendedTable      = (CPU_MICROCODE_EXTENDED_TABLE *) (ExtendedTableHeader + 1);
+                for (Index = 0; Index < ExtendedTableCount; Index ++) {
+                  CheckSum32 = CalculateSum32 ((UINT32 *) ExtendedTable, sizeof(CPU_MICROCODE_EXTENDED_TABLE));
+                  if (CheckSum32 == 0) {
                     //
-                    // Find one
+                    // Verify Header
                     //
-                    CorrectMicrocode = TRUE;
-                    break;
+                    if ((ExtendedTable->ProcessorSignature.Uint32 == Eax.Uint32) &&
+                        (ExtendedTable->ProcessorFlag & (1 << PlatformId)) ) {
+                      //
+                      // Find one
+                      //
+                      CorrectMicrocode = TRUE;
+                      break;
+                    }
                   }
+                  ExtendedTable ++;
                 }
-                ExtendedTable ++;
               }
             }
           }
         }
+      } else {
+        //
+        // It is the padding data between the microcode patches for microcode patches alignment.
+        // Because the microcode patch is the multiple of 1-KByte, the padding data should not
+        // exist if the microcode patch alignment value is not larger than 1-KByte. So, the microcode
+        // alignment value should be larger than 1-KByte. We could skip SIZE_1KB padding data to
+        // find the next possible microcode patch header.
+        //
+        MicrocodeEntryPoint = (CPU_MICROCODE_HEADER *) (((UINTN) MicrocodeEntryPoint) + SIZE_1KB);
+        continue;
       }
-    } else {
       //
-      // It is the padding data between the microcode patches for microcode patches alignment.
-      // Because the microcode patch is the multiple of 1-KByte, the padding data should not
-      // exist if the microcode patch alignment value is not larger than 1-KByte. So, the microcode
-      // alignment value should be larger than 1-KByte. We could skip SIZE_1KB padding data to
-      // find the next possible microcode patch header.
+      // Get the next patch.
       //
-      MicrocodeEntryPoint = (CPU_MICROCODE_HEADER *) (((UINTN) MicrocodeEntryPoint) + SIZE_1KB);
-      continue;
-    }
+      if (MicrocodeEntryPoint->DataSize == 0) {
+        TotalSize = 2048;
+      } else {
+        TotalSize = MicrocodeEntryPoint->TotalSize;
+      }
+
+      if (CorrectMicrocode) {
+        LatestRevision = MicrocodeEntryPoint->UpdateRevision;
+        MicrocodeData = (VOID *) ((UINTN) MicrocodeEntryPoint + sizeof (CPU_MICROCODE_HEADER));
+      }
+
+      MicrocodeEntryPoint = (CPU_MICROCODE_HEADER *) (((UINTN) MicrocodeEntryPoint) + TotalSize);
+    } while (((UINTN) MicrocodeEntryPoint < MicrocodeEnd));
+
     //
-    // Get the next patch.
+    // Record the result for the processors of the same type. Only the first
+    // processor to finish the scan records it.
     //
-    if (MicrocodeEntryPoint->DataSize == 0) {
-      TotalSize = 2048;
-    } else {
-      TotalSize = MicrocodeEntryPoint->TotalSize;
+    AcquireSpinLock (&CpuMpData->MpLock);
+    if (!CpuMpData->MicrocodeCached) {
+      CpuMpData->MicrocodeSignature  = Eax.Uint32;
+      CpuMpData->MicrocodePlatformId = PlatformId;
+      CpuMpData->MicrocodeRevision   = LatestRevision;
+      CpuMpData->MicrocodeData       = MicrocodeData;
+      MemoryFence ();
+      CpuMpData->MicrocodeCached     = TRUE;
     }
-
-    if (CorrectMicrocode) {
-      LatestRevision = MicrocodeEntryPoint->UpdateRevision;
-      MicrocodeData = (VOID *) ((UINTN) MicrocodeEntryPoint + sizeof (CPU_MICROCODE_HEADER));
-    }
-
-    MicrocodeEntryPoint = (CPU_MICROCODE_HEADER *) (((UINTN) MicrocodeEntryPoint) + TotalSize);
-  } while (((UINTN) MicrocodeEntryPoint < MicrocodeEnd));
+    ReleaseSpinLock (&CpuMpData->MpLock);
+  }
 
   if (LatestRevision > CurrentRevision) {
     //
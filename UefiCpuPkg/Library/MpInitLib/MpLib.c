@@ -119,6 +119,55 @@ SetApState (
   ReleaseSpinLock (&CpuData->ApLock);
 }
 
+/**
+  Set the bit of the specified AP in the finished AP bitmap.
+
+  @param[in]   CpuMpData        Pointer to CPU MP Data
+  @param[in]   ProcessorNumber  The handle number of the AP
+**/
+VOID
+SetApFinishedBit (
+  IN CPU_MP_DATA     *CpuMpData,
+  IN UINTN           ProcessorNumber
+  )
+{
+  volatile UINT32    *Word;
+  UINT32             Bit;
+  UINT32             Value;
+
+  Word = &CpuMpData->FinishedApBitmap[ProcessorNumber / 32];
+  Bit  = (UINT32) 1 << (ProcessorNumber % 32);
+  do {
+    Value = *Word;
+  } while (InterlockedCompareExchange32 ((UINT32 *) Word, Value, Value | Bit) != Value);
+}
+
+/**
+  Take and clear one word of the finished AP bitmap.
+
+  @param[in]   CpuMpData        Pointer to CPU MP Data
+  @param[in]   WordIndex        The index of the bitmap word
+
+  @return  The bits that were set in the word.
+**/
+UINT32
+TakeApFinishedBits (
+  IN CPU_MP_DATA     *CpuMpData,
+  IN UINTN           WordIndex
+  )
+{
+  volatile UINT32    *Word;
+  UINT32             Value;
+
+  Word = &CpuMpData->FinishedApBitmap[WordIndex];
+  do {
+    Value = *Word;
+  } while (Value != 0 &&
+           InterlockedCompareExchange32 ((UINT32 *) Word, Value, 0) != Value);
+
+  return Value;
+}
+
 /**
   Save BSP's local APIC timer setting.
 
@@ -627,6 +676,7 @@ ApWakeupFunction (
           }
         }
         SetApState (&CpuMpData->CpuData[ProcessorNumber], CpuStateFinished);
+        SetApFinishedBit (CpuMpData, ProcessorNumber);
       }
     }
 
@@ -1164,6 +1214,8 @@ CheckAllAPs (
   UINTN           ProcessorNumber;
   UINTN           NextProcessorNumber;
   UINTN           ListIndex;
+  UINTN           WordIndex;
+  UINT32          FinishedBits;
   EFI_STATUS      Status;
   CPU_MP_DATA     *CpuMpData;
   CPU_AP_DATA     *CpuData;
@@ -1173,39 +1225,51 @@ CheckAllAPs (
   NextProcessorNumber = 0;
 
   //
-  // Go through all APs that are responsible for the StartupAllAPs().
+  // Go through the APs that reported completion in the finished bitmap since
+  // the last check, instead of polling the state of every AP.
   //
-  for (ProcessorNumber = 0; ProcessorNumber < CpuMpData->CpuCount; ProcessorNumber++) {
-    if (!CpuMpData->CpuData[ProcessorNumber].Waiting) {
-      continue;
-    }
+  for (WordIndex = 0; WordIndex < (CpuMpData->CpuCount + 31) / 32; WordIndex++) {
+    FinishedBits = TakeApFinishedBits (CpuMpData, WordIndex);
+    while (FinishedBits != 0) {
+      ProcessorNumber = WordIndex * 32 + (UINTN) LowBitSet32 (FinishedBits);
+      FinishedBits   &= FinishedBits - 1;
 
-    CpuData = &CpuMpData->CpuData[ProcessorNumber];
-    //
-    // Check the CPU state of AP. If it is CpuStateFinished, then the AP has finished its task.
-    // Only BSP and corresponding AP access this unit of CPU Data. This means the AP will not modify the
-    // value of state after setting the it to CpuStateFinished, so BSP can safely make use of its value.
-    //
-    if (GetApState(CpuData) == CpuStateFinished) {
-      CpuMpData->RunningCount ++;
-      CpuMpData->CpuData[ProcessorNumber].Waiting = FALSE;
-      SetApState(CpuData, CpuStateIdle);
+      //
+      // Skip the APs that are not responsible for the StartupAllAPs(). A bit
+      // left over from an earlier StartupThisAP() is dropped here as well.
+      //
+      if (!CpuMpData->CpuData[ProcessorNumber].Waiting) {
+        continue;
+      }
 
+      CpuData = &CpuMpData->CpuData[ProcessorNumber];
       //
-      // If in Single Thread mode, then search for the next waiting AP for execution.
+      // Check the CPU state of AP. If it is CpuStateFinished, then the AP has finished its task.
+      // Only BSP and corresponding AP access this unit of CPU Data. This means the AP will not modify the
+      // value of state after setting the it to CpuStateFinished, so BSP can safely make use of its value.
+      // The AP sets its bit again when it finishes, so a bit taken too early is not lost.
       //
-      if (CpuMpData->SingleThread) {
-        Status = GetNextWaitingProcessorNumber (&NextProcessorNumber);
-
-        if (!EFI_ERROR (Status)) {
-          WakeUpAP (
-            CpuMpData,
-            FALSE,
-            (UINT32) NextProcessorNumber,
-            CpuMpData->Procedure,
-            CpuMpData->ProcArguments
-            );
-         }
+      if (GetApState(CpuData) == CpuStateFinished) {
+        CpuMpData->RunningCount ++;
+        CpuMpData->CpuData[ProcessorNumber].Waiting = FALSE;
+        SetApState(CpuData, CpuStateIdle);
+
+        //
+        // If in Single Thread mode, then search for the next waiting AP for execution.
+        //
+        if (CpuMpData->SingleThread) {
+          Status = GetNextWaitingProcessorNumber (&NextProcessorNumber);
+
+          if (!EFI_ERROR (Status)) {
+            WakeUpAP (
+              CpuMpData,
+              FALSE,
+              (UINT32) NextProcessorNumber,
+              CpuMpData->Procedure,
+              CpuMpData->ProcArguments
+              );
+           }
+        }
       }
     }
   }
@@ -1311,6 +1375,7 @@ MpInitLibInitialize (
   BufferSize += sizeof (CPU_MP_DATA);
   BufferSize += ApResetVectorSize;
   BufferSize += (sizeof (CPU_AP_DATA) + sizeof (CPU_INFO_IN_HOB))* MaxLogicalProcessorNumber;
+  BufferSize += sizeof (UINT32) * ((MaxLogicalProcessorNumber + 31) / 32);
   MpBuffer    = AllocatePages (EFI_SIZE_TO_PAGES (BufferSize));
   ASSERT (MpBuffer != NULL);
   ZeroMem (MpBuffer, BufferSize);
@@ -1331,6 +1396,8 @@ MpInitLibInitialize (
   CpuMpData->SwitchBspFlag    = FALSE;
   CpuMpData->CpuData          = (CPU_AP_DATA *) (CpuMpData + 1);
   CpuMpData->CpuInfoInHob     = (UINT64) (UINTN) (CpuMpData->CpuData + MaxLogicalProcessorNumber);
+  CpuMpData->FinishedApBitmap = (UINT32 *) (UINTN) (CpuMpData->CpuInfoInHob +
+                                  sizeof (CPU_INFO_IN_HOB) * MaxLogicalProcessorNumber);
   InitializeSpinLock(&CpuMpData->MpLock);
   //
   // Save BSP's Control registers to APs
@@ -233,6 +233,22 @@ struct _CPU_MP_DATA {
   UINT8                          Vector;
   BOOLEAN                        PeriodicMode;
   BOOLEAN                        TimerInterruptState;
+
+  //
+  // One bit per processor, set by an AP when it finishes the task
+  // assigned by StartupAllAPs() and consumed by CheckAllAPs().
+  //
+  volatile UINT32                *FinishedApBitmap;
+
+  //
+  // Result of the first scan of the microcode patch region, reused by
+  // the processors with the same signature and platform ID.
+  //
+  volatile BOOLEAN               MicrocodeCached;
+  UINT32                         MicrocodeSignature;
+  UINT8                          MicrocodePlatformId;
+  UINT32                         MicrocodeRevision;
+  VOID                           *MicrocodeData;
 };
 
 extern EFI_GUID mCpuInitMpLibHobGuid;
@@ -31,6 +31,14 @@
 #define CLEAR_SEED   0xFFFFFFFFFFFFFFFFull
 
 #define MTRR_LIB_ASSERT_ALIGNED(B, L) ASSERT ((B & ~(L - 1)) == B);
+
+//
+// Size of the cost arrays of the variable MTRR solver, which are indexed by
+// the memory type covering a range, CacheInvalid meaning no covering MTRR.
+//
+#define MTRR_LIB_TYPE_COUNT           (CacheInvalid + 1)
+#define MTRR_LIB_INFINITE_COST        MAX_UINT32
+
 //
 // Context to save and restore when MTRRs are programmed
 //
@@ -39,11 +47,14 @@ typedef struct {
   BOOLEAN  InterruptState;
 } MTRR_CONTEXT;
 
+//
+// Context of the variable MTRR solver
+//
 typedef struct {
-  UINT64                 BaseAddress;
-  UINT64                 Length;
-  MTRR_MEMORY_CACHE_TYPE Type;
-} MEMORY_RANGE;
+  CONST MTRR_MEMORY_RANGE  *Ranges;
+  UINT32                   RangeCount;
+  MTRR_MEMORY_CACHE_TYPE   DefaultType;
+} MTRR_SOLVER_CONTEXT;
 
 //
 // This table defines the offset, base and length of the fixed MTRRs
@@ -106,6 +117,17 @@ CONST FIXED_MTRR  mMtrrLibFixedMtrrTable[] = {
   }
 };
 
+//
+// Memory types that a variable MTRR can be programmed with
+//
+CONST MTRR_MEMORY_CACHE_TYPE  mMtrrLibVariableMtrrTypes[] = {
+  CacheUncacheable,
+  CacheWriteCombining,
+  CacheWriteThrough,
+  CacheWriteProtected,
+  CacheWriteBack
+};
+
 //
 // Lookup table used to print MTRRs
 //
@@ -659,78 +681,6 @@ MtrrGetMemoryAttributeInVariableMtrr (
            );
 }
 
-/**
-  Return the least alignment of address.
-
-  @param Address    The address to return the alignment.
-  @param Alignment0 The alignment to return when Address is 0.
-
-  @return The least alignment of the Address.
-**/
-UINT64
-MtrrLibLeastAlignment (
-  UINT64    Address,
-  UINT64    Alignment0
-)
-{
-  if (Address == 0) {
-    return Alignment0;
-  }
-
-  return LShiftU64 (1, (UINTN) LowBitSet64 (Address));
-}
-
-/**
-  Return the number of required variable MTRRs to positively cover the
-  specified range.
-
-  @param BaseAddress Base address of the range.
-  @param Length      Length of the range.
-  @param Alignment0  Alignment of 0.
-
-  @return The number of the required variable MTRRs.
-**/
-UINT32
-MtrrLibGetPositiveMtrrNumber (
-  IN UINT64      BaseAddress,
-  IN UINT64      Length,
-  IN UINT64      Alignment0
-)
-{
-  UINT64         SubLength;
-  UINT32         MtrrNumber;
-  BOOLEAN        UseLeastAlignment;
-
-  UseLeastAlignment = TRUE;
-  SubLength = 0;
-
-  //
-  // Calculate the alignment of the base address.
-  //
-  for (MtrrNumber = 0; Length != 0; MtrrNumber++) {
-    if (UseLeastAlignment) {
-      SubLength = MtrrLibLeastAlignment (BaseAddress, Alignment0);
-
-      if (SubLength > Length) {
-        //
-        // Set a flag when remaining length is too small
-        //  so that MtrrLibLeastAlignment() is not called in following loops.
-        //
-        UseLeastAlignment = FALSE;
-      }
-    }
-
-    if (!UseLeastAlignment) {
-      SubLength = GetPowerOfTwo64 (Length);
-    }
-
-    BaseAddress += SubLength;
-    Length -= SubLength;
-  }
-
-  return MtrrNumber;
-}
-
 /**
   Return whether the left MTRR type precedes the right MTRR type.
 
@@ -756,220 +706,6 @@ MtrrLibTypeLeftPrecedeRight (
 }
 
 
-/**
-  Return whether the type of the specified range can precede the specified type.
-
-  @param Ranges     Memory range array holding memory type settings for all
-                    the memory address.
-  @param RangeCount Count of memory ranges.
-  @param Type       Type to check precedence.
-  @param SubBase    Base address of the specified range.
-  @param SubLength  Length of the specified range.
-
-  @retval TRUE  The type of the specified range can precede the Type.
-  @retval FALSE The type of the specified range cannot precede the Type.
-                So the subtraction is not applicable.
-**/
-BOOLEAN
-MtrrLibSubstractable (
-  IN CONST MEMORY_RANGE     *Ranges,
-  IN UINT32                  RangeCount,
-  IN MTRR_MEMORY_CACHE_TYPE  Type,
-  IN UINT64                  SubBase,
-  IN UINT64                  SubLength
-)
-{
-  UINT32                     Index;
-  UINT64                     Length;
-  // WT > WB
-  // UC > *
-  for (Index = 0; Index < RangeCount; Index++) {
-    if (Ranges[Index].BaseAddress <= SubBase && SubBase < Ranges[Index].BaseAddress + Ranges[Index].Length) {
-
-      if (Ranges[Index].BaseAddress + Ranges[Index].Length >= SubBase + SubLength) {
-        return MtrrLibTypeLeftPrecedeRight (Ranges[Index].Type, Type);
-
-      } else {
-        if (!MtrrLibTypeLeftPrecedeRight (Ranges[Index].Type, Type)) {
-          return FALSE;
-        }
-
-        Length = Ranges[Index].BaseAddress + Ranges[Index].Length - SubBase;
-        SubBase += Length;
-        SubLength -= Length;
-      }
-    }
-  }
-
-  ASSERT (FALSE);
-  return FALSE;
-}
-
-/**
-  Return the number of required variable MTRRs to cover the specified range.
-
-  The routine considers subtraction in the both side of the range to find out
-  the most optimal solution (which uses the least MTRRs).
-
-  @param Ranges            Array holding memory type settings of all memory
-                           address.
-  @param RangeCount        Count of memory ranges.
-  @param VariableMtrr      Array holding allocated variable MTRRs.
-  @param VariableMtrrCount Count of allocated variable MTRRs.
-  @param BaseAddress       Base address of the specified range.
-  @param Length            Length of the specified range.
-  @param Type              MTRR type of the specified range.
-  @param Alignment0        Alignment of 0.
-  @param SubLeft           Return the count of left subtraction.
-  @param SubRight          Return the count of right subtraction.
-
-  @return Number of required variable MTRRs.
-**/
-UINT32
-MtrrLibGetMtrrNumber (
-  IN CONST MEMORY_RANGE    *Ranges,
-  IN UINT32                 RangeCount,
-  IN CONST VARIABLE_MTRR    *VariableMtrr,
-  IN UINT32                 VariableMtrrCount,
-  IN UINT64                 BaseAddress,
-  IN UINT64                 Length,
-  IN MTRR_MEMORY_CACHE_TYPE Type,
-  IN UINT64                 Alignment0,
-  OUT UINT32                *SubLeft, // subtractive from BaseAddress to get more aligned address, to save MTRR
-  OUT UINT32                *SubRight // subtractive from BaseAddress + Length, to save MTRR
-  )
-{
-  UINT64  Alignment;
-  UINT32  LeastLeftMtrrNumber;
-  UINT32  MiddleMtrrNumber;
-  UINT32  LeastRightMtrrNumber;
-  UINT32  CurrentMtrrNumber;
-  UINT32  SubtractiveCount;
-  UINT32  SubtractiveMtrrNumber;
-  UINT32  LeastSubtractiveMtrrNumber;
-  UINT64  SubtractiveBaseAddress;
-  UINT64  SubtractiveLength;
-  UINT64  BaseAlignment;
-  UINT32  Index;
-
-  *SubLeft = 0;
-  *SubRight = 0;
-  LeastSubtractiveMtrrNumber = 0;
-  BaseAlignment = 0;
-
-  //
-  // Get the optimal left subtraction solution.
-  //
-  if (BaseAddress != 0) {
-    SubtractiveBaseAddress = 0;
-    SubtractiveLength      = 0;
-    //
-    // Get the MTRR number needed without left subtraction.
-    //
-    LeastLeftMtrrNumber = MtrrLibGetPositiveMtrrNumber (BaseAddress, Length, Alignment0);
-
-    //
-    // Left subtraction bit by bit, to find the optimal left subtraction solution.
-    //
-    for (SubtractiveMtrrNumber = 0, SubtractiveCount = 1; BaseAddress != 0; SubtractiveCount++) {
-      Alignment = MtrrLibLeastAlignment (BaseAddress, Alignment0);
-
-      //
-      // Check whether the memory type of [BaseAddress - Alignment, BaseAddress) can override Type.
-      // IA32 Manual defines the following override rules:
-      //   WT > WB
-      //   UC > * (any)
-      //
-      if (!MtrrLibSubstractable (Ranges, RangeCount, Type, BaseAddress - Alignment, Alignment)) {
-        break;
-      }
-
-      for (Index = 0; Index < VariableMtrrCount; Index++) {
-        if ((VariableMtrr[Index].BaseAddress == BaseAddress - Alignment) &&
-            (VariableMtrr[Index].Length == Alignment)) {
-          break;
-        }
-      }
-      if (Index == VariableMtrrCount) {
-        //
-        // Increment SubtractiveMtrrNumber when [BaseAddress - Alignment, BaseAddress) is not be planed as a MTRR
-        //
-        SubtractiveMtrrNumber++;
-      }
-
-      BaseAddress -= Alignment;
-      Length += Alignment;
-
-      CurrentMtrrNumber = SubtractiveMtrrNumber + MtrrLibGetPositiveMtrrNumber (BaseAddress, Length, Alignment0);
-      if (CurrentMtrrNumber <= LeastLeftMtrrNumber) {
-        LeastLeftMtrrNumber = CurrentMtrrNumber;
-        LeastSubtractiveMtrrNumber = SubtractiveMtrrNumber;
-        *SubLeft = SubtractiveCount;
-        SubtractiveBaseAddress = BaseAddress;
-        SubtractiveLength = Length;
-      }
-    }
-
-    //
-    // If left subtraction is better, subtract BaseAddress to left, and enlarge Length
-    //
-    if (*SubLeft != 0) {
-      BaseAddress = SubtractiveBaseAddress;
-      Length = SubtractiveLength;
-    }
-  }
-
-  //
-  // Increment BaseAddress greedily until (BaseAddress + Alignment) exceeds (BaseAddress + Length)
-  //
-  MiddleMtrrNumber = 0;
-  while (Length != 0) {
-    BaseAlignment = MtrrLibLeastAlignment (BaseAddress, Alignment0);
-    if (BaseAlignment > Length) {
-      break;
-    }
-    BaseAddress += BaseAlignment;
-    Length -= BaseAlignment;
-    MiddleMtrrNumber++;
-  }
-
-
-  if (Length == 0) {
-    return LeastSubtractiveMtrrNumber + MiddleMtrrNumber;
-  }
-
-
-  //
-  // Get the optimal right subtraction solution.
-  //
-
-  //
-  // Get the MTRR number needed without right subtraction.
-  //
-  LeastRightMtrrNumber = MtrrLibGetPositiveMtrrNumber (BaseAddress, Length, Alignment0);
-
-  for (SubtractiveCount = 1; Length < BaseAlignment; SubtractiveCount++) {
-    Alignment = MtrrLibLeastAlignment (BaseAddress + Length, Alignment0);
-    if (!MtrrLibSubstractable (Ranges, RangeCount, Type, BaseAddress + Length, Alignment)) {
-      break;
-    }
-
-    Length += Alignment;
-
-    //
-    // SubtractiveCount = Number of MTRRs used for subtraction
-    //
-    CurrentMtrrNumber = SubtractiveCount + MtrrLibGetPositiveMtrrNumber (BaseAddress, Length, Alignment0);
-    if (CurrentMtrrNumber <= LeastRightMtrrNumber) {
-      LeastRightMtrrNumber = CurrentMtrrNumber;
-      *SubRight = SubtractiveCount;
-      SubtractiveLength = Length;
-    }
-  }
-
-  return LeastSubtractiveMtrrNumber + MiddleMtrrNumber + LeastRightMtrrNumber;
-}
-
 /**
   Initializes the valid bits mask and valid address mask for MTRRs.
 
@@ -1359,7 +1095,7 @@ MtrrDebugPrintAllMtrrs (
 **/
 RETURN_STATUS
 MtrrLibSetMemoryType (
-  IN MEMORY_RANGE                 *Ranges,
+  IN MTRR_MEMORY_RANGE            *Ranges,
   IN UINT32                        Capacity,
   IN OUT UINT32                    *Count,
   IN UINT64                        BaseAddress,
@@ -1462,229 +1198,355 @@ MtrrLibSetMemoryType (
 }
 
 /**
-  Allocate one or more variable MTRR to cover the range identified by
-  BaseAddress and Length.
+  Return the memory type of an address after one more variable MTRR of the
+  specified type is added to the variable MTRRs covering it.
 
-  @param Ranges               Memory range array holding the memory type
-                              settings for all memory address.
-  @param RangeCount           Count of memory ranges.
-  @param VariableMtrr         Variable MTRR array.
-  @param VariableMtrrCapacity Capacity of variable MTRR array.
-  @param VariableMtrrCount    Count of variable MTRR.
-  @param BaseAddress          Base address of the memory range.
-  @param Length               Length of the memory range.
-  @param Type                 MTRR type of the memory range.
-  @param Alignment0           Alignment of 0.
+  @param Covered The memory type from the variable MTRRs already covering the
+                 address, or CacheInvalid if no variable MTRR covers it.
+  @param Type    The memory type of the added variable MTRR.
+  @param Result  Return the memory type from all the variable MTRRs.
 
-  @retval RETURN_SUCCESS          Variable MTRRs are allocated successfully.
-  @retval RETURN_OUT_OF_RESOURCES Count of variable MTRRs exceeds capacity.
+  @retval TRUE  The resulting memory type is defined by the precedence rules.
+  @retval FALSE The overlapping is undefined by the precedence rules.
 **/
-RETURN_STATUS
-MtrrLibSetMemoryAttributeInVariableMtrr (
-  IN CONST MEMORY_RANGE           *Ranges,
-  IN UINT32                        RangeCount,
-  IN OUT VARIABLE_MTRR             *VariableMtrr,
-  IN UINT32                        VariableMtrrCapacity,
-  IN OUT UINT32                    *VariableMtrrCount,
-  IN UINT64                        BaseAddress,
-  IN UINT64                        Length,
-  IN MTRR_MEMORY_CACHE_TYPE        Type,
-  IN UINT64                        Alignment0
-  );
+BOOLEAN
+MtrrLibCombineType (
+  IN  MTRR_MEMORY_CACHE_TYPE  Covered,
+  IN  MTRR_MEMORY_CACHE_TYPE  Type,
+  OUT MTRR_MEMORY_CACHE_TYPE  *Result
+  )
+{
+  if ((Covered == CacheInvalid) || (Covered == Type) || MtrrLibTypeLeftPrecedeRight (Type, Covered)) {
+    *Result = Type;
+    return TRUE;
+  }
+
+  if (MtrrLibTypeLeftPrecedeRight (Covered, Type)) {
+    *Result = Covered;
+    return TRUE;
+  }
+
+  return FALSE;
+}
 
 /**
-  Allocate one or more variable MTRR to cover the range identified by
-  BaseAddress and Length.
+  Return whether the whole specified range has one memory type.
 
-  The routine recursively calls MtrrLibSetMemoryAttributeInVariableMtrr()
-  to allocate variable MTRRs when the range contains several sub-ranges
-  with different attributes.
+  The part of the range below 1MB is covered by the fixed MTRRs, so the
+  variable MTRRs may give it any type.
 
-  @param Ranges               Memory range array holding the memory type
-                              settings for all memory address.
-  @param RangeCount           Count of memory ranges.
-  @param VariableMtrr         Variable MTRR array.
-  @param VariableMtrrCapacity Capacity of variable MTRR array.
-  @param VariableMtrrCount    Count of variable MTRR.
-  @param BaseAddress          Base address of the memory range.
-  @param Length               Length of the memory range.
-  @param Type                 MTRR type of the range.
-                              If it's CacheInvalid, the memory range may
-                              contains several sub-ranges with different
-                              attributes.
-  @param Alignment0           Alignment of 0.
+  @param Solver      The solver context.
+  @param BaseAddress Base address of the range.
+  @param Length      Length of the range.
+  @param Type        Return the memory type of the range, or CacheInvalid when
+                     the whole range is below 1MB.
 
-  @retval RETURN_SUCCESS          Variable MTRRs are allocated successfully.
-  @retval RETURN_OUT_OF_RESOURCES Count of variable MTRRs exceeds capacity.
+  @retval TRUE  The range has one memory type.
+  @retval FALSE The range contains several memory types.
 **/
-RETURN_STATUS
-MtrrLibAddVariableMtrr (
-  IN CONST MEMORY_RANGE           *Ranges,
-  IN UINT32                        RangeCount,
-  IN OUT VARIABLE_MTRR             *VariableMtrr,
-  IN UINT32                        VariableMtrrCapacity,
-  IN OUT UINT32                    *VariableMtrrCount,
-  IN PHYSICAL_ADDRESS              BaseAddress,
-  IN UINT64                        Length,
-  IN MTRR_MEMORY_CACHE_TYPE        Type,
-  IN UINT64                        Alignment0
-)
+BOOLEAN
+MtrrLibGetUniformType (
+  IN  CONST MTRR_SOLVER_CONTEXT    *Solver,
+  IN  UINT64                       BaseAddress,
+  IN  UINT64                       Length,
+  OUT MTRR_MEMORY_CACHE_TYPE       *Type
+  )
 {
-  RETURN_STATUS                    Status;
   UINT32                           Index;
-  UINT64                           SubLength;
+  CONST MTRR_MEMORY_RANGE          *Range;
 
-  MTRR_LIB_ASSERT_ALIGNED (BaseAddress, Length);
-  if (Type == CacheInvalid) {
-    for (Index = 0; Index < RangeCount; Index++) {
-      if (Ranges[Index].BaseAddress <= BaseAddress && BaseAddress < Ranges[Index].BaseAddress + Ranges[Index].Length) {
-
-        //
-        // Because the Length may not be aligned to BaseAddress, below code calls
-        // MtrrLibSetMemoryAttributeInVariableMtrr() instead of itself.
-        // MtrrLibSetMemoryAttributeInVariableMtrr() splits the range to several
-        // aligned ranges.
-        //
-        if (Ranges[Index].BaseAddress + Ranges[Index].Length >= BaseAddress + Length) {
-          return MtrrLibSetMemoryAttributeInVariableMtrr (
-            Ranges, RangeCount, VariableMtrr, VariableMtrrCapacity, VariableMtrrCount,
-            BaseAddress, Length, Ranges[Index].Type, Alignment0
-          );
-        } else {
-          SubLength = Ranges[Index].BaseAddress + Ranges[Index].Length - BaseAddress;
-          Status = MtrrLibSetMemoryAttributeInVariableMtrr (
-            Ranges, RangeCount, VariableMtrr, VariableMtrrCapacity, VariableMtrrCount,
-            BaseAddress, SubLength, Ranges[Index].Type, Alignment0
-          );
-          if (RETURN_ERROR (Status)) {
-            return Status;
-          }
-          BaseAddress += SubLength;
-          Length -= SubLength;
-        }
-      }
+  if (BaseAddress + Length <= BASE_1MB) {
+    *Type = CacheInvalid;
+    return TRUE;
+  }
+
+  if (BaseAddress < BASE_1MB) {
+    Length     -= BASE_1MB - BaseAddress;
+    BaseAddress = BASE_1MB;
+  }
+
+  for (Index = 0; Index < Solver->RangeCount; Index++) {
+    Range = &Solver->Ranges[Index];
+    if ((Range->BaseAddress <= BaseAddress) && (BaseAddress < Range->BaseAddress + Range->Length)) {
+      *Type = Range->Type;
+      return (BOOLEAN) (BaseAddress + Length <= Range->BaseAddress + Range->Length);
     }
+  }
 
-    //
-    // Because memory ranges cover all the memory addresses, it's impossible to be here.
-    //
-    ASSERT (FALSE);
-    return RETURN_DEVICE_ERROR;
-  } else {
-    for (Index = 0; Index < *VariableMtrrCount; Index++) {
-      if (VariableMtrr[Index].BaseAddress == BaseAddress && VariableMtrr[Index].Length == Length) {
-        ASSERT (VariableMtrr[Index].Type == Type);
-        break;
+  //
+  // Because memory ranges cover all the memory addresses, it's impossible to be here.
+  //
+  ASSERT (FALSE);
+  *Type = CacheInvalid;
+  return TRUE;
+}
+
+/**
+  Return the number of variable MTRRs needed inside a range of one memory type.
+
+  @param Solver   The solver context.
+  @param Covered  The memory type from the variable MTRRs covering the range
+                  from outside, or CacheInvalid if there is none.
+  @param Type     The memory type of the range, or CacheInvalid if any type
+                  is fine.
+  @param MtrrType Return the type of the variable MTRR to add for the range,
+                  or CacheInvalid if none is needed. Optional.
+
+  @return The number of variable MTRRs, MTRR_LIB_INFINITE_COST if the range
+          cannot get the memory type.
+**/
+UINT32
+MtrrLibGetUniformCost (
+  IN  CONST MTRR_SOLVER_CONTEXT    *Solver,
+  IN  MTRR_MEMORY_CACHE_TYPE       Covered,
+  IN  MTRR_MEMORY_CACHE_TYPE       Type,
+  OUT MTRR_MEMORY_CACHE_TYPE       *MtrrType OPTIONAL
+  )
+{
+  UINTN                            Index;
+  MTRR_MEMORY_CACHE_TYPE           Result;
+
+  if (MtrrType != NULL) {
+    *MtrrType = CacheInvalid;
+  }
+
+  if ((Type == CacheInvalid) ||
+      (Type == ((Covered == CacheInvalid) ? Solver->DefaultType : Covered))) {
+    return 0;
+  }
+
+  for (Index = 0; Index < ARRAY_SIZE (mMtrrLibVariableMtrrTypes); Index++) {
+    if (MtrrLibCombineType (Covered, mMtrrLibVariableMtrrTypes[Index], &Result) && (Result == Type)) {
+      if (MtrrType != NULL) {
+        *MtrrType = mMtrrLibVariableMtrrTypes[Index];
       }
+      return 1;
+    }
+  }
+
+  return MTRR_LIB_INFINITE_COST;
+}
+
+/**
+  Choose whether to cover a range that contains several memory types by a
+  variable MTRR, and of which type, given the costs of its two halves.
+
+  @param Covered   The memory type from the variable MTRRs covering the range
+                   from outside, or CacheInvalid if there is none.
+  @param LeftCost  The costs of the lower half, indexed by the covering type.
+  @param RightCost The costs of the upper half, indexed by the covering type.
+  @param MtrrType  Return the type of the variable MTRR to add for the range,
+                   or CacheInvalid if none is needed. Optional.
+
+  @return The least number of variable MTRRs for the range,
+          MTRR_LIB_INFINITE_COST if the range cannot get its memory types.
+**/
+UINT32
+MtrrLibChooseMtrr (
+  IN  MTRR_MEMORY_CACHE_TYPE       Covered,
+  IN  CONST UINT32                 *LeftCost,
+  IN  CONST UINT32                 *RightCost,
+  OUT MTRR_MEMORY_CACHE_TYPE       *MtrrType OPTIONAL
+  )
+{
+  UINTN                            Index;
+  UINT32                           Cost;
+  UINT32                           LeastCost;
+  MTRR_MEMORY_CACHE_TYPE           Result;
+
+  if (MtrrType != NULL) {
+    *MtrrType = CacheInvalid;
+  }
+
+  LeastCost = MTRR_LIB_INFINITE_COST;
+  if ((LeftCost[Covered] != MTRR_LIB_INFINITE_COST) && (RightCost[Covered] != MTRR_LIB_INFINITE_COST)) {
+    LeastCost = LeftCost[Covered] + RightCost[Covered];
+  }
+
+  for (Index = 0; Index < ARRAY_SIZE (mMtrrLibVariableMtrrTypes); Index++) {
+    if (!MtrrLibCombineType (Covered, mMtrrLibVariableMtrrTypes[Index], &Result) ||
+        (LeftCost[Result] == MTRR_LIB_INFINITE_COST) || (RightCost[Result] == MTRR_LIB_INFINITE_COST)) {
+      continue;
     }
-    if (Index == *VariableMtrrCount) {
-      if (*VariableMtrrCount == VariableMtrrCapacity) {
-        return RETURN_OUT_OF_RESOURCES;
+
+    Cost = 1 + LeftCost[Result] + RightCost[Result];
+    if (Cost < LeastCost) {
+      LeastCost = Cost;
+      if (MtrrType != NULL) {
+        *MtrrType = mMtrrLibVariableMtrrTypes[Index];
       }
-      VariableMtrr[Index].BaseAddress = BaseAddress;
-      VariableMtrr[Index].Length = Length;
-      VariableMtrr[Index].Type = Type;
-      VariableMtrr[Index].Valid = TRUE;
-      VariableMtrr[Index].Used = TRUE;
-      (*VariableMtrrCount)++;
     }
-    return RETURN_SUCCESS;
   }
+
+  return LeastCost;
 }
 
 /**
-  Allocate one or more variable MTRR to cover the range identified by
-  BaseAddress and Length.
+  Calculate the least number of variable MTRRs inside a naturally aligned
+  power of two range, for each memory type that may cover the range from
+  outside.
+
+  A variable MTRR covers a naturally aligned power of two range, so all the
+  variable MTRRs form a binary tree of ranges in which a range is either
+  covered by one more variable MTRR or not, and the memory type of an address
+  only depends on the variable MTRRs on its path from the root. The routine
+  walks the tree and only descends into the ranges that contain several
+  memory types.
+
+  @param Solver      The solver context.
+  @param BaseAddress Base address of the range.
+  @param Length      Length of the range.
+  @param Cost        Return MTRR_LIB_TYPE_COUNT costs indexed by the memory
+                     type covering the range, CacheInvalid for none.
+**/
+VOID
+MtrrLibGetMtrrCost (
+  IN  CONST MTRR_SOLVER_CONTEXT    *Solver,
+  IN  UINT64                       BaseAddress,
+  IN  UINT64                       Length,
+  OUT UINT32                       *Cost
+  )
+{
+  UINT32                           LeftCost[MTRR_LIB_TYPE_COUNT];
+  UINT32                           RightCost[MTRR_LIB_TYPE_COUNT];
+  MTRR_MEMORY_CACHE_TYPE           Type;
+  UINTN                            Covered;
 
-  @param Ranges               Memory range array holding the memory type
-                              settings for all memory address.
-  @param RangeCount           Count of memory ranges.
+  MTRR_LIB_ASSERT_ALIGNED (BaseAddress, Length);
+  if (MtrrLibGetUniformType (Solver, BaseAddress, Length, &Type)) {
+    for (Covered = 0; Covered < MTRR_LIB_TYPE_COUNT; Covered++) {
+      Cost[Covered] = MtrrLibGetUniformCost (Solver, (MTRR_MEMORY_CACHE_TYPE) Covered, Type, NULL);
+    }
+    return;
+  }
+
+  MtrrLibGetMtrrCost (Solver, BaseAddress, RShiftU64 (Length, 1), LeftCost);
+  MtrrLibGetMtrrCost (Solver, BaseAddress + RShiftU64 (Length, 1), RShiftU64 (Length, 1), RightCost);
+  for (Covered = 0; Covered < MTRR_LIB_TYPE_COUNT; Covered++) {
+    Cost[Covered] = MtrrLibChooseMtrr ((MTRR_MEMORY_CACHE_TYPE) Covered, LeftCost, RightCost, NULL);
+  }
+}
+
+/**
+  Add the variable MTRRs of the least cost solution inside a naturally aligned
+  power of two range.
+
+  @param Solver               The solver context.
+  @param Covered              The memory type from the variable MTRRs covering
+                              the range from outside, CacheInvalid for none.
+  @param BaseAddress          Base address of the range.
+  @param Length               Length of the range.
   @param VariableMtrr         Variable MTRR array.
   @param VariableMtrrCapacity Capacity of variable MTRR array.
   @param VariableMtrrCount    Count of variable MTRR.
-  @param BaseAddress          Base address of the memory range.
-  @param Length               Length of the memory range.
-  @param Type                 MTRR type of the memory range.
-  @param Alignment0           Alignment of 0.
 
   @retval RETURN_SUCCESS          Variable MTRRs are allocated successfully.
   @retval RETURN_OUT_OF_RESOURCES Count of variable MTRRs exceeds capacity.
 **/
 RETURN_STATUS
-MtrrLibSetMemoryAttributeInVariableMtrr (
-  IN CONST MEMORY_RANGE     *Ranges,
-  IN UINT32                 RangeCount,
-  IN OUT VARIABLE_MTRR      *VariableMtrr,
-  IN UINT32                 VariableMtrrCapacity,
-  IN OUT UINT32             *VariableMtrrCount,
-  IN UINT64                 BaseAddress,
-  IN UINT64                 Length,
-  IN MTRR_MEMORY_CACHE_TYPE Type,
-  IN UINT64                 Alignment0
-)
+MtrrLibAddVariableMtrrs (
+  IN CONST MTRR_SOLVER_CONTEXT     *Solver,
+  IN MTRR_MEMORY_CACHE_TYPE        Covered,
+  IN UINT64                        BaseAddress,
+  IN UINT64                        Length,
+  IN OUT VARIABLE_MTRR             *VariableMtrr,
+  IN UINT32                        VariableMtrrCapacity,
+  IN OUT UINT32                    *VariableMtrrCount
+  )
 {
-  UINT64                    Alignment;
-  UINT32                    MtrrNumber;
-  UINT32                    SubtractiveLeft;
-  UINT32                    SubtractiveRight;
-  BOOLEAN                   UseLeastAlignment;
-
-  Alignment = 0;
-
-  MtrrNumber = MtrrLibGetMtrrNumber (Ranges, RangeCount, VariableMtrr, *VariableMtrrCount,
-                                     BaseAddress, Length, Type, Alignment0, &SubtractiveLeft, &SubtractiveRight);
-
-  if (MtrrNumber + *VariableMtrrCount > VariableMtrrCapacity) {
-    return RETURN_OUT_OF_RESOURCES;
+  RETURN_STATUS                    Status;
+  UINT32                           LeftCost[MTRR_LIB_TYPE_COUNT];
+  UINT32                           RightCost[MTRR_LIB_TYPE_COUNT];
+  MTRR_MEMORY_CACHE_TYPE           Type;
+  MTRR_MEMORY_CACHE_TYPE           MtrrType;
+  BOOLEAN                          Uniform;
+
+  Uniform = MtrrLibGetUniformType (Solver, BaseAddress, Length, &Type);
+  if (Uniform) {
+    MtrrLibGetUniformCost (Solver, Covered, Type, &MtrrType);
+  } else {
+    MtrrLibGetMtrrCost (Solver, BaseAddress, RShiftU64 (Length, 1), LeftCost);
+    MtrrLibGetMtrrCost (Solver, BaseAddress + RShiftU64 (Length, 1), RShiftU64 (Length, 1), RightCost);
+    MtrrLibChooseMtrr (Covered, LeftCost, RightCost, &MtrrType);
   }
 
-  while (SubtractiveLeft-- != 0) {
-    Alignment = MtrrLibLeastAlignment (BaseAddress, Alignment0);
-    ASSERT (Alignment <= Length);
-
-    MtrrLibAddVariableMtrr (Ranges, RangeCount, VariableMtrr, VariableMtrrCapacity, VariableMtrrCount,
-                            BaseAddress - Alignment, Alignment, CacheInvalid, Alignment0);
-    BaseAddress -= Alignment;
-    Length += Alignment;
+  if (MtrrType != CacheInvalid) {
+    if (*VariableMtrrCount == VariableMtrrCapacity) {
+      return RETURN_OUT_OF_RESOURCES;
+    }
+    VariableMtrr[*VariableMtrrCount].BaseAddress = BaseAddress;
+    VariableMtrr[*VariableMtrrCount].Length      = Length;
+    VariableMtrr[*VariableMtrrCount].Type        = MtrrType;
+    VariableMtrr[*VariableMtrrCount].Valid       = TRUE;
+    VariableMtrr[*VariableMtrrCount].Used        = TRUE;
+    (*VariableMtrrCount)++;
+    MtrrLibCombineType (Covered, MtrrType, &Covered);
   }
 
-  while (Length != 0) {
-    Alignment = MtrrLibLeastAlignment (BaseAddress, Alignment0);
-    if (Alignment > Length) {
-      break;
-    }
-    MtrrLibAddVariableMtrr (NULL, 0, VariableMtrr, VariableMtrrCapacity, VariableMtrrCount,
-                            BaseAddress, Alignment, Type, Alignment0);
-    BaseAddress += Alignment;
-    Length -= Alignment;
+  if (Uniform) {
+    return RETURN_SUCCESS;
   }
 
-  while (SubtractiveRight-- != 0) {
-    Alignment = MtrrLibLeastAlignment (BaseAddress + Length, Alignment0);
-    MtrrLibAddVariableMtrr (Ranges, RangeCount, VariableMtrr, VariableMtrrCapacity, VariableMtrrCount,
-                            BaseAddress + Length, Alignment, CacheInvalid, Alignment0);
-    Length += Alignment;
+  Status = MtrrLibAddVariableMtrrs (
+             Solver, Covered, BaseAddress, RShiftU64 (Length, 1),
+             VariableMtrr, VariableMtrrCapacity, VariableMtrrCount
+             );
+  if (RETURN_ERROR (Status)) {
+    return Status;
   }
+  return MtrrLibAddVariableMtrrs (
+           Solver, Covered, BaseAddress + RShiftU64 (Length, 1), RShiftU64 (Length, 1),
+           VariableMtrr, VariableMtrrCapacity, VariableMtrrCount
+           );
+}
 
-  UseLeastAlignment = TRUE;
-  while (Length != 0) {
-    if (UseLeastAlignment) {
-      Alignment = MtrrLibLeastAlignment (BaseAddress, Alignment0);
-      if (Alignment > Length) {
-        UseLeastAlignment = FALSE;
-      }
-    }
+/**
+  Calculate the least number of variable MTRRs that give every memory address
+  the memory type in the memory range array, and allocate them.
 
-    if (!UseLeastAlignment) {
-      Alignment = GetPowerOfTwo64 (Length);
-    }
+  The memory below 1MB is covered by the fixed MTRRs and may get any type
+  from the variable MTRRs.
+
+  @param Ranges               Memory range array holding the memory type
+                              settings for all memory address.
+  @param RangeCount           Count of memory ranges.
+  @param DefaultType          The default memory type.
+  @param TotalLength          The total length of the memory.
+  @param VariableMtrr         Return the variable MTRR array.
+  @param VariableMtrrCapacity Capacity of variable MTRR array.
+  @param VariableMtrrCount    Return the count of variable MTRR.
+
+  @retval RETURN_SUCCESS          Variable MTRRs are allocated successfully.
+  @retval RETURN_OUT_OF_RESOURCES Count of variable MTRRs exceeds capacity.
+**/
+RETURN_STATUS
+MtrrLibCalculateVariableMtrrs (
+  IN CONST MTRR_MEMORY_RANGE       *Ranges,
+  IN UINT32                        RangeCount,
+  IN MTRR_MEMORY_CACHE_TYPE        DefaultType,
+  IN UINT64                        TotalLength,
+  OUT VARIABLE_MTRR                *VariableMtrr,
+  IN UINT32                        VariableMtrrCapacity,
+  OUT UINT32                       *VariableMtrrCount
+  )
+{
+  MTRR_SOLVER_CONTEXT              Solver;
+  UINT32                           Cost[MTRR_LIB_TYPE_COUNT];
 
-    MtrrLibAddVariableMtrr (NULL, 0, VariableMtrr, VariableMtrrCapacity, VariableMtrrCount,
-                            BaseAddress, Alignment, Type, Alignment0);
-    BaseAddress += Alignment;
-    Length -= Alignment;
+  Solver.Ranges      = Ranges;
+  Solver.RangeCount  = RangeCount;
+  Solver.DefaultType = DefaultType;
+
+  *VariableMtrrCount = 0;
+  MtrrLibGetMtrrCost (&Solver, 0, TotalLength, Cost);
+  if (Cost[CacheInvalid] > VariableMtrrCapacity) {
+    return RETURN_OUT_OF_RESOURCES;
   }
-  return RETURN_SUCCESS;
+
+  return MtrrLibAddVariableMtrrs (
+           &Solver, CacheInvalid, 0, TotalLength,
+           VariableMtrr, VariableMtrrCapacity, VariableMtrrCount
+           );
 }
 
 /**
@@ -1709,7 +1571,7 @@ MtrrLibGetMemoryTypes (
   IN UINT64                      TotalLength,
   IN CONST VARIABLE_MTRR         *VariableMtrr,
   IN UINT32                      VariableMtrrCount,
-  OUT MEMORY_RANGE               *Ranges,
+  OUT MTRR_MEMORY_RANGE          *Ranges,
   IN UINT32                      RangeCapacity,
   OUT UINT32                     *RangeCount
 )
@@ -1785,47 +1647,51 @@ MtrrLibGetMemoryTypes (
   settings buffer.
   If MtrrSetting is NULL, set the attributes into MTRRs registers.
 
+  All the memory ranges are applied to the memory type map first, and the
+  variable MTRRs are calculated and programmed once for the final map.
+  MtrrSetting is only updated when all the memory ranges are set.
+
   @param[in, out]  MtrrSetting       A buffer holding all MTRRs content.
-  @param[in]       BaseAddress       The physical address that is the start
-                                     address of a memory range.
-  @param[in]       Length            The size in bytes of the memory range.
-  @param[in]       Type              The MTRR type to set for the memory range.
+  @param[in]       MemoryRanges      The memory ranges to set.
+  @param[in]       MemoryRangeCount  The count of memory ranges.
 
   @retval RETURN_SUCCESS            The attributes were set for the memory
-                                    range.
-  @retval RETURN_INVALID_PARAMETER  Length is zero.
+                                    ranges.
+  @retval RETURN_INVALID_PARAMETER  Length of a memory range is zero.
   @retval RETURN_UNSUPPORTED        The processor does not support one or
-                                    more bytes of the memory resource range
-                                    specified by BaseAddress and Length.
-  @retval RETURN_UNSUPPORTED        The MTRR type is not support for the
-                                    memory resource range specified
-                                    by BaseAddress and Length.
+                                    more bytes of a memory resource range.
+  @retval RETURN_UNSUPPORTED        The MTRR type is not support for a
+                                    memory resource range.
   @retval RETURN_OUT_OF_RESOURCES   There are not enough system resources to
                                     modify the attributes of the memory
-                                    resource range.
+                                    resource ranges.
 
 **/
 RETURN_STATUS
 MtrrSetMemoryAttributeWorker (
   IN OUT MTRR_SETTINGS           *MtrrSetting,
-  IN PHYSICAL_ADDRESS            BaseAddress,
-  IN UINT64                      Length,
-  IN MTRR_MEMORY_CACHE_TYPE      Type
+  IN CONST MTRR_MEMORY_RANGE     *MemoryRanges,
+  IN UINTN                       MemoryRangeCount
   )
 {
   RETURN_STATUS             Status;
   UINT32                    Index;
   UINT32                    WorkingIndex;
+  UINTN                     RangeIndex;
+  PHYSICAL_ADDRESS          BaseAddress;
+  UINT64                    Length;
+  BOOLEAN                   VariableMtrrNeeded;
   //
   // N variable MTRRs can maximumly separate (2N + 1) Ranges, plus 1 range for [0, 1M).
   //
-  MEMORY_RANGE              Ranges[MTRR_NUMBER_OF_VARIABLE_MTRR * 2 + 2];
+  MTRR_MEMORY_RANGE         Ranges[MTRR_NUMBER_OF_VARIABLE_MTRR * 2 + 2];
   UINT32                    RangeCount;
   UINT64                    MtrrValidBitsMask;
   UINT64                    MtrrValidAddressMask;
-  UINT64                    Alignment0;
   MTRR_CONTEXT              MtrrContext;
   BOOLEAN                   MtrrContextValid;
+  MTRR_SETTINGS             *OriginalMtrrSetting;
+  MTRR_SETTINGS             WorkingMtrrSetting;
 
   MTRR_MEMORY_CACHE_TYPE    DefaultType;
 
@@ -1847,14 +1713,27 @@ MtrrSetMemoryAttributeWorker (
   BOOLEAN                   VariableSettingModified[MTRR_NUMBER_OF_VARIABLE_MTRR];
   UINTN                     FreeVariableMtrrCount;
 
-  if (Length == 0) {
-    return RETURN_INVALID_PARAMETER;
+  MtrrLibInitializeMtrrMask (&MtrrValidBitsMask, &MtrrValidAddressMask);
+  for (RangeIndex = 0; RangeIndex < MemoryRangeCount; RangeIndex++) {
+    if (MemoryRanges[RangeIndex].Length == 0) {
+      return RETURN_INVALID_PARAMETER;
+    }
+    if (((MemoryRanges[RangeIndex].BaseAddress & ~MtrrValidAddressMask) != 0) ||
+        ((MemoryRanges[RangeIndex].Length & ~MtrrValidAddressMask) != 0)) {
+      return RETURN_UNSUPPORTED;
+    }
   }
 
-  MtrrLibInitializeMtrrMask (&MtrrValidBitsMask, &MtrrValidAddressMask);
-  if (((BaseAddress & ~MtrrValidAddressMask) != 0) || (Length & ~MtrrValidAddressMask) != 0) {
-    return RETURN_UNSUPPORTED;
+  //
+  // Work on a copy of the MTRR settings buffer, so that the buffer is left
+  // unchanged when a later memory range fails.
+  //
+  OriginalMtrrSetting = MtrrSetting;
+  if (MtrrSetting != NULL) {
+    CopyMem (&WorkingMtrrSetting, MtrrSetting, sizeof (WorkingMtrrSetting));
+    MtrrSetting = &WorkingMtrrSetting;
   }
+
   OriginalVariableMtrrCount = 0;
   VariableSettings          = NULL;
 
@@ -1867,39 +1746,47 @@ MtrrSetMemoryAttributeWorker (
   //
   // Check if Fixed MTRR
   //
-  if (BaseAddress < BASE_1MB) {
-    MsrIndex = (UINT32)-1;
-    while ((BaseAddress < BASE_1MB) && (Length != 0)) {
-      Status = MtrrLibProgramFixedMtrr (Type, &BaseAddress, &Length, &MsrIndex, &ClearMask, &OrMask);
-      if (RETURN_ERROR (Status)) {
-        return Status;
-      }
-      if (MtrrSetting != NULL) {
-        MtrrSetting->Fixed.Mtrr[MsrIndex] = (MtrrSetting->Fixed.Mtrr[MsrIndex] & ~ClearMask) | OrMask;
-        ((MSR_IA32_MTRR_DEF_TYPE_REGISTER *) &MtrrSetting->MtrrDefType)->Bits.FE = 1;
-      } else {
-        if (!FixedSettingsValid[MsrIndex]) {
-          WorkingFixedSettings.Mtrr[MsrIndex] = AsmReadMsr64 (mMtrrLibFixedMtrrTable[MsrIndex].Msr);
-          FixedSettingsValid[MsrIndex] = TRUE;
+  VariableMtrrNeeded = FALSE;
+  for (RangeIndex = 0; RangeIndex < MemoryRangeCount; RangeIndex++) {
+    BaseAddress = MemoryRanges[RangeIndex].BaseAddress;
+    Length      = MemoryRanges[RangeIndex].Length;
+    if (BaseAddress < BASE_1MB) {
+      MsrIndex = (UINT32)-1;
+      while ((BaseAddress < BASE_1MB) && (Length != 0)) {
+        Status = MtrrLibProgramFixedMtrr (MemoryRanges[RangeIndex].Type, &BaseAddress, &Length, &MsrIndex, &ClearMask, &OrMask);
+        if (RETURN_ERROR (Status)) {
+          return Status;
         }
-        NewValue = (WorkingFixedSettings.Mtrr[MsrIndex] & ~ClearMask) | OrMask;
-        if (WorkingFixedSettings.Mtrr[MsrIndex] != NewValue) {
-          WorkingFixedSettings.Mtrr[MsrIndex] = NewValue;
-          FixedSettingsModified[MsrIndex] = TRUE;
+        if (MtrrSetting != NULL) {
+          MtrrSetting->Fixed.Mtrr[MsrIndex] = (MtrrSetting->Fixed.Mtrr[MsrIndex] & ~ClearMask) | OrMask;
+          ((MSR_IA32_MTRR_DEF_TYPE_REGISTER *) &MtrrSetting->MtrrDefType)->Bits.FE = 1;
+        } else {
+          if (!FixedSettingsValid[MsrIndex]) {
+            WorkingFixedSettings.Mtrr[MsrIndex] = AsmReadMsr64 (mMtrrLibFixedMtrrTable[MsrIndex].Msr);
+            FixedSettingsValid[MsrIndex] = TRUE;
+          }
+          NewValue = (WorkingFixedSettings.Mtrr[MsrIndex] & ~ClearMask) | OrMask;
+          if (WorkingFixedSettings.Mtrr[MsrIndex] != NewValue) {
+            WorkingFixedSettings.Mtrr[MsrIndex] = NewValue;
+            FixedSettingsModified[MsrIndex] = TRUE;
+          }
         }
       }
     }
-
-    if (Length == 0) {
-      //
-      // A Length of 0 can only make sense for fixed MTTR ranges.
-      // Since we just handled the fixed MTRRs, we can skip the
-      // variable MTRR section.
-      //
-      goto Done;
+    if (Length != 0) {
+      VariableMtrrNeeded = TRUE;
     }
   }
 
+  if (!VariableMtrrNeeded) {
+    //
+    // A Length of 0 can only make sense for fixed MTTR ranges.
+    // Since we just handled the fixed MTRRs, we can skip the
+    // variable MTRR section.
+    //
+    goto Done;
+  }
+
   //
   // Read the default MTRR type
   //
@@ -1928,50 +1815,41 @@ MtrrSetMemoryAttributeWorker (
   ASSERT (RangeCount <= 2 * FirmwareVariableMtrrCount + 1);
 
   //
-  // Force [0, 1M) to UC, so that it doesn't impact left subtraction algorithm.
-  //
-  Status = MtrrLibSetMemoryType (Ranges, 2 * FirmwareVariableMtrrCount + 2, &RangeCount, 0, SIZE_1MB, CacheUncacheable);
-  ASSERT (Status == RETURN_SUCCESS);
-  //
-  // Apply Type to [BaseAddress, BaseAddress + Length)
+  // Apply the type of each memory range above 1MB; the fixed MTRRs cover the
+  // part below. The ranges are applied in order, so that a later range
+  // overrides an earlier one. The map may hold more ranges than the variable
+  // MTRRs can separate until the later ranges are applied, but no more than
+  // ARRAY_SIZE (Ranges).
   //
-  Status = MtrrLibSetMemoryType (Ranges, 2 * FirmwareVariableMtrrCount + 2, &RangeCount, BaseAddress, Length, Type);
-  if (RETURN_ERROR (Status)) {
-    return Status;
-  }
-
-  Alignment0 = LShiftU64 (1, (UINTN) HighBitSet64 (MtrrValidBitsMask));
-  WorkingVariableMtrrCount = 0;
-  ZeroMem (&WorkingVariableMtrr, sizeof (WorkingVariableMtrr));
-  for (Index = 0; Index < RangeCount; Index++) {
-    if (Ranges[Index].Type != DefaultType) {
-      //
-      // Maximum allowed MTRR count is (FirmwareVariableMtrrCount + 1)
-      // Because potentially the range [0, 1MB) is not merged, but can be ignored because fixed MTRR covers that
-      //
-      Status = MtrrLibSetMemoryAttributeInVariableMtrr (
-        Ranges, RangeCount,
-        WorkingVariableMtrr, FirmwareVariableMtrrCount + 1, &WorkingVariableMtrrCount,
-        Ranges[Index].BaseAddress, Ranges[Index].Length,
-        Ranges[Index].Type, Alignment0
-      );
-      if (RETURN_ERROR (Status)) {
-        return Status;
-      }
+  for (RangeIndex = 0; RangeIndex < MemoryRangeCount; RangeIndex++) {
+    BaseAddress = MemoryRanges[RangeIndex].BaseAddress;
+    Length      = MemoryRanges[RangeIndex].Length;
+    if (BaseAddress + Length <= BASE_1MB) {
+      continue;
+    }
+    if (BaseAddress < BASE_1MB) {
+      Length     -= BASE_1MB - BaseAddress;
+      BaseAddress = BASE_1MB;
+    }
+    Status = MtrrLibSetMemoryType (
+               Ranges, ARRAY_SIZE (Ranges), &RangeCount,
+               BaseAddress, Length, MemoryRanges[RangeIndex].Type
+               );
+    if (RETURN_ERROR (Status)) {
+      return Status;
     }
   }
 
   //
-  // Remove the [0, 1MB) MTRR if it still exists (not merged with other range)
+  // Calculate the least variable MTRRs for the whole memory type map.
   //
-  if (WorkingVariableMtrr[0].BaseAddress == 0 && WorkingVariableMtrr[0].Length == SIZE_1MB) {
-    ASSERT (WorkingVariableMtrr[0].Type == CacheUncacheable);
-    WorkingVariableMtrrCount--;
-    CopyMem (&WorkingVariableMtrr[0], &WorkingVariableMtrr[1], WorkingVariableMtrrCount * sizeof (VARIABLE_MTRR));
-  }
-
-  if (WorkingVariableMtrrCount > FirmwareVariableMtrrCount) {
-    return RETURN_OUT_OF_RESOURCES;
+  ZeroMem (&WorkingVariableMtrr, sizeof (WorkingVariableMtrr));
+  Status = MtrrLibCalculateVariableMtrrs (
+             Ranges, RangeCount, DefaultType, MtrrValidBitsMask + 1,
+             WorkingVariableMtrr, FirmwareVariableMtrrCount, &WorkingVariableMtrrCount
+             );
+  if (RETURN_ERROR (Status)) {
+    return Status;
   }
 
   for (Index = 0; Index < OriginalVariableMtrrCount; Index++) {
@@ -2069,6 +1947,7 @@ MtrrSetMemoryAttributeWorker (
 Done:
   if (MtrrSetting != NULL) {
     ((MSR_IA32_MTRR_DEF_TYPE_REGISTER *) &MtrrSetting->MtrrDefType)->Bits.E = 1;
+    CopyMem (OriginalMtrrSetting, MtrrSetting, sizeof (*OriginalMtrrSetting));
     return RETURN_SUCCESS;
   }
 
@@ -2152,12 +2031,16 @@ MtrrSetMemoryAttribute (
   )
 {
   RETURN_STATUS              Status;
+  MTRR_MEMORY_RANGE          Range;
 
   if (!IsMtrrSupported ()) {
     return RETURN_UNSUPPORTED;
   }
 
-  Status = MtrrSetMemoryAttributeWorker (NULL, BaseAddress, Length, Attribute);
+  Range.BaseAddress = BaseAddress;
+  Range.Length      = Length;
+  Range.Type        = Attribute;
+  Status = MtrrSetMemoryAttributeWorker (NULL, &Range, 1);
   DEBUG ((DEBUG_CACHE, "MtrrSetMemoryAttribute() %a: [%016lx, %016lx) - %r\n",
           mMtrrMemoryCacheTypeShortName[Attribute], BaseAddress, BaseAddress + Length, Status));
 
@@ -2199,7 +2082,12 @@ MtrrSetMemoryAttributeInMtrrSettings (
   )
 {
   RETURN_STATUS              Status;
-  Status = MtrrSetMemoryAttributeWorker (MtrrSetting, BaseAddress, Length, Attribute);
+  MTRR_MEMORY_RANGE          Range;
+
+  Range.BaseAddress = BaseAddress;
+  Range.Length      = Length;
+  Range.Type        = Attribute;
+  Status = MtrrSetMemoryAttributeWorker (MtrrSetting, &Range, 1);
   DEBUG((DEBUG_CACHE, "MtrrSetMemoryAttributeMtrrSettings(%p) %a: [%016lx, %016lx) - %r\n",
          MtrrSetting, mMtrrMemoryCacheTypeShortName[Attribute], BaseAddress, BaseAddress + Length, Status));
 
@@ -2210,6 +2098,69 @@ MtrrSetMemoryAttributeInMtrrSettings (
   return Status;
 }
 
+/**
+  This function attempts to set the attributes into MTRR setting buffer for
+  several memory ranges at once.
+
+  The memory ranges are applied in order, so a later range overrides an
+  earlier one where they overlap. The variable MTRRs are calculated once for
+  the result, so the intermediate results do not need to fit in the variable
+  MTRRs. Callers can collect all the changes in an MTRR setting buffer and
+  program the processors once with MtrrSetAllMtrrs().
+
+  The memory type map built while the ranges are applied can hold up to
+  2 * MTRR_NUMBER_OF_VARIABLE_MTRR + 2 ranges. RETURN_OUT_OF_RESOURCES is
+  returned when an intermediate map needs more, even if the final one would
+  fit in the variable MTRRs.
+
+  MtrrSetting is only updated when all the memory ranges are set, it is left
+  unchanged when an error is returned.
+
+  @param[in, out]  MtrrSetting  MTRR setting buffer to be set.
+  @param[in]       Ranges       The memory ranges to set.
+  @param[in]       RangeCount   The count of memory ranges.
+
+  @retval RETURN_SUCCESS            The attributes were set for all the memory ranges.
+  @retval RETURN_INVALID_PARAMETER  Ranges is NULL or RangeCount is zero.
+  @retval RETURN_INVALID_PARAMETER  Length of a memory range is zero.
+  @retval RETURN_UNSUPPORTED        The processor does not support one or more bytes of a
+                                    memory resource range.
+  @retval RETURN_UNSUPPORTED        The bit mask of attributes is not support for a memory
+                                    resource range.
+  @retval RETURN_OUT_OF_RESOURCES   There are not enough system resources to modify the attributes of
+                                    the memory resource ranges.
+
+**/
+RETURN_STATUS
+EFIAPI
+MtrrSetMemoryAttributesInMtrrSettings (
+  IN OUT MTRR_SETTINGS            *MtrrSetting,
+  IN CONST MTRR_MEMORY_RANGE      *Ranges,
+  IN UINTN                        RangeCount
+  )
+{
+  RETURN_STATUS                   Status;
+  UINTN                           Index;
+
+  if ((Ranges == NULL) || (RangeCount == 0)) {
+    return RETURN_INVALID_PARAMETER;
+  }
+
+  Status = MtrrSetMemoryAttributeWorker (MtrrSetting, Ranges, RangeCount);
+  for (Index = 0; Index < RangeCount; Index++) {
+    DEBUG((DEBUG_CACHE, "MtrrSetMemoryAttributesInMtrrSettings(%p) %a: [%016lx, %016lx)\n",
+           MtrrSetting, mMtrrMemoryCacheTypeShortName[Ranges[Index].Type],
+           Ranges[Index].BaseAddress, Ranges[Index].BaseAddress + Ranges[Index].Length));
+  }
+  DEBUG((DEBUG_CACHE, "MtrrSetMemoryAttributesInMtrrSettings(%p) - %r\n", MtrrSetting, Status));
+
+  if (!RETURN_ERROR (Status)) {
+    MtrrDebugPrintAllMtrrsWorker (MtrrSetting);
+  }
+
+  return Status;
+}
+
 /**
   Worker function setting variable MTRRs
 
@@ -0,0 +1,1171 @@
+/** @file
+  Host-side random memory layout test of the variable MTRR solver.
+
+  The test builds MtrrLib.c on the build host, generates random memory type
+  layouts and lets both MtrrLibCalculateVariableMtrrs() and the per-range
+  algorithm that MtrrLib used before it cover each layout with variable MTRRs.
+  It checks that the solver gives every address above 1MB the memory type of
+  the layout, and that it never needs more variable MTRRs than the per-range
+  algorithm.
+
+  The test is not part of any platform build. Build and run it from the
+  workspace root with a host compiler, optionally passing a seed and an
+  iteration count:
+
+    gcc -IMdePkg/Include -IMdePkg/Include/X64 -IUefiCpuPkg/Include
+        -o MtrrLibHostTest UefiCpuPkg/Library/MtrrLib/UnitTest/MtrrLibHostTest.c
+    ./MtrrLibHostTest [Seed] [Iterations]
+
+  Copyright (c) 2017, Intel Corporation. All rights reserved.<BR>
+  This program and the accompanying materials
+  are licensed and made available under the terms and conditions of the BSD License
+  which accompanies this distribution.  The full text of the license may be found at
+  http://opensource.org/licenses/bsd-license.php
+
+  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+
+**/
+
+//
+// The C library routines the test prints with. They are declared ahead of
+// Base.h, which gives the later declarations hidden visibility.
+//
+int
+printf (
+  const char  *Format,
+  ...
+  );
+
+void
+exit (
+  int  Status
+  );
+
+//
+// MtrrLib reads the reserved variable MTRR count from a dynamic PCD, which
+// the build tool would otherwise define in AutoGen.h.
+//
+#include <Base.h>
+#include <Library/PcdLib.h>
+#define _PCD_GET_MODE_32_PcdCpuNumberOfReservedVariableMtrrs  0
+
+#include "../MtrrLib.c"
+
+//
+// The address width of the random layouts and the most ranges in one layout
+//
+#define TEST_PHYSICAL_ADDRESS_BITS  36
+#define TEST_MAX_RANGE_COUNT        16
+#define TEST_MTRR_CAPACITY          256
+
+UINT64  mRandomState;
+
+//
+// Host stubs of the library functions MtrrLib.c depends on. The test only
+// calls the routines that work on memory range and variable MTRR arrays, so
+// the processor access stubs return zero and have no side effect.
+//
+
+UINT64
+EFIAPI
+LShiftU64 (
+  IN UINT64  Operand,
+  IN UINTN   Count
+  )
+{
+  return Operand << Count;
+}
+
+UINT64
+EFIAPI
+RShiftU64 (
+  IN UINT64  Operand,
+  IN UINTN   Count
+  )
+{
+  return Operand >> Count;
+}
+
+UINT64
+EFIAPI
+MultU64x32 (
+  IN UINT64  Multiplicand,
+  IN UINT32  Multiplier
+  )
+{
+  return Multiplicand * Multiplier;
+}
+
+INTN
+EFIAPI
+LowBitSet64 (
+  IN UINT64  Operand
+  )
+{
+  INTN  BitIndex;
+
+  if (Operand == 0) {
+    return -1;
+  }
+  for (BitIndex = 0; (Operand & 1) == 0; BitIndex++) {
+    Operand >>= 1;
+  }
+  return BitIndex;
+}
+
+INTN
+EFIAPI
+HighBitSet64 (
+  IN UINT64  Operand
+  )
+{
+  INTN  BitIndex;
+
+  if (Operand == 0) {
+    return -1;
+  }
+  for (BitIndex = -1; Operand != 0; BitIndex++) {
+    Operand >>= 1;
+  }
+  return BitIndex;
+}
+
+UINT64
+EFIAPI
+GetPowerOfTwo64 (
+  IN UINT64  Operand
+  )
+{
+  if (Operand == 0) {
+    return 0;
+  }
+  return LShiftU64 (1, (UINTN) HighBitSet64 (Operand));
+}
+
+VOID *
+EFIAPI
+CopyMem (
+  OUT VOID       *DestinationBuffer,
+  IN CONST VOID  *SourceBuffer,
+  IN UINTN       Length
+  )
+{
+  return __builtin_memmove (DestinationBuffer, SourceBuffer, Length);
+}
+
+VOID *
+EFIAPI
+ZeroMem (
+  OUT VOID  *Buffer,
+  IN UINTN  Length
+  )
+{
+  return __builtin_memset (Buffer, 0, Length);
+}
+
+UINT32
+EFIAPI
+AsmCpuid (
+  IN  UINT32  Index,
+  OUT UINT32  *RegisterEax,  OPTIONAL
+  OUT UINT32  *RegisterEbx,  OPTIONAL
+  OUT UINT32  *RegisterEcx,  OPTIONAL
+  OUT UINT32  *RegisterEdx   OPTIONAL
+  )
+{
+  if (RegisterEax != NULL) {
+    *RegisterEax = 0;
+  }
+  if (RegisterEbx != NULL) {
+    *RegisterEbx = 0;
+  }
+  if (RegisterEcx != NULL) {
+    *RegisterEcx = 0;
+  }
+  if (RegisterEdx != NULL) {
+    *RegisterEdx = 0;
+  }
+  return Index;
+}
+
+UINT64
+EFIAPI
+AsmReadMsr64 (
+  IN UINT32  Index
+  )
+{
+  return 0;
+}
+
+UINT64
+EFIAPI
+AsmWriteMsr64 (
+  IN UINT32  Index,
+  IN UINT64  Value
+  )
+{
+  return Value;
+}
+
+UINTN
+EFIAPI
+AsmReadCr4 (
+  VOID
+  )
+{
+  return 0;
+}
+
+UINTN
+EFIAPI
+AsmWriteCr4 (
+  UINTN  Cr4
+  )
+{
+  return Cr4;
+}
+
+VOID
+EFIAPI
+AsmDisableCache (
+  VOID
+  )
+{
+}
+
+VOID
+EFIAPI
+AsmEnableCache (
+  VOID
+  )
+{
+}
+
+VOID
+EFIAPI
+CpuFlushTlb (
+  VOID
+  )
+{
+}
+
+BOOLEAN
+EFIAPI
+SaveAndDisableInterrupts (
+  VOID
+  )
+{
+  return FALSE;
+}
+
+BOOLEAN
+EFIAPI
+SetInterruptState (
+  IN BOOLEAN  InterruptState
+  )
+{
+  return InterruptState;
+}
+
+VOID
+EFIAPI
+DebugPrint (
+  IN UINTN        ErrorLevel,
+  IN CONST CHAR8  *Format,
+  ...
+  )
+{
+}
+
+VOID
+EFIAPI
+DebugAssert (
+  IN CONST CHAR8  *FileName,
+  IN UINTN        LineNumber,
+  IN CONST CHAR8  *Description
+  )
+{
+  printf ("ASSERT %s(%d): %s\n", FileName, (int) LineNumber, Description);
+  exit (1);
+}
+
+BOOLEAN
+EFIAPI
+DebugAssertEnabled (
+  VOID
+  )
+{
+  return TRUE;
+}
+
+BOOLEAN
+EFIAPI
+DebugPrintEnabled (
+  VOID
+  )
+{
+  return FALSE;
+}
+
+BOOLEAN
+EFIAPI
+DebugCodeEnabled (
+  VOID
+  )
+{
+  return FALSE;
+}
+
+BOOLEAN
+EFIAPI
+DebugPrintLevelEnabled (
+  IN CONST UINTN  ErrorLevel
+  )
+{
+  return FALSE;
+}
+
+//
+// The per-range variable MTRR algorithm that MtrrSetMemoryAttributeWorker()
+// used before MtrrLibCalculateVariableMtrrs(), kept as the reference of the
+// test. It covers each range that differs from the default type on its own,
+// subtracting aligned blocks of higher precedence types on both sides of the
+// range when that saves variable MTRRs.
+//
+
+/**
+  Return the least alignment of address.
+
+  @param Address    The address to return the alignment.
+  @param Alignment0 The alignment to return when Address is 0.
+
+  @return The least alignment of the Address.
+**/
+UINT64
+ReferenceLeastAlignment (
+  IN UINT64  Address,
+  IN UINT64  Alignment0
+  )
+{
+  if (Address == 0) {
+    return Alignment0;
+  }
+
+  return LShiftU64 (1, (UINTN) LowBitSet64 (Address));
+}
+
+/**
+  Return the number of required variable MTRRs to positively cover the
+  specified range.
+
+  @param BaseAddress Base address of the range.
+  @param Length      Length of the range.
+  @param Alignment0  Alignment of 0.
+
+  @return The number of the required variable MTRRs.
+**/
+UINT32
+ReferenceGetPositiveMtrrNumber (
+  IN UINT64  BaseAddress,
+  IN UINT64  Length,
+  IN UINT64  Alignment0
+  )
+{
+  UINT64   SubLength;
+  UINT32   MtrrNumber;
+  BOOLEAN  UseLeastAlignment;
+
+  UseLeastAlignment = TRUE;
+  SubLength         = 0;
+
+  for (MtrrNumber = 0; Length != 0; MtrrNumber++) {
+    if (UseLeastAlignment) {
+      SubLength = ReferenceLeastAlignment (BaseAddress, Alignment0);
+      if (SubLength > Length) {
+        UseLeastAlignment = FALSE;
+      }
+    }
+
+    if (!UseLeastAlignment) {
+      SubLength = GetPowerOfTwo64 (Length);
+    }
+
+    BaseAddress += SubLength;
+    Length      -= SubLength;
+  }
+
+  return MtrrNumber;
+}
+
+/**
+  Return whether the type of the specified range can precede the specified type.
+
+  @param Ranges     Memory range array holding memory type settings for all
+                    the memory address.
+  @param RangeCount Count of memory ranges.
+  @param Type       Type to check precedence.
+  @param SubBase    Base address of the specified range.
+  @param SubLength  Length of the specified range.
+
+  @retval TRUE  The type of the specified range can precede the Type.
+  @retval FALSE The type of the specified range cannot precede the Type.
+**/
+BOOLEAN
+ReferenceSubstractable (
+  IN CONST MTRR_MEMORY_RANGE  *Ranges,
+  IN UINT32                   RangeCount,
+  IN MTRR_MEMORY_CACHE_TYPE   Type,
+  IN UINT64                   SubBase,
+  IN UINT64                   SubLength
+  )
+{
+  UINT32  Index;
+  UINT64  Length;
+
+  for (Index = 0; Index < RangeCount; Index++) {
+    if ((Ranges[Index].BaseAddress <= SubBase) && (SubBase < Ranges[Index].BaseAddress + Ranges[Index].Length)) {
+      if (Ranges[Index].BaseAddress + Ranges[Index].Length >= SubBase + SubLength) {
+        return MtrrLibTypeLeftPrecedeRight (Ranges[Index].Type, Type);
+      }
+
+      if (!MtrrLibTypeLeftPrecedeRight (Ranges[Index].Type, Type)) {
+        return FALSE;
+      }
+
+      Length     = Ranges[Index].BaseAddress + Ranges[Index].Length - SubBase;
+      SubBase   += Length;
+      SubLength -= Length;
+    }
+  }
+
+  ASSERT (FALSE);
+  return FALSE;
+}
+
+/**
+  Return the number of required variable MTRRs to cover the specified range,
+  considering subtraction on both sides of the range.
+
+  @param Ranges            Array holding memory type settings of all memory
+                           address.
+  @param RangeCount        Count of memory ranges.
+  @param VariableMtrr      Array holding allocated variable MTRRs.
+  @param VariableMtrrCount Count of allocated variable MTRRs.
+  @param BaseAddress       Base address of the specified range.
+  @param Length            Length of the specified range.
+  @param Type              MTRR type of the specified range.
+  @param Alignment0        Alignment of 0.
+  @param SubLeft           Return the count of left subtraction.
+  @param SubRight          Return the count of right subtraction.
+
+  @return Number of required variable MTRRs.
+**/
+UINT32
+ReferenceGetMtrrNumber (
+  IN CONST MTRR_MEMORY_RANGE  *Ranges,
+  IN UINT32                   RangeCount,
+  IN CONST VARIABLE_MTRR      *VariableMtrr,
+  IN UINT32                   VariableMtrrCount,
+  IN UINT64                   BaseAddress,
+  IN UINT64                   Length,
+  IN MTRR_MEMORY_CACHE_TYPE   Type,
+  IN UINT64                   Alignment0,
+  OUT UINT32                  *SubLeft,
+  OUT UINT32                  *SubRight
+  )
+{
+  UINT64  Alignment;
+  UINT32  LeastLeftMtrrNumber;
+  UINT32  MiddleMtrrNumber;
+  UINT32  LeastRightMtrrNumber;
+  UINT32  CurrentMtrrNumber;
+  UINT32  SubtractiveCount;
+  UINT32  SubtractiveMtrrNumber;
+  UINT32  LeastSubtractiveMtrrNumber;
+  UINT64  SubtractiveBaseAddress;
+  UINT64  SubtractiveLength;
+  UINT64  BaseAlignment;
+  UINT32  Index;
+
+  *SubLeft                   = 0;
+  *SubRight                  = 0;
+  LeastSubtractiveMtrrNumber = 0;
+  BaseAlignment              = 0;
+
+  if (BaseAddress != 0) {
+    SubtractiveBaseAddress = 0;
+    SubtractiveLength      = 0;
+    LeastLeftMtrrNumber    = ReferenceGetPositiveMtrrNumber (BaseAddress, Length, Alignment0);
+
+    for (SubtractiveMtrrNumber = 0, SubtractiveCount = 1; BaseAddress != 0; SubtractiveCount++) {
+      Alignment = ReferenceLeastAlignment (BaseAddress, Alignment0);
+      if (!ReferenceSubstractable (Ranges, RangeCount, Type, BaseAddress - Alignment, Alignment)) {
+        break;
+      }
+
+      for (Index = 0; Index < VariableMtrrCount; Index++) {
+        if ((VariableMtrr[Index].BaseAddress == BaseAddress - Alignment) &&
+            (VariableMtrr[Index].Length == Alignment)) {
+          break;
+        }
+      }
+      if (Index == VariableMtrrCount) {
+        SubtractiveMtrrNumber++;
+      }
+
+      BaseAddress -= Alignment;
+      Length      += Alignment;
+
+      CurrentMtrrNumber = SubtractiveMtrrNumber + ReferenceGetPositiveMtrrNumber (BaseAddress, Length, Alignment0);
+      if (CurrentMtrrNumber <= LeastLeftMtrrNumber) {
+        LeastLeftMtrrNumber        = CurrentMtrrNumber;
+        LeastSubtractiveMtrrNumber = SubtractiveMtrrNumber;
+        *SubLeft                   = SubtractiveCount;
+        SubtractiveBaseAddress     = BaseAddress;
+        SubtractiveLength          = Length;
+      }
+    }
+
+    if (*SubLeft != 0) {
+      BaseAddress = SubtractiveBaseAddress;
+      Length      = SubtractiveLength;
+    }
+  }
+
+  MiddleMtrrNumber = 0;
+  while (Length != 0) {
+    BaseAlignment = ReferenceLeastAlignment (BaseAddress, Alignment0);
+    if (BaseAlignment > Length) {
+      break;
+    }
+    BaseAddress += BaseAlignment;
+    Length      -= BaseAlignment;
+    MiddleMtrrNumber++;
+  }
+
+  if (Length == 0) {
+    return LeastSubtractiveMtrrNumber + MiddleMtrrNumber;
+  }
+
+  LeastRightMtrrNumber = ReferenceGetPositiveMtrrNumber (BaseAddress, Length, Alignment0);
+  for (SubtractiveCount = 1; Length < BaseAlignment; SubtractiveCount++) {
+    Alignment = ReferenceLeastAlignment (BaseAddress + Length, Alignment0);
+    if (!ReferenceSubstractable (Ranges, RangeCount, Type, BaseAddress + Length, Alignment)) {
+      break;
+    }
+
+    Length += Alignment;
+
+    CurrentMtrrNumber = SubtractiveCount + ReferenceGetPositiveMtrrNumber (BaseAddress, Length, Alignment0);
+    if (CurrentMtrrNumber <= LeastRightMtrrNumber) {
+      LeastRightMtrrNumber = CurrentMtrrNumber;
+      *SubRight            = SubtractiveCount;
+    }
+  }
+
+  return LeastSubtractiveMtrrNumber + MiddleMtrrNumber + LeastRightMtrrNumber;
+}
+
+RETURN_STATUS
+ReferenceSetMemoryAttributeInVariableMtrr (
+  IN CONST MTRR_MEMORY_RANGE  *Ranges,
+  IN UINT32                   RangeCount,
+  IN OUT VARIABLE_MTRR        *VariableMtrr,
+  IN UINT32                   VariableMtrrCapacity,
+  IN OUT UINT32               *VariableMtrrCount,
+  IN UINT64                   BaseAddress,
+  IN UINT64                   Length,
+  IN MTRR_MEMORY_CACHE_TYPE   Type,
+  IN UINT64                   Alignment0
+  );
+
+/**
+  Allocate one or more variable MTRR to cover the range identified by
+  BaseAddress and Length.
+
+  @param Ranges               Memory range array holding the memory type
+                              settings for all memory address.
+  @param RangeCount           Count of memory ranges.
+  @param VariableMtrr         Variable MTRR array.
+  @param VariableMtrrCapacity Capacity of variable MTRR array.
+  @param VariableMtrrCount    Count of variable MTRR.
+  @param BaseAddress          Base address of the memory range.
+  @param Length               Length of the memory range.
+  @param Type                 MTRR type of the range, or CacheInvalid if the
+                              range may contain several memory types.
+  @param Alignment0           Alignment of 0.
+
+  @retval RETURN_SUCCESS          Variable MTRRs are allocated successfully.
+  @retval RETURN_OUT_OF_RESOURCES Count of variable MTRRs exceeds capacity.
+**/
+RETURN_STATUS
+ReferenceAddVariableMtrr (
+  IN CONST MTRR_MEMORY_RANGE  *Ranges,
+  IN UINT32                   RangeCount,
+  IN OUT VARIABLE_MTRR        *VariableMtrr,
+  IN UINT32                   VariableMtrrCapacity,
+  IN OUT UINT32               *VariableMtrrCount,
+  IN UINT64                   BaseAddress,
+  IN UINT64                   Length,
+  IN MTRR_MEMORY_CACHE_TYPE   Type,
+  IN UINT64                   Alignment0
+  )
+{
+  RETURN_STATUS  Status;
+  UINT32         Index;
+  UINT64         SubLength;
+
+  MTRR_LIB_ASSERT_ALIGNED (BaseAddress, Length);
+  if (Type == CacheInvalid) {
+    for (Index = 0; Index < RangeCount; Index++) {
+      if ((Ranges[Index].BaseAddress <= BaseAddress) && (BaseAddress < Ranges[Index].BaseAddress + Ranges[Index].Length)) {
+        if (Ranges[Index].BaseAddress + Ranges[Index].Length >= BaseAddress + Length) {
+          return ReferenceSetMemoryAttributeInVariableMtrr (
+                   Ranges, RangeCount, VariableMtrr, VariableMtrrCapacity, VariableMtrrCount,
+                   BaseAddress, Length, Ranges[Index].Type, Alignment0
+                   );
+        }
+
+        SubLength = Ranges[Index].BaseAddress + Ranges[Index].Length - BaseAddress;
+        Status = ReferenceSetMemoryAttributeInVariableMtrr (
+                   Ranges, RangeCount, VariableMtrr, VariableMtrrCapacity, VariableMtrrCount,
+                   BaseAddress, SubLength, Ranges[Index].Type, Alignment0
+                   );
+        if (RETURN_ERROR (Status)) {
+          return Status;
+        }
+        BaseAddress += SubLength;
+        Length      -= SubLength;
+      }
+    }
+
+    ASSERT (FALSE);
+    return RETURN_DEVICE_ERROR;
+  }
+
+  for (Index = 0; Index < *VariableMtrrCount; Index++) {
+    if ((VariableMtrr[Index].BaseAddress == BaseAddress) && (VariableMtrr[Index].Length == Length)) {
+      //
+      // Two ranges may plan the same block with different types. The old code
+      // asserted the types match and kept the existing MTRR in release builds,
+      // which the layout check then reports as a wrong reference solution.
+      //
+      return RETURN_SUCCESS;
+    }
+  }
+
+  if (*VariableMtrrCount == VariableMtrrCapacity) {
+    return RETURN_OUT_OF_RESOURCES;
+  }
+  VariableMtrr[Index].BaseAddress = BaseAddress;
+  VariableMtrr[Index].Length      = Length;
+  VariableMtrr[Index].Type        = Type;
+  VariableMtrr[Index].Valid       = TRUE;
+  VariableMtrr[Index].Used        = TRUE;
+  (*VariableMtrrCount)++;
+  return RETURN_SUCCESS;
+}
+
+/**
+  Allocate one or more variable MTRR to cover the range identified by
+  BaseAddress and Length.
+
+  @param Ranges               Memory range array holding the memory type
+                              settings for all memory address.
+  @param RangeCount           Count of memory ranges.
+  @param VariableMtrr         Variable MTRR array.
+  @param VariableMtrrCapacity Capacity of variable MTRR array.
+  @param VariableMtrrCount    Count of variable MTRR.
+  @param BaseAddress          Base address of the memory range.
+  @param Length               Length of the memory range.
+  @param Type                 MTRR type of the memory range.
+  @param Alignment0           Alignment of 0.
+
+  @retval RETURN_SUCCESS          Variable MTRRs are allocated successfully.
+  @retval RETURN_OUT_OF_RESOURCES Count of variable MTRRs exceeds capacity.
+**/
+RETURN_STATUS
+ReferenceSetMemoryAttributeInVariableMtrr (
+  IN CONST MTRR_MEMORY_RANGE  *Ranges,
+  IN UINT32                   RangeCount,
+  IN OUT VARIABLE_MTRR        *VariableMtrr,
+  IN UINT32                   VariableMtrrCapacity,
+  IN OUT UINT32               *VariableMtrrCount,
+  IN UINT64                   BaseAddress,
+  IN UINT64                   Length,
+  IN MTRR_MEMORY_CACHE_TYPE   Type,
+  IN UINT64                   Alignment0
+  )
+{
+  UINT64   Alignment;
+  UINT32   MtrrNumber;
+  UINT32   SubtractiveLeft;
+  UINT32   SubtractiveRight;
+  BOOLEAN  UseLeastAlignment;
+
+  MtrrNumber = ReferenceGetMtrrNumber (
+                 Ranges, RangeCount, VariableMtrr, *VariableMtrrCount,
+                 BaseAddress, Length, Type, Alignment0, &SubtractiveLeft, &SubtractiveRight
+                 );
+  if (MtrrNumber + *VariableMtrrCount > VariableMtrrCapacity) {
+    return RETURN_OUT_OF_RESOURCES;
+  }
+
+  while (SubtractiveLeft-- != 0) {
+    Alignment = ReferenceLeastAlignment (BaseAddress, Alignment0);
+    ASSERT (Alignment <= Length);
+    ReferenceAddVariableMtrr (
+      Ranges, RangeCount, VariableMtrr, VariableMtrrCapacity, VariableMtrrCount,
+      BaseAddress - Alignment, Alignment, CacheInvalid, Alignment0
+      );
+    BaseAddress -= Alignment;
+    Length      += Alignment;
+  }
+
+  while (Length != 0) {
+    Alignment = ReferenceLeastAlignment (BaseAddress, Alignment0);
+    if (Alignment > Length) {
+      break;
+    }
+    ReferenceAddVariableMtrr (
+      NULL, 0, VariableMtrr, VariableMtrrCapacity, VariableMtrrCount,
+      BaseAddress, Alignment, Type, Alignment0
+      );
+    BaseAddress += Alignment;
+    Length      -= Alignment;
+  }
+
+  while (SubtractiveRight-- != 0) {
+    Alignment = ReferenceLeastAlignment (BaseAddress + Length, Alignment0);
+    ReferenceAddVariableMtrr (
+      Ranges, RangeCount, VariableMtrr, VariableMtrrCapacity, VariableMtrrCount,
+      BaseAddress + Length, Alignment, CacheInvalid, Alignment0
+      );
+    Length += Alignment;
+  }
+
+  UseLeastAlignment = TRUE;
+  while (Length != 0) {
+    if (UseLeastAlignment) {
+      Alignment = ReferenceLeastAlignment (BaseAddress, Alignment0);
+      if (Alignment > Length) {
+        UseLeastAlignment = FALSE;
+      }
+    }
+
+    if (!UseLeastAlignment) {
+      Alignment = GetPowerOfTwo64 (Length);
+    }
+
+    ReferenceAddVariableMtrr (
+      NULL, 0, VariableMtrr, VariableMtrrCapacity, VariableMtrrCount,
+      BaseAddress, Alignment, Type, Alignment0
+      );
+    BaseAddress += Alignment;
+    Length      -= Alignment;
+  }
+  return RETURN_SUCCESS;
+}
+
+/**
+  Cover a memory layout with variable MTRRs the way MtrrSetMemoryAttributeWorker()
+  did before the solver: force [0, 1MB) to UC, allocate the variable MTRRs of
+  every range that differs from the default type in turn, and drop the
+  [0, 1MB) MTRR when it is left on its own.
+
+  @param Ranges               Memory range array of the layout.
+  @param RangeCount           Count of memory ranges.
+  @param DefaultType          The default memory type.
+  @param TotalLength          The total length of the memory.
+  @param VariableMtrr         Return the variable MTRR array.
+  @param VariableMtrrCapacity Capacity of variable MTRR array.
+  @param VariableMtrrCount    Return the count of variable MTRR.
+
+  @retval RETURN_SUCCESS          Variable MTRRs are allocated successfully.
+  @retval RETURN_OUT_OF_RESOURCES Count of variable MTRRs exceeds capacity.
+**/
+RETURN_STATUS
+ReferenceCalculateVariableMtrrs (
+  IN CONST MTRR_MEMORY_RANGE  *Ranges,
+  IN UINT32                   RangeCount,
+  IN MTRR_MEMORY_CACHE_TYPE   DefaultType,
+  IN UINT64                   TotalLength,
+  OUT VARIABLE_MTRR           *VariableMtrr,
+  IN UINT32                   VariableMtrrCapacity,
+  OUT UINT32                  *VariableMtrrCount
+  )
+{
+  RETURN_STATUS      Status;
+  MTRR_MEMORY_RANGE  WorkingRanges[TEST_MAX_RANGE_COUNT + 2];
+  UINT32             WorkingRangeCount;
+  UINT32             Index;
+  UINT64             Alignment0;
+
+  CopyMem (WorkingRanges, Ranges, RangeCount * sizeof (Ranges[0]));
+  WorkingRangeCount = RangeCount;
+  Status = MtrrLibSetMemoryType (
+             WorkingRanges, ARRAY_SIZE (WorkingRanges), &WorkingRangeCount,
+             0, SIZE_1MB, CacheUncacheable
+             );
+  ASSERT (Status == RETURN_SUCCESS);
+
+  Alignment0 = LShiftU64 (1, (UINTN) HighBitSet64 (TotalLength - 1));
+  *VariableMtrrCount = 0;
+  for (Index = 0; Index < WorkingRangeCount; Index++) {
+    if (WorkingRanges[Index].Type != DefaultType) {
+      Status = ReferenceSetMemoryAttributeInVariableMtrr (
+                 WorkingRanges, WorkingRangeCount,
+                 VariableMtrr, VariableMtrrCapacity, VariableMtrrCount,
+                 WorkingRanges[Index].BaseAddress, WorkingRanges[Index].Length,
+                 WorkingRanges[Index].Type, Alignment0
+                 );
+      if (RETURN_ERROR (Status)) {
+        return Status;
+      }
+    }
+  }
+
+  if ((*VariableMtrrCount != 0) && (VariableMtrr[0].BaseAddress == 0) && (VariableMtrr[0].Length == SIZE_1MB)) {
+    (*VariableMtrrCount)--;
+    CopyMem (&VariableMtrr[0], &VariableMtrr[1], *VariableMtrrCount * sizeof (VARIABLE_MTRR));
+  }
+  return RETURN_SUCCESS;
+}
+
+/**
+  Return the next pseudo random number.
+
+  @return A 64-bit pseudo random number.
+**/
+UINT64
+TestRandom (
+  VOID
+  )
+{
+  mRandomState ^= mRandomState << 13;
+  mRandomState ^= mRandomState >> 7;
+  mRandomState ^= mRandomState << 17;
+  return mRandomState;
+}
+
+/**
+  Generate a random memory layout covering [0, TotalLength) with ranges
+  of page granularity at random alignments.
+
+  @param TotalLength Total length of the memory.
+  @param Ranges      Return the memory range array of the layout.
+  @param RangeCount  Return the count of memory ranges.
+  @param DefaultType Return the default memory type.
+**/
+VOID
+TestGenerateLayout (
+  IN  UINT64                  TotalLength,
+  OUT MTRR_MEMORY_RANGE       *Ranges,
+  OUT UINT32                  *RangeCount,
+  OUT MTRR_MEMORY_CACHE_TYPE  *DefaultType
+  )
+{
+  UINT64                  Points[TEST_MAX_RANGE_COUNT + 1];
+  UINT64                  Point;
+  UINT32                  PointCount;
+  UINT32                  Index;
+  UINT32                  Index2;
+  MTRR_MEMORY_CACHE_TYPE  Type;
+
+  //
+  // Pick the range boundaries, each aligned to a random power of two between
+  // 4KB and half of the memory.
+  //
+  PointCount = (UINT32) (TestRandom () % (TEST_MAX_RANGE_COUNT - 1));
+  for (Index = 0; Index < PointCount; Index++) {
+    Point = TestRandom () & (TotalLength - 1);
+    Points[Index] = Point & ~(LShiftU64 (1, 12 + (UINTN) (TestRandom () % (TEST_PHYSICAL_ADDRESS_BITS - 13))) - 1);
+  }
+  Points[PointCount++] = 0;
+  Points[PointCount++] = TotalLength;
+
+  for (Index = 0; Index < PointCount; Index++) {
+    for (Index2 = Index + 1; Index2 < PointCount; Index2++) {
+      if (Points[Index2] < Points[Index]) {
+        Point          = Points[Index];
+        Points[Index]  = Points[Index2];
+        Points[Index2] = Point;
+      }
+    }
+  }
+
+  //
+  // Favor UC and WB, which most of the real memory maps consist of. Adjacent
+  // ranges of one type are merged as MtrrLibSetMemoryType() does, which the
+  // per-range algorithm relies on.
+  //
+  *RangeCount = 0;
+  for (Index = 0; Index + 1 < PointCount; Index++) {
+    if (Points[Index + 1] == Points[Index]) {
+      continue;
+    }
+    if ((TestRandom () % 2) == 0) {
+      Type = mMtrrLibVariableMtrrTypes[TestRandom () % ARRAY_SIZE (mMtrrLibVariableMtrrTypes)];
+    } else {
+      Type = ((TestRandom () % 2) == 0) ? CacheWriteBack : CacheUncacheable;
+    }
+    if ((*RangeCount != 0) && (Ranges[*RangeCount - 1].Type == Type)) {
+      Ranges[*RangeCount - 1].Length += Points[Index + 1] - Points[Index];
+      continue;
+    }
+    Ranges[*RangeCount].BaseAddress = Points[Index];
+    Ranges[*RangeCount].Length      = Points[Index + 1] - Points[Index];
+    Ranges[*RangeCount].Type        = Type;
+    (*RangeCount)++;
+  }
+
+  *DefaultType = ((TestRandom () % 2) == 0) ? CacheWriteBack : CacheUncacheable;
+}
+
+/**
+  Return the memory type that the variable MTRRs and the default type give to
+  an address.
+
+  @param VariableMtrr      The variable MTRR array.
+  @param VariableMtrrCount The count of variable MTRRs.
+  @param DefaultType       The default memory type.
+  @param Address           The address.
+
+  @return The memory type of the address, CacheInvalid if the overlapping
+          variable MTRRs are undefined by the precedence rules.
+**/
+MTRR_MEMORY_CACHE_TYPE
+TestGetEffectiveType (
+  IN CONST VARIABLE_MTRR      *VariableMtrr,
+  IN UINT32                   VariableMtrrCount,
+  IN MTRR_MEMORY_CACHE_TYPE   DefaultType,
+  IN UINT64                   Address
+  )
+{
+  UINT32                  Index;
+  MTRR_MEMORY_CACHE_TYPE  Covered;
+
+  Covered = CacheInvalid;
+  for (Index = 0; Index < VariableMtrrCount; Index++) {
+    if ((VariableMtrr[Index].BaseAddress <= Address) &&
+        (Address < VariableMtrr[Index].BaseAddress + VariableMtrr[Index].Length)) {
+      if (!MtrrLibCombineType (Covered, (MTRR_MEMORY_CACHE_TYPE) VariableMtrr[Index].Type, &Covered)) {
+        return CacheInvalid;
+      }
+    }
+  }
+
+  return (Covered == CacheInvalid) ? DefaultType : Covered;
+}
+
+/**
+  Check that the variable MTRRs give every address above 1MB the memory type
+  of the layout.
+
+  The memory type only changes at a range or variable MTRR boundary, so
+  checking those addresses covers the whole memory.
+
+  @param Ranges            Memory range array of the layout.
+  @param RangeCount        Count of memory ranges.
+  @param DefaultType       The default memory type.
+  @param TotalLength       The total length of the memory.
+  @param VariableMtrr      The variable MTRR array.
+  @param VariableMtrrCount The count of variable MTRRs.
+
+  @retval TRUE  The variable MTRRs match the layout.
+  @retval FALSE Some address gets a wrong or undefined memory type.
+**/
+BOOLEAN
+TestCheckLayout (
+  IN CONST MTRR_MEMORY_RANGE  *Ranges,
+  IN UINT32                   RangeCount,
+  IN MTRR_MEMORY_CACHE_TYPE   DefaultType,
+  IN UINT64                   TotalLength,
+  IN CONST VARIABLE_MTRR      *VariableMtrr,
+  IN UINT32                   VariableMtrrCount
+  )
+{
+  UINT64  Addresses[TEST_MAX_RANGE_COUNT + 2 * TEST_MTRR_CAPACITY];
+  UINT32  AddressCount;
+  UINT32  Index;
+  UINT32  RangeIndex;
+
+  AddressCount = 0;
+  for (Index = 0; Index < RangeCount; Index++) {
+    Addresses[AddressCount++] = Ranges[Index].BaseAddress;
+  }
+  for (Index = 0; Index < VariableMtrrCount; Index++) {
+    Addresses[AddressCount++] = VariableMtrr[Index].BaseAddress;
+    Addresses[AddressCount++] = VariableMtrr[Index].BaseAddress + VariableMtrr[Index].Length;
+  }
+  Addresses[AddressCount++] = BASE_1MB;
+
+  for (Index = 0; Index < AddressCount; Index++) {
+    if ((Addresses[Index] < BASE_1MB) || (Addresses[Index] >= TotalLength)) {
+      continue;
+    }
+    for (RangeIndex = 0; RangeIndex < RangeCount; RangeIndex++) {
+      if ((Ranges[RangeIndex].BaseAddress <= Addresses[Index]) &&
+          (Addresses[Index] < Ranges[RangeIndex].BaseAddress + Ranges[RangeIndex].Length)) {
+        break;
+      }
+    }
+    if (TestGetEffectiveType (VariableMtrr, VariableMtrrCount, DefaultType, Addresses[Index]) != Ranges[RangeIndex].Type) {
+      printf ("  address %016llx expects type %d\n", (unsigned long long) Addresses[Index], (int) Ranges[RangeIndex].Type);
+      return FALSE;
+    }
+  }
+
+  return TRUE;
+}
+
+/**
+  Print a memory layout and the variable MTRRs covering it.
+
+  @param Ranges            Memory range array of the layout.
+  @param RangeCount        Count of memory ranges.
+  @param DefaultType       The default memory type.
+  @param VariableMtrr      The variable MTRR array.
+  @param VariableMtrrCount The count of variable MTRRs.
+**/
+VOID
+TestDumpLayout (
+  IN CONST MTRR_MEMORY_RANGE  *Ranges,
+  IN UINT32                   RangeCount,
+  IN MTRR_MEMORY_CACHE_TYPE   DefaultType,
+  IN CONST VARIABLE_MTRR      *VariableMtrr,
+  IN UINT32                   VariableMtrrCount
+  )
+{
+  UINT32  Index;
+
+  printf ("  default %s\n", mMtrrMemoryCacheTypeShortName[DefaultType]);
+  for (Index = 0; Index < RangeCount; Index++) {
+    printf (
+      "  range [%016llx, %016llx) %s\n",
+      (unsigned long long) Ranges[Index].BaseAddress,
+      (unsigned long long) (Ranges[Index].BaseAddress + Ranges[Index].Length),
+      mMtrrMemoryCacheTypeShortName[Ranges[Index].Type]
+      );
+  }
+  for (Index = 0; Index < VariableMtrrCount; Index++) {
+    printf (
+      "  mtrr  [%016llx, %016llx) %s\n",
+      (unsigned long long) VariableMtrr[Index].BaseAddress,
+      (unsigned long long) (VariableMtrr[Index].BaseAddress + VariableMtrr[Index].Length),
+      mMtrrMemoryCacheTypeShortName[VariableMtrr[Index].Type]
+      );
+  }
+}
+
+/**
+  Parse a decimal command line argument.
+
+  @param String The argument.
+
+  @return The value of the argument.
+**/
+UINT64
+TestParseDecimal (
+  IN CONST CHAR8  *String
+  )
+{
+  UINT64  Value;
+
+  for (Value = 0; (*String >= '0') && (*String <= '9'); String++) {
+    Value = Value * 10 + (*String - '0');
+  }
+  return Value;
+}
+
+int
+main (
+  int   Argc,
+  char  **Argv
+  )
+{
+  UINT64                  Seed;
+  UINT64                  Iterations;
+  UINT64                  Iteration;
+  UINT64                  TotalLength;
+  MTRR_MEMORY_RANGE       Ranges[TEST_MAX_RANGE_COUNT];
+  UINT32                  RangeCount;
+  MTRR_MEMORY_CACHE_TYPE  DefaultType;
+  VARIABLE_MTRR           VariableMtrr[TEST_MTRR_CAPACITY];
+  UINT32                  VariableMtrrCount;
+  VARIABLE_MTRR           ReferenceMtrr[TEST_MTRR_CAPACITY];
+  UINT32                  ReferenceMtrrCount;
+  RETURN_STATUS           Status;
+  UINT64                  SolverTotal;
+  UINT64                  ReferenceTotal;
+  UINT64                  Fewer;
+  UINT64                  ReferenceWrong;
+
+  Seed       = (Argc > 1) ? TestParseDecimal (Argv[1]) : 1;
+  Iterations = (Argc > 2) ? TestParseDecimal (Argv[2]) : 10000;
+  mRandomState = Seed * 0x9E3779B97F4A7C15ull + 1;
+
+  TotalLength    = LShiftU64 (1, TEST_PHYSICAL_ADDRESS_BITS);
+  SolverTotal    = 0;
+  ReferenceTotal = 0;
+  Fewer          = 0;
+  ReferenceWrong = 0;
+  for (Iteration = 0; Iteration < Iterations; Iteration++) {
+    TestGenerateLayout (TotalLength, Ranges, &RangeCount, &DefaultType);
+
+    Status = MtrrLibCalculateVariableMtrrs (
+               Ranges, RangeCount, DefaultType, TotalLength,
+               VariableMtrr, TEST_MTRR_CAPACITY, &VariableMtrrCount
+               );
+    if (RETURN_ERROR (Status) ||
+        !TestCheckLayout (Ranges, RangeCount, DefaultType, TotalLength, VariableMtrr, VariableMtrrCount)) {
+      printf ("FAIL: iteration %llu, the solver output mismatches the layout\n", (unsigned long long) Iteration);
+      TestDumpLayout (Ranges, RangeCount, DefaultType, VariableMtrr, VariableMtrrCount);
+      return 1;
+    }
+
+    Status = ReferenceCalculateVariableMtrrs (
+               Ranges, RangeCount, DefaultType, TotalLength,
+               ReferenceMtrr, TEST_MTRR_CAPACITY, &ReferenceMtrrCount
+               );
+    if (RETURN_ERROR (Status)) {
+      printf ("FAIL: iteration %llu, the per-range algorithm fails\n", (unsigned long long) Iteration);
+      return 1;
+    }
+
+    //
+    // The count comparison only makes sense against a valid reference
+    // solution, so layouts the per-range algorithm gets wrong are counted
+    // but not compared.
+    //
+    if (!TestCheckLayout (Ranges, RangeCount, DefaultType, TotalLength, ReferenceMtrr, ReferenceMtrrCount)) {
+      ReferenceWrong++;
+      continue;
+    }
+
+    if (VariableMtrrCount > ReferenceMtrrCount) {
+      printf (
+        "FAIL: iteration %llu, the solver uses %u variable MTRRs, the per-range algorithm %u\n",
+        (unsigned long long) Iteration, VariableMtrrCount, ReferenceMtrrCount
+        );
+      TestDumpLayout (Ranges, RangeCount, DefaultType, VariableMtrr, VariableMtrrCount);
+      return 1;
+    }
+    if (VariableMtrrCount < ReferenceMtrrCount) {
+      Fewer++;
+    }
+    SolverTotal    += VariableMtrrCount;
+    ReferenceTotal += ReferenceMtrrCount;
+  }
+
+  printf (
+    "PASS: %llu layouts, seed %llu\n"
+    "  variable MTRRs: solver %llu, per-range %llu, solver fewer in %llu layouts\n"
+    "  layouts the per-range algorithm covers wrongly: %llu\n",
+    (unsigned long long) Iterations, (unsigned long long) Seed,
+    (unsigned long long) SolverTotal, (unsigned long long) ReferenceTotal,
+    (unsigned long long) Fewer, (unsigned long long) ReferenceWrong
+    );
+  return 0;
+}
@@ -28,6 +28,21 @@ UINTN                                       mSemaphoreSize;
 SPIN_LOCK                                   *mPFLock = NULL;
 SMM_CPU_SYNC_MODE                           mCpuSmmSyncMode;
 
+//
+// Sync groups of the processors. mSmmCpuSyncGroupCpus lists the processors
+// group by group, and mSmmCpuSyncGroupIndex gives the group of each processor.
+//
+SMM_CPU_SYNC_GROUP                          *mSmmCpuSyncGroups;
+UINTN                                       mSmmCpuSyncGroupCount;
+UINTN                                       *mSmmCpuSyncGroupCpus;
+UINTN                                       *mSmmCpuSyncGroupIndex;
+
+//
+// Time stamp counter ticks the BSP spent waiting for the APs in the current SMI,
+// recorded in SMM profile.
+//
+UINT64                                      mSmmRendezvousTicks;
+
 /**
   Performs an atomic compare exchange operation to get semaphore.
   The compare exchange operation must be performed using
@@ -114,6 +129,9 @@ LockdownSemaphore (
 /**
   Wait all APs to performs an atomic compare exchange operation to release semaphore.
 
+  The APs signal the arrival semaphore of their sync group, so the BSP collects
+  the signals group by group instead of from one semaphore all APs contend for.
+
   @param   NumberOfAPs      AP number
 
 **/
@@ -122,11 +140,36 @@ WaitForAllAPs (
   IN      UINTN                     NumberOfAPs
   )
 {
-  UINTN                             BspIndex;
+  UINTN                             Index;
+  volatile UINT32                   *Arrival;
+  UINT32                            Value;
+  UINT32                            Count;
+  UINT64                            Start;
 
-  BspIndex = mSmmMpSyncData->BspIndex;
-  while (NumberOfAPs-- > 0) {
-    WaitForSemaphore (mSmmMpSyncData->CpuData[BspIndex].Run);
+  Start = 0;
+  if (FeaturePcdGet (PcdCpuSmmProfileEnable)) {
+    Start = AsmReadTsc ();
+  }
+
+  while (NumberOfAPs > 0) {
+    for (Index = 0; Index < mSmmCpuSyncGroupCount && NumberOfAPs > 0; Index++) {
+      Arrival = mSmmCpuSyncGroups[Index].Arrival;
+      Value   = *Arrival;
+      if (Value == 0) {
+        continue;
+      }
+      Count = (UINT32) MIN (Value, NumberOfAPs);
+      if (InterlockedCompareExchange32 ((UINT32 *) Arrival, Value, Value - Count) == Value) {
+        NumberOfAPs -= Count;
+      }
+    }
+    if (NumberOfAPs > 0) {
+      CpuPause ();
+    }
+  }
+
+  if (FeaturePcdGet (PcdCpuSmmProfileEnable)) {
+    mSmmRendezvousTicks += AsmReadTsc () - Start;
   }
 }
 
@@ -134,19 +177,82 @@ WaitForAllAPs (
   Performs an atomic compare exchange operation to release semaphore
   for each AP.
 
+  Only the first present AP of each sync group is released; it becomes the
+  leader of its group and releases the other present APs of the group.
+
 **/
 VOID
 ReleaseAllAPs (
   VOID
   )
 {
+  UINTN                             GroupIndex;
   UINTN                             Index;
+  UINTN                             CpuIndex;
   UINTN                             BspIndex;
+  SMM_CPU_SYNC_GROUP                *Group;
 
   BspIndex = mSmmMpSyncData->BspIndex;
-  for (Index = mMaxNumberOfCpus; Index-- > 0;) {
-    if (Index != BspIndex && *(mSmmMpSyncData->CpuData[Index].Present)) {
-      ReleaseSemaphore (mSmmMpSyncData->CpuData[Index].Run);
+  for (GroupIndex = 0; GroupIndex < mSmmCpuSyncGroupCount; GroupIndex++) {
+    Group = &mSmmCpuSyncGroups[GroupIndex];
+    for (Index = 0; Index < Group->CpuCount; Index++) {
+      CpuIndex = mSmmCpuSyncGroupCpus[Group->FirstCpu + Index];
+      if (CpuIndex != BspIndex && *(mSmmMpSyncData->CpuData[CpuIndex].Present)) {
+        Group->Leader = CpuIndex;
+        ReleaseSemaphore (mSmmMpSyncData->CpuData[CpuIndex].Run);
+        break;
+      }
+    }
+  }
+}
+
+/**
+  Signal the BSP that this AP has reached a synchronization point.
+
+  @param   CpuIndex         AP processor Index
+
+**/
+VOID
+ReleaseBsp (
+  IN      UINTN                     CpuIndex
+  )
+{
+  ReleaseSemaphore (mSmmMpSyncData->CpuData[CpuIndex].Arrival);
+}
+
+/**
+  Wait for the signal from BSP to this AP.
+
+  If the AP was released as the leader of its sync group by ReleaseAllAPs(),
+  it passes the signal on to the other present APs of the group.
+
+  @param   CpuIndex         AP processor Index
+
+**/
+VOID
+WaitForBsp (
+  IN      UINTN                     CpuIndex
+  )
+{
+  SMM_CPU_SYNC_GROUP                *Group;
+  UINTN                             Index;
+  UINTN                             MemberIndex;
+  UINTN                             BspIndex;
+
+  WaitForSemaphore (mSmmMpSyncData->CpuData[CpuIndex].Run);
+
+  Group = &mSmmCpuSyncGroups[mSmmCpuSyncGroupIndex[CpuIndex]];
+  if (Group->Leader != CpuIndex) {
+    return;
+  }
+  Group->Leader = (UINTN)-1;
+
+  BspIndex = mSmmMpSyncData->BspIndex;
+  for (Index = 0; Index < Group->CpuCount; Index++) {
+    MemberIndex = mSmmCpuSyncGroupCpus[Group->FirstCpu + Index];
+    if (MemberIndex != CpuIndex && MemberIndex != BspIndex &&
+        *(mSmmMpSyncData->CpuData[MemberIndex].Present)) {
+      ReleaseSemaphore (mSmmMpSyncData->CpuData[MemberIndex].Run);
     }
   }
 }
@@ -209,9 +315,15 @@ SmmWaitForApArrival (
 {
   UINT64                            Timer;
   UINTN                             Index;
+  UINT64                            Start;
 
   ASSERT (*mSmmMpSyncData->Counter <= mNumberOfCpus);
 
+  Start = 0;
+  if (FeaturePcdGet (PcdCpuSmmProfileEnable)) {
+    Start = AsmReadTsc ();
+  }
+
   //
   // Platform implementor should choose a timeout value appropriately:
   // - The timeout value should balance the SMM time constrains and the likelihood that delayed CPUs are excluded in the SMM run. Note
@@ -270,6 +382,9 @@ SmmWaitForApArrival (
     }
   }
 
+  if (FeaturePcdGet (PcdCpuSmmProfileEnable)) {
+    mSmmRendezvousTicks += AsmReadTsc () - Start;
+  }
   return;
 }
 
@@ -311,9 +426,12 @@ BSPHandler (
   UINTN                             ApCount;
   BOOLEAN                           ClearTopLevelSmiResult;
   UINTN                             PresentCount;
+  UINT64                            Start;
 
   ASSERT (CpuIndex == mSmmMpSyncData->BspIndex);
   ApCount = 0;
+  Start = 0;
+  mSmmRendezvousTicks = 0;
 
   //
   // Flag BSP's presence
@@ -449,6 +567,9 @@ BSPHandler (
     //
     // Make sure all APs have their Present flag set
     //
+    if (FeaturePcdGet (PcdCpuSmmProfileEnable)) {
+      Start = AsmReadTsc ();
+    }
     while (TRUE) {
       PresentCount = 0;
       for (Index = mMaxNumberOfCpus; Index-- > 0;) {
@@ -460,6 +581,9 @@ BSPHandler (
         break;
       }
     }
+    if (FeaturePcdGet (PcdCpuSmmProfileEnable)) {
+      mSmmRendezvousTicks += AsmReadTsc () - Start;
+    }
   }
 
   //
@@ -518,6 +642,10 @@ BSPHandler (
   //
   WaitForAllAPs (ApCount);
 
+  if (FeaturePcdGet (PcdCpuSmmProfileEnable)) {
+    SmmProfileRecordRendezvous (mSmmRendezvousTicks);
+  }
+
   //
   // Reset BspIndex to -1, meaning BSP has not been elected.
   //
@@ -618,14 +746,14 @@ APHandler (
     //
     // Notify BSP of arrival at this point
     //
-    ReleaseSemaphore (mSmmMpSyncData->CpuData[BspIndex].Run);
+    ReleaseBsp (CpuIndex);
   }
 
   if (SmmCpuFeaturesNeedConfigureMtrrs()) {
     //
     // Wait for the signal from BSP to backup MTRRs
     //
-    WaitForSemaphore (mSmmMpSyncData->CpuData[CpuIndex].Run);
+    WaitForBsp (CpuIndex);
 
     //
     // Backup OS MTRRs
@@ -635,12 +763,12 @@ APHandler (
     //
     // Signal BSP the completion of this AP
     //
-    ReleaseSemaphore (mSmmMpSyncData->CpuData[BspIndex].Run);
+    ReleaseBsp (CpuIndex);
 
     //
     // Wait for BSP's signal to program MTRRs
     //
-    WaitForSemaphore (mSmmMpSyncData->CpuData[CpuIndex].Run);
+    WaitForBsp (CpuIndex);
 
     //
     // Replace OS MTRRs with SMI MTRRs
@@ -650,14 +778,14 @@ APHandler (
     //
     // Signal BSP the completion of this AP
     //
-    ReleaseSemaphore (mSmmMpSyncData->CpuData[BspIndex].Run);
+    ReleaseBsp (CpuIndex);
   }
 
   while (TRUE) {
     //
     // Wait for something to happen
     //
-    WaitForSemaphore (mSmmMpSyncData->CpuData[CpuIndex].Run);
+    WaitForBsp (CpuIndex);
 
     //
     // Check if BSP wants to exit SMM
@@ -690,12 +818,12 @@ APHandler (
     //
     // Notify BSP the readiness of this AP to program MTRRs
     //
-    ReleaseSemaphore (mSmmMpSyncData->CpuData[BspIndex].Run);
+    ReleaseBsp (CpuIndex);
 
     //
     // Wait for the signal from BSP to program MTRRs
     //
-    WaitForSemaphore (mSmmMpSyncData->CpuData[CpuIndex].Run);
+    WaitForBsp (CpuIndex);
 
     //
     // Restore OS MTRRs
@@ -707,12 +835,12 @@ APHandler (
   //
   // Notify BSP the readiness of this AP to Reset states/semaphore for this processor
   //
-  ReleaseSemaphore (mSmmMpSyncData->CpuData[BspIndex].Run);
+  ReleaseBsp (CpuIndex);
 
   //
   // Wait for the signal from BSP to Reset states/semaphore for this processor
   //
-  WaitForSemaphore (mSmmMpSyncData->CpuData[CpuIndex].Run);
+  WaitForBsp (CpuIndex);
 
   //
   // Reset states/semaphore for this processor
@@ -722,7 +850,7 @@ APHandler (
   //
   // Notify BSP the readiness of this AP to exit SMM
   //
-  ReleaseSemaphore (mSmmMpSyncData->CpuData[BspIndex].Run);
+  ReleaseBsp (CpuIndex);
 
 }
 
@@ -1226,6 +1354,8 @@ InitializeSmmCpuSemaphores (
   mSmmCpuSemaphores.SemaphoreCpu.Run     = (UINT32 *)SemaphoreAddr;
   SemaphoreAddr += ProcessorCount * SemaphoreSize;
   mSmmCpuSemaphores.SemaphoreCpu.Present = (BOOLEAN *)SemaphoreAddr;
+  SemaphoreAddr += ProcessorCount * SemaphoreSize;
+  mSmmCpuSemaphores.SemaphoreCpu.Arrival = (UINT32 *)SemaphoreAddr;
 
   SemaphoreAddr = (UINTN)SemaphoreBlock + GlobalSemaphoresSize + CpuSemaphoresSize;
   mSmmCpuSemaphores.SemaphoreMsr.Msr              = (SPIN_LOCK *)SemaphoreAddr;
@@ -1240,6 +1370,89 @@ InitializeSmmCpuSemaphores (
   mSemaphoreSize = SemaphoreSize;
 }
 
+/**
+  Check if the location of a processor comes after the location of another one
+  in package, core and thread order.
+
+  @param  CpuIndex1     The index of the first processor.
+  @param  CpuIndex2     The index of the second processor.
+
+  @retval TRUE          The first processor comes after the second one.
+  @retval FALSE         The first processor does not come after the second one.
+
+**/
+BOOLEAN
+IsSmmCpuLocationAfter (
+  IN UINTN                   CpuIndex1,
+  IN UINTN                   CpuIndex2
+  )
+{
+  EFI_CPU_PHYSICAL_LOCATION  *Location1;
+  EFI_CPU_PHYSICAL_LOCATION  *Location2;
+
+  Location1 = &gSmmCpuPrivate->ProcessorInfo[CpuIndex1].Location;
+  Location2 = &gSmmCpuPrivate->ProcessorInfo[CpuIndex2].Location;
+  if (Location1->Package != Location2->Package) {
+    return (BOOLEAN) (Location1->Package > Location2->Package);
+  }
+  if (Location1->Core != Location2->Core) {
+    return (BOOLEAN) (Location1->Core > Location2->Core);
+  }
+  return (BOOLEAN) (Location1->Thread > Location2->Thread);
+}
+
+/**
+  Split the processors into sync groups.
+
+  The processors are sorted by package, core and thread, and split into groups of
+  at most SMM_CPU_SYNC_GROUP_SIZE processors that never span two packages, so that
+  the processors sharing a group semaphore also share a package.
+
+**/
+VOID
+InitializeSmmCpuSyncGroups (
+  VOID
+  )
+{
+  UINTN                      ProcessorCount;
+  UINTN                      Index;
+  UINTN                      Position;
+  UINTN                      CpuIndex;
+  SMM_CPU_SYNC_GROUP         *Group;
+
+  ProcessorCount = gSmmCpuPrivate->SmmCoreEntryContext.NumberOfCpus;
+  mSmmCpuSyncGroups     = AllocatePool (sizeof (SMM_CPU_SYNC_GROUP) * ProcessorCount);
+  mSmmCpuSyncGroupCpus  = AllocatePool (sizeof (UINTN) * ProcessorCount);
+  mSmmCpuSyncGroupIndex = AllocatePool (sizeof (UINTN) * ProcessorCount);
+  ASSERT (mSmmCpuSyncGroups != NULL && mSmmCpuSyncGroupCpus != NULL && mSmmCpuSyncGroupIndex != NULL);
+
+  for (Index = 0; Index < ProcessorCount; Index++) {
+    for (Position = Index;
+         Position > 0 && IsSmmCpuLocationAfter (mSmmCpuSyncGroupCpus[Position - 1], Index);
+         Position--) {
+      mSmmCpuSyncGroupCpus[Position] = mSmmCpuSyncGroupCpus[Position - 1];
+    }
+    mSmmCpuSyncGroupCpus[Position] = Index;
+  }
+
+  Group = NULL;
+  mSmmCpuSyncGroupCount = 0;
+  for (Index = 0; Index < ProcessorCount; Index++) {
+    CpuIndex = mSmmCpuSyncGroupCpus[Index];
+    if (Group == NULL || Group->CpuCount == SMM_CPU_SYNC_GROUP_SIZE ||
+        gSmmCpuPrivate->ProcessorInfo[CpuIndex].Location.Package !=
+        gSmmCpuPrivate->ProcessorInfo[mSmmCpuSyncGroupCpus[Index - 1]].Location.Package) {
+      Group = &mSmmCpuSyncGroups[mSmmCpuSyncGroupCount++];
+      Group->FirstCpu = Index;
+      Group->CpuCount = 0;
+    }
+    Group->CpuCount++;
+    mSmmCpuSyncGroupIndex[CpuIndex] = mSmmCpuSyncGroupCount - 1;
+  }
+
+  DEBUG ((EFI_D_INFO, "SMM CPU sync groups = %d\n", mSmmCpuSyncGroupCount));
+}
+
 /**
   Initialize un-cacheable data.
 
@@ -1251,6 +1464,7 @@ InitializeMpSyncData (
   )
 {
   UINTN                      CpuIndex;
+  UINTN                      GroupIndex;
 
   if (mSmmMpSyncData != NULL) {
     //
@@ -1277,7 +1491,15 @@ InitializeMpSyncData (
     *mSmmMpSyncData->InsideSmm     = FALSE;
     *mSmmMpSyncData->AllCpusInSync = FALSE;
 
+    for (GroupIndex = 0; GroupIndex < mSmmCpuSyncGroupCount; GroupIndex++) {
+      mSmmCpuSyncGroups[GroupIndex].Arrival =
+        (UINT32 *)((UINTN)mSmmCpuSemaphores.SemaphoreCpu.Arrival + mSemaphoreSize * GroupIndex);
+      mSmmCpuSyncGroups[GroupIndex].Leader  = (UINTN)-1;
+      *(mSmmCpuSyncGroups[GroupIndex].Arrival) = 0;
+    }
+
     for (CpuIndex = 0; CpuIndex < gSmmCpuPrivate->SmmCoreEntryContext.NumberOfCpus; CpuIndex ++) {
+      mSmmMpSyncData->CpuData[CpuIndex].Arrival = mSmmCpuSyncGroups[mSmmCpuSyncGroupIndex[CpuIndex]].Arrival;
       mSmmMpSyncData->CpuData[CpuIndex].Busy    =
         (SPIN_LOCK *)((UINTN)mSmmCpuSemaphores.SemaphoreCpu.Busy + mSemaphoreSize * CpuIndex);
       mSmmMpSyncData->CpuData[CpuIndex].Run     =
@@ -1314,6 +1536,11 @@ InitializeMpServiceData (
   //
   InitializeSmmCpuSemaphores ();
 
+  //
+  // Split the processors into sync groups
+  //
+  InitializeSmmCpuSyncGroups ();
+
   //
   // Initialize mSmmMpSyncData
   //
@@ -330,6 +330,10 @@ typedef struct {
   volatile VOID                     *Parameter;
   volatile UINT32                   *Run;
   volatile BOOLEAN                  *Present;
+  //
+  // Arrival semaphore of the sync group of the processor.
+  //
+  volatile UINT32                   *Arrival;
 } SMM_CPU_DATA_BLOCK;
 
 typedef enum {
@@ -353,6 +357,29 @@ typedef struct {
   volatile BOOLEAN              *CandidateBsp;
 } SMM_DISPATCHER_MP_SYNC_DATA;
 
+///
+/// Maximum number of processors in a sync group.
+///
+#define SMM_CPU_SYNC_GROUP_SIZE     8
+
+///
+/// The processors are split into sync groups of neighbouring processors of one package.
+/// APs signal the BSP through the arrival semaphore of their group, and the BSP releases
+/// one AP per group, the leader, which releases the other APs of the group.
+///
+typedef struct {
+  //
+  // Index of the first processor of the group in the sync group processor list.
+  //
+  UINTN                         FirstCpu;
+  UINTN                         CpuCount;
+  volatile UINT32               *Arrival;
+  //
+  // The AP that releases the rest of the group, or -1 if there is none pending.
+  //
+  volatile UINTN                Leader;
+} SMM_CPU_SYNC_GROUP;
+
 #define MSR_SPIN_LOCK_INIT_NUM 15
 
 typedef struct {
@@ -381,6 +408,7 @@ typedef struct {
   SPIN_LOCK                         *Busy;
   volatile UINT32                   *Run;
   volatile BOOLEAN                  *Present;
+  volatile UINT32                   *Arrival;
 } SMM_CPU_SEMAPHORE_CPU;
 
 ///
@@ -928,6 +928,9 @@ InitSmmProfileInternal (
   mSmmProfileBase->TsegSize       = mCpuHotPlugData.SmrrSize;
   mSmmProfileBase->NumSmis        = 0;
   mSmmProfileBase->NumCpus        = gSmmCpuPrivate->SmmCoreEntryContext.NumberOfCpus;
+  mSmmProfileBase->RendezvousTicks     = 0;
+  mSmmProfileBase->LastRendezvousTicks = 0;
+  mSmmProfileBase->MaxRendezvousTicks  = 0;
 
   if (mBtsSupported) {
     mMsrDsArea = (MSR_DS_AREA_STRUCT **)AllocateZeroPool (sizeof (MSR_DS_AREA_STRUCT *) * mMaxNumberOfCpus);
@@ -1119,6 +1122,26 @@ SmmProfileRecordSmiNum (
   }
 }
 
+/**
+  Record the time the BSP spent waiting for the APs to rendezvous in an SMI.
+
+  @param  Ticks  The time stamp counter ticks spent waiting.
+
+**/
+VOID
+SmmProfileRecordRendezvous (
+  IN UINT64 Ticks
+  )
+{
+  if (mSmmProfileStart) {
+    mSmmProfileBase->RendezvousTicks    += Ticks;
+    mSmmProfileBase->LastRendezvousTicks = Ticks;
+    if (Ticks > mSmmProfileBase->MaxRendezvousTicks) {
+      mSmmProfileBase->MaxRendezvousTicks = Ticks;
+    }
+  }
+}
+
 /**
   Initialize processor environment for SMM profile.
 
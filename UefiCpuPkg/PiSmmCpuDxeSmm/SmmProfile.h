@@ -52,6 +52,17 @@ SmmProfileRecordSmiNum (
   VOID
   );
 
+/**
+  Record the time the BSP spent waiting for the APs to rendezvous in an SMI.
+
+  @param  Ticks  The time stamp counter ticks spent waiting.
+
+**/
+VOID
+SmmProfileRecordRendezvous (
+  IN UINT64 Ticks
+  );
+
 /**
   The Page fault handler to save SMM profile data.
 
@@ -89,6 +89,13 @@ typedef struct {
   UINT64  TsegSize;
   UINT64  NumSmis;
   UINT64  NumCpus;
+  //
+  // Time stamp counter ticks the BSP spent waiting for the APs to rendezvous,
+  // over all the recorded SMIs, for the last one and the largest one.
+  //
+  UINT64  RendezvousTicks;
+  UINT64  LastRendezvousTicks;
+  UINT64  MaxRendezvousTicks;
 } SMM_PROFILE_HEADER;
 
 typedef struct {